@@ -0,0 +1,268 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Line protocol spoken between hub-ctrl and hub-ctrld
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ctrld.h"
+
+static const char *const verbs[] = {
+	[CTRLD_RESCAN] = "rescan",
+	[CTRLD_POWER] = "power",
+	[CTRLD_LED] = "led",
+	[CTRLD_READ] = "read",
+	[CTRLD_WRITE] = "write",
+	[CTRLD_UPDATE] = "update",
+	[CTRLD_ERASE] = "erase",
+};
+
+int ctrld_parse_request(const char *line, struct ctrld_req *req)
+{
+	char verb[16];
+	int offset = 0;
+	int i;
+
+	if (!line || !req)
+		return -EINVAL;
+
+	memset(req, 0, sizeof(*req));
+	req->value = 1;
+
+	if (sscanf(line, "%15s %n", verb, &offset) < 1)
+		return -EINVAL;
+	line += offset;
+
+	for (i = 0; i < sizeof(verbs) / sizeof(verbs[0]); i++)
+		if (!strcmp(verb, verbs[i]))
+			break;
+	if (i == sizeof(verbs) / sizeof(verbs[0]))
+		return -EOPNOTSUPP;
+	req->verb = i;
+
+	if (req->verb == CTRLD_RESCAN)
+		return 0;
+
+	if (sscanf(line, "%u %u %n", &req->busnum, &req->devnum,
+			&offset) < 2)
+		return -EINVAL;
+	line += offset;
+
+	switch (req->verb) {
+	case CTRLD_POWER:
+	case CTRLD_LED:
+		if (sscanf(line, "%u %u", &req->port, &req->value) < 2)
+			return -EINVAL;
+		break;
+
+	case CTRLD_READ:
+		if (sscanf(line, "%u", &req->size) < 1 || !req->size ||
+				req->size > MAX_EEPROM_SIZE)
+			return -EINVAL;
+		break;
+
+	case CTRLD_ERASE:
+		if (sscanf(line, "%u", &req->size) < 1)
+			return -EINVAL;
+		break;
+
+	default:
+		/* the overwrite flag comes in front of the data */
+		if (sscanf(line, "%u %n", &req->value, &offset) < 1)
+			return -EINVAL;
+		req->data = line + offset;
+		break;
+	}
+
+	return 0;
+}
+
+int ctrld_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (!path || strlen(path) >= sizeof(addr.sun_path))
+		return -EINVAL;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		return -errno;
+	}
+
+	return fd;
+}
+
+int ctrld_write_line(int fd, const char *line)
+{
+	size_t len = strlen(line);
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = send(fd, line + done, len - done, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		done += ret;
+	}
+
+	if (len && line[len - 1] == '\n')
+		return 0;
+
+	ret = send(fd, "\n", 1, MSG_NOSIGNAL);
+
+	return ret < 0 ? -errno : 0;
+}
+
+ssize_t ctrld_read_line(int fd, char *buf, size_t size)
+{
+	size_t len = 0;
+	ssize_t ret;
+	char *eol;
+
+	if (!buf || !size)
+		return -EINVAL;
+
+	/*
+	 * Peek first and only consume up to the newline, so that pipelined
+	 * requests on the same connection stay in the socket.
+	 */
+	for (;;) {
+		if (len + 1 >= size)
+			return -EMSGSIZE;
+
+		ret = recv(fd, buf + len, size - len - 1, MSG_PEEK);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (!ret) {
+			if (!len)
+				return 0;
+			break;
+		}
+
+		eol = memchr(buf + len, '\n', ret);
+		if (eol)
+			ret = eol - (buf + len) + 1;
+
+		ret = recv(fd, buf + len, ret, 0);
+		if (ret < 0)
+			return -errno;
+		len += ret;
+
+		if (eol)
+			break;
+	}
+
+	if (len && buf[len - 1] == '\n')
+		len--;
+	buf[len] = '\0';
+
+	return len + 1;
+}
+
+int ctrld_request(const char *path, const char *request, char *reply,
+	size_t size, char **payload)
+{
+	ssize_t len;
+	int ret;
+	int fd;
+
+	fd = ctrld_connect(path);
+	if (fd < 0)
+		return fd;
+
+	ret = ctrld_write_line(fd, request);
+	if (ret)
+		goto cleanup;
+
+	len = ctrld_read_line(fd, reply, size);
+	if (len <= 0) {
+		ret = len < 0 ? len : -ECONNRESET;
+		goto cleanup;
+	}
+
+	if (!strncmp(reply, "OK", 2) && (!reply[2] || reply[2] == ' ')) {
+		if (payload)
+			*payload = reply[2] ? reply + 3 : reply + 2;
+		ret = 0;
+	} else if (!strncmp(reply, "ERR ", 4)) {
+		ret = -abs(atoi(reply + 4));
+		if (!ret)
+			ret = -EIO;
+	} else {
+		ret = -EPROTO;
+	}
+
+cleanup:
+	close(fd);
+
+	return ret;
+}
+
+void ctrld_hex_encode(char *dest, const uint8_t *src, size_t len)
+{
+	static const char digits[] = "0123456789abcdef";
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		*dest++ = digits[src[i] >> 4];
+		*dest++ = digits[src[i] & 0x0f];
+	}
+	*dest = '\0';
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+ssize_t ctrld_hex_decode(uint8_t *dest, size_t size, const char *src)
+{
+	size_t len = 0;
+	int hi;
+	int lo;
+
+	while (src[0] && src[0] != ' ') {
+		hi = hex_digit(src[0]);
+		lo = hex_digit(src[1]);
+		if (hi < 0 || lo < 0)
+			return -EINVAL;
+		if (len >= size)
+			return -EMSGSIZE;
+		dest[len++] = (hi << 4) | lo;
+		src += 2;
+	}
+
+	return len;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Line protocol spoken between hub-ctrl and hub-ctrld
+ *
+ * Every request is a single line of the form
+ * "<verb> <bus> <dev> [<arg>...]", the daemon answers each one with either
+ * "OK [<payload>]" or "ERR <errno> <message>". EEPROM data travels hex encoded.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CTRLD_H
+#define CTRLD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "usb_eeprom.h"
+
+#define CTRLD_SOCKET_PATH	"/run/hub-ctrld.sock"
+/** Longest line, a full EEPROM image in hex plus verb and arguments */
+#define CTRLD_LINE_MAX		(2 * MAX_EEPROM_SIZE + 64)
+
+/** Verb of a request */
+enum ctrld_verb {
+	CTRLD_RESCAN,	/**< "rescan", no bus and device number */
+	CTRLD_POWER,	/**< "power <bus> <dev> <port> <on>" */
+	CTRLD_LED,	/**< "led <bus> <dev> <port> <value>" */
+	CTRLD_READ,	/**< "read <bus> <dev> <size>" */
+	CTRLD_WRITE,	/**< "write <bus> <dev> <overwrite> <hex>" */
+	CTRLD_UPDATE,	/**< "update <bus> <dev> <overwrite> <hex>" */
+	CTRLD_ERASE,	/**< "erase <bus> <dev> <size>" */
+};
+
+/** A parsed request line */
+struct ctrld_req {
+	enum ctrld_verb verb;
+	unsigned int busnum;	/**< USB bus number, 0 for the single hub */
+	unsigned int devnum;	/**< USB device number, 0 for the single hub */
+	unsigned int port;	/**< port of "power" and "led" */
+	/** power or LED value, overwrite flag of "write" and "update", else 1 */
+	unsigned int value;
+	unsigned int size;	/**< bytes of "read" and "erase" */
+	/** hex encoded image of "write" and "update", points into the line */
+	const char *data;
+};
+
+/**
+ * @brief Parse a request line
+ *
+ * @param line request without trailing newline
+ * @param req result
+ * @return 0 on success
+ * @return -EOPNOTSUPP if the verb is unknown
+ * @return -EINVAL if arguments are missing or out of range
+ */
+int ctrld_parse_request(const char *line, struct ctrld_req *req);
+
+int ctrld_connect(const char *path);
+
+int ctrld_write_line(int fd, const char *line);
+
+ssize_t ctrld_read_line(int fd, char *buf, size_t size);
+
+/**
+ * @brief Send a single request to hub-ctrld and wait for the answer
+ *
+ * @param path socket path of the daemon
+ * @param request request line without trailing newline
+ * @param reply buffer for the answer
+ * @param size size of the reply buffer
+ * @param payload set to the payload part of an "OK" answer, may be @c NULL
+ * @return 0 on success
+ * @return -errno reported by the daemon or on communication failure
+ */
+int ctrld_request(const char *path, const char *request, char *reply,
+	size_t size, char **payload);
+
+void ctrld_hex_encode(char *dest, const uint8_t *src, size_t len);
+
+ssize_t ctrld_hex_decode(uint8_t *dest, size_t size, const char *src);
+
+#endif /* CTRLD_H */
@@ -0,0 +1,256 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Resumable EEPROM programming with a checkpoint file
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eeprom_checkpoint.h"
+#include "file_io.h"
+#include "usb_eeprom.h"
+#include "usb_policy.h"
+#include "usb_stats.h"
+
+#define CHECKPOINT_MAGIC	"hub-ctrl-checkpoint 1"
+
+/* State shared with the progress callback */
+struct resume {
+	struct eeprom_checkpoint cp;
+	const char *file;
+	const uint8_t *image;
+	/* data read back, indexed like the image */
+	uint8_t *read;
+	int verify;
+	int verbose;
+	volatile sig_atomic_t *stop;
+	/* first error of the callback, reported instead of -ECANCELED */
+	int error;
+};
+
+static uint64_t fnv1a(const uint8_t *data, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static int checkpoint_load(const char *file, struct eeprom_checkpoint *cp)
+{
+	char hub[EEPROM_CHECKPOINT_HUB_SIZE];
+	uint64_t hash;
+	size_t offset;
+	size_t len;
+	size_t written;
+	size_t verified;
+	FILE *fp;
+	int num;
+
+	fp = fopen(file, "r");
+	if (!fp)
+		return -errno;
+
+	num = fscanf(fp, CHECKPOINT_MAGIC " %47s %" SCNx64 " %zu %zu %zu %zu",
+		hub, &hash, &offset, &len, &written, &verified);
+	fclose(fp);
+	if (num != 6)
+		return -EINVAL;
+
+	/* resume only the very same region of the same hub */
+	if (strcmp(hub, cp->hub) || hash != cp->hash ||
+			offset != cp->offset || len != cp->len ||
+			written > len || verified > written)
+		return -ESTALE;
+
+	cp->written = written;
+	cp->verified = verified;
+
+	return 0;
+}
+
+static int checkpoint_save(const char *file,
+	const struct eeprom_checkpoint *cp)
+{
+	char line[256];
+	ssize_t ret;
+	int len;
+
+	len = snprintf(line, sizeof(line), CHECKPOINT_MAGIC " %s %016" PRIx64
+		" %zu %zu %zu %zu\n", cp->hub, cp->hash, cp->offset, cp->len,
+		cp->written, cp->verified);
+	if (len >= sizeof(line))
+		return -EOVERFLOW;
+
+	ret = file_replace(file, (const uint8_t *)line, len);
+
+	return ret < 0 ? ret : 0;
+}
+
+/*
+ * Trust no more of a checkpoint than still reads back as in the image. The
+ * hub at this place may not be the one of the checkpoint, or its EEPROM
+ * was written in between.
+ */
+static int checkpoint_check(libusb_device_handle *dev, struct resume *r)
+{
+	const char *phase = usb_stats_get_phase();
+	size_t same;
+	int ret;
+
+	if (!r->cp.written)
+		return 0;
+
+	usb_stats_phase("verify");
+	ret = usb_eeprom_read_at(dev, r->cp.offset, r->read, r->cp.written);
+	usb_stats_phase(phase);
+	if (ret < 0)
+		return ret;
+
+	for (same = 0; same < ret; same++)
+		if (r->read[same] != r->image[same])
+			break;
+
+	/* what reads back the same is verified as well */
+	r->cp.written = same;
+	r->cp.verified = same;
+
+	return 0;
+}
+
+static int chunk_done(void *data, size_t offset, size_t len)
+{
+	struct resume *r = data;
+	size_t start = offset - r->cp.offset;
+	int ret;
+
+	if (!r->verify) {
+		r->cp.written = start + len;
+	} else if (!memcmp(r->read + start, r->image + start, len)) {
+		r->cp.verified = start + len;
+	} else {
+		/* write this chunk and all following again */
+		r->cp.written = start;
+		r->error = -EBADMSG;
+	}
+
+	ret = checkpoint_save(r->file, &r->cp);
+	if (ret && !r->error)
+		r->error = ret;
+
+	if (r->verbose)
+		fprintf(stderr, "\r%s %zu/%zu B", r->verify ? "verify" : "write",
+			r->verify ? r->cp.verified : r->cp.written, r->cp.len);
+
+	return r->error || (r->stop && *r->stop);
+}
+
+int eeprom_checkpoint_name(char *buf, size_t size, const struct hub_info *hub)
+{
+	struct libusb_device_descriptor desc;
+	int len;
+	int ret;
+
+	if (!buf || !hub)
+		return -EINVAL;
+
+	ret = libusb_get_device_descriptor(hub->dev, &desc);
+	if (ret)
+		return usb_policy_errno(ret);
+
+	/* the device number changes when the hub resets, its path does not */
+	if (hub->path[0])
+		len = snprintf(buf, size, "%04x:%04x@%s", desc.idVendor,
+			desc.idProduct, hub->path);
+	else
+		len = snprintf(buf, size, "%04x:%04x@%d:%d", desc.idVendor,
+			desc.idProduct, hub->busnum, hub->devnum);
+
+	return len < size ? 0 : -ENAMETOOLONG;
+}
+
+int eeprom_checkpoint_program(libusb_device_handle *dev, const char *hub,
+	uint8_t *buffer, size_t offset, size_t len, const char *file,
+	int verbose, volatile sig_atomic_t *stop)
+{
+	const char *phase = usb_stats_get_phase();
+	struct resume r = {
+		.cp = { .hash = fnv1a(buffer, len), .offset = offset,
+			.len = len },
+		.file = file,
+		.image = buffer,
+		.verbose = verbose,
+		.stop = stop,
+	};
+	size_t rest;
+	int written = 0;
+	int ret = 0;
+
+	if (!dev || !hub || !buffer || !len || !file)
+		return -EINVAL;
+
+	r.read = malloc(len);
+	if (!r.read)
+		return -ENOMEM;
+
+	snprintf(r.cp.hub, sizeof(r.cp.hub), "%s", hub);
+	if (!checkpoint_load(file, &r.cp)) {
+		ret = checkpoint_check(dev, &r);
+		if (ret < 0) {
+			free(r.read);
+			return ret;
+		}
+		if (verbose)
+			fprintf(stderr, "Resuming %s, %zu B written and "
+				"verified\n", file, r.cp.written);
+	}
+
+	usb_eeprom_set_progress(chunk_done, &r);
+
+	rest = len - r.cp.written;
+	if (rest) {
+		ret = usb_eeprom_write_at(dev, offset + r.cp.written,
+			buffer + r.cp.written, rest);
+		if (ret >= 0 && ret != rest)
+			ret = -EIO;
+		written = ret;
+	}
+
+	rest = len - r.cp.verified;
+	if (ret >= 0 && rest) {
+		r.verify = 1;
+		usb_stats_phase("verify");
+		ret = usb_eeprom_read_at(dev, offset + r.cp.verified,
+			r.read + r.cp.verified, rest);
+		usb_stats_phase(phase);
+		if (ret >= 0 && ret != rest)
+			ret = -EIO;
+	}
+
+	usb_eeprom_set_progress(NULL, NULL);
+	if (verbose)
+		fputc('\n', stderr);
+	free(r.read);
+
+	if (r.error)
+		return r.error;
+	if (ret < 0)
+		return ret;
+
+	remove(file);
+
+	return written;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Resumable EEPROM programming with a checkpoint file
+ *
+ * The image is written and verified chunk by chunk. After each chunk, the
+ * bytes written and verified so far are stored in a checkpoint file. A run
+ * that is interrupted, by a hub reset or Ctrl-C, is resumed by the next run
+ * with the same hub, image and region from the last chunk completed, instead
+ * of from the start. The file is removed once the region verified.
+ *
+ * The hub is named by its vendor and product ID and its port path, which
+ * stay the same when the hub resets, unlike the device number. Its serial
+ * number does not qualify, it is stored in the very EEPROM being written.
+ * As another hub of the same kind may have taken the place in between, the
+ * bytes written so far are read back before the rest is written.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef EEPROM_CHECKPOINT_H
+#define EEPROM_CHECKPOINT_H
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libusb.h>
+
+#include "hubs.h"
+
+/** Size of the name of a hub in a checkpoint */
+#define EEPROM_CHECKPOINT_HUB_SIZE	48
+
+/** Progress of programming a region */
+struct eeprom_checkpoint {
+	/** hub programmed, see eeprom_checkpoint_name() */
+	char hub[EEPROM_CHECKPOINT_HUB_SIZE];
+	/** FNV-1a hash of the data */
+	uint64_t hash;
+	/** region of the EEPROM */
+	size_t offset;
+	size_t len;
+	/** bytes of the region written and verified, from its start */
+	size_t written;
+	size_t verified;
+};
+
+/**
+ * @brief Name a hub for a checkpoint
+ *
+ * @param buf buffer for the name, "VID:PID@PATH" or "VID:PID@BUS:DEV" if
+ * the port path is unknown
+ * @param size size of buf, at least @ref EEPROM_CHECKPOINT_HUB_SIZE
+ * @param hub hub to name
+ * @return 0 on success
+ * @return -errno if the device descriptor could not be read
+ */
+int eeprom_checkpoint_name(char *buf, size_t size, const struct hub_info *hub);
+
+/**
+ * @brief Write a region of the EEPROM and verify it, resuming a checkpoint
+ *
+ * A checkpoint of another hub, image or region is ignored and replaced.
+ * Writing resumes after the part of the bytes already written that still
+ * reads back as in the image. A chunk that does not verify is written again
+ * by the next run.
+ *
+ * @param dev handle of the hub
+ * @param hub name of the hub stored in the checkpoint
+ * @param buffer data to write
+ * @param offset address of the region
+ * @param len size of the region
+ * @param file checkpoint file
+ * @param verbose non-zero to print the progress to stderr
+ * @param stop set from a signal handler to stop after the current chunk, may
+ * be @c NULL
+ * @return number of bytes written by this run on success
+ * @return -EBADMSG if the read back data differs
+ * @return -ECANCELED if stopped, the checkpoint is kept
+ * @return -errno on any other failure
+ */
+int eeprom_checkpoint_program(libusb_device_handle *dev, const char *hub,
+	uint8_t *buffer, size_t offset, size_t len, const char *file,
+	int verbose, volatile sig_atomic_t *stop);
+
+#endif /* EEPROM_CHECKPOINT_H */
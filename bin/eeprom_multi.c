@@ -0,0 +1,214 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Programming the EEPROMs of several hubs at once
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "eeprom_multi.h"
+#include "hubs.h"
+#include "usb_eeprom.h"
+#include "usb_stats.h"
+
+struct eeprom_worker {
+	pthread_t thread;
+	struct eeprom_target *target;
+	int update;
+	int started;
+};
+
+static int target_usable(int hub, int overwrite)
+{
+	int mask = EEPROM_SUPPORT_DEVICE | EEPROM_SUPPORT_STORAGE;
+	int ret;
+
+	ret = usb_eeprom_support(hubs[hub].dev);
+	if (ret < 0 || (ret & mask) != mask)
+		return 0;
+
+	return overwrite || (ret & EEPROM_SUPPORT_BLANK);
+}
+
+static int add_target(struct eeprom_target **targets, int *num, int hub)
+{
+	struct eeprom_target *tmp;
+	int i;
+
+	for (i = 0; i < *num; i++)
+		if ((*targets)[i].hub == hub)
+			return 0;
+
+	tmp = realloc(*targets, (*num + 1) * sizeof(*tmp));
+	if (!tmp)
+		return -ENOMEM;
+
+	memset(&tmp[*num], 0, sizeof(*tmp));
+	tmp[*num].hub = hub;
+	*targets = tmp;
+	(*num)++;
+
+	return 0;
+}
+
+static int find_target(const char *name)
+{
+	int busnum;
+	int devnum;
+	int len = 0;
+
+	if (sscanf(name, "%d:%d%n", &busnum, &devnum, &len) == 2 && !name[len])
+		return get_hub(busnum, devnum);
+
+	return get_hub_by_path(name);
+}
+
+int eeprom_select_targets(const char *spec, int overwrite,
+	struct eeprom_target **targets)
+{
+	char *token;
+	char *save;
+	char *list;
+	int num = 0;
+	int ret = 0;
+	int hub;
+	int i;
+
+	if (!spec || !targets)
+		return -EINVAL;
+
+	list = strdup(spec);
+	if (!list)
+		return -ENOMEM;
+
+	*targets = NULL;
+
+	for (token = strtok_r(list, ",", &save); token && !ret;
+			token = strtok_r(NULL, ",", &save)) {
+		if (!strcmp(token, "all") || !strcmp(token, "blank")) {
+			for (i = 0; i < num_hubs && !ret; i++)
+				if (target_usable(i, token[0] == 'a' &&
+						overwrite))
+					ret = add_target(targets, &num, i);
+			continue;
+		}
+
+		hub = find_target(token);
+		if (hub < 0 || !target_usable(hub, overwrite)) {
+			fprintf(stderr, "No hub with %s EEPROM at '%s'.\n",
+				overwrite ? "programmable" : "blank", token);
+			ret = -ENODEV;
+			break;
+		}
+
+		ret = add_target(targets, &num, hub);
+	}
+
+	free(list);
+
+	if (ret) {
+		free(*targets);
+		*targets = NULL;
+		return ret;
+	}
+
+	return num;
+}
+
+static void *program_worker(void *arg)
+{
+	struct eeprom_worker *worker = arg;
+	struct eeprom_target *target = worker->target;
+	struct timespec start;
+	struct timespec end;
+
+	usb_stats_phase("write");
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	target->result = usb_eeprom_program(hub_handle(&hubs[target->hub]),
+		target->buffer, target->len, worker->update);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	target->ms = (end.tv_sec - start.tv_sec) * 1000 +
+		(end.tv_nsec - start.tv_nsec) / 1000000;
+
+	return NULL;
+}
+
+int eeprom_program_many(struct eeprom_target *targets, int num, int update)
+{
+	struct eeprom_worker *workers;
+	int count = 0;
+	int i;
+
+	workers = calloc(num, sizeof(*workers));
+	if (!workers) {
+		for (i = 0; i < num; i++)
+			targets[i].result = -ENOMEM;
+		return 0;
+	}
+
+	/* open in advance, the workers only transfer */
+	for (i = 0; i < num; i++) {
+		targets[i].result = hub_open(&hubs[targets[i].hub]);
+		if (targets[i].result)
+			continue;
+
+		workers[i].target = &targets[i];
+		workers[i].update = update;
+		if (pthread_create(&workers[i].thread, NULL, program_worker,
+				&workers[i]) == 0)
+			workers[i].started = 1;
+		else
+			program_worker(&workers[i]);
+	}
+
+	for (i = 0; i < num; i++) {
+		if (workers[i].started)
+			pthread_join(workers[i].thread, NULL);
+		if (targets[i].result >= 0)
+			count++;
+	}
+
+	free(workers);
+
+	return count;
+}
+
+void eeprom_print_results(const struct eeprom_target *targets, int num)
+{
+	const struct eeprom_target *target;
+	const struct hub_info *info;
+	char path[HUB_PATH_SIZE];
+	int i;
+
+	printf("%-8s %-16s %s\n", "BUS:DEV", "PATH", "RESULT");
+
+	for (i = 0; i < num; i++) {
+		target = &targets[i];
+		info = &hubs[target->hub];
+		if (hub_port_path(info, path, sizeof(path)) < 0)
+			strcpy(path, "-");
+
+		printf("%03d:%03d  %-16s ", info->busnum, info->devnum, path);
+		if (target->result == -EBADMSG)
+			printf("verification failed\n");
+		else if (target->result < 0)
+			printf("failed: %d\n", target->result);
+		else
+			printf("ok, %d of %d B written in %u ms",
+				target->result, target->len, target->ms);
+		if (target->result >= 0 && target->serial[0])
+			printf(", serial %s", target->serial);
+		if (target->result >= 0)
+			putchar('\n');
+	}
+}
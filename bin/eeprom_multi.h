@@ -0,0 +1,69 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Programming the EEPROMs of several hubs at once
+ *
+ * Each hub gets a worker thread of its own, so the write cycles of all hubs
+ * overlap and a failing hub does not hold up or abort the others.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef EEPROM_MULTI_H
+#define EEPROM_MULTI_H
+
+#include <stdint.h>
+
+#include "eeprom_image.h"
+
+/** A hub to program and the outcome */
+struct eeprom_target {
+	int hub;		/**< registry index */
+	uint8_t *buffer;	/**< image to write */
+	int len;		/**< size of the image */
+	/** bytes written or negative error code, see usb_eeprom_program() */
+	int result;
+	unsigned int ms;	/**< time taken to program and verify */
+	/** serial number patched into the image, empty for none */
+	char serial[EEPROM_IMAGE_STRING_MAX + 1];
+};
+
+/**
+ * @brief Select hubs by a comma separated list of targets
+ *
+ * A target is "BUS:DEV", a port path like "1-2.3", "blank" for every hub
+ * with a blank EEPROM or "all" for every hub with an EEPROM, non-blank ones
+ * only with overwrite set. Hubs are selected once even if several targets
+ * match.
+ *
+ * @param spec list of targets
+ * @param overwrite non-zero to accept hubs with non-blank EEPROM
+ * @param targets set to an allocated array of selected hubs, free() it
+ * after use
+ * @return number of selected hubs on success
+ * @return -ENODEV if a listed hub does not exist or has no usable EEPROM
+ * @return -errno on any other failure
+ */
+int eeprom_select_targets(const char *spec, int overwrite,
+	struct eeprom_target **targets);
+
+/**
+ * @brief Program and verify all targets concurrently
+ *
+ * @param targets hubs to program, results are stored in place
+ * @param num number of targets
+ * @param update non-zero to write only the pages that differ
+ * @return number of targets programmed successfully
+ */
+int eeprom_program_many(struct eeprom_target *targets, int num, int update);
+
+/**
+ * @brief Print one line per target with the outcome
+ *
+ * @param targets programmed hubs
+ * @param num number of targets
+ */
+void eeprom_print_results(const struct eeprom_target *targets, int num);
+
+#endif /* EEPROM_MULTI_H */
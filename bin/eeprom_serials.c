@@ -0,0 +1,203 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Serial numbers for programming hubs from a template image
+ *
+ * @copyright GPLv3
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eeprom_serials.h"
+#include "file_io.h"
+
+#define STATE_SUFFIX	".next"
+
+int serial_source_counter(struct serial_source *src, const uint8_t *image,
+	size_t len, unsigned long start)
+{
+	const uint8_t *chars;
+	size_t num = 0;
+	size_t i;
+	uint16_t c;
+
+	memset(src, 0, sizeof(*src));
+	src->next = start;
+
+	chars = eeprom_image_string(image, len, EEPROM_IMAGE_SERIAL, &num);
+	for (i = 0; chars && i < num; i++) {
+		c = eeprom_image_u16(chars + 2 * i);
+		if (c < 0x20 || c >= 0x7f)
+			return -EINVAL;
+		src->prefix[i] = c;
+	}
+
+	/* the number is the run of digits at the end */
+	while (num && isdigit((unsigned char)src->prefix[num - 1])) {
+		src->prefix[--num] = '\0';
+		src->width++;
+	}
+	if (!src->width)
+		src->width = 1;
+
+	return 0;
+}
+
+/* First field of a CSV line, without quotes and surrounding blanks */
+static char *first_field(char *line)
+{
+	char *end;
+
+	line += strspn(line, " \t");
+	end = line + strcspn(line, ",\r\n");
+	while (end > line && (end[-1] == ' ' || end[-1] == '\t'))
+		end--;
+	*end = '\0';
+
+	if (end - line >= 2 && line[0] == '"' && end[-1] == '"') {
+		end[-1] = '\0';
+		line++;
+	}
+
+	return line;
+}
+
+/* Position of previous runs, 0 without a state file */
+static int state_load(struct serial_source *src)
+{
+	size_t pos;
+	FILE *fp;
+	int num;
+
+	fp = fopen(src->state, "r");
+	if (!fp)
+		return errno == ENOENT ? 0 : -errno;
+
+	num = fscanf(fp, "%zu", &pos);
+	fclose(fp);
+	if (num != 1 || pos > src->num)
+		return -EINVAL;
+
+	src->pos = pos;
+
+	return 0;
+}
+
+static int state_save(const struct serial_source *src, size_t pos)
+{
+	char line[32];
+	ssize_t ret;
+	int len;
+
+	len = snprintf(line, sizeof(line), "%zu\n", pos);
+	ret = file_replace(src->state, (const uint8_t *)line, len);
+
+	return ret < 0 ? ret : 0;
+}
+
+int serial_source_csv(struct serial_source *src, const char *file)
+{
+	char *line = NULL;
+	size_t size = 0;
+	char *serial;
+	char **tmp;
+	FILE *fp;
+	int ret = 0;
+
+	memset(src, 0, sizeof(*src));
+
+	fp = fopen(file, "r");
+	if (!fp)
+		return -errno;
+
+	while (getline(&line, &size, fp) >= 0) {
+		serial = first_field(line);
+		if (!*serial || *serial == '#')
+			continue;
+		if (strlen(serial) > EEPROM_IMAGE_STRING_MAX) {
+			ret = -EINVAL;
+			break;
+		}
+
+		tmp = realloc(src->list, (src->num + 1) * sizeof(*tmp));
+		if (tmp)
+			src->list = tmp;
+		serial = strdup(serial);
+		if (!tmp || !serial) {
+			free(serial);
+			ret = -ENOMEM;
+			break;
+		}
+		src->list[src->num++] = serial;
+	}
+
+	free(line);
+	fclose(fp);
+
+	/* a source with a list is a list, even an empty one */
+	if (!ret && !src->list)
+		src->list = calloc(1, sizeof(*src->list));
+	if (!ret && !src->list)
+		ret = -ENOMEM;
+
+	if (!ret) {
+		src->state = malloc(strlen(file) + sizeof(STATE_SUFFIX));
+		if (src->state)
+			sprintf(src->state, "%s" STATE_SUFFIX, file);
+		else
+			ret = -ENOMEM;
+	}
+	if (!ret)
+		ret = state_load(src);
+	if (ret)
+		serial_source_free(src);
+
+	return ret;
+}
+
+int serial_source_next(struct serial_source *src, char *serial, size_t size)
+{
+	int len;
+	int ret;
+
+	if (src->list) {
+		if (src->pos == src->num)
+			return -ENODATA;
+		len = snprintf(serial, size, "%s", src->list[src->pos]);
+	} else {
+		len = snprintf(serial, size, "%s%0*lu", src->prefix,
+			src->width, src->next);
+	}
+	if (len < 0 || len >= size)
+		return -ENOSPC;
+
+	if (src->list) {
+		ret = state_save(src, src->pos + 1);
+		if (ret)
+			return ret;
+		src->pos++;
+	} else {
+		src->next++;
+	}
+
+	return 0;
+}
+
+void serial_source_free(struct serial_source *src)
+{
+	size_t i;
+
+	for (i = 0; i < src->num; i++)
+		free(src->list[i]);
+	free(src->list);
+	free(src->state);
+	src->list = NULL;
+	src->state = NULL;
+	src->num = 0;
+	src->pos = 0;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Serial numbers for programming hubs from a template image
+ *
+ * The serials come from a counter or from a CSV file. A counter replaces
+ * the number at the end of the serial of the template image, keeping its
+ * prefix and width, so "4416-000001" counting from 42 gives "4416-000042",
+ * "4416-000043" and so on. A CSV file gives one serial per line in its
+ * first field, empty lines and lines starting with '#' are skipped.
+ *
+ * The counter starts from the number given on every run. The position in
+ * a CSV file is kept in a state file next to it, FILE.next, so that runs
+ * programming one hub each take the serials one after the other. A serial
+ * counts as taken once it is handed out, whether the hub is programmed or
+ * not, no serial is handed out twice.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef EEPROM_SERIALS_H
+#define EEPROM_SERIALS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eeprom_image.h"
+
+/** Source of serial numbers */
+struct serial_source {
+	/** serial of the template up to its number, for a counter */
+	char prefix[EEPROM_IMAGE_STRING_MAX + 1];
+	/** digits of the number */
+	int width;
+	/** number of the next serial */
+	unsigned long next;
+	/** serials read from a CSV file, @c NULL for a counter */
+	char **list;
+	size_t num;
+	size_t pos;
+	/** state file holding pos, for a CSV file */
+	char *state;
+};
+
+/**
+ * @brief Count serials up from the serial of an image
+ *
+ * @param src source to set up
+ * @param image template image
+ * @param len size of the image
+ * @param start number of the first serial
+ * @return 0 on success
+ * @return -EINVAL if the serial of the image is not printable ASCII
+ */
+int serial_source_counter(struct serial_source *src, const uint8_t *image,
+	size_t len, unsigned long start);
+
+/**
+ * @brief Read serials from a CSV file
+ *
+ * Continues after the serials taken by previous runs, as recorded in
+ * FILE.next.
+ *
+ * @param src source to set up, serial_source_free() it after use
+ * @param file CSV file
+ * @return 0 on success
+ * @return -EINVAL if a serial is longer than @ref EEPROM_IMAGE_STRING_MAX
+ * or the state file is garbled
+ * @return -errno on any other failure
+ */
+int serial_source_csv(struct serial_source *src, const char *file);
+
+/**
+ * @brief Get the next serial
+ *
+ * A serial of a CSV file is recorded as taken in its state file before it
+ * is returned.
+ *
+ * @param src source
+ * @param serial buffer for the serial
+ * @param size size of the buffer, at least @ref EEPROM_IMAGE_STRING_MAX + 1
+ * @return 0 on success
+ * @return -ENODATA if the CSV file has no serials left
+ * @return -ENOSPC if the serial does not fit the buffer
+ * @return -errno if the state file could not be written
+ */
+int serial_source_next(struct serial_source *src, char *serial, size_t size);
+
+/**
+ * @brief Free the serials read from a CSV file, the state file is kept
+ *
+ * @param src source
+ */
+void serial_source_free(struct serial_source *src);
+
+#endif /* EEPROM_SERIALS_H */
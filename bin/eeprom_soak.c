@@ -0,0 +1,240 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief EEPROM soak test, erase, write and verify in a loop
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "eeprom_soak.h"
+#include "usb_eeprom.h"
+#include "usb_stats.h"
+
+static const char *const step_names[SOAK_STEPS] = {
+	"erase", "write", "verify",
+};
+
+static const char *const fault_names[SOAK_FAULTS] = {
+	"pass", "short", "timeout", "error", "mismatch",
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+enum soak_fault eeprom_soak_classify(int ret, int len)
+{
+	if (ret == len)
+		return SOAK_PASS;
+	if (ret >= 0)
+		return SOAK_SHORT;
+	if (ret == -ETIMEDOUT)
+		return SOAK_TIMEOUT;
+
+	return SOAK_ERROR;
+}
+
+/* Run one step, returns non-zero if the iteration failed */
+static int run_step(struct soak_iteration *it, enum soak_step step, int ret,
+	int len, uint64_t start)
+{
+	it->ns[step] = now_ns() - start;
+	it->fault = eeprom_soak_classify(ret, len);
+	if (it->fault == SOAK_PASS)
+		return 0;
+
+	it->step = step;
+	it->result = ret;
+
+	return 1;
+}
+
+void eeprom_soak_compare(struct soak_iteration *it, const uint8_t *image,
+	const uint8_t *read, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (image[i] == read[i])
+			continue;
+
+		if (!it->mismatches++)
+			it->first = i;
+		it->last = i;
+	}
+
+	if (it->mismatches) {
+		it->fault = SOAK_MISMATCH;
+		it->step = SOAK_VERIFY;
+	}
+}
+
+static void print_iteration(int index, const struct soak_iteration *it)
+{
+	int i;
+
+	printf("%7d ", index + 1);
+	for (i = 0; i < SOAK_STEPS; i++)
+		printf(" %s %8.3f", step_names[i], it->ns[i] / 1e6);
+	printf(" ms  %s\n", fault_names[it->fault]);
+}
+
+int eeprom_soak(libusb_device_handle *dev, const uint8_t *image, int len,
+	int iterations, int verbose, volatile sig_atomic_t *stop,
+	struct soak_iteration **results)
+{
+	const char *phase = usb_stats_get_phase();
+	struct soak_iteration *it;
+	uint8_t *write;
+	uint8_t *read;
+	uint64_t start;
+	int ret;
+	int n;
+
+	if (!dev || !image || len <= 0 || iterations < 1 ||
+			iterations > SOAK_LIMIT || !results)
+		return -EINVAL;
+
+	*results = calloc(iterations, sizeof(**results));
+	/* usb_eeprom_write() does not take a const image */
+	write = malloc(len);
+	read = malloc(len);
+	if (!*results || !write || !read) {
+		free(*results);
+		free(write);
+		free(read);
+		*results = NULL;
+		return -ENOMEM;
+	}
+	memcpy(write, image, len);
+
+	for (n = 0; n < iterations && !(stop && *stop); n++) {
+		it = &(*results)[n];
+
+		usb_stats_phase("erase");
+		start = now_ns();
+		ret = usb_eeprom_erase(dev, len);
+		if (run_step(it, SOAK_ERASE, ret, len, start))
+			goto next;
+
+		usb_stats_phase("write");
+		start = now_ns();
+		ret = usb_eeprom_write(dev, write, len);
+		if (run_step(it, SOAK_WRITE, ret, len, start))
+			goto next;
+
+		usb_stats_phase("verify");
+		start = now_ns();
+		ret = usb_eeprom_read(dev, read, len);
+		if (!run_step(it, SOAK_VERIFY, ret, len, start))
+			eeprom_soak_compare(it, image, read, len);
+
+next:
+		if (verbose)
+			print_iteration(n, it);
+	}
+
+	usb_stats_phase(phase);
+	free(write);
+	free(read);
+
+	return n;
+}
+
+static int cmp_ns(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+uint64_t eeprom_soak_percentile(const uint64_t *sorted, int num, int percent)
+{
+	int rank = (num * percent + 99) / 100;
+
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void print_latency(const char *name, uint64_t *ns, int num)
+{
+	qsort(ns, num, sizeof(*ns), cmp_ns);
+	printf("%-8s %9.3f %9.3f %9.3f %9.3f\n", name, ns[0] / 1e6,
+		eeprom_soak_percentile(ns, num, 50) / 1e6,
+		eeprom_soak_percentile(ns, num, 99) / 1e6,
+		ns[num - 1] / 1e6);
+}
+
+int eeprom_soak_print(const struct soak_iteration *results, int num)
+{
+	const struct soak_iteration *it;
+	int faults[SOAK_FAULTS] = { 0 };
+	uint64_t *ns;
+	int passed;
+	int step;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		it = &results[i];
+		faults[it->fault]++;
+
+		if (it->fault == SOAK_MISMATCH)
+			printf("Iteration %d: verify mismatch at "
+				"0x%04x..0x%04x, %d bytes differ\n", i + 1,
+				it->first, it->last, it->mismatches);
+		else if (it->fault == SOAK_SHORT)
+			printf("Iteration %d: %s short, %d bytes\n", i + 1,
+				step_names[it->step], it->result);
+		else if (it->fault != SOAK_PASS)
+			printf("Iteration %d: %s %s: %d\n", i + 1,
+				step_names[it->step],
+				it->fault == SOAK_TIMEOUT ?
+				"timed out" : "failed", it->result);
+	}
+
+	passed = faults[SOAK_PASS];
+	printf("%d iterations, %d passed", num, passed);
+	for (i = SOAK_PASS + 1; i < SOAK_FAULTS; i++)
+		printf(", %d %s", faults[i], fault_names[i]);
+	putchar('\n');
+
+	ns = passed ? malloc(passed * sizeof(*ns)) : NULL;
+	if (!ns)
+		return num - passed;
+
+	printf("\n%-8s %9s %9s %9s %9s\n", "STEP", "min ms", "p50 ms",
+		"p99 ms", "max ms");
+	for (step = 0; step <= SOAK_STEPS; step++) {
+		passed = 0;
+		for (i = 0; i < num; i++) {
+			it = &results[i];
+			if (it->fault != SOAK_PASS)
+				continue;
+
+			ns[passed] = step < SOAK_STEPS ? it->ns[step] :
+				it->ns[SOAK_ERASE] + it->ns[SOAK_WRITE] +
+				it->ns[SOAK_VERIFY];
+			passed++;
+		}
+
+		print_latency(step < SOAK_STEPS ?
+			step_names[step] : "total", ns, passed);
+	}
+
+	free(ns);
+
+	return num - passed;
+}
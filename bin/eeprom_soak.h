@@ -0,0 +1,123 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief EEPROM soak test, erase, write and verify in a loop
+ *
+ * The hub stays open for all iterations, so the time of an iteration is the
+ * time the EEPROM takes and not that of starting hub-ctrl and scanning the
+ * bus. Each iteration is kept with its latencies and the kind of failure.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef EEPROM_SOAK_H
+#define EEPROM_SOAK_H
+
+#include <signal.h>
+#include <stdint.h>
+
+#include <libusb.h>
+
+/** most iterations of a soak test */
+#define SOAK_LIMIT	1000000
+
+/** Steps of an iteration */
+enum soak_step {
+	SOAK_ERASE,
+	SOAK_WRITE,
+	SOAK_VERIFY,
+	SOAK_STEPS
+};
+
+/** Outcome of an iteration */
+enum soak_fault {
+	SOAK_PASS,	/**< all steps succeeded */
+	SOAK_SHORT,	/**< fewer bytes transferred than requested */
+	SOAK_TIMEOUT,	/**< a request or the write cycle timed out */
+	SOAK_ERROR,	/**< a request failed otherwise */
+	SOAK_MISMATCH,	/**< the data read back differs from the image */
+	SOAK_FAULTS
+};
+
+/** One iteration */
+struct soak_iteration {
+	enum soak_fault fault;
+	/** step that failed, the remaining ones are skipped */
+	enum soak_step step;
+	/** return value of the failed step, bytes or negative error code */
+	int result;
+	/** first and last differing byte and their number, for a mismatch */
+	int first;
+	int last;
+	int mismatches;
+	/** time of each step in ns, 0 if skipped */
+	uint64_t ns[SOAK_STEPS];
+};
+
+/**
+ * @brief Erase, write and verify an image over and over
+ *
+ * @param dev open hub
+ * @param image image to write
+ * @param len size of the image
+ * @param iterations number of iterations, at most @ref SOAK_LIMIT
+ * @param verbose non-zero to print a line per iteration
+ * @param stop set from a signal handler to end early, may be @c NULL
+ * @param results set to an allocated array of the iterations run, free()
+ * it after use
+ * @return number of iterations run
+ * @return -errno if the test could not be set up
+ */
+int eeprom_soak(libusb_device_handle *dev, const uint8_t *image, int len,
+	int iterations, int verbose, volatile sig_atomic_t *stop,
+	struct soak_iteration **results);
+
+/**
+ * @brief Classify the return value of a step
+ *
+ * @param ret bytes transferred or negative error code
+ * @param len bytes requested
+ * @return outcome of the step, @ref SOAK_MISMATCH is left to
+ * eeprom_soak_compare()
+ */
+enum soak_fault eeprom_soak_classify(int ret, int len);
+
+/**
+ * @brief Compare the data read back with the image
+ *
+ * Sets the differing range and count of the iteration and marks it as
+ * @ref SOAK_MISMATCH at the verify step if any byte differs. The
+ * iteration is left alone otherwise.
+ *
+ * @param it iteration with zero mismatches so far
+ * @param image image written
+ * @param read data read back
+ * @param len size of both
+ */
+void eeprom_soak_compare(struct soak_iteration *it, const uint8_t *image,
+	const uint8_t *read, int len);
+
+/**
+ * @brief Nearest-rank percentile of sorted latencies
+ *
+ * @param sorted latencies in ascending order
+ * @param num number of latencies, at least 1
+ * @param percent percentile, 0 to 100
+ * @return smallest latency not exceeded by @p percent percent of them
+ */
+uint64_t eeprom_soak_percentile(const uint64_t *sorted, int num, int percent);
+
+/**
+ * @brief Print the failed iterations and a summary
+ *
+ * The summary counts the iterations by outcome and gives min, p50, p99 and
+ * max latency of the iterations that passed, in total and per step.
+ *
+ * @param results iterations run
+ * @param num number of iterations
+ * @return number of failed iterations
+ */
+int eeprom_soak_print(const struct soak_iteration *results, int num);
+
+#endif /* EEPROM_SOAK_H */
@@ -22,6 +22,7 @@
  */
 
 #include <errno.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,305 +31,813 @@
 #include <libusb.h>
 
 #include "config.h"
+#include "ctrld.h"
+#include "eeprom_checkpoint.h"
+#include "eeprom_image.h"
+#include "eeprom_multi.h"
+#include "eeprom_serials.h"
+#include "eeprom_soak.h"
 #include "file_io.h"
+#include "hub_monitor.h"
+#include "hubs.h"
 #include "options.h"
+#include "power_seq.h"
+#include "usb_devnode.h"
 #include "usb_eeprom.h"
+#include "usb_policy.h"
+#include "usb_stats.h"
 
-#define USB_RT_HUB			(LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_DEVICE)
-#define USB_RT_PORT			(LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_OTHER)
-#define USB_PORT_FEAT_POWER		8
-#define USB_PORT_FEAT_INDICATOR		22
+/*
+ * Requests are tried three times with 5 and 10 ms in between. After eight
+ * answers of a kind a hub gets four times its p99 latency, at least 50 ms.
+ */
+static const struct usb_policy policy = {
+	.attempts = 3,
+	.backoff_ms = 5,
+	.timeout_factor = 4,
+	.min_timeout_ms = 50,
+	.min_samples = 8,
+};
+
+static void print_programmed(int len, int written, int update)
+{
+	if (!update)
+		printf("EEPROM updated (%i B)\n", len);
+	else if (written)
+		printf("EEPROM updated (%i of %i B written)\n", written, len);
+	else
+		printf("EEPROM unchanged (%i B)\n", len);
+}
 
-#define HUB_LED_GREEN			2
+/*
+ * Read the image to write. A whole image must be valid, a region is a part
+ * of one and cannot be checked on its own.
+ */
+static int read_image(struct hub_options *opts, uint8_t **buffer)
+{
+	const char *problem;
+	int len;
+
+	if (!opts->filename) {
+		fprintf(stderr, "No input file?\n");
+		return -EINVAL;
+	}
 
-#define HUB_CHAR_LPSM			0x0003
-#define HUB_CHAR_PORTIND		0x0080
+	len = file_read(opts->filename, buffer,
+		opts->length ? opts->length : opts->eesize);
+	if (len < 0) {
+		fprintf(stderr, "Reading file '%s' failed: %d\n",
+			opts->filename, len);
+		return len;
+	}
 
-#define CTRL_TIMEOUT			1000
-#define USB_STATUS_SIZE			4
+	if (!opts->length && eeprom_image_validate(*buffer, len, &problem)) {
+		fprintf(stderr, "Invalid EEPROM image '%s': %s\n",
+			opts->filename, problem);
+		return -EINVAL;
+	}
 
-#define MAX_HUBS 128
+	return len;
+}
 
-struct usb_hub_descriptor {
-	uint8_t bDescLength;
-	uint8_t bDescriptorType;
-	uint8_t bNbrPorts;
-	uint16_t wHubCharacteristics;
-	uint8_t bPwrOn2PwrGood;
-	uint8_t bHubContrCurrent;
-} __attribute__((packed));
+/* Copy the image with the next serial patched in, the copy may grow */
+static int image_with_serial(const uint8_t *image, int len,
+	struct serial_source *serials, uint8_t **buffer, char *serial)
+{
+	int ret;
 
-struct hub_info {
-	int busnum;
-	int devnum;
-	libusb_device *dev;
-	int nport;
-	int indicator_support;
-};
+	*buffer = malloc(MAX_EEPROM_SIZE);
+	if (!*buffer)
+		return -ENOMEM;
+	memcpy(*buffer, image, len);
+
+	ret = serial_source_next(serials, serial, EEPROM_IMAGE_STRING_MAX + 1);
+	if (!ret)
+		ret = eeprom_image_set_string(*buffer, len, MAX_EEPROM_SIZE,
+			EEPROM_IMAGE_SERIAL, serial);
+	if (ret < 0) {
+		fprintf(stderr, "No serial for the image: %s\n",
+			strerror(-ret));
+		free(*buffer);
+		*buffer = NULL;
+	}
 
-static struct hub_info hubs[MAX_HUBS];
-/** Number of hubs supporting power switching */
-static int num_hubs;
+	return ret;
+}
 
-static void hub_port_status(libusb_device_handle *dev, int nport)
+/*
+ * Set up the serials of a template image. Several hubs get theirs when
+ * they are programmed, a single hub gets the first one right away.
+ */
+static int load_serials(struct hub_options *opts,
+	struct serial_source *serials, uint8_t **buffer, int len,
+	char *serial)
 {
-	uint8_t buf[USB_STATUS_SIZE];
+	uint8_t *patched;
 	int ret;
-	int i;
 
-	if (!dev)
-		return;
+	if (opts->serial_csv)
+		ret = serial_source_csv(serials, opts->serial_csv);
+	else
+		ret = serial_source_counter(serials, *buffer, len,
+			opts->serial_start);
+	if (ret) {
+		fprintf(stderr, "Reading the serials failed: %s\n",
+			strerror(-ret));
+		return ret;
+	}
 
-	printf(" Hub Port Status:\n");
-	for (i = 0; i < nport; i++) {
-
-		ret = libusb_control_transfer(dev,
-			LIBUSB_ENDPOINT_IN | USB_RT_PORT,
-			LIBUSB_REQUEST_GET_STATUS, 0, i + 1, buf, USB_STATUS_SIZE,
-			CTRL_TIMEOUT);
-		if (ret < 0) {
-			fprintf(stderr,
-				"cannot read port %d status, %s (%d)\n",
-				i + 1, strerror(errno), errno);
-			break;
-		}
+	if (opts->targets)
+		return len;
+
+	ret = image_with_serial(*buffer, len, serials, &patched, serial);
+	if (ret < 0)
+		return ret;
+
+	free(*buffer);
+	*buffer = patched;
+
+	return ret;
+}
+
+/* Decode an image file, no hub involved */
+static int run_dump_fields(struct hub_options *opts)
+{
+	uint8_t *buffer = NULL;
+	int len;
 
-		printf("   Port %d: %02x%02x.%02x%02x", i + 1, buf[3], buf[2],
-			buf[1], buf[0]);
-
-		printf("%s%s%s%s%s",
-			(buf[2] & 0x10) ? " C_RESET" : "",
-			(buf[2] & 0x08) ? " C_OC" : "",
-			(buf[2] & 0x04) ? " C_SUSPEND" : "",
-			(buf[2] & 0x02) ? " C_ENABLE" : "",
-			(buf[2] & 0x01) ? " C_CONNECT" : "");
-
-		printf("%s%s%s%s%s%s%s%s%s%s\n",
-			(buf[1] & 0x10) ? " indicator" : "",
-			(buf[1] & 0x08) ? " test" : "",
-			(buf[1] & 0x04) ? " highspeed" : "",
-			(buf[1] & 0x02) ? " lowspeed" : "",
-			(buf[1] & 0x01) ? " power" : "",
-			(buf[0] & 0x10) ? " RESET" : "",
-			(buf[0] & 0x08) ? " oc" : "",
-			(buf[0] & 0x04) ? " suspend" : "",
-			(buf[0] & 0x02) ? " enable" : "",
-			(buf[0] & 0x01) ? " connect" : "");
+	len = file_read(opts->dump_fields, &buffer, MAX_EEPROM_SIZE);
+	if (len < 0) {
+		fprintf(stderr, "Reading file '%s' failed: %d\n",
+			opts->dump_fields, len);
+		return 1;
 	}
+
+	eeprom_image_print(stdout, buffer, len);
+	len = eeprom_image_validate(buffer, len, NULL);
+	free(buffer);
+
+	return len != 0;
 }
 
-static int usb_find_hubs(int print)
+/* Send each port change to hub-ctrld, it keeps the hubs open in between */
+static int run_remote_ports(struct hub_options *opts)
 {
-	struct libusb_device_descriptor desc;
-	struct usb_hub_descriptor hub_desc;
-	libusb_device_handle *dev = NULL;
-	libusb_device **devlist;
-	libusb_device *hub;
-	uint8_t buf[sizeof(hub_desc)];
-	uint8_t id_node;
-	uint8_t id_bus;
+	const struct port_op *op;
+	char request[64];
+	char reply[64];
+	int result = 0;
 	int ret;
-	int len;
-	int num;
 	int i;
 
-	num_hubs = 0;
+	for (i = 0; i < opts->num_ops; i++) {
+		op = &opts->ops[i];
+		snprintf(request, sizeof(request), "%s %zu %zu %zu %zu",
+			opts->cmd == COMMAND_SET_LED ? "led" : "power",
+			op->busnum, op->devnum, op->port, op->value);
 
-	num = libusb_get_device_list(NULL, &devlist);
-	if (num < 0) {
-		fprintf(stderr, "Failed to get USB device list: %s\n",
-			libusb_strerror(num));
-		return -ENODEV;
+		ret = ctrld_request(opts->socket, request, reply,
+			sizeof(reply), NULL);
+		if (ret) {
+			fprintf(stderr, "hub-ctrld request '%s' failed: %s\n",
+				request, strerror(-ret));
+			result = 1;
+		}
 	}
 
-	if (print)
-		printf("%d USB devices found.\n", num);
+	return result;
+}
 
-	for (i = 0; i < num; i++) {
-		if (dev) {
-			libusb_close(dev);
-			dev = NULL;
+/*
+ * Hand the command over to a running hub-ctrld instead of touching the bus,
+ * which saves the libusb setup and the hub scan of every invocation.
+ */
+static int run_remote(struct hub_options *opts)
+{
+	char *default_file = "output.iic";
+	uint8_t *buffer = NULL;
+	char *payload = NULL;
+	char *request;
+	int result = 1;
+	int len = 0;
+	int offset;
+	int ret;
+
+	if (!(opts->cmd & COMMAND_TYPE_EEPROM))
+		return run_remote_ports(opts);
+
+	request = malloc(CTRLD_LINE_MAX);
+	if (!request) {
+		fprintf(stderr, "malloc() failed: %s\n", strerror(errno));
+		return 1;
+	}
+
+	offset = snprintf(request, CTRLD_LINE_MAX, "%s %zu %zu",
+		opts->cmd == COMMAND_GET_EEPROM ? "read" :
+		opts->cmd != COMMAND_SET_EEPROM ? "erase" :
+		opts->update ? "update" : "write",
+		opts->busnum, opts->devnum);
+
+	switch (opts->cmd) {
+	case COMMAND_SET_EEPROM:
+		ret = read_image(opts, &buffer);
+		if (ret < 0)
+			goto cleanup;
+		offset += snprintf(request + offset, CTRLD_LINE_MAX - offset,
+			" %d ", opts->overwrite);
+		ctrld_hex_encode(request + offset, buffer, ret);
+		len = ret;
+		break;
+	default:
+		snprintf(request + offset, CTRLD_LINE_MAX - offset, " %zu",
+			opts->eesize);
+		break;
+	}
+
+	ret = ctrld_request(opts->socket, request, request, CTRLD_LINE_MAX,
+		&payload);
+	if (ret) {
+		fprintf(stderr, "hub-ctrld request failed: %s\n",
+			strerror(-ret));
+		goto cleanup;
+	}
+
+	switch (opts->cmd) {
+	case COMMAND_GET_EEPROM:
+		free(buffer);
+		buffer = malloc(opts->eesize);
+		if (!buffer) {
+			fprintf(stderr, "malloc() failed: %s\n",
+					strerror(errno));
+			goto cleanup;
 		}
 
-		hub = devlist[i];
-		id_bus = libusb_get_bus_number(hub);
-		id_node = libusb_get_device_address(hub);
-		memset(&desc, 0, sizeof(desc));
+		ret = ctrld_hex_decode(buffer, opts->eesize, payload);
+		if (ret != opts->eesize) {
+			fprintf(stderr, "EEPROM read failed: %d\n", ret);
+			goto cleanup;
+		}
 
-		ret = libusb_get_device_descriptor(hub, &desc);
-		if (ret && print > 1) {
-			fprintf(stderr, "Device %03d:%03d: No descriptor: %s\n",
-				id_bus, id_node, libusb_strerror(ret));
+		if (!opts->filename)
+			opts->filename = default_file;
+
+		ret = file_write(opts->filename, buffer, opts->eesize);
+		if (ret != opts->eesize) {
+			fprintf(stderr, "Writing file '%s' failed: %d\n",
+				opts->filename, ret);
+			goto cleanup;
 		}
 
-		if (desc.bDeviceClass != LIBUSB_CLASS_HUB &&
-				!usb_eeprom_support(hub)) {
-			if (print > 1) {
-				fprintf(stderr, "Device %03d:%03d (%04x:%04x): "
-						"Not a hub\n",
-						id_bus, id_node, desc.idVendor,
-						desc.idProduct);
-			}
-			continue;
+		if (strcmp(opts->filename, "-") != 0 && !opts->quiet)
+			printf("EEPROM dumped to '%s'\n", opts->filename);
+		break;
+	case COMMAND_SET_EEPROM:
+		if (!opts->quiet)
+			print_programmed(len, atoi(payload), opts->update);
+		break;
+	}
+
+	result = 0;
+
+cleanup:
+	free(request);
+	free(buffer);
+
+	return result;
+}
+
+/* Switch the ports on in waves keeping their inrush within the budget */
+static int run_power_seq(struct hub_options *opts, struct hub_port_req *reqs,
+	int num)
+{
+	struct power_step *steps;
+	struct hub_info *info;
+	int result = 0;
+	int total;
+	int waves;
+	int i;
+
+	steps = calloc(num, sizeof(*steps));
+	if (!steps) {
+		fprintf(stderr, "malloc() failed: %s\n", strerror(errno));
+		return 1;
+	}
+
+	for (i = 0; i < num; i++) {
+		info = &hubs[reqs[i].hub];
+		steps[i].hub = reqs[i].hub;
+		steps[i].port = reqs[i].port;
+		total = hub_power_good_delay(info);
+		if (total < 0) {
+			if (opts->verbose)
+				fprintf(stderr, "No power-good time of "
+					"%03d:%03d, assuming %d ms.\n",
+					info->busnum, info->devnum,
+					HUB_PWR_GOOD_MAX_MS);
+			total = HUB_PWR_GOOD_MAX_MS;
 		}
+		steps[i].settle_ms = total;
+	}
 
-		ret = libusb_open(hub, &dev);
-		if (ret) {
-			if (print > 1) {
-				fprintf(stderr, "Device %03d:%03d (%04x:%04x): "
-					"Failed to open: %s\n",
-					id_bus, id_node, desc.idVendor,
-					desc.idProduct, libusb_strerror(ret));
-			}
+	total = power_seq_plan(steps, num, opts->budget, opts->port_current);
+	if (total < 0) {
+		if (total == -EINVAL)
+			fprintf(stderr, "Current budget of %zu mA is below the "
+				"%zu mA of a port.\n", opts->budget,
+				opts->port_current);
+		else
+			fprintf(stderr, "Planning power-on failed: %s\n",
+				strerror(-total));
+		free(steps);
+		return 1;
+	}
+
+	for (i = 0; i < num && opts->verbose; i++) {
+		info = &hubs[steps[i].hub];
+		printf("+%4u ms: power on port %d of %03d:%03d, good after "
+			"%u ms\n", steps[i].start_ms, steps[i].port,
+			info->busnum, info->devnum, steps[i].settle_ms);
+	}
+
+	waves = power_seq_run(steps, num);
+	if (waves < 0) {
+		fprintf(stderr, "Sending control messages failed: %s\n",
+			strerror(-waves));
+		free(steps);
+		return 1;
+	}
+
+	for (i = 0; i < num; i++) {
+		if (!steps[i].result)
 			continue;
-		}
 
-		len = libusb_control_transfer(dev,
-			LIBUSB_ENDPOINT_IN | USB_RT_HUB,
-			LIBUSB_REQUEST_GET_DESCRIPTOR,
-			LIBUSB_DT_HUB << 8, 0, buf, sizeof(buf), CTRL_TIMEOUT);
-
-		if (len <= 0) {
-			if (print > 1) {
-				fprintf(stderr, "Device %03d:%03d (%04x:%04x): "
-					"Failed to get descriptor: %s\n",
-					id_bus, id_node, desc.idVendor,
-					desc.idProduct, len < 0 ?
-						libusb_strerror(len) :
-						"None found.");
-			}
+		info = &hubs[steps[i].hub];
+		fprintf(stderr, "libusb_control_transfer failed for port %d of "
+			"%03d:%03d: %s.\n", steps[i].port, info->busnum,
+			info->devnum, strerror(-steps[i].result));
+		result = 1;
+	}
+
+	if (!opts->quiet)
+		printf("%d ports powered on in %d waves within %zu mA, "
+			"%d ms\n", num, waves, opts->budget, total);
+
+	free(steps);
+
+	return result;
+}
+
+/* How far apart the successful requests were submitted and completed */
+static void print_skew(const struct hub_options *opts,
+	const struct hub_port_req *reqs, int num)
+{
+	uint64_t first_submit = UINT64_MAX;
+	uint64_t last_submit = 0;
+	uint64_t first_done = UINT64_MAX;
+	uint64_t last_done = 0;
+	struct hub_info *info;
+	int ok = 0;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (reqs[i].result || !reqs[i].done_ns)
 			continue;
-		}
 
-		memset(&hub_desc, 0, sizeof(hub_desc));
-		memcpy(&hub_desc, buf, len);
-
-		if (!(hub_desc.wHubCharacteristics & HUB_CHAR_PORTIND) &&
-				(hub_desc.wHubCharacteristics & HUB_CHAR_LPSM) >= 2) {
-			if (print > 1) {
-				fprintf(stderr, "Device %03d:%03d (%04x:%04x): "
-					"Neither power switching nor "
-					"indicators supported.\n",
-					id_bus, id_node, desc.idVendor,
-					desc.idProduct);
-			}
+		if (reqs[i].submit_ns < first_submit)
+			first_submit = reqs[i].submit_ns;
+		if (reqs[i].submit_ns > last_submit)
+			last_submit = reqs[i].submit_ns;
+		if (reqs[i].done_ns < first_done)
+			first_done = reqs[i].done_ns;
+		if (reqs[i].done_ns > last_done)
+			last_done = reqs[i].done_ns;
+		ok++;
+	}
+
+	if (!ok)
+		return;
+
+	for (i = 0; i < num && opts->verbose; i++) {
+		if (reqs[i].result || !reqs[i].done_ns)
 			continue;
+
+		info = &hubs[reqs[i].hub];
+		printf("port %d of %03d:%03d: submitted +%.3f ms, completed "
+			"+%.3f ms\n", reqs[i].port, info->busnum,
+			info->devnum, (reqs[i].submit_ns - first_submit) / 1e6,
+			(reqs[i].done_ns - first_done) / 1e6);
+	}
+
+	printf("%d port changes completed within %.3f ms, submitted within "
+		"%.3f ms\n", ok, (last_done - first_done) / 1e6,
+		(last_submit - first_submit) / 1e6);
+}
+
+/* Switch the ports off and on again with one shared off-window */
+static int run_power_cycle(struct hub_options *opts, struct hub_port_req *reqs,
+	int num)
+{
+	struct hub_info *info;
+	uint64_t off_ns = 0;
+	int timer_error = 0;
+	int result = 0;
+	int ret;
+	int i;
+
+	ret = power_seq_cycle(reqs, num, opts->cycle_ms, &off_ns,
+		&timer_error);
+	if (ret < 0) {
+		fprintf(stderr, "Power cycle failed: %s\n", strerror(-ret));
+		return 1;
+	}
+
+	/* the ports were cycled all the same, just timed by a sleep */
+	if (timer_error)
+		fprintf(stderr, "Off-time timer failed, slept instead: "
+			"%s\n", strerror(-timer_error));
+
+	for (i = 0; i < num; i++) {
+		if (!reqs[i].result)
+			continue;
+
+		info = &hubs[reqs[i].hub];
+		fprintf(stderr, "libusb_control_transfer failed for port %d of "
+			"%03d:%03d%s: %s.\n", reqs[i].port, info->busnum,
+			info->devnum, reqs[i].value ? ", left off" : ", left on",
+			strerror(-reqs[i].result));
+		result = 1;
+	}
+
+	if (!opts->quiet)
+		printf("%d ports power cycled, off for %.3f ms (%zu ms "
+			"requested)\n", ret, off_ns / 1e6, opts->cycle_ms);
+	if (opts->sync)
+		print_skew(opts, reqs, num);
+
+	return result;
+}
+
+/* Switch whole branches, level by level */
+static int run_subtree(struct hub_options *opts, struct hub_port_req **reqs,
+	int num)
+{
+	struct hub_info *info;
+	int result = 0;
+	int levels;
+	int ret;
+	int i;
+
+	ret = power_seq_subtree(reqs, &num);
+	if (ret) {
+		fprintf(stderr, "Collecting the branch failed: %s\n",
+			strerror(-ret));
+		return 1;
+	}
+
+	levels = power_seq_branch(*reqs, num);
+	if (levels < 0) {
+		fprintf(stderr, "Sending control messages failed: %s\n",
+			strerror(-levels));
+		return 1;
+	}
+
+	for (i = 0; i < num; i++) {
+		info = &hubs[(*reqs)[i].hub];
+		if ((*reqs)[i].result) {
+			fprintf(stderr, "libusb_control_transfer failed for "
+				"port %d of %03d:%03d: %s.\n", (*reqs)[i].port,
+				info->busnum, info->devnum,
+				strerror(-(*reqs)[i].result));
+			result = 1;
+		} else if (opts->verbose) {
+			printf("level %d: port %d of %03d:%03d %s\n",
+				hub_depth((*reqs)[i].hub), (*reqs)[i].port,
+				info->busnum, info->devnum,
+				(*reqs)[i].value ? "on" : "off");
 		}
+	}
+
+	if (!opts->quiet && num)
+		printf("%d ports switched %s in %d levels\n", num,
+			(*reqs)[0].value ? "on" : "off", levels);
+	if (opts->sync)
+		print_skew(opts, *reqs, num);
+
+	return result;
+}
+
+/*
+ * Apply all port changes in one batch, hub is the registry index used for
+ * changes without bus and device number.
+ */
+static int run_ports(struct hub_options *opts, int hub)
+{
+	struct hub_port_req *reqs;
+	const struct port_op *op;
+	struct hub_info *info;
+	int result = 0;
+	int request;
+	int index;
+	int ret;
+	int i;
+	int j;
+
+	reqs = calloc(opts->num_ops, sizeof(*reqs));
+	if (!reqs) {
+		fprintf(stderr, "malloc() failed: %s\n", strerror(errno));
+		return 1;
+	}
 
-		if (print) {
-			printf("Device %03d:%03d (%04x:%04x): Supported!\n",
-				id_bus, id_node, desc.idVendor, desc.idProduct);
+	for (i = 0; i < opts->num_ops; i++) {
+		op = &opts->ops[i];
+		reqs[i].hub = op->busnum ? get_hub(op->busnum, op->devnum) :
+			hub;
+		if (reqs[i].hub < 0) {
+			fprintf(stderr, "No device %03zu:%03zu?\n", op->busnum,
+				op->devnum);
+			free(reqs);
+			return 1;
 		}
 
-		if (print) {
-			switch ((hub_desc.wHubCharacteristics & HUB_CHAR_LPSM)) {
-			case 0:
-				fprintf(stderr, "  INFO: ganged switching.\n");
-				break;
-			case 1:
-				fprintf(stderr, "  INFO: individual power switching.\n");
-				break;
-			case 2:
-			case 3:
-				fprintf(stderr, "  WARN: No power switching.\n");
-				break;
-			}
+		reqs[i].port = op->port;
+		reqs[i].value = op->value;
+		if (opts->cmd == COMMAND_SET_POWER) {
+			reqs[i].feature = USB_PORT_FEAT_POWER;
+		} else {
+			reqs[i].feature = USB_PORT_FEAT_INDICATOR;
+			if (!opts->quiet)
+				printf("port %02zx value = %02zx\n", op->port,
+					op->value);
+		}
+	}
 
-			if (!(hub_desc.wHubCharacteristics & HUB_CHAR_PORTIND))
-				fprintf(stderr, "  WARN: Port indicators are NOT supported.\n");
+	usb_stats_phase("ports");
+	if (opts->subtree) {
+		result = run_subtree(opts, &reqs, opts->num_ops);
+		free(reqs);
+		return result;
+	}
+
+	if (opts->cycle_ms) {
+		result = run_power_cycle(opts, reqs, opts->num_ops);
+		free(reqs);
+		return result;
+	}
+
+	if (opts->budget) {
+		result = run_power_seq(opts, reqs, opts->num_ops);
+		free(reqs);
+		return result;
+	}
+
+	ret = hub_port_request_batch(reqs, opts->num_ops);
+	if (ret < 0) {
+		fprintf(stderr, "Sending control messages failed: %s\n",
+			strerror(-ret));
+		free(reqs);
+		return 1;
+	}
+
+	for (i = 0; i < opts->num_ops; i++) {
+		info = &hubs[reqs[i].hub];
+		if (reqs[i].result) {
+			fprintf(stderr, "libusb_control_transfer failed for "
+				"port %d of %03d:%03d: %s.\n", reqs[i].port,
+				info->busnum, info->devnum,
+				strerror(-reqs[i].result));
+			result = 1;
+			continue;
 		}
 
-		hubs[num_hubs].busnum = id_bus;
-		hubs[num_hubs].devnum = id_node;
-		hubs[num_hubs].dev = libusb_ref_device(hub);
-		hubs[num_hubs].indicator_support = (buf[4] & HUB_CHAR_PORTIND) ? 1 : 0;
-		hubs[num_hubs].nport = buf[2];
-		num_hubs++;
+		if (!opts->verbose)
+			continue;
 
-		if (print)
-			hub_port_status(dev, buf[2]);
+		request = LIBUSB_REQUEST_SET_FEATURE;
+		index = reqs[i].port;
+		if (reqs[i].feature == USB_PORT_FEAT_INDICATOR)
+			index |= reqs[i].value << 8;
+		else if (!reqs[i].value)
+			request = LIBUSB_REQUEST_CLEAR_FEATURE;
 
-		libusb_close(dev);
-		dev = NULL;
+		printf("Sent control message (REQUEST=%d, FEATURE=%d, INDEX=%04x)\n",
+			request, reqs[i].feature, index);
 	}
 
-	libusb_free_device_list(devlist, 1);
+	if (opts->sync)
+		print_skew(opts, reqs, opts->num_ops);
+
+	/* status of every hub involved, each printed once */
+	for (i = 0; i < opts->num_ops && opts->verbose; i++) {
+		for (j = 0; j < i; j++)
+			if (reqs[j].hub == reqs[i].hub)
+				break;
+		info = &hubs[reqs[i].hub];
+		if (j < i || !hub_handle(info))
+			continue;
+
+		usb_stats_phase("status");
+		hub_status_collect(info, 1);
+		hub_status_print(info);
+	}
 
-	if (print)
-		printf("%d supported hubs found.\n", num_hubs);
+	free(reqs);
 
-	return num_hubs;
+	return result;
 }
 
-int get_hub(int busnum, int devnum)
+/* Program the same image into the EEPROMs of all selected hubs at once */
+static int run_multi(struct hub_options *opts, uint8_t *buffer, int len,
+	struct serial_source *serials)
 {
+	struct eeprom_target *targets = NULL;
+	int result = 1;
+	int num = 0;
+	int ret;
 	int i;
 
-	for (i = 0; i < num_hubs; i++)
-		if (hubs[i].busnum == busnum && hubs[i].devnum == devnum)
-			return i;
+	num = eeprom_select_targets(opts->targets, opts->overwrite, &targets);
+	if (num == 0) {
+		fprintf(stderr, "No hubs with programmable (non-blank?) EEPROM "
+			"detected.\n");
+		goto cleanup;
+	} else if (num < 0) {
+		if (num != -ENODEV)
+			fprintf(stderr, "Selecting hubs failed: %s\n",
+				strerror(-num));
+		goto cleanup;
+	}
+
+	for (i = 0; i < num; i++) {
+		targets[i].buffer = buffer;
+		targets[i].len = len;
+		if (!serials)
+			continue;
+
+		/* one copy per hub, made before any hub is written */
+		ret = image_with_serial(buffer, len, serials,
+			&targets[i].buffer, targets[i].serial);
+		if (ret < 0)
+			goto cleanup;
+		targets[i].len = ret;
+	}
+
+	if (eeprom_program_many(targets, num, opts->update) == num)
+		result = 0;
+
+	if (!opts->quiet || result)
+		eeprom_print_results(targets, num);
+
+cleanup:
+	for (i = 0; i < num; i++)
+		if (targets[i].buffer != buffer)
+			free(targets[i].buffer);
+	free(targets);
+
+	return result;
+}
+
+static volatile sig_atomic_t stop_requested;
 
-	return -1;
+static void stop_signal(int sig)
+{
+	stop_requested = 1;
 }
 
-int get_hub_with_eeprom(int *hub, int accept_nonblank)
+static int run_monitor(struct hub_options *opts)
 {
-	int mask = EEPROM_SUPPORT_DEVICE | EEPROM_SUPPORT_STORAGE;
-	int count = 0;
+	struct sigaction action = { .sa_handler = stop_signal };
+	struct hub_info *watch = hubs;
+	int num = num_hubs;
+	int hub;
 	int ret;
-	int i;
 
-	if (!hub)
-		return -1;
+	if (opts->busnum) {
+		hub = get_hub(opts->busnum, opts->devnum);
+		if (hub < 0) {
+			fprintf(stderr, "No device?\n");
+			return 1;
+		}
+		watch = &hubs[hub];
+		num = 1;
+	}
 
-	if (!accept_nonblank)
-		mask |= EEPROM_SUPPORT_BLANK;
+	/* without SA_RESTART, so that waiting for events is interrupted */
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
 
-	for (i = 0; i < num_hubs; i++) {
-		ret = usb_eeprom_support(hubs[i].dev);
-		if ((ret & mask) == mask) {
-			if (!count)
-				*hub = i;
-			count++;
-		}
+	usb_stats_phase("monitor");
+	ret = hub_monitor_run(watch, num, opts->verbose, &stop_requested);
+	if (ret < 0) {
+		fprintf(stderr, "Monitoring failed: %s\n", strerror(-ret));
+		return 1;
 	}
 
-	return count;
+	return 0;
 }
 
-void clean_hub_info(struct hub_info *hubs, int len)
+/* Erase, write and verify the image in a loop, until done or interrupted */
+static int run_soak(struct hub_options *opts, libusb_device_handle *dev,
+	const uint8_t *buffer, int len)
 {
-	int i;
+	struct sigaction action = { .sa_handler = stop_signal };
+	struct soak_iteration *results;
+	int failed;
+	int num;
+
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	num = eeprom_soak(dev, buffer, len, opts->soak, opts->verbose,
+		&stop_requested, &results);
+	if (num < 0) {
+		fprintf(stderr, "Soak test failed: %s\n", strerror(-num));
+		return 1;
+	}
+
+	failed = eeprom_soak_print(results, num);
+	free(results);
+
+	return failed || num < opts->soak;
+}
+
+/* Write and verify from the checkpoint on, until done or interrupted */
+static int run_checkpoint(struct hub_options *opts, int hub,
+	uint8_t *buffer, int len)
+{
+	struct sigaction action = { .sa_handler = stop_signal };
+	struct hub_info *info = &hubs[hub];
+	char name[EEPROM_CHECKPOINT_HUB_SIZE];
+	int ret;
+
+	ret = eeprom_checkpoint_name(name, sizeof(name), info);
+	if (ret < 0)
+		return ret;
+
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
 
-	for (i = 0; i < len; i++)
-		libusb_unref_device(hubs[i].dev);
+	return eeprom_checkpoint_program(hub_handle(info), name, buffer,
+		opts->offset, len, opts->checkpoint, opts->verbose,
+		&stop_requested);
 }
 
 int main(int argc, char **argv)
 {
-	int feature = USB_PORT_FEAT_INDICATOR;
-	int request = LIBUSB_REQUEST_SET_FEATURE;
 	char *default_file = "output.iic";
 	libusb_device_handle *dev = NULL;
+	struct hub_filter filter;
+	struct serial_source serials = { .list = NULL };
+	char serial[EEPROM_IMAGE_STRING_MAX + 1] = "";
 	struct hub_options opts = {
 		.cmd = COMMAND_SET_NONE,
 		.filename = NULL,
+		.socket = NULL,
 		.eesize = 0,
 		.busnum = 0,
 		.devnum = 0,
 		.power = 0,
-		.port = 1,
+		.ports = NULL,
+		.ops = NULL,
+		.num_ops = 0,
+		.operands = 0,
 		.overwrite = 0,
+		.update = 0,
+		.targets = NULL,
+		.budget = 0,
+		.port_current = DEFAULT_PORT_CURRENT,
+		.cycle_ms = 0,
+		.sync = 0,
+		.subtree = 0,
+		.deadline_ms = 0,
+		.eeprom_wait = EEPROM_WAIT_SLEEP,
+		.soak = 0,
+		.offset = 0,
+		.length = 0,
+		.checkpoint = NULL,
+		.dump_fields = NULL,
+		.serial_counter = 0,
+		.serial_start = 0,
+		.serial_csv = NULL,
+		.monitor = 0,
+		.stats = STATS_NONE,
+		.vendor = -1,
+		.product = -1,
+		.dev_class = -1,
+		.path = NULL,
+		.serial = NULL,
 		.verbose = 0,
 		.listing = 0,
 		.quiet = 0,
 		.version = 0
 	};
-	uint8_t *cmp_buffer = NULL;
 	uint8_t *buffer = NULL;
 	int ret_val = 0;
 	int result = 0;
-	int index = 0;
+	int direct = 0;
+	size_t size;
 	int len = 0;
 	int hub = 0;
 	int i;
@@ -348,13 +857,126 @@ int main(int argc, char **argv)
 		exit(ret_val);
 	}
 
+	if (opts.dump_fields) {
+		result = run_dump_fields(&opts);
+		options_free(&opts);
+		exit(result);
+	}
+
 	/* Default is POWER */
 	if (opts.cmd == COMMAND_SET_NONE)
 		opts.cmd = COMMAND_SET_POWER;
 
+	/* several hubs are programmed by a local scan only */
+	if (opts.targets && (opts.cmd != COMMAND_SET_EEPROM || opts.busnum ||
+			opts.socket)) {
+		options_help(argv[0]);
+		exit(1);
+	}
+
+	if (opts.socket) {
+		if (opts.listing) {
+			fprintf(stderr, "Listing is not available through "
+				"hub-ctrld.\n");
+			exit(1);
+		}
+		if (opts.budget) {
+			fprintf(stderr, "Staggered power-on is not available "
+				"through hub-ctrld.\n");
+			exit(1);
+		}
+		if (opts.monitor) {
+			fprintf(stderr, "Monitoring is not available through "
+				"hub-ctrld.\n");
+			exit(1);
+		}
+		if (opts.stats) {
+			fprintf(stderr, "Statistics are not available through "
+				"hub-ctrld.\n");
+			exit(1);
+		}
+		if (opts.cycle_ms || opts.sync || opts.subtree ||
+				opts.deadline_ms || opts.soak || opts.length ||
+				opts.checkpoint ||
+				opts.eeprom_wait != EEPROM_WAIT_SLEEP) {
+			fprintf(stderr, "Power cycling, --sync, --subtree, "
+				"--deadline, --eeprom-wait, --soak, --offset, "
+				"--length and --checkpoint are not available "
+				"through hub-ctrld.\n");
+			exit(1);
+		}
+		if (opts.serial_counter || opts.serial_csv) {
+			fprintf(stderr, "Serial templates are not available "
+				"through hub-ctrld.\n");
+			exit(1);
+		}
+		if (options_filtered(&opts)) {
+			fprintf(stderr, "Selection filters are not available "
+				"through hub-ctrld, use -b and -d.\n");
+			exit(1);
+		}
+		result = run_remote(&opts);
+		options_free(&opts);
+		exit(result);
+	}
+
+	/* the image is read and checked before any USB traffic */
+	if (opts.cmd == COMMAND_SET_EEPROM) {
+		len = read_image(&opts, &buffer);
+		if (len >= 0 && (opts.serial_counter || opts.serial_csv))
+			len = load_serials(&opts, &serials, &buffer, len,
+				serial);
+		if (len < 0) {
+			serial_source_free(&serials);
+			free(buffer);
+			options_free(&opts);
+			exit(1);
+		}
+	}
+
+	/*
+	 * With BUS and DEV given, the device node is opened without a scan.
+	 * Listings and operands name other hubs, monitoring needs the device
+	 * list for hotplug events and a subtree all hubs downstream.
+	 */
+	direct = opts.busnum && opts.devnum && !opts.listing &&
+		!opts.operands && !opts.monitor && !opts.subtree;
+#ifdef HAVE_LIBUSB_WRAP_SYS_DEVICE
+	if (direct)
+		libusb_set_option(NULL, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
+#else
+	direct = 0;
+#endif
+
+	filter.vendor = opts.vendor;
+	filter.product = opts.product;
+	filter.device_class = opts.dev_class;
+	filter.path = opts.path;
+	filter.serial = opts.serial;
+
+	/* only switching ports needs the hub characteristics */
+	hub_need_caps = !(opts.cmd & COMMAND_TYPE_EEPROM);
+
+	if (opts.stats)
+		usb_stats_enable(1);
+	usb_stats_phase("scan");
+	usb_policy_set(&policy);
+	usb_policy_deadline(opts.deadline_ms);
+	usb_eeprom_set_wait(opts.eeprom_wait);
+
 	libusb_init(NULL);
 
-	if (usb_find_hubs(opts.listing * (1 + opts.verbose)) <= 0) {
+	if (direct) {
+		ret_val = hub_open_direct(USB_DEVNODE_ROOT, opts.busnum,
+			opts.devnum);
+		if (ret_val < 0) {
+			fprintf(stderr, "No device? (%s)\n", strerror(-ret_val));
+			result = 1;
+			goto cleanup;
+		}
+		hub = ret_val;
+	} else if (usb_find_hubs_matching(opts.listing * (1 + opts.verbose),
+			options_filtered(&opts) ? &filter : NULL) <= 0) {
 		fprintf(stderr, "No hubs found.\n");
 		result = 1;
 		goto cleanup;
@@ -365,7 +987,30 @@ int main(int argc, char **argv)
 		goto cleanup;
 	}
 
-	if (!opts.busnum && !opts.devnum) {
+	if (opts.targets) {
+		result = run_multi(&opts, buffer, len,
+			opts.serial_counter || opts.serial_csv ?
+			&serials : NULL);
+		goto cleanup;
+	}
+
+	if (opts.monitor) {
+		result = run_monitor(&opts);
+		goto cleanup;
+	}
+
+	if (direct || opts.operands) {
+		/* already selected, or given with each port change */
+	} else if (options_filtered(&opts) &&
+			!(opts.cmd & COMMAND_TYPE_EEPROM)) {
+		if (num_hubs > 1) {
+			fprintf(stderr, "%d hubs match the selection, narrow "
+				"it down.\n", num_hubs);
+			result = 1;
+			goto cleanup;
+		}
+		hub = 0;
+	} else if (!opts.busnum && !opts.devnum) {
 		ret_val = get_hub_with_eeprom(&hub,
 			opts.cmd == COMMAND_SET_EEPROM ? opts.overwrite : 1);
 		if (ret_val < 1) {
@@ -390,17 +1035,26 @@ int main(int argc, char **argv)
 		}
 	}
 
-	ret_val = libusb_open(hubs[hub].dev, &dev);
+	if (!(opts.cmd & COMMAND_TYPE_EEPROM)) {
+		result = run_ports(&opts, hub);
+		goto cleanup;
+	}
+
+	ret_val = hub_open(&hubs[hub]);
 	if (ret_val) {
 		fprintf(stderr, "Failed to open device: %s\n",
-			libusb_strerror(ret_val));
+			strerror(-ret_val));
 		result = 1;
 		goto cleanup;
 	}
+	dev = hub_handle(&hubs[hub]);
+	/* with --offset or --length, only the region is transferred */
+	size = opts.length ? opts.length : opts.eesize;
 
 	switch (opts.cmd) {
 	case COMMAND_GET_EEPROM:
-		buffer = malloc(opts.eesize);
+		usb_stats_phase("read");
+		buffer = malloc(size);
 		if (!buffer) {
 			fprintf(stderr, "malloc() failed: %s\n",
 					strerror(errno));
@@ -408,8 +1062,12 @@ int main(int argc, char **argv)
 			goto cleanup;
 		}
 
-		ret_val = usb_eeprom_read(dev, buffer, opts.eesize);
-		if (ret_val != opts.eesize) {
+		if (opts.length)
+			ret_val = usb_eeprom_read_at(dev, opts.offset, buffer,
+				size);
+		else
+			ret_val = usb_eeprom_read(dev, buffer, size);
+		if (ret_val != size) {
 			fprintf(stderr, "EEPROM read failed: %d\n", ret_val);
 			result = 1;
 			goto cleanup;
@@ -417,8 +1075,8 @@ int main(int argc, char **argv)
 
 		if (opts.verbose) {
 			for (i = 0; i < ret_val; i++) {
-				if (!(i % 16))
-					printf("\n %04x:   ", i);
+				if (!i || !((opts.offset + i) % 16))
+					printf("\n %04zx:   ", opts.offset + i);
 				printf("%02X ", buffer[i]);
 			}
 			putchar('\n');
@@ -427,8 +1085,8 @@ int main(int argc, char **argv)
 		if (!opts.filename)
 			opts.filename = default_file;
 
-		ret_val = file_write(opts.filename, buffer, opts.eesize);
-		if (ret_val != opts.eesize) {
+		ret_val = file_write(opts.filename, buffer, size);
+		if (ret_val != size) {
 			fprintf(stderr, "Writing file '%s' failed: %d\n",
 				opts.filename, ret_val);
 			result = 1;
@@ -439,120 +1097,74 @@ int main(int argc, char **argv)
 			printf("EEPROM dumped to '%s'\n", opts.filename);
 		break;
 	case COMMAND_SET_EEPROM:
-		if (!opts.filename) {
-			fprintf(stderr, "No input file?\n");
-			result = 1;
-			goto cleanup;
-		}
-		ret_val = file_read(opts.filename, &buffer, opts.eesize);
-		if (ret_val < 0) {
-			fprintf(stderr, "Reading file '%s' failed: %d\n",
-				opts.filename, ret_val);
-			result = 1;
-			goto cleanup;
-		}
-
-		/* switch write size to actually read number of bytes from file */
-		len = ret_val;
-
-		ret_val = usb_eeprom_write(dev, buffer, len);
-		if (ret_val != len) {
-			fprintf(stderr, "EEPROM write failed: %d\n", ret_val);
-			result = 1;
+		if (opts.soak) {
+			result = run_soak(&opts, dev, buffer, len);
 			goto cleanup;
 		}
 
-		cmp_buffer = malloc(len);
-		if (!cmp_buffer) {
-			fprintf(stderr, "malloc() failed: %s\n",
-					strerror(errno));
+		usb_stats_phase("write");
+		if (opts.checkpoint)
+			ret_val = run_checkpoint(&opts, hub, buffer, len);
+		else if (opts.length)
+			ret_val = usb_eeprom_patch(dev, opts.offset, buffer,
+				len);
+		else
+			ret_val = usb_eeprom_program(dev, buffer, len,
+				opts.update);
+		if (ret_val == -EBADMSG) {
+			fprintf(stderr, "EEPROM verification failed!\n");
 			result = 1;
 			goto cleanup;
-		}
-		ret_val = usb_eeprom_read(dev, cmp_buffer, len);
-		if (ret_val != len) {
-			fprintf(stderr, "EEPROM read failed: %d\n", ret_val);
+		} else if (ret_val == -ECANCELED) {
+			fprintf(stderr, "EEPROM write stopped, resume from "
+				"'%s'\n", opts.checkpoint);
 			result = 1;
 			goto cleanup;
-		}
-
-		if (memcmp(buffer, cmp_buffer, len) != 0) {
-			fprintf(stderr, "EEPROM verification failed!\n");
+		} else if (ret_val < 0) {
+			fprintf(stderr, "EEPROM write failed: %d\n", ret_val);
 			result = 1;
 			goto cleanup;
 		} else if (!opts.quiet) {
-			printf("EEPROM updated (%i B)\n", len);
+			print_programmed(len, ret_val, opts.update);
+			if (serial[0])
+				printf("Serial %s\n", serial);
 		}
 
 		break;
 	case COMMAND_CLR_EEPROM:
-		ret_val = usb_eeprom_erase(dev, opts.eesize);
+		usb_stats_phase("erase");
+		if (opts.length)
+			ret_val = usb_eeprom_erase_at(dev, opts.offset, size);
+		else
+			ret_val = usb_eeprom_erase(dev, size);
 
-		if (ret_val == opts.eesize)
+		if (ret_val == size)
 			break;
 
 		if (ret_val < 0) {
 			fprintf(stderr, "EEPROM erase failed: %d\n", ret_val);
 		} else {
 			fprintf(stderr, "EEPROM erase incomplete (%i/%zu B)\n",
-					ret_val, opts.eesize);
+					ret_val, size);
 		}
 
 		result = 1;
 		goto cleanup;
-	case COMMAND_SET_POWER:
-		if (opts.power)
-			request = LIBUSB_REQUEST_SET_FEATURE;
-		else
-			request = LIBUSB_REQUEST_CLEAR_FEATURE;
-		feature = USB_PORT_FEAT_POWER;
-		index = opts.port;
-		len = libusb_control_transfer(dev, USB_RT_PORT, request, feature, index,
-				NULL, 0, CTRL_TIMEOUT);
-		if (len < 0) {
-			fprintf(stderr, "libusb_control_transfer failed: %s.\n",
-					libusb_strerror(len));
-			result = 1;
-			goto cleanup;
-		}
-		break;
 	default:
-		request = LIBUSB_REQUEST_SET_FEATURE;
-		feature = USB_PORT_FEAT_INDICATOR;
-		index = (opts.power << 8) | opts.port;
-		if (!opts.quiet)
-			printf("port %02zx value = %02zx\n", opts.port, opts.power);
-		len = libusb_control_transfer(dev, USB_RT_PORT, request, feature, index,
-				NULL, 0, CTRL_TIMEOUT);
-		if (len < 0) {
-			fprintf(stderr, "libusb_control_transfer failed: %s.\n",
-					libusb_strerror(len));
-			result = 1;
-			goto cleanup;
-		}
-	}
-
-	if (opts.verbose && !(opts.cmd & COMMAND_TYPE_EEPROM)) {
-		printf("Sent control message (REQUEST=%d, FEATURE=%d, INDEX=%04x)\n",
-			request, feature, index);
+		break;
 	}
 
 cleanup:
-	if (opts.verbose && dev && !(opts.cmd & COMMAND_TYPE_EEPROM))
-		hub_port_status(dev, hubs[hub].nport);
-
-	if (dev)
-		libusb_close(dev);
-
-	clean_hub_info(hubs, num_hubs);
+	hub_registry_exit();
+	if (opts.stats)
+		usb_stats_print(stderr, opts.stats == STATS_JSON);
+	options_free(&opts);
 
 	libusb_exit(NULL);
 
+	serial_source_free(&serials);
 	if (buffer)
 		free(buffer);
 
-	if (cmp_buffer)
-		free(cmp_buffer);
-
 	exit(result);
 }
@@ -0,0 +1,406 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Persistent hub-ctrl service
+ *
+ * Keeps the libusb context, the hub registry and the opened hub handles
+ * alive and executes power, indicator and EEPROM requests received on a
+ * Unix domain socket. See ctrld.h for the protocol, "hub-ctrl -S" is the
+ * matching client.
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <libusb.h>
+
+#include "config.h"
+#include "ctrld.h"
+#include "eeprom_image.h"
+#include "hubs.h"
+#include "usb_eeprom.h"
+
+/** Receive timeout for a client, a stuck client must not block the daemon */
+#define CLIENT_TIMEOUT_S	2
+/** Upper bound for the number of libusb file descriptors polled */
+#define MAX_POLL_FDS		16
+/** Access to the socket, whoever may write to it controls the hubs */
+#define SOCKET_MODE		0660
+
+static volatile sig_atomic_t terminate;
+static int verbose;
+
+static void on_signal(int sig)
+{
+	terminate = 1;
+}
+
+static void help(const char *progname)
+{
+	fprintf(stderr,
+		"Usage: %s [-s SOCKET] [-m MODE] [-v]\n\n"
+		"Options:\n"
+		"-h                     help\n"
+		"-m     <mode>          Create the socket with this octal mode,\n"
+		"                       default %04o\n"
+		"-s     <socket>        Listen on this socket, default \"%s\"\n"
+		"-v                     verbose\n"
+		"-V                     show program version and quit\n",
+		progname, SOCKET_MODE, CTRLD_SOCKET_PATH);
+}
+
+/*
+ * Bind to path, replacing a socket left behind but nothing else. The
+ * socket is created with mode right away, it is never open to everyone.
+ */
+static int listen_socket(const char *path, mode_t mode)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	mode_t mask;
+	int ret;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	if (!lstat(path, &st)) {
+		if (!S_ISSOCK(st.st_mode)) {
+			close(fd);
+			return -EEXIST;
+		}
+		unlink(path);
+	} else if (errno != ENOENT) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+	mask = umask(~mode & 0777);
+	ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (ret || listen(fd, 16)) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+	return fd;
+}
+
+static int rescan(void)
+{
+	return usb_find_hubs(verbose);
+}
+
+/*
+ * Wait for a client while dispatching libusb events, so that hotplug events
+ * keep the registry current in between requests. client is -1 if none came.
+ */
+static int wait_client(int fd, int *client)
+{
+	const struct libusb_pollfd **usb_fds;
+	struct pollfd fds[MAX_POLL_FDS + 1];
+	struct timeval tv = { 0, 0 };
+	int num = 1;
+	int ret;
+	int i;
+
+	*client = -1;
+	fds[0].fd = fd;
+	fds[0].events = POLLIN;
+
+	usb_fds = libusb_get_pollfds(NULL);
+	for (i = 0; usb_fds && usb_fds[i] && num <= MAX_POLL_FDS; i++) {
+		fds[num].fd = usb_fds[i]->fd;
+		fds[num].events = usb_fds[i]->events;
+		num++;
+	}
+	libusb_free_pollfds(usb_fds);
+
+	/* without pollable libusb descriptors look for events now and then */
+	ret = poll(fds, num, num > 1 ? -1 : 1000);
+	if (ret < 0)
+		return errno == EINTR ? 0 : -errno;
+
+	libusb_handle_events_timeout(NULL, &tv);
+	hub_registry_update(verbose);
+
+	if (!(fds[0].revents & POLLIN))
+		return 0;
+
+	ret = accept(fd, NULL, NULL);
+	if (ret < 0)
+		return errno == EINTR ? 0 : -errno;
+
+	*client = ret;
+
+	return 0;
+}
+
+/*
+ * Pick the hub a request addresses. Without bus and device number the
+ * single hub with an EEPROM is used, as hub-ctrl does.
+ */
+static int select_hub(int busnum, int devnum, int accept_nonblank)
+{
+	int hub = -1;
+	int count;
+
+	if (busnum || devnum) {
+		hub = get_hub(busnum, devnum);
+		return hub < 0 ? -ENODEV : hub;
+	}
+
+	count = get_hub_with_eeprom(&hub, accept_nonblank);
+	if (count < 1)
+		return -ENODEV;
+	if (count > 1)
+		return -EBUSY;
+
+	return hub;
+}
+
+static int exec_request(const char *line, char *reply, size_t size)
+{
+	libusb_device_handle *dev;
+	struct ctrld_req req;
+	uint8_t *buffer = NULL;
+	int accept_nonblank;
+	int hub;
+	int ret;
+
+	ret = ctrld_parse_request(line, &req);
+	if (ret)
+		return ret;
+
+	if (req.verb == CTRLD_RESCAN) {
+		ret = rescan();
+		if (ret >= 0)
+			snprintf(reply, size, "OK %d", ret);
+		return ret < 0 ? ret : 0;
+	}
+
+	/* only "write" and "update" carry the overwrite flag */
+	accept_nonblank = req.verb == CTRLD_WRITE ||
+		req.verb == CTRLD_UPDATE ? req.value : 1;
+	hub = select_hub(req.busnum, req.devnum, accept_nonblank);
+	if (hub < 0)
+		return hub;
+
+	ret = hub_open(&hubs[hub]);
+	if (ret)
+		return ret;
+	dev = hub_handle(&hubs[hub]);
+
+	switch (req.verb) {
+	case CTRLD_POWER:
+	case CTRLD_LED:
+		if (req.verb == CTRLD_POWER)
+			ret = hub_set_power(hub, req.port, req.value);
+		else
+			ret = hub_set_indicator(hub, req.port, req.value);
+		/* the hotplug event of the departed hub updates the registry */
+		if (ret == -ENODEV && !hub_registry_hotplug())
+			rescan();
+		return ret < 0 ? ret : 0;
+
+	case CTRLD_ERASE:
+		ret = usb_eeprom_erase(dev, req.size);
+		if (ret >= 0)
+			snprintf(reply, size, "OK %d", ret);
+		return ret < 0 ? ret : 0;
+
+	case CTRLD_READ:
+		buffer = malloc(req.size);
+		if (!buffer)
+			return -ENOMEM;
+
+		ret = usb_eeprom_read(dev, buffer, req.size);
+		if (ret == req.size) {
+			strcpy(reply, "OK ");
+			ctrld_hex_encode(reply + 3, buffer, req.size);
+			ret = 0;
+		} else if (ret >= 0) {
+			ret = -EIO;
+		}
+
+		free(buffer);
+		return ret;
+
+	case CTRLD_WRITE:
+	case CTRLD_UPDATE:
+		buffer = malloc(MAX_EEPROM_SIZE);
+		if (!buffer)
+			return -ENOMEM;
+
+		ret = ctrld_hex_decode(buffer, MAX_EEPROM_SIZE, req.data);
+		if (ret > 0 && eeprom_image_validate(buffer, ret, NULL)) {
+			ret = -EINVAL;
+		} else if (ret > 0) {
+			ret = usb_eeprom_program(dev, buffer, ret,
+				req.verb == CTRLD_UPDATE);
+			if (ret >= 0) {
+				snprintf(reply, size, "OK %d", ret);
+				ret = 0;
+			}
+		} else if (!ret) {
+			ret = -EINVAL;
+		}
+
+		free(buffer);
+		return ret;
+
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void serve_client(int fd)
+{
+	struct timeval tv = { .tv_sec = CLIENT_TIMEOUT_S };
+	char *request;
+	char *reply;
+	ssize_t len;
+	int ret;
+
+	request = malloc(CTRLD_LINE_MAX);
+	reply = malloc(CTRLD_LINE_MAX);
+	if (!request || !reply)
+		goto cleanup;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	while (!terminate) {
+		len = ctrld_read_line(fd, request, CTRLD_LINE_MAX);
+		if (len <= 0)
+			break;
+
+		strcpy(reply, "OK");
+		ret = exec_request(request, reply, CTRLD_LINE_MAX);
+		if (ret) {
+			snprintf(reply, CTRLD_LINE_MAX, "ERR %d %s", -ret,
+				strerror(-ret));
+		}
+
+		if (verbose)
+			fprintf(stderr, "%.40s -> %.40s\n", request, reply);
+
+		if (ctrld_write_line(fd, reply))
+			break;
+	}
+
+cleanup:
+	free(request);
+	free(reply);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = CTRLD_SOCKET_PATH;
+	mode_t mode = SOCKET_MODE;
+	struct sigaction sa;
+	unsigned long value;
+	int result = 0;
+	int option;
+	int client;
+	char *end;
+	int ret;
+	int fd;
+
+	while ((option = getopt(argc, argv, "hm:s:vV")) != -1) {
+		switch (option) {
+		case 'm':
+			errno = 0;
+			value = strtoul(optarg, &end, 8);
+			if (errno || end == optarg || *end || value > 0777) {
+				fprintf(stderr, "Invalid mode '%s'\n", optarg);
+				exit(1);
+			}
+			mode = value;
+			break;
+		case 's':
+			path = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'V':
+			printf("%s\n", PACKAGE_STRING);
+			exit(0);
+		default:
+			help(argv[0]);
+			exit(option == 'h' ? 0 : 1);
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	libusb_init(NULL);
+
+	if (hub_registry_init(verbose) < 0) {
+		result = 1;
+		goto cleanup;
+	}
+
+	fd = listen_socket(path, mode);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot listen on '%s': %s\n", path,
+			strerror(-fd));
+		result = 1;
+		goto cleanup;
+	}
+
+	if (verbose)
+		fprintf(stderr, "%d hubs, listening on '%s'\n", num_hubs, path);
+
+	while (!terminate) {
+		ret = wait_client(fd, &client);
+		if (ret < 0) {
+			fprintf(stderr, "accept() failed: %s\n",
+				strerror(-ret));
+			result = 1;
+			break;
+		}
+		if (client < 0)
+			continue;
+
+		serve_client(client);
+		close(client);
+	}
+
+	close(fd);
+	unlink(path);
+
+cleanup:
+	hub_registry_exit();
+
+	libusb_exit(NULL);
+
+	exit(result);
+}
@@ -0,0 +1,540 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Event-driven monitoring of hub port status
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <libusb.h>
+
+#include "hub_monitor.h"
+#include "hub_xfer.h"
+#include "usb_policy.h"
+
+/* bitmap of the status-change endpoint, bit 0 for the hub, up to 255 ports */
+#define CHANGE_BITMAP_SIZE		32
+
+#define USB_PORT_STAT_CONNECTION	0x0001
+#define USB_PORT_STAT_ENABLE		0x0002
+#define USB_PORT_STAT_OVERCURRENT	0x0008
+#define USB_PORT_STAT_POWER		0x0100
+#define USB_HUB_STAT_OVERCURRENT	0x0002
+
+/* change bit n of wPortChange is cleared with feature C_PORT_CONNECTION + n */
+#define USB_PORT_FEAT_C_CONNECTION	16
+#define USB_PORT_CHANGE_BITS		5
+/* change bit n of wHubChange is cleared with feature n */
+#define USB_HUB_CHANGE_BITS		2
+
+/* time between checks of the stop flag in ms */
+#define MONITOR_TICK_MS			250
+
+struct monitor_hub {
+	struct hub_info *info;
+	/** transfer on the status-change endpoint, NULL if not owned */
+	struct libusb_transfer *transfer;
+	/** bitmap received on the endpoint */
+	uint8_t bitmap[CHANGE_BITMAP_SIZE];
+	/** hub and ports still to read, laid out like the bitmap */
+	uint8_t pending[CHANGE_BITMAP_SIZE];
+	/** wHubStatus of the last read */
+	uint16_t hub_status;
+	/** the transfer is submitted */
+	int submitted;
+	/** the hub was unplugged */
+	int removed;
+	/** the hub is no longer watched */
+	int gone;
+};
+
+struct monitor {
+	struct monitor_hub *hubs;
+	int num;
+};
+
+/* a GET_STATUS request of a pending hub or port */
+struct monitor_read {
+	struct monitor_hub *mh;
+	int port;
+	uint8_t bytes[USB_STATUS_SIZE];
+};
+
+static const struct {
+	uint16_t bit;
+	const char *set;
+	const char *cleared;
+} port_events[] = {
+	{ USB_PORT_STAT_CONNECTION, "connected", "disconnected" },
+	{ USB_PORT_STAT_ENABLE, "enabled", "disabled" },
+	{ USB_PORT_STAT_OVERCURRENT, "over-current", "over-current cleared" },
+	{ USB_PORT_STAT_POWER, "power on", "power off" },
+};
+
+static void print_event(const struct hub_info *hub, int port,
+	const char *event)
+{
+	struct timespec ts;
+	char date[32];
+	struct tm tm;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	localtime_r(&ts.tv_sec, &tm);
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+
+	if (port)
+		printf("%s.%03ld %03d:%03d port %d %s\n", date,
+			ts.tv_nsec / 1000000, hub->busnum, hub->devnum, port,
+			event);
+	else
+		printf("%s.%03ld %03d:%03d hub %s\n", date,
+			ts.tv_nsec / 1000000, hub->busnum, hub->devnum, event);
+}
+
+static void report_port(const struct hub_info *hub, int port, uint16_t old,
+	uint16_t status, uint16_t change)
+{
+	uint16_t bit;
+	size_t i;
+
+	for (i = 0; i < sizeof(port_events) / sizeof(port_events[0]); i++) {
+		bit = port_events[i].bit;
+		if (!((old ^ status) & bit) && !(change & bit))
+			continue;
+
+		/* changed and back again between two reads */
+		if (!((old ^ status) & bit))
+			print_event(hub, port, status & bit ?
+				port_events[i].cleared : port_events[i].set);
+
+		print_event(hub, port, status & bit ?
+			port_events[i].set : port_events[i].cleared);
+	}
+}
+
+static void report_hub(struct monitor_hub *mh, uint16_t status,
+	uint16_t change)
+{
+	if (((mh->hub_status ^ status) | change) & USB_HUB_STAT_OVERCURRENT)
+		print_event(mh->info, 0, status & USB_HUB_STAT_OVERCURRENT ?
+			"over-current" : "over-current cleared");
+
+	mh->hub_status = status;
+}
+
+static void LIBUSB_CALL status_changed(struct libusb_transfer *transfer)
+{
+	struct monitor_hub *mh = transfer->user_data;
+	int i;
+
+	mh->submitted = 0;
+
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		for (i = 0; i < transfer->actual_length; i++)
+			mh->pending[i] |= transfer->buffer[i];
+		break;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		mh->removed = 1;
+		break;
+	default:
+		/* resubmitted by the main loop unless stopping */
+		break;
+	}
+}
+
+static int LIBUSB_CALL device_changed(libusb_context *ctx,
+	libusb_device *dev, libusb_hotplug_event event, void *user_data)
+{
+	struct monitor *mon = user_data;
+	libusb_device *parent = libusb_get_parent(dev);
+	struct monitor_hub *mh;
+	int busnum = libusb_get_bus_number(dev);
+	int devnum = libusb_get_device_address(dev);
+	int port = libusb_get_port_number(dev);
+	int i;
+
+	for (i = 0; i < mon->num; i++) {
+		mh = &mon->hubs[i];
+		if (mh->transfer || mh->gone)
+			continue;
+
+		if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT &&
+				mh->info->busnum == busnum &&
+				mh->info->devnum == devnum)
+			mh->removed = 1;
+
+		if (parent && port &&
+				mh->info->busnum ==
+					libusb_get_bus_number(parent) &&
+				mh->info->devnum ==
+					libusb_get_device_address(parent))
+			mh->pending[port / 8] |= 1 << (port % 8);
+	}
+
+	return 0;
+}
+
+static int find_status_endpoint(libusb_device *dev, uint8_t *address,
+	int *size)
+{
+	const struct libusb_interface_descriptor *alt;
+	const struct libusb_endpoint_descriptor *ep;
+	struct libusb_config_descriptor *config;
+	int ret = -ENOENT;
+	int i;
+
+	if (libusb_get_active_config_descriptor(dev, &config))
+		return -ENOENT;
+
+	if (config->bNumInterfaces < 1 ||
+			config->interface[0].num_altsetting < 1)
+		goto out;
+
+	alt = &config->interface[0].altsetting[0];
+	for (i = 0; i < alt->bNumEndpoints; i++) {
+		ep = &alt->endpoint[i];
+		if ((ep->bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) !=
+				LIBUSB_ENDPOINT_IN ||
+				(ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) !=
+				LIBUSB_TRANSFER_TYPE_INTERRUPT)
+			continue;
+
+		*address = ep->bEndpointAddress;
+		*size = ep->wMaxPacketSize;
+		ret = 0;
+		break;
+	}
+
+out:
+	libusb_free_config_descriptor(config);
+
+	return ret;
+}
+
+/* Returns -EBUSY if the interface is owned by someone else */
+static int watch_endpoint(struct monitor_hub *mh)
+{
+	struct hub_info *hub = mh->info;
+	uint8_t address;
+	int size;
+	int ret;
+
+	ret = hub_open(hub);
+	if (ret)
+		return ret;
+
+	ret = find_status_endpoint(hub->dev, &address, &size);
+	if (ret)
+		return ret;
+
+	/* LIBUSB_ERROR_NOT_SUPPORTED where there are no kernel drivers */
+	if (libusb_kernel_driver_active(hub_handle(hub), 0) == 1)
+		return -EBUSY;
+
+	ret = libusb_claim_interface(hub_handle(hub), 0);
+	if (ret)
+		return usb_policy_errno(ret);
+
+	mh->transfer = libusb_alloc_transfer(0);
+	if (!mh->transfer) {
+		libusb_release_interface(hub_handle(hub), 0);
+		return -ENOMEM;
+	}
+
+	if (size > (int)sizeof(mh->bitmap))
+		size = sizeof(mh->bitmap);
+
+	libusb_fill_interrupt_transfer(mh->transfer, hub_handle(hub), address,
+		mh->bitmap, size, status_changed, mh, 0);
+
+	ret = libusb_submit_transfer(mh->transfer);
+	if (ret) {
+		libusb_free_transfer(mh->transfer);
+		mh->transfer = NULL;
+		libusb_release_interface(hub_handle(hub), 0);
+		return usb_policy_errno(ret);
+	}
+
+	mh->submitted = 1;
+
+	return 0;
+}
+
+static void unwatch_endpoint(struct monitor_hub *mh)
+{
+	struct timeval tv = { 0, MONITOR_TICK_MS * 1000 };
+
+	if (!mh->transfer)
+		return;
+
+	if (mh->submitted && libusb_cancel_transfer(mh->transfer) == 0)
+		while (mh->submitted)
+			if (libusb_handle_events_timeout_completed(NULL, &tv,
+					NULL) < 0)
+				break;
+
+	if (!mh->submitted)
+		libusb_free_transfer(mh->transfer);
+	mh->transfer = NULL;
+
+	if (!mh->removed)
+		libusb_release_interface(hub_handle(mh->info), 0);
+}
+
+/* Clears the change bits of a status just read from a hub we own */
+static int add_clear_requests(struct hub_xfer *xfers,
+	const struct monitor_read *read, uint16_t change)
+{
+	int bits = read->port ? USB_PORT_CHANGE_BITS : USB_HUB_CHANGE_BITS;
+	int num = 0;
+	int i;
+
+	for (i = 0; i < bits; i++) {
+		if (!(change & (1 << i)))
+			continue;
+
+		xfers[num].handle = hub_handle(read->mh->info);
+		xfers[num].request_type = read->port ? USB_RT_PORT : USB_RT_HUB;
+		xfers[num].request = LIBUSB_REQUEST_CLEAR_FEATURE;
+		xfers[num].value = read->port ?
+			USB_PORT_FEAT_C_CONNECTION + i : i;
+		xfers[num].index = read->port;
+		num++;
+	}
+
+	return num;
+}
+
+static int read_pending(struct monitor *mon)
+{
+	struct hub_port_status *last;
+	struct monitor_read *reads;
+	struct monitor_hub *mh;
+	struct hub_xfer *xfers;
+	uint16_t status;
+	uint16_t change;
+	int clears = 0;
+	int num = 0;
+	int ret;
+	int i;
+	int j;
+
+	for (i = 0; i < mon->num; i++)
+		for (j = 0; j <= mon->hubs[i].info->nport; j++)
+			if (mon->hubs[i].pending[j / 8] & (1 << (j % 8)))
+				num++;
+	if (!num)
+		return 0;
+
+	/* room for the reads and then for clearing every change bit */
+	reads = calloc(num, sizeof(*reads));
+	xfers = calloc(num * (USB_PORT_CHANGE_BITS + 1), sizeof(*xfers));
+	if (!reads || !xfers) {
+		free(reads);
+		free(xfers);
+		return -ENOMEM;
+	}
+
+	num = 0;
+	for (i = 0; i < mon->num; i++) {
+		mh = &mon->hubs[i];
+		for (j = 0; j <= mh->info->nport; j++) {
+			if (!(mh->pending[j / 8] & (1 << (j % 8))))
+				continue;
+
+			reads[num].mh = mh;
+			reads[num].port = j;
+			xfers[num].handle = hub_handle(mh->info);
+			xfers[num].request_type = LIBUSB_ENDPOINT_IN |
+				(j ? USB_RT_PORT : USB_RT_HUB);
+			xfers[num].request = LIBUSB_REQUEST_GET_STATUS;
+			xfers[num].index = j;
+			xfers[num].data = reads[num].bytes;
+			xfers[num].length = USB_STATUS_SIZE;
+			num++;
+		}
+		memset(mh->pending, 0, sizeof(mh->pending));
+	}
+
+	ret = hub_xfer_run(NULL, xfers, num, CTRL_TIMEOUT);
+	if (ret < 0)
+		goto out;
+
+	for (i = 0; i < num; i++) {
+		if (xfers[i].result < USB_STATUS_SIZE)
+			continue;
+
+		mh = reads[i].mh;
+		status = reads[i].bytes[0] | reads[i].bytes[1] << 8;
+		change = reads[i].bytes[2] | reads[i].bytes[3] << 8;
+
+		if (!reads[i].port) {
+			report_hub(mh, status, change);
+		} else {
+			last = &mh->info->status[reads[i].port - 1];
+			report_port(mh->info, reads[i].port,
+				last->result < USB_STATUS_SIZE ? status :
+				last->bytes[0] | last->bytes[1] << 8,
+				status, change);
+			memcpy(last->bytes, reads[i].bytes, USB_STATUS_SIZE);
+			last->result = USB_STATUS_SIZE;
+		}
+
+		/* the kernel hub driver clears the bits of the hubs it owns */
+		if (mh->transfer)
+			clears += add_clear_requests(&xfers[num + clears],
+				&reads[i], change);
+	}
+	fflush(stdout);
+
+	if (clears)
+		ret = hub_xfer_run(NULL, &xfers[num], clears, CTRL_TIMEOUT);
+
+out:
+	free(reads);
+	free(xfers);
+
+	return ret < 0 ? usb_policy_errno(ret) : 0;
+}
+
+int hub_monitor_run(struct hub_info *hubs, int num, int verbose,
+	volatile sig_atomic_t *stop)
+{
+	libusb_hotplug_callback_handle hotplug;
+	struct monitor mon = { .num = num };
+	struct monitor_hub *mh;
+	struct timeval tv;
+	int hotplug_active = 0;
+	int watched = 0;
+	int unowned = 0;
+	int ret;
+	int i;
+
+	mon.hubs = calloc(num, sizeof(*mon.hubs));
+	if (!mon.hubs && num)
+		return -ENOMEM;
+
+	/* the starting point the first events are relative to */
+	ret = hub_status_collect(hubs, num);
+	if (ret) {
+		free(mon.hubs);
+		return ret;
+	}
+
+	for (i = 0; i < num; i++) {
+		mh = &mon.hubs[i];
+		mh->info = &hubs[i];
+
+		ret = watch_endpoint(mh);
+		if (ret == -EBUSY) {
+			unowned++;
+		} else if (ret) {
+			fprintf(stderr, "Cannot watch hub %03d:%03d: %s\n",
+				hubs[i].busnum, hubs[i].devnum,
+				strerror(-ret));
+			mh->gone = 1;
+		} else {
+			watched++;
+			if (verbose)
+				fprintf(stderr, "Hub %03d:%03d: watching the "
+					"status-change endpoint\n",
+					hubs[i].busnum, hubs[i].devnum);
+		}
+	}
+
+	if (unowned) {
+		ret = -ENOTSUP;
+		if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+			ret = libusb_hotplug_register_callback(NULL,
+				LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+				LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+				LIBUSB_HOTPLUG_NO_FLAGS,
+				LIBUSB_HOTPLUG_MATCH_ANY,
+				LIBUSB_HOTPLUG_MATCH_ANY,
+				LIBUSB_HOTPLUG_MATCH_ANY, device_changed, &mon,
+				&hotplug);
+		hotplug_active = ret == 0;
+		ret = usb_policy_errno(ret);
+
+		for (i = 0; i < num; i++) {
+			mh = &mon.hubs[i];
+			if (mh->transfer || mh->gone)
+				continue;
+
+			if (!hotplug_active) {
+				fprintf(stderr, "Cannot watch hub %03d:%03d: "
+					"in use by a driver and %s\n",
+					hubs[i].busnum, hubs[i].devnum,
+					strerror(-ret));
+				mh->gone = 1;
+				continue;
+			}
+
+			watched++;
+			if (verbose)
+				fprintf(stderr, "Hub %03d:%03d: in use by a "
+					"driver, watching devices arriving "
+					"and leaving\n",
+					hubs[i].busnum, hubs[i].devnum);
+		}
+	}
+
+	if (!watched) {
+		free(mon.hubs);
+		return ret ? ret : -ENOENT;
+	}
+
+	ret = 0;
+	while (!*stop && watched) {
+		tv.tv_sec = 0;
+		tv.tv_usec = MONITOR_TICK_MS * 1000;
+		ret = libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+		if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED) {
+			ret = usb_policy_errno(ret);
+			break;
+		}
+
+		ret = read_pending(&mon);
+		if (ret < 0)
+			break;
+
+		for (i = 0; i < num; i++) {
+			mh = &mon.hubs[i];
+			if (mh->removed && !mh->gone) {
+				print_event(mh->info, 0, "removed");
+				fflush(stdout);
+				mh->gone = 1;
+				watched--;
+			}
+
+			if (!mh->transfer || mh->submitted || mh->gone ||
+					*stop)
+				continue;
+
+			ret = libusb_submit_transfer(mh->transfer);
+			if (ret == 0)
+				mh->submitted = 1;
+			else if (ret == LIBUSB_ERROR_NO_DEVICE)
+				mh->removed = 1;
+			ret = 0;
+		}
+	}
+
+	if (hotplug_active)
+		libusb_hotplug_deregister_callback(NULL, hotplug);
+	for (i = 0; i < num; i++)
+		unwatch_endpoint(&mon.hubs[i]);
+	free(mon.hubs);
+
+	return ret < 0 ? ret : 0;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Event-driven monitoring of hub port status
+ *
+ * A hub reports changes of its ports on its status-change interrupt
+ * endpoint as a bitmap, bit 0 for the hub and bit n for port n. Only the
+ * flagged ports are read with GET_STATUS, so an idle bus carries no
+ * requests at all.
+ *
+ * The interface of a hub is normally owned by the kernel hub driver, which
+ * consumes the bitmap and clears the change bits itself. For such hubs the
+ * ports are read when a device arrives or leaves behind them instead.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef HUB_MONITOR_H
+#define HUB_MONITOR_H
+
+#include <signal.h>
+
+#include "hubs.h"
+
+/**
+ * @brief Stream port status changes of hubs to stdout
+ *
+ * Each change is printed as a line with the local time in ms, the hub, the
+ * port and the event: connected, disconnected, enabled, disabled,
+ * over-current, over-current cleared, power on or power off. The status
+ * read by hub_status_collect() is the starting point.
+ *
+ * @param hubs hubs to watch
+ * @param num number of hubs
+ * @param verbose report on stderr how each hub is watched
+ * @param stop returns once this is non-zero, e.g. set by a signal handler
+ * @return 0 once stopped or all hubs are gone
+ * @return -errno if no hub could be watched
+ */
+int hub_monitor_run(struct hub_info *hubs, int num, int verbose,
+	volatile sig_atomic_t *stop);
+
+#endif /* HUB_MONITOR_H */
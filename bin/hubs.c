@@ -0,0 +1,1041 @@
+/**
+ * @file
+ * @author NIIBE Yutaka <gniibe at fsij.org>
+ * @author Bert van Hall <bert.vanhall\@avionic-design.de>
+ * @author Meike Vocke <meike.vocke\@avionic-design.de>
+ * @date 2006-2016
+ *
+ * @brief Hub registry and port control shared by hub-ctrl and hub-ctrld
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libusb.h>
+
+#include "hubs.h"
+#include "usb_devnode.h"
+#include "usb_eeprom.h"
+#include "usb_stats.h"
+#include "usb_sysfs.h"
+
+/* open addressing hash table of registry index + 1, 0 marks a free slot */
+struct hub_index {
+	int *slots;
+	size_t size;
+};
+
+struct hub_info *hubs;
+int num_hubs;
+const char *hub_sysfs_root = USB_SYSFS_ROOT;
+int hub_need_caps = 1;
+
+/* holds the registered hubs, with the same indices */
+static struct hubctrl *hub_ctx;
+static int max_hubs;
+static struct hub_index index_busdev;
+static struct hub_index index_path;
+static struct hub_index index_serial;
+/* the serial index is built on demand and dropped on every change */
+static int serials_indexed;
+
+static int hub_index(const struct hub_info *hub)
+{
+	return hub - hubs;
+}
+
+int hub_status_collect(struct hub_info *hubs, int num)
+{
+	struct hubctrl_port_req *reqs;
+	struct hub_port_status *status;
+	struct hubctrl_port_req *req;
+	int total = 0;
+	int ret;
+	int i;
+	int j;
+
+	for (i = 0; i < num; i++) {
+		status = realloc(hubs[i].status,
+			hubs[i].nport * sizeof(*status));
+		if (!status && hubs[i].nport)
+			return -ENOMEM;
+		hubs[i].status = status;
+
+		for (j = 0; j < hubs[i].nport; j++)
+			status[j].result = -ENODEV;
+		total += hubs[i].nport;
+	}
+
+	reqs = calloc(total, sizeof(*reqs));
+	if (!reqs && total)
+		return -ENOMEM;
+
+	total = 0;
+	for (i = 0; i < num; i++) {
+		for (j = 0; j < hubs[i].nport; j++, total++) {
+			reqs[total].hub = hub_index(&hubs[i]);
+			reqs[total].port = j + 1;
+			reqs[total].op = HUBCTRL_OP_STATUS;
+		}
+	}
+
+	ret = hubctrl_batch(hub_ctx, reqs, total);
+
+	total = 0;
+	for (i = 0; i < num && ret >= 0; i++) {
+		for (j = 0; j < hubs[i].nport; j++, total++) {
+			req = &reqs[total];
+			status = &hubs[i].status[j];
+
+			/* -EPROTO stands for a short read */
+			if (req->result == -EPROTO)
+				status->result = 0;
+			else if (req->result)
+				status->result = req->result;
+			else
+				status->result = USB_STATUS_SIZE;
+
+			status->bytes[0] = req->status & 0xff;
+			status->bytes[1] = req->status >> 8;
+			status->bytes[2] = req->change & 0xff;
+			status->bytes[3] = req->change >> 8;
+		}
+	}
+
+	free(reqs);
+
+	return ret < 0 ? ret : 0;
+}
+
+void hub_status_print(const struct hub_info *hub)
+{
+	const uint8_t *buf;
+	int i;
+
+	if (!hub || !hub->status)
+		return;
+
+	printf(" Hub %03d:%03d Port Status:\n", hub->busnum, hub->devnum);
+	for (i = 0; i < hub->nport; i++) {
+		if (hub->status[i].result < USB_STATUS_SIZE) {
+			fprintf(stderr,
+				"cannot read port %d status, %s\n", i + 1,
+				hub->status[i].result < 0 ?
+					strerror(-hub->status[i].result) :
+					"short read");
+			continue;
+		}
+
+		buf = hub->status[i].bytes;
+		printf("   Port %d: %02x%02x.%02x%02x", i + 1, buf[3], buf[2],
+			buf[1], buf[0]);
+
+		printf("%s%s%s%s%s",
+			(buf[2] & 0x10) ? " C_RESET" : "",
+			(buf[2] & 0x08) ? " C_OC" : "",
+			(buf[2] & 0x04) ? " C_SUSPEND" : "",
+			(buf[2] & 0x02) ? " C_ENABLE" : "",
+			(buf[2] & 0x01) ? " C_CONNECT" : "");
+
+		printf("%s%s%s%s%s%s%s%s%s%s\n",
+			(buf[1] & 0x10) ? " indicator" : "",
+			(buf[1] & 0x08) ? " test" : "",
+			(buf[1] & 0x04) ? " highspeed" : "",
+			(buf[1] & 0x02) ? " lowspeed" : "",
+			(buf[1] & 0x01) ? " power" : "",
+			(buf[0] & 0x10) ? " RESET" : "",
+			(buf[0] & 0x08) ? " oc" : "",
+			(buf[0] & 0x04) ? " suspend" : "",
+			(buf[0] & 0x02) ? " enable" : "",
+			(buf[0] & 0x01) ? " connect" : "");
+	}
+}
+
+/*
+ * Check whether a hub of the context is one we can handle. The handle
+ * opened for probing stays open if requested.
+ */
+static int hub_probe(int hub, int print, int keep_open)
+{
+	struct hubctrl_hub info;
+	int ret;
+
+	ret = hubctrl_open(hub_ctx, hub);
+	hubctrl_info(hub_ctx, hub, &info);
+	if (ret) {
+		if (print > 1) {
+			fprintf(stderr, "Device %03d:%03d (%04x:%04x): "
+				"Failed to probe: %s\n",
+				info.busnum, info.devnum, info.vendor,
+				info.product, ret == -ENODEV ?
+					"No hub descriptor." :
+					strerror(-ret));
+		}
+		return -ENODEV;
+	}
+
+	if (!info.power_switching && !info.indicators) {
+		if (print > 1) {
+			fprintf(stderr, "Device %03d:%03d (%04x:%04x): "
+				"Neither power switching nor "
+				"indicators supported.\n",
+				info.busnum, info.devnum, info.vendor,
+				info.product);
+		}
+		hubctrl_close(hub_ctx, hub);
+		return -ENODEV;
+	}
+
+	if (print) {
+		printf("Device %03d:%03d (%04x:%04x): Supported!\n",
+			info.busnum, info.devnum, info.vendor, info.product);
+
+		if (!info.power_switching)
+			fprintf(stderr, "  WARN: No power switching.\n");
+		else if (info.per_port_power)
+			fprintf(stderr, "  INFO: individual power switching.\n");
+		else
+			fprintf(stderr, "  INFO: ganged switching.\n");
+
+		if (!info.indicators)
+			fprintf(stderr, "  WARN: Port indicators are NOT supported.\n");
+	}
+
+	if (!keep_open)
+		hubctrl_close(hub_ctx, hub);
+
+	return 0;
+}
+
+/*
+ * Get the number of ports from sysfs without opening the device. Returns
+ * -ENOENT when sysfs lacks something and the libusb probe has to decide,
+ * as for the hub characteristics, which sysfs does not have.
+ */
+static int hub_probe_sysfs(libusb_device *hub, struct usb_sysfs_device *devs,
+	int num)
+{
+	struct usb_sysfs_device *sdev;
+
+	if (hub_need_caps)
+		return -ENOENT;
+
+	sdev = usb_sysfs_lookup(devs, num, libusb_get_bus_number(hub),
+		libusb_get_device_address(hub));
+	if (!sdev || !(sdev->valid & USB_SYSFS_HAVE_IDS))
+		return -ENOENT;
+
+	if (sdev->device_class != LIBUSB_CLASS_HUB)
+		return usb_eeprom_support(hub) > 0 ? -ENOENT : -ENODEV;
+
+	if (!(sdev->valid & USB_SYSFS_HAVE_MAXCHILD))
+		return -ENOENT;
+	if (!sdev->maxchild)
+		return -ENODEV;
+
+	return sdev->maxchild;
+}
+
+static uint32_t hash_busdev(int busnum, int devnum)
+{
+	return (uint32_t)(busnum << 8 | devnum) * 2654435761u;
+}
+
+/* FNV-1a */
+static uint32_t hash_string(const char *str)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*str) {
+		hash ^= (uint8_t)*str++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static int match_busdev(const struct hub_info *hub, const void *key)
+{
+	const struct hub_info *busdev = key;
+
+	return hub->busnum == busdev->busnum && hub->devnum == busdev->devnum;
+}
+
+static int match_path(const struct hub_info *hub, const void *key)
+{
+	return !strcmp(hub->path, key);
+}
+
+static int match_serial(const struct hub_info *hub, const void *key)
+{
+	return hub->serial && !strcmp(hub->serial, key);
+}
+
+static void index_insert(struct hub_index *index, uint32_t hash, int hub)
+{
+	size_t mask = index->size - 1;
+	size_t i;
+
+	for (i = hash & mask; index->slots[i]; i = (i + 1) & mask)
+		;
+
+	index->slots[i] = hub + 1;
+}
+
+static int index_find(const struct hub_index *index, uint32_t hash,
+	int (*match)(const struct hub_info *, const void *), const void *key)
+{
+	size_t mask = index->size - 1;
+	size_t i;
+
+	if (!index->size)
+		return -1;
+
+	for (i = hash & mask; index->slots[i]; i = (i + 1) & mask)
+		if (match(&hubs[index->slots[i] - 1], key))
+			return index->slots[i] - 1;
+
+	return -1;
+}
+
+static int index_resize(struct hub_index *index, size_t size)
+{
+	int *slots;
+
+	if (size != index->size) {
+		slots = calloc(size, sizeof(*slots));
+		if (!slots)
+			return -ENOMEM;
+		free(index->slots);
+		index->slots = slots;
+		index->size = size;
+	} else {
+		memset(index->slots, 0, size * sizeof(*index->slots));
+	}
+
+	return 0;
+}
+
+/* Index all hubs, in tables at most half full */
+static int hub_index_rebuild(void)
+{
+	size_t size = index_busdev.size ? index_busdev.size : 16;
+	int i;
+
+	while (size < 2 * (size_t)max_hubs)
+		size *= 2;
+
+	if (index_resize(&index_busdev, size) ||
+			index_resize(&index_path, size) ||
+			index_resize(&index_serial, size))
+		return -ENOMEM;
+
+	for (i = 0; i < num_hubs; i++) {
+		index_insert(&index_busdev,
+			hash_busdev(hubs[i].busnum, hubs[i].devnum), i);
+		if (hubs[i].path[0])
+			index_insert(&index_path, hash_string(hubs[i].path), i);
+	}
+	serials_indexed = 0;
+
+	return 0;
+}
+
+/* Release what the registry keeps besides the libhubctrl entry */
+static void clean_hub_info(struct hub_info *hubs, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		free(hubs[i].status);
+		hubs[i].status = NULL;
+		free(hubs[i].serial);
+		hubs[i].serial = NULL;
+	}
+}
+
+static void hub_registry_clear(void)
+{
+	clean_hub_info(hubs, num_hubs);
+	num_hubs = 0;
+	hub_ctx_clear(hub_ctx);
+	hub_index_rebuild();
+}
+
+/* The context of the registry, on the default libusb context */
+static int hub_registry_ctx(void)
+{
+	if (hub_ctx)
+		return 0;
+
+	return hub_ctx_new(&hub_ctx, NULL);
+}
+
+/*
+ * Register the hub of the context that follows the registered ones. It is
+ * dropped from the context again on failure.
+ */
+static int hub_registry_add(void)
+{
+	struct hubctrl_hub info;
+	struct hub_info *grown;
+	struct hub_info *hub;
+	int max;
+
+	if (num_hubs == max_hubs) {
+		max = max_hubs ? max_hubs * 2 : 32;
+		grown = realloc(hubs, max * sizeof(*hubs));
+		if (grown) {
+			hubs = grown;
+			max_hubs = max;
+		}
+		if (!grown || hub_index_rebuild()) {
+			hub_ctx_remove(hub_ctx, num_hubs);
+			return -ENOMEM;
+		}
+	}
+
+	hubctrl_info(hub_ctx, num_hubs, &info);
+	hub = &hubs[num_hubs];
+	memset(hub, 0, sizeof(*hub));
+	hub->busnum = info.busnum;
+	hub->devnum = info.devnum;
+	hub->dev = hub_ctx_device(hub_ctx, num_hubs);
+	hub->nport = info.nports;
+	hub->indicator_support = info.indicators;
+	hub->parent = -1;
+	strcpy(hub->path, info.path);
+
+	index_insert(&index_busdev, hash_busdev(hub->busnum, hub->devnum),
+		num_hubs);
+	if (hub->path[0])
+		index_insert(&index_path, hash_string(hub->path), num_hubs);
+	serials_indexed = 0;
+
+	return num_hubs++;
+}
+
+static void hub_read_serial(struct hub_info *hub)
+{
+	struct libusb_device_descriptor desc;
+	unsigned char buf[128];
+	uint64_t start;
+	int len;
+
+	if (hub->serial_read)
+		return;
+	hub->serial_read = 1;
+
+	if (libusb_get_device_descriptor(hub->dev, &desc) ||
+			!desc.iSerialNumber || hub_open(hub))
+		return;
+
+	start = usb_stats_start();
+	len = libusb_get_string_descriptor_ascii(hub_handle(hub),
+		desc.iSerialNumber, buf, sizeof(buf));
+	usb_stats_stop("GET_DESCRIPTOR", start);
+	if (len > 0)
+		hub->serial = strndup((char *)buf, len);
+}
+
+static int serial_matches(libusb_device *dev, uint8_t index,
+	const char *serial)
+{
+	libusb_device_handle *handle;
+	unsigned char buf[128];
+	uint64_t start;
+	int len;
+
+	if (!index)
+		return 0;
+
+	start = usb_stats_start();
+	len = libusb_open(dev, &handle);
+	usb_stats_stop("open", start);
+	if (len)
+		return 0;
+
+	start = usb_stats_start();
+	len = libusb_get_string_descriptor_ascii(handle, index, buf,
+		sizeof(buf));
+	usb_stats_stop("GET_DESCRIPTOR", start);
+	libusb_close(handle);
+
+	return len > 0 && len == strlen(serial) && !memcmp(buf, serial, len);
+}
+
+/* Everything but a serial number unknown to sysfs is decided without I/O */
+static int hub_filter_match(libusb_device *dev, const struct hub_filter *filter,
+	struct usb_sysfs_device *sysfs, int num_sysfs)
+{
+	struct libusb_device_descriptor desc;
+	struct usb_sysfs_device *sdev;
+	char path[HUB_PATH_SIZE];
+
+	if (!filter)
+		return 1;
+
+	if (libusb_get_device_descriptor(dev, &desc))
+		return 0;
+
+	if ((filter->vendor >= 0 && desc.idVendor != filter->vendor) ||
+			(filter->product >= 0 &&
+				desc.idProduct != filter->product) ||
+			(filter->device_class >= 0 &&
+				desc.bDeviceClass != filter->device_class))
+		return 0;
+
+	if (filter->path && (hub_class_port_path(dev, path, sizeof(path)) < 0 ||
+			strcmp(path, filter->path)))
+		return 0;
+
+	if (!filter->serial)
+		return 1;
+
+	sdev = usb_sysfs_lookup(sysfs, num_sysfs, libusb_get_bus_number(dev),
+		libusb_get_device_address(dev));
+	if (sdev && (sdev->valid & USB_SYSFS_HAVE_IDS))
+		return (sdev->valid & USB_SYSFS_HAVE_SERIAL) &&
+			!strcmp(sdev->serial, filter->serial);
+
+	return serial_matches(dev, desc.iSerialNumber, filter->serial);
+}
+
+void hub_topology_build(void)
+{
+	libusb_device *parent;
+	uint8_t ports[7];
+	int num;
+	int i;
+
+	for (i = 0; i < num_hubs; i++) {
+		hubs[i].parent = -1;
+		hubs[i].parent_port = 0;
+
+		parent = libusb_get_parent(hubs[i].dev);
+		num = libusb_get_port_numbers(hubs[i].dev, ports,
+			sizeof(ports));
+		if (!parent || num < 1)
+			continue;
+
+		hubs[i].parent = get_hub(libusb_get_bus_number(parent),
+			libusb_get_device_address(parent));
+		if (hubs[i].parent >= 0)
+			hubs[i].parent_port = ports[num - 1];
+	}
+}
+
+int hub_depth(int hub)
+{
+	int depth = 0;
+
+	/* USB allows five hubs below the root hub, stop at loops anyway */
+	while (hubs[hub].parent >= 0 && depth < 8) {
+		hub = hubs[hub].parent;
+		depth++;
+	}
+
+	return depth;
+}
+
+int hub_children(int hub, int port, int *children, int max)
+{
+	int num = 0;
+	int i;
+
+	for (i = 0; i < num_hubs; i++) {
+		if (hubs[i].parent != hub || (port &&
+				hubs[i].parent_port != port))
+			continue;
+
+		if (children && num < max)
+			children[num] = i;
+		num++;
+	}
+
+	return num;
+}
+
+static void hub_topology_print(int hub, int indent)
+{
+	int i;
+
+	printf("%*s%03d:%03d %s, %d ports\n", 2 * indent, "",
+		hubs[hub].busnum, hubs[hub].devnum,
+		hubs[hub].path[0] ? hubs[hub].path : "?", hubs[hub].nport);
+
+	for (i = 0; i < num_hubs && indent < 8; i++) {
+		if (hubs[i].parent != hub)
+			continue;
+
+		printf("%*sport %d:\n", 2 * indent + 2, "",
+			hubs[i].parent_port);
+		hub_topology_print(i, indent + 2);
+	}
+}
+
+int usb_find_hubs(int print)
+{
+	return usb_find_hubs_matching(print, NULL);
+}
+
+/* Filter of a scan, applied before a device is checked for being a hub */
+struct hub_scan {
+	const struct hub_filter *filter;
+	struct usb_sysfs_device *sysfs;
+	int num_sysfs;
+	int print;
+	/* devices on the bus */
+	int devices;
+};
+
+static int hub_scan_match(libusb_device *dev, void *data)
+{
+	struct libusb_device_descriptor desc;
+	struct hub_scan *scan = data;
+	int ret;
+
+	scan->devices++;
+	if (!hub_filter_match(dev, scan->filter, scan->sysfs,
+			scan->num_sysfs))
+		return 0;
+
+	if (scan->print > 1) {
+		ret = hub_class_candidate(dev, &desc);
+		if (ret == -EIO)
+			fprintf(stderr, "Device %03d:%03d: No descriptor\n",
+				libusb_get_bus_number(dev),
+				libusb_get_device_address(dev));
+		else if (ret < 0)
+			fprintf(stderr, "Device %03d:%03d (%04x:%04x): "
+				"Not a hub\n",
+				libusb_get_bus_number(dev),
+				libusb_get_device_address(dev),
+				desc.idVendor, desc.idProduct);
+	}
+
+	return 1;
+}
+
+int usb_find_hubs_matching(int print, const struct hub_filter *filter)
+{
+	struct hub_scan scan = { .filter = filter, .print = print };
+	int nport;
+	int num;
+	int i;
+
+	hub_registry_clear();
+	if (hub_registry_ctx())
+		return -ENOMEM;
+
+	/* a listing needs the hub descriptor and port status anyway */
+	if (((!print && !hub_need_caps) || (filter && filter->serial)) &&
+			hub_sysfs_root) {
+		scan.num_sysfs = usb_sysfs_scan(hub_sysfs_root, &scan.sysfs);
+		if (scan.num_sysfs < 0)
+			scan.num_sysfs = 0;
+	}
+
+	num = hub_ctx_enumerate(hub_ctx, hub_scan_match, &scan);
+	if (num < 0) {
+		fprintf(stderr, "Failed to get USB device list: %s\n",
+			strerror(-num));
+		free(scan.sysfs);
+		return -ENODEV;
+	}
+
+	if (print)
+		printf("%d USB devices found.\n", scan.devices);
+
+	/* a hub the probe drops moves the next one up to the same index */
+	while (num_hubs < hubctrl_count(hub_ctx)) {
+		nport = -ENOENT;
+		if (scan.num_sysfs && !print)
+			nport = hub_probe_sysfs(hub_ctx_device(hub_ctx,
+				num_hubs), scan.sysfs, scan.num_sysfs);
+
+		/* keep the handle for the port status collected below */
+		if (nport == -ENOENT)
+			nport = hub_probe(num_hubs, print, print) ? -ENODEV : 0;
+
+		if (nport < 0) {
+			hub_ctx_remove(hub_ctx, num_hubs);
+			continue;
+		}
+
+		i = hub_registry_add();
+		if (i >= 0 && nport)
+			hubs[i].nport = nport;
+	}
+
+	free(scan.sysfs);
+	hub_topology_build();
+
+	if (print) {
+		hub_status_collect(hubs, num_hubs);
+		for (i = 0; i < num_hubs; i++)
+			hub_status_print(&hubs[i]);
+
+		printf("%d supported hubs found.\n", num_hubs);
+	}
+
+	if (print > 1) {
+		printf("Topology:\n");
+		for (i = 0; i < num_hubs; i++)
+			if (hubs[i].parent < 0)
+				hub_topology_print(i, 1);
+	}
+
+	return num_hubs;
+}
+
+int get_hub(int busnum, int devnum)
+{
+	struct hub_info key = { .busnum = busnum, .devnum = devnum };
+
+	return index_find(&index_busdev, hash_busdev(busnum, devnum),
+		match_busdev, &key);
+}
+
+int get_hub_by_path(const char *path)
+{
+	if (!path || !*path)
+		return -1;
+
+	return index_find(&index_path, hash_string(path), match_path, path);
+}
+
+int get_hub_by_serial(const char *serial)
+{
+	int i;
+
+	if (!serial)
+		return -1;
+
+	if (!serials_indexed) {
+		memset(index_serial.slots, 0,
+			index_serial.size * sizeof(*index_serial.slots));
+		for (i = 0; i < num_hubs; i++) {
+			hub_read_serial(&hubs[i]);
+			if (hubs[i].serial)
+				index_insert(&index_serial,
+					hash_string(hubs[i].serial), i);
+		}
+		serials_indexed = 1;
+	}
+
+	return index_find(&index_serial, hash_string(serial), match_serial,
+		serial);
+}
+
+int hub_port_path(const struct hub_info *hub, char *buf, size_t size)
+{
+	return hub_class_port_path(hub->dev, buf, size);
+}
+
+int get_hub_with_eeprom(int *hub, int accept_nonblank)
+{
+	int mask = EEPROM_SUPPORT_DEVICE | EEPROM_SUPPORT_STORAGE;
+	int count = 0;
+	int ret;
+	int i;
+
+	if (!hub)
+		return -1;
+
+	if (!accept_nonblank)
+		mask |= EEPROM_SUPPORT_BLANK;
+
+	for (i = 0; i < num_hubs; i++) {
+		ret = usb_eeprom_support(hubs[i].dev);
+		if ((ret & mask) == mask) {
+			if (!count)
+				*hub = i;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/** Hotplug event queued by the callback until hub_registry_update() */
+struct hub_event {
+	libusb_device *dev;
+	libusb_hotplug_event event;
+};
+
+static struct hub_event *hub_events;
+static int num_hub_events;
+static int max_hub_events;
+static libusb_hotplug_callback_handle hotplug_handle;
+static int hotplug_active;
+
+/*
+ * No synchronous I/O is allowed from within a hotplug callback, so events
+ * are only recorded here and the devices get probed later on.
+ */
+static int LIBUSB_CALL hub_hotplug(libusb_context *ctx, libusb_device *dev,
+	libusb_hotplug_event event, void *user_data)
+{
+	struct hub_event *events;
+	int max;
+
+	if (num_hub_events == max_hub_events) {
+		max = max_hub_events * 2 + 16;
+		events = realloc(hub_events, max * sizeof(*events));
+		if (!events)
+			return 0;
+		hub_events = events;
+		max_hub_events = max;
+	}
+
+	hub_events[num_hub_events].dev = libusb_ref_device(dev);
+	hub_events[num_hub_events].event = event;
+	num_hub_events++;
+
+	return 0;
+}
+
+static int hub_find_dev(libusb_device *dev)
+{
+	return get_hub(libusb_get_bus_number(dev),
+		libusb_get_device_address(dev));
+}
+
+static void hub_remove(int hub)
+{
+	clean_hub_info(&hubs[hub], 1);
+	hub_ctx_remove(hub_ctx, hub);
+
+	num_hubs--;
+	memmove(&hubs[hub], &hubs[hub + 1],
+		(num_hubs - hub) * sizeof(*hubs));
+
+	/* rare enough to simply index everything again */
+	hub_index_rebuild();
+}
+
+int hub_registry_init(int print)
+{
+	int ret;
+
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+		return usb_find_hubs(print);
+
+	hub_registry_clear();
+	if (hub_registry_ctx())
+		return -ENOMEM;
+
+	/* hubs with a blank EEPROM are vendor class, so match everything */
+	ret = libusb_hotplug_register_callback(NULL,
+		LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+		LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, LIBUSB_HOTPLUG_ENUMERATE,
+		LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+		LIBUSB_HOTPLUG_MATCH_ANY, hub_hotplug, NULL, &hotplug_handle);
+	if (ret)
+		return usb_find_hubs(print);
+
+	hotplug_active = 1;
+	hub_registry_update(print);
+
+	return num_hubs;
+}
+
+int hub_registry_update(int print)
+{
+	libusb_hotplug_event event;
+	libusb_device *dev;
+	int changes = 0;
+	int hub;
+	int i;
+
+	/* probing runs the event loop, which may append further events */
+	for (i = 0; i < num_hub_events; i++) {
+		dev = hub_events[i].dev;
+		event = hub_events[i].event;
+		hub = hub_find_dev(dev);
+
+		if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+			if (hub < 0 && hub_ctx_add(hub_ctx, dev) == num_hubs) {
+				if (hub_probe(num_hubs, print, 0))
+					hub_ctx_remove(hub_ctx, num_hubs);
+				else if (hub_registry_add() >= 0)
+					changes++;
+			}
+		} else if (hub >= 0) {
+			if (print)
+				printf("Device %03d:%03d: Removed\n",
+					hubs[hub].busnum, hubs[hub].devnum);
+			hub_remove(hub);
+			changes++;
+		}
+
+		libusb_unref_device(dev);
+	}
+
+	num_hub_events = 0;
+	if (changes)
+		hub_topology_build();
+
+	return changes;
+}
+
+void hub_registry_exit(void)
+{
+	int i;
+
+	if (hotplug_active)
+		libusb_hotplug_deregister_callback(NULL, hotplug_handle);
+	hotplug_active = 0;
+
+	for (i = 0; i < num_hub_events; i++)
+		libusb_unref_device(hub_events[i].dev);
+
+	free(hub_events);
+	hub_events = NULL;
+	num_hub_events = 0;
+	max_hub_events = 0;
+
+	hub_registry_clear();
+	hubctrl_free(hub_ctx);
+	hub_ctx = NULL;
+	free(hubs);
+	hubs = NULL;
+	max_hubs = 0;
+	free(index_busdev.slots);
+	free(index_path.slots);
+	free(index_serial.slots);
+	memset(&index_busdev, 0, sizeof(index_busdev));
+	memset(&index_path, 0, sizeof(index_path));
+	memset(&index_serial, 0, sizeof(index_serial));
+}
+
+int hub_registry_hotplug(void)
+{
+	return hotplug_active;
+}
+
+int hub_open_direct(const char *root, int busnum, int devnum)
+{
+	struct usb_sysfs_device *sysfs;
+	struct usb_sysfs_device *sdev;
+	int num;
+	int ret;
+	int fd;
+
+	if (num_hubs || hub_registry_ctx())
+		return -EINVAL;
+
+	fd = usb_devnode_open(root, busnum, devnum);
+	if (fd < 0)
+		return fd;
+
+	ret = hub_ctx_wrap(hub_ctx, fd, busnum, devnum);
+	if (ret < 0)
+		return ret;
+
+	ret = hub_registry_add();
+	if (ret < 0)
+		return ret;
+
+	/* the port path of a wrapped device comes from sysfs, if at all */
+	num = usb_sysfs_scan(hub_sysfs_root, &sysfs);
+	if (num < 0)
+		return ret;
+
+	sdev = usb_sysfs_lookup(sysfs, num, busnum, devnum);
+	if (sdev && strlen(sdev->name) < sizeof(hubs[ret].path)) {
+		strcpy(hubs[ret].path, sdev->name);
+		index_insert(&index_path, hash_string(hubs[ret].path), ret);
+	}
+	free(sysfs);
+
+	return ret;
+}
+
+int hub_open(struct hub_info *hub)
+{
+	if (!hub)
+		return -EINVAL;
+
+	return hubctrl_open(hub_ctx, hub_index(hub));
+}
+
+libusb_device_handle *hub_handle(const struct hub_info *hub)
+{
+	return hub ? hub_ctx_handle(hub_ctx, hub_index(hub)) : NULL;
+}
+
+void hub_close(struct hub_info *hub)
+{
+	if (hub)
+		hubctrl_close(hub_ctx, hub_index(hub));
+}
+
+int hub_power_good_delay(struct hub_info *hub)
+{
+	struct hubctrl_hub info;
+	int ret;
+
+	ret = hub_open(hub);
+	if (ret)
+		return ret;
+
+	hubctrl_info(hub_ctx, hub_index(hub), &info);
+
+	return info.pwr_good_ms < 0 ? -EPROTO : info.pwr_good_ms;
+}
+
+int hub_set_power(int hub, int port, int on)
+{
+	return hubctrl_set_power(hub_ctx, hub, port, on);
+}
+
+int hub_set_indicator(int hub, int port, int value)
+{
+	return hubctrl_set_indicator(hub_ctx, hub, port, value);
+}
+
+int hub_port_request_batch(struct hub_port_req *reqs, int num)
+{
+	struct hubctrl_port_req *batch;
+	int ret;
+	int i;
+
+	if (num <= 0)
+		return 0;
+
+	batch = calloc(num, sizeof(*batch));
+	if (!batch)
+		return -ENOMEM;
+
+	for (i = 0; i < num; i++) {
+		batch[i].hub = reqs[i].hub;
+		batch[i].port = reqs[i].port;
+		batch[i].op = reqs[i].feature == USB_PORT_FEAT_POWER ?
+			HUBCTRL_OP_POWER : HUBCTRL_OP_INDICATOR;
+		batch[i].value = reqs[i].value;
+	}
+
+	ret = hubctrl_batch(hub_ctx, batch, num);
+	if (ret < 0) {
+		free(batch);
+		return ret;
+	}
+
+	for (i = 0; i < num; i++) {
+		reqs[i].result = batch[i].result;
+		reqs[i].submit_ns = batch[i].submit_ns;
+		reqs[i].done_ns = batch[i].done_ns;
+	}
+
+	free(batch);
+
+	return ret;
+}
@@ -0,0 +1,359 @@
+/**
+ * @file
+ * @author Bert van Hall <bert.vanhall\@avionic-design.de>
+ * @date 2016
+ *
+ * @brief Hub registry and port control shared by hub-ctrl and hub-ctrld
+ *
+ * The hubs of the registry are held by a libhubctrl context, with the same
+ * indices, which opens them and sends the port requests. The registry adds
+ * what only the tools need: filtered scans, hubs described from sysfs,
+ * hotplug events, lookups and the topology.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef HUBS_H
+#define HUBS_H
+
+#include <stdint.h>
+
+#include <libusb.h>
+
+#include "hub_class.h"
+#include "hubctrl_usb.h"
+
+#define HUB_LED_GREEN			2
+
+/** Longest power-on to power-good time a hub may declare, in ms */
+#define HUB_PWR_GOOD_MAX_MS		(255 * 2)
+
+/** Size of a port path like "1-2.3.4", see hub_port_path() */
+#define HUB_PATH_SIZE			HUBCTRL_PATH_SIZE
+
+/** Result of a GET_STATUS request for one port */
+struct hub_port_status {
+	int result;			/**< bytes received or -errno */
+	uint8_t bytes[USB_STATUS_SIZE];	/**< wPortStatus and wPortChange */
+};
+
+struct hub_info {
+	int busnum;
+	int devnum;
+	/** Device of the libhubctrl entry, valid while the hub is registered */
+	libusb_device *dev;
+	int nport;
+	int indicator_support;
+	/** Port status of the last hub_status_collect(), nport entries */
+	struct hub_port_status *status;
+	/** Port path, empty if unknown */
+	char path[HUB_PATH_SIZE];
+	/** Serial number, read on the first lookup by serial number */
+	char *serial;
+	/** Non-zero once the serial number was read */
+	int serial_read;
+	/** Registry index of the hub this one is plugged into, -1 if none */
+	int parent;
+	/** Port of the parent hub this one is plugged into, 0 if unknown */
+	int parent_port;
+};
+
+/**
+ * Hub registry, grown as needed. Entries move when hubs are added or
+ * removed, so keep indices or pointers only until the next change.
+ */
+extern struct hub_info *hubs;
+/** sysfs directory used by usb_find_hubs(), @c NULL to always use libusb */
+extern const char *hub_sysfs_root;
+/**
+ * Non-zero, the default, when the hubs of a scan are switched and must
+ * support power switching or indicators. Only scans for EEPROM access
+ * describe hubs from sysfs, it has no hub characteristics.
+ */
+extern int hub_need_caps;
+/** Number of hubs supporting power switching */
+extern int num_hubs;
+
+/**
+ * @brief Read the status of all ports of the given hubs
+ *
+ * The GET_STATUS requests for every port of every hub are submitted at once,
+ * so the whole collection takes about one round trip per bus.
+ *
+ * @param hubs hubs to query, closed hubs are opened
+ * @param num number of hubs
+ * @return 0 on success
+ * @return -errno on failure
+ */
+int hub_status_collect(struct hub_info *hubs, int num);
+
+/**
+ * @brief Print the port status gathered by hub_status_collect()
+ *
+ * @param hub registry entry
+ */
+void hub_status_print(const struct hub_info *hub);
+
+/**
+ * @brief Scan the bus and fill the hub registry
+ *
+ * Entries of a previous scan are released first. Unless a listing is
+ * printed or @ref hub_need_caps is set, hubs are described from sysfs
+ * without opening them; only devices sysfs tells too little about are
+ * probed through libusb. Otherwise every hub is probed and registered only
+ * if it supports power switching or indicators.
+ *
+ * @param print verbosity of the scan report, 0 for a silent scan
+ * @return number of hubs found on success
+ * @return -errno on failure
+ */
+int usb_find_hubs(int print);
+
+/** Devices a scan considers, everything else is never opened */
+struct hub_filter {
+	int vendor;		/**< idVendor, -1 for any */
+	int product;		/**< idProduct, -1 for any */
+	int device_class;	/**< bDeviceClass, -1 for any */
+	const char *path;	/**< port path, e.g. "1-2.3", NULL for any */
+	const char *serial;	/**< serial number, NULL for any */
+};
+
+/**
+ * @brief Scan the bus for the hubs matching a filter
+ *
+ * Like usb_find_hubs(), but devices are checked against the filter before
+ * they are probed. IDs, class and port path come from the cached device
+ * descriptor and topology, the serial number from sysfs. Only devices
+ * matching everything else but unknown to sysfs are opened to read their
+ * serial number.
+ *
+ * @param print verbosity of the scan report, 0 for a silent scan
+ * @param filter devices to consider, NULL for all
+ * @return number of hubs found on success
+ * @return -errno on failure
+ */
+int usb_find_hubs_matching(int print, const struct hub_filter *filter);
+
+/**
+ * @brief Find a hub by bus and device number
+ *
+ * @param busnum USB bus number
+ * @param devnum USB device number
+ * @return registry index
+ * @return -1 if there is no such hub
+ */
+int get_hub(int busnum, int devnum);
+
+/**
+ * @brief Find a hub by its port path
+ *
+ * @param path port path as built by hub_port_path(), e.g. "1-2.3"
+ * @return registry index
+ * @return -1 if there is no such hub
+ */
+int get_hub_by_path(const char *path);
+
+/**
+ * @brief Find a hub by its serial number
+ *
+ * The serial numbers are read from the hubs on the first call after the
+ * registry was filled, later calls only look them up.
+ *
+ * @param serial serial number
+ * @return registry index of the first hub with that serial number
+ * @return -1 if there is no such hub
+ */
+int get_hub_by_serial(const char *serial);
+
+/**
+ * @brief Build the port path of a hub as used by sysfs, e.g. "1-2.3"
+ *
+ * The path stays the same when a hub is plugged in again, unlike its device
+ * number. Root hubs are named "usbN".
+ *
+ * @param hub registry entry
+ * @param buf buffer for the path
+ * @param size size of the buffer
+ * @return length of the path on success
+ * @return -ENAMETOOLONG if the buffer is too small
+ * @return -EIO if the port numbers cannot be read
+ */
+int hub_port_path(const struct hub_info *hub, char *buf, size_t size);
+
+/**
+ * @brief Link every registered hub to the hub it is plugged into
+ *
+ * Sets parent and parent_port of all entries from libusb_get_parent() and
+ * the last of libusb_get_port_numbers(). Scans and hotplug updates call
+ * this, the links only hold until the registry changes.
+ */
+void hub_topology_build(void);
+
+/**
+ * @brief Get the number of hubs between a hub and its root hub
+ *
+ * @param hub registry index
+ * @return 0 for a root hub or a hub without known parent, 1 for a hub
+ *         plugged into a root hub and so on
+ */
+int hub_depth(int hub);
+
+/**
+ * @brief Find the hubs plugged into a port
+ *
+ * @param hub registry index of the upstream hub
+ * @param port port number, 0 for all ports
+ * @param children registry indices of the hubs found, may be @c NULL
+ * @param max size of children
+ * @return number of hubs plugged into the port, even if more than max
+ */
+int hub_children(int hub, int port, int *children, int max);
+
+int get_hub_with_eeprom(int *hub, int accept_nonblank);
+
+/**
+ * @brief Fill the hub registry and keep it current through hotplug events
+ *
+ * Existing devices are probed once, later on only arriving devices are
+ * probed and departed ones dropped by hub_registry_update(). Without hotplug
+ * support in libusb this is a plain usb_find_hubs().
+ *
+ * @param print verbosity of the scan report, 0 for a silent scan
+ * @return number of hubs found on success
+ * @return -errno on failure
+ */
+int hub_registry_init(int print);
+
+/**
+ * @brief Apply the hotplug events received since the last call
+ *
+ * Events are delivered while libusb handles events, call this afterwards.
+ * Registry indices are only stable in between two calls.
+ *
+ * @param print verbosity of the report, 0 to stay silent
+ * @return number of registry entries added or removed
+ */
+int hub_registry_update(int print);
+
+/**
+ * @brief Stop tracking hotplug events and release the registry
+ */
+void hub_registry_exit(void);
+
+/**
+ * @brief Tell whether hotplug events keep the registry current
+ *
+ * @return non-zero after hub_registry_init() registered for hotplug events
+ * @return 0 if the registry only changes by scanning the bus
+ */
+int hub_registry_hotplug(void);
+
+/**
+ * @brief Open a hub through its device node without enumerating the bus
+ *
+ * Opens /dev/bus/usb/BBB/DDD, wraps it into a libusb handle and fetches the
+ * hub descriptor of just this device, see hub_ctx_wrap(). The hub is added
+ * to the registry and stays open. Its port path is looked up in sysfs and
+ * stays empty if sysfs does not list the device. For the bus scan to be
+ * skipped as well, libusb must be initialized with
+ * LIBUSB_OPTION_NO_DEVICE_DISCOVERY.
+ *
+ * @param root device node directory, usually @ref USB_DEVNODE_ROOT
+ * @param busnum USB bus number
+ * @param devnum USB device number
+ * @return registry index on success
+ * @return -ENOSYS if libusb lacks libusb_wrap_sys_device()
+ * @return -errno on failure
+ */
+int hub_open_direct(const char *root, int busnum, int devnum);
+
+/**
+ * @brief Open a registered hub, reusing an already open handle
+ *
+ * @param hub registry entry
+ * @return 0 on success, see hub_handle()
+ * @return -errno on failure
+ */
+int hub_open(struct hub_info *hub);
+
+/**
+ * @brief Get the handle of an open hub
+ *
+ * @param hub registry entry
+ * @return handle, valid until the hub is closed
+ * @return @c NULL if the hub is not open
+ */
+libusb_device_handle *hub_handle(const struct hub_info *hub);
+
+/**
+ * @brief Close the cached handle of a registered hub
+ *
+ * @param hub registry entry
+ */
+void hub_close(struct hub_info *hub);
+
+/**
+ * @brief Get the time a port of the hub needs until its power is good
+ *
+ * This is bPwrOn2PwrGood of the hub descriptor, which is fetched when
+ * the hub is opened.
+ *
+ * @param hub registry entry
+ * @return time in ms on success
+ * @return -errno on failure
+ */
+int hub_power_good_delay(struct hub_info *hub);
+
+/**
+ * @brief Switch the power of a hub port
+ *
+ * @param hub registry index, the hub is opened as needed
+ * @param port port number, starting at 1
+ * @param on non-zero to switch power on
+ * @return 0 on success
+ * @return -errno on failure
+ */
+int hub_set_power(int hub, int port, int on);
+
+/**
+ * @brief Set the indicator LED of a hub port
+ *
+ * @param hub registry index, the hub is opened as needed
+ * @param port port number, starting at 1
+ * @param value 0 for automatic mode, otherwise one of amber, green and off
+ * @return 0 on success
+ * @return -errno on failure
+ */
+int hub_set_indicator(int hub, int port, int value);
+
+/** Power or indicator change of one port, see hub_port_request_batch() */
+struct hub_port_req {
+	int hub;	/**< registry index */
+	int port;	/**< port number, starting at 1 */
+	/** USB_PORT_FEAT_POWER or USB_PORT_FEAT_INDICATOR */
+	int feature;
+	/** power on/off, or indicator value as for hub_set_indicator() */
+	int value;
+	/** 0 or -errno, set by hub_port_request_batch() */
+	int result;
+	/** CLOCK_MONOTONIC time the request was submitted in ns, 0 if not */
+	uint64_t submit_ns;
+	/** CLOCK_MONOTONIC time the request completed in ns, 0 if not */
+	uint64_t done_ns;
+};
+
+/**
+ * @brief Apply power and indicator changes to many ports at once
+ *
+ * The requests are sent as one hubctrl_batch(), in rounds: the first
+ * request to every hub is submitted before any second one, so hubs are
+ * switched nearly at once while the requests to one hub keep their order.
+ *
+ * @param reqs requests to send, results are stored in place
+ * @param num number of requests
+ * @return number of requests that succeeded
+ * @return -errno if the batch could not be set up
+ */
+int hub_port_request_batch(struct hub_port_req *reqs, int num);
+
+#endif /* HUBS_H */
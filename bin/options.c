@@ -13,10 +13,60 @@
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "eeprom_soak.h"
 #include "options.h"
+#include "usb_eeprom.h"
 
 #define EEPROM_SIZE_LIMIT	4096
+#define PORT_LIMIT		255
+#define CYCLE_LIMIT_MS		600000
+#define DEADLINE_LIMIT_MS	3600000
+
+/* long options without a short one */
+enum {
+	OPTION_MONITOR = 256,
+	OPTION_STATS,
+	OPTION_VIDPID,
+	OPTION_PATH,
+	OPTION_SERIAL,
+	OPTION_CLASS,
+	OPTION_SYNC,
+	OPTION_SUBTREE,
+	OPTION_DEADLINE,
+	OPTION_EEPROM_WAIT,
+	OPTION_SOAK,
+	OPTION_OFFSET,
+	OPTION_LENGTH,
+	OPTION_CHECKPOINT,
+	OPTION_DUMP_FIELDS,
+	OPTION_SERIAL_COUNTER,
+	OPTION_SERIAL_CSV,
+};
+
+static const struct option long_options[] = {
+	{ "checkpoint", required_argument, NULL, OPTION_CHECKPOINT },
+	{ "class", required_argument, NULL, OPTION_CLASS },
+	{ "deadline", required_argument, NULL, OPTION_DEADLINE },
+	{ "dump-fields", required_argument, NULL, OPTION_DUMP_FIELDS },
+	{ "eeprom-wait", required_argument, NULL, OPTION_EEPROM_WAIT },
+	{ "help", no_argument, NULL, 'h' },
+	{ "length", required_argument, NULL, OPTION_LENGTH },
+	{ "monitor", no_argument, NULL, OPTION_MONITOR },
+	{ "offset", required_argument, NULL, OPTION_OFFSET },
+	{ "path", required_argument, NULL, OPTION_PATH },
+	{ "serial", required_argument, NULL, OPTION_SERIAL },
+	{ "serial-counter", required_argument, NULL, OPTION_SERIAL_COUNTER },
+	{ "serial-csv", required_argument, NULL, OPTION_SERIAL_CSV },
+	{ "soak", required_argument, NULL, OPTION_SOAK },
+	{ "stats", optional_argument, NULL, OPTION_STATS },
+	{ "subtree", no_argument, NULL, OPTION_SUBTREE },
+	{ "sync", no_argument, NULL, OPTION_SYNC },
+	{ "vidpid", required_argument, NULL, OPTION_VIDPID },
+	{ "version", no_argument, NULL, 'V' },
+	{ NULL, 0, NULL, 0 }
+};
 
 static int conv_ul_arg(size_t *dest, const char *arg, size_t min, size_t max,
 	int base, char name)
@@ -47,43 +97,263 @@ static int conv_ul_arg(size_t *dest, const char *arg, size_t min, size_t max,
 	return 0;
 }
 
+static int add_op(struct hub_options *hargs, size_t busnum, size_t devnum,
+	size_t port, size_t value)
+{
+	struct port_op *ops;
+
+	ops = realloc(hargs->ops, (hargs->num_ops + 1) * sizeof(*ops));
+	if (!ops)
+		return -ENOMEM;
+
+	ops[hargs->num_ops].busnum = busnum;
+	ops[hargs->num_ops].devnum = devnum;
+	ops[hargs->num_ops].port = port;
+	ops[hargs->num_ops].value = value;
+	hargs->ops = ops;
+	hargs->num_ops++;
+
+	return 0;
+}
+
+static int has_op(const struct hub_options *hargs, size_t busnum,
+	size_t devnum, size_t port, size_t value)
+{
+	int i;
+
+	for (i = 0; i < hargs->num_ops; i++)
+		if (hargs->ops[i].busnum == busnum &&
+				hargs->ops[i].devnum == devnum &&
+				hargs->ops[i].port == port &&
+				hargs->ops[i].value == value)
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Add one change per port of a list like "1-4,7" ending at stop. A port
+ * listed twice is changed once.
+ */
+static int add_port_ops(struct hub_options *hargs, const char *list,
+	char stop, size_t busnum, size_t devnum, size_t value)
+{
+	unsigned long first;
+	unsigned long last;
+	const char *arg = list;
+	char *end;
+	int ret;
+
+	for (;;) {
+		errno = 0;
+		first = strtoul(arg, &end, 10);
+		if (errno || end == arg)
+			return -EINVAL;
+
+		last = first;
+		if (*end == '-') {
+			arg = end + 1;
+			last = strtoul(arg, &end, 10);
+			if (errno || end == arg)
+				return -EINVAL;
+		}
+
+		if (first < 1 || last > PORT_LIMIT || first > last)
+			return -ERANGE;
+
+		for (; first <= last; first++) {
+			if (has_op(hargs, busnum, devnum, first, value))
+				continue;
+			ret = add_op(hargs, busnum, devnum, first, value);
+			if (ret)
+				return ret;
+		}
+
+		if (*end != ',')
+			break;
+		arg = end + 1;
+	}
+
+	return *end == stop ? 0 : -EINVAL;
+}
+
+/* BUS:DEV:PORTS=VALUE, e.g. "1:4:1-3=0" */
+static int add_operand(struct hub_options *hargs, const char *arg)
+{
+	size_t busnum;
+	size_t devnum;
+	size_t value;
+	const char *list;
+	char *end;
+	int ret;
+
+	ret = conv_ul_arg(&busnum, arg, 1, USHRT_MAX, 10, 0);
+	end = strchr(arg, ':');
+	if (ret || !end)
+		goto invalid;
+
+	list = end + 1;
+	ret = conv_ul_arg(&devnum, list, 1, USHRT_MAX, 10, 0);
+	end = strchr(list, ':');
+	if (ret || !end)
+		goto invalid;
+
+	list = end + 1;
+	end = strchr(list, '=');
+	if (!end || conv_ul_arg(&value, end + 1, 0, 1, 0, 0))
+		goto invalid;
+
+	ret = add_port_ops(hargs, list, '=', busnum, devnum, value);
+	if (ret == -ENOMEM)
+		return ret;
+	if (ret)
+		goto invalid;
+
+	return 0;
+
+invalid:
+	fprintf(stderr, "Invalid operand '%s', expected BUS:DEV:PORTS=VALUE\n",
+		arg);
+	return -EINVAL;
+}
+
+/* VID[:PID] in hex, e.g. "04b4:6560" */
+static int conv_vidpid(struct hub_options *hargs, const char *arg)
+{
+	unsigned long vendor;
+	unsigned long product;
+	const char *pid;
+	char *end;
+
+	errno = 0;
+	vendor = strtoul(arg, &end, 16);
+	if (errno || end == arg || vendor > USHRT_MAX ||
+			(*end && *end != ':'))
+		goto invalid;
+	hargs->vendor = vendor;
+
+	if (*end == ':') {
+		pid = end + 1;
+		product = strtoul(pid, &end, 16);
+		if (errno || end == pid || *end || product > USHRT_MAX)
+			goto invalid;
+		hargs->product = product;
+	}
+
+	return 0;
+
+invalid:
+	fprintf(stderr, "Invalid parameter for --vidpid: '%s'\n", arg);
+
+	return -EINVAL;
+}
+
+/* BUDGET[:PORT] in mA */
+static int conv_budget(struct hub_options *hargs, const char *arg)
+{
+	const char *sep = strchr(arg, ':');
+	int ret;
+
+	ret = conv_ul_arg(&hargs->budget, arg, 1, UINT_MAX, 10, 'I');
+	if (!ret && sep)
+		ret = conv_ul_arg(&hargs->port_current, sep + 1, 1, UINT_MAX,
+			10, 'I');
+
+	return ret;
+}
+
 void options_help(const char *progname)
 {
 	fprintf(stderr,
-		"Usage: %s [{-b BUSNUM -d DEVNUM}] [-v] [-l]\n"
-		"          [-P PORT] [{-p [VALUE]|-i [VALUE]}]\n\n"
-		"or:    %s [{-b BUSNUM -d DEVNUM}] [-v]\n"
-		"          [{-w BYTES -f filename} | {-r BYTES -f filename} | -e BYTES] [-x]\n\n"
+		"Usage: %s [{-b BUSNUM -d DEVNUM}] [-v] [-l] [-S SOCKET]\n"
+		"          [-P PORTS] [{-p [VALUE]|-i [VALUE]|-c MS}] [-I BUDGET[:PORT]]\n"
+		"          [--sync] [--subtree] [--deadline MS]\n\n"
+		"or:    %s [-v] [-S SOCKET] [-c MS] [--sync] [--subtree]\n"
+		"          [--deadline MS]\n"
+		"          BUS:DEV:PORTS=VALUE...\n\n"
+		"or:    %s [{-b BUSNUM -d DEVNUM}] [-v] [-S SOCKET]\n"
+		"          [{-w BYTES -f filename} | {-r BYTES -f filename} | -e BYTES] [-x] [-u]\n"
+		"          [--eeprom-wait MODE] [--offset OFFSET] [--length LEN]\n"
+		"          [--checkpoint FILE] [{--serial-counter N | --serial-csv FILE}]\n\n"
+		"or:    %s -m TARGETS -w BYTES -f filename [-x] [-u] [--eeprom-wait MODE]\n"
+		"          [{--serial-counter N | --serial-csv FILE}]\n\n"
+		"or:    %s [{-b BUSNUM -d DEVNUM}] [-v] --soak N -w BYTES -f filename [-x]\n"
+		"          [--eeprom-wait MODE]\n\n"
+		"or:    %s --monitor [{-b BUSNUM -d DEVNUM}] [-v]\n\n"
+		"or:    %s --dump-fields filename\n\n"
+		"Instead of -b and -d, hubs can be selected with --vidpid, --path,\n"
+		"--serial and --class, devices not matching are never opened.\n\n"
 		"Options:\n"
 		"-b     <bus-number>    USB bus number\n"
+		"-c     <ms>            Power cycle the ports, off for ms\n"
+		"--checkpoint <file>    Keep the progress of -w in file and resume from it\n"
+		"--class <class>        Select hubs by bDeviceClass, e.g. 9 or 0xff\n"
 		"-d     <dev-number>    USB device number\n"
+		"--deadline <ms>        Give up on the USB requests after ms in total\n"
+		"--dump-fields <file>   Decode and check an EEPROM image, \"-\" for stdin\n"
 		"-e     <N>             Erase N bytes in EEPROM\n"
+		"--eeprom-wait <mode>   Wait for EEPROM writes to finish by \"sleep\"ing\n"
+		"                       5.5 ms (default), \"poll\"ing or \"none\"\n"
 		"-f     <filename>      filename, \"-\" for stdin/stdout, if not used a file \"output.iic\" was created\n"
 		"-h                     help\n"
 		"-i     <indicator>     Set USB hub indicators to specified value[0, 1, 2, 3]\n"
+		"-I     <mA>[:<mA>]     Power ports on in waves within a current budget,\n"
+		"                       optionally with the inrush per port (default 500)\n"
 		"-l                     Scan for and list supported hubs\n"
-		"-P     <port-ID>       ID of USB hub port\n"
+		"--length <N>           Size of the region of -r, -w and -e, the rest of\n"
+		"                       the BYTES from --offset by default\n"
+		"-m     <targets>       Program the EEPROMs of several hubs at once, comma\n"
+		"                       separated BUS:DEV, port paths, \"blank\" or \"all\"\n"
+		"--monitor              Print port status changes of the hubs as they occur\n"
+		"--stats[=json]         Print count, total and p50/p95/p99 latency of the\n"
+		"                       USB requests per phase to stderr at exit\n"
+		"--subtree              Switch the ports of all hubs downstream of the\n"
+		"                       ports too, all ports of the hub without -P\n"
+		"--sync                 Report how far apart the port changes completed\n"
+		"-P     <port-list>     IDs of USB hub ports, e.g. 1-4,7\n"
 		"-p     <enable>        Value enable or disable port [0, 1]\n"
+		"--path <port-path>     Select the hub at a port path, e.g. 1-2.3\n"
+		"--offset <offset>      Read, write or erase the EEPROM from offset on, the\n"
+		"                       file holds the region only\n"
 		"-q     <quiet>         no output at all\n"
 		"-r     <N>             Read N bytes from EEPROM\n"
+		"-S     <socket>        Send the command to hub-ctrld listening on socket\n"
+		"--serial <serial>      Select hubs by serial number\n"
+		"--serial-counter <N>   Program the image of -w with its serial numbered\n"
+		"                       from N on, one per hub\n"
+		"--serial-csv <file>    Program the image of -w with the serials of the\n"
+		"                       first CSV column, one per hub, continuing\n"
+		"                       after those taken before, see <file>.next\n"
+		"--soak <N>             Erase, write and verify the EEPROM N times and\n"
+		"                       report failures and latencies\n"
+		"-u                     Write only EEPROM pages differing from the file\n"
 		"-v                     verbose\n"
 		"-V                     show program version and quit\n"
+		"--vidpid <vid>[:<pid>] Select hubs by vendor and product ID in hex\n"
 		"-w     <N>             Write N bytes to EEPROM\n"
-		"-x                     Overwrite non-blank EEPROM devices\n",
-		progname, progname);
+		"-x                     Overwrite non-blank EEPROM devices\n\n"
+		"Operands BUS:DEV:PORTS=VALUE switch the power of the listed ports\n"
+		"of hub BUS:DEV, all changes are sent after a single scan. With -c\n"
+		"they name the ports to power cycle and VALUE is ignored.\n",
+		progname, progname, progname, progname, progname, progname,
+		progname);
 }
 
 int options_scan(struct hub_options *hargs, int argc, char **argv)
 {
-	const char short_options[] = "b:d:e:f:hi:lP:p:qr:Vvw:x";
+	const char short_options[] = "b:c:d:e:f:hI:i:lm:P:p:qr:S:uVvw:x";
+	size_t value;
+	int region = 0;
 	int option;
 	int ret;
+	int i;
 
 	if (!hargs)
 		return -EINVAL;
 
 	for (;;) {
-		option = getopt(argc, argv, short_options);
+		option = getopt_long(argc, argv, short_options, long_options,
+			NULL);
 		if (option == -1)
 			break;
 
@@ -109,19 +379,25 @@ int options_scan(struct hub_options *hargs, int argc, char **argv)
 				return ret;
 			break;
 
-		case 'P':
-			if (hargs->cmd != COMMAND_SET_NONE &&
-					hargs->cmd != COMMAND_SET_POWER)
+		case 'c':
+			if (hargs->cmd != COMMAND_SET_NONE)
 				return -EINVAL;
 
-			ret = conv_ul_arg(&hargs->port, optarg, 1, USHRT_MAX,
-				10, option);
+			ret = conv_ul_arg(&hargs->cycle_ms, optarg, 1,
+				CYCLE_LIMIT_MS, 10, option);
 			if (ret)
 				return ret;
 
 			hargs->cmd = COMMAND_SET_POWER;
 			break;
 
+		case 'P':
+			if (hargs->cmd & COMMAND_TYPE_EEPROM)
+				return -EINVAL;
+
+			hargs->ports = optarg;
+			break;
+
 		case 'i':
 			if (hargs->cmd != COMMAND_SET_NONE)
 				return -EINVAL;
@@ -135,8 +411,9 @@ int options_scan(struct hub_options *hargs, int argc, char **argv)
 			break;
 
 		case 'p':
-			if (hargs->cmd != COMMAND_SET_NONE &&
-					hargs->cmd != COMMAND_SET_POWER)
+			if ((hargs->cmd != COMMAND_SET_NONE &&
+					hargs->cmd != COMMAND_SET_POWER) ||
+					hargs->cycle_ms)
 				return -EINVAL;
 
 			ret = conv_ul_arg(&hargs->power, optarg, 0, 1, 0,
@@ -158,7 +435,7 @@ int options_scan(struct hub_options *hargs, int argc, char **argv)
 		case 'r':
 		case 'w':
 		case 'e':
-			if (hargs->cmd != COMMAND_SET_NONE)
+			if (hargs->cmd != COMMAND_SET_NONE || hargs->ports)
 				return -EINVAL;
 
 			ret = conv_ul_arg(&hargs->eesize, optarg, 1,
@@ -176,18 +453,275 @@ int options_scan(struct hub_options *hargs, int argc, char **argv)
 			hargs->overwrite = 1;
 			break;
 
+		case 'u':
+			hargs->update = 1;
+			break;
+
+		case 'm':
+			hargs->targets = optarg;
+			break;
+
+		case 'I':
+			ret = conv_budget(hargs, optarg);
+			if (ret)
+				return ret;
+			break;
+
 		case 'f':
 			hargs->filename = optarg;
 			break;
 
+		case 'S':
+			hargs->socket = optarg;
+			break;
+
 		case 'V':
 			hargs->version = 1;
 			return 0;
 
+		case OPTION_MONITOR:
+			hargs->monitor = 1;
+			break;
+
+		case OPTION_VIDPID:
+			ret = conv_vidpid(hargs, optarg);
+			if (ret)
+				return ret;
+			break;
+
+		case OPTION_PATH:
+			hargs->path = optarg;
+			break;
+
+		case OPTION_SERIAL:
+			hargs->serial = optarg;
+			break;
+
+		case OPTION_CLASS:
+			ret = conv_ul_arg(&value, optarg, 0, UCHAR_MAX, 0, 0);
+			if (ret) {
+				fprintf(stderr, "Invalid parameter for "
+					"--class: '%s'\n", optarg);
+				return ret;
+			}
+			hargs->dev_class = value;
+			break;
+
+		case OPTION_DEADLINE:
+			ret = conv_ul_arg(&hargs->deadline_ms, optarg, 1,
+				DEADLINE_LIMIT_MS, 10, 0);
+			if (ret) {
+				fprintf(stderr, "Invalid parameter for "
+					"--deadline: '%s'\n", optarg);
+				return ret;
+			}
+			break;
+
+		case OPTION_EEPROM_WAIT:
+			if (!strcmp(optarg, "sleep"))
+				hargs->eeprom_wait = EEPROM_WAIT_SLEEP;
+			else if (!strcmp(optarg, "poll"))
+				hargs->eeprom_wait = EEPROM_WAIT_POLL;
+			else if (!strcmp(optarg, "none"))
+				hargs->eeprom_wait = EEPROM_WAIT_NONE;
+			else
+				return -EINVAL;
+			break;
+
+		case OPTION_SOAK:
+			ret = conv_ul_arg(&hargs->soak, optarg, 1, SOAK_LIMIT,
+				10, 0);
+			if (ret) {
+				fprintf(stderr, "Invalid parameter for "
+					"--soak: '%s'\n", optarg);
+				return ret;
+			}
+			break;
+
+		case OPTION_OFFSET:
+			ret = conv_ul_arg(&hargs->offset, optarg, 0,
+				MAX_EEPROM_SIZE - 1, 0, 0);
+			if (ret) {
+				fprintf(stderr, "Invalid parameter for "
+					"--offset: '%s'\n", optarg);
+				return ret;
+			}
+			region = 1;
+			break;
+
+		case OPTION_LENGTH:
+			ret = conv_ul_arg(&hargs->length, optarg, 1,
+				MAX_EEPROM_SIZE, 0, 0);
+			if (ret) {
+				fprintf(stderr, "Invalid parameter for "
+					"--length: '%s'\n", optarg);
+				return ret;
+			}
+			region = 1;
+			break;
+
+		case OPTION_CHECKPOINT:
+			hargs->checkpoint = optarg;
+			break;
+
+		case OPTION_SERIAL_COUNTER:
+			ret = conv_ul_arg(&hargs->serial_start, optarg, 0,
+				ULONG_MAX, 10, 0);
+			if (ret) {
+				fprintf(stderr, "Invalid parameter for "
+					"--serial-counter: '%s'\n", optarg);
+				return ret;
+			}
+			hargs->serial_counter = 1;
+			break;
+
+		case OPTION_SERIAL_CSV:
+			hargs->serial_csv = optarg;
+			break;
+
+		case OPTION_DUMP_FIELDS:
+			hargs->dump_fields = optarg;
+			break;
+
+		case OPTION_SUBTREE:
+			hargs->subtree = 1;
+			break;
+
+		case OPTION_SYNC:
+			hargs->sync = 1;
+			break;
+
+		case OPTION_STATS:
+			if (!optarg)
+				hargs->stats = STATS_TEXT;
+			else if (!strcmp(optarg, "json"))
+				hargs->stats = STATS_JSON;
+			else
+				return -EINVAL;
+			break;
+
 		default:
 			return -EINVAL;
 		}
 	}
 
+	for (i = optind; i < argc; i++) {
+		if (hargs->cmd != COMMAND_SET_NONE &&
+				hargs->cmd != COMMAND_SET_POWER)
+			return -EINVAL;
+		if (hargs->ports || hargs->busnum || hargs->devnum)
+			return -EINVAL;
+
+		ret = add_operand(hargs, argv[i]);
+		if (ret)
+			return ret;
+
+		hargs->cmd = COMMAND_SET_POWER;
+		hargs->operands = 1;
+	}
+
+	/* decoding an image file needs no hub */
+	if (hargs->dump_fields)
+		return hargs->cmd == COMMAND_SET_NONE && !hargs->ports &&
+			!hargs->targets && !hargs->monitor &&
+			!hargs->listing && !hargs->socket ? optind : -EINVAL;
+
+	/* -b and -d select a single hub already */
+	if ((hargs->busnum || hargs->devnum) && options_filtered(hargs))
+		return -EINVAL;
+
+	/* monitoring changes nothing */
+	if (hargs->monitor && (hargs->cmd != COMMAND_SET_NONE ||
+			hargs->ports || hargs->operands || hargs->targets ||
+			hargs->budget || hargs->deadline_ms))
+		return -EINVAL;
+
+	/* a branch is switched off or on as a whole */
+	if (hargs->subtree && ((hargs->cmd != COMMAND_SET_NONE &&
+			hargs->cmd != COMMAND_SET_POWER) || hargs->cycle_ms ||
+			hargs->budget || hargs->monitor))
+		return -EINVAL;
+	for (i = 1; hargs->subtree && i < hargs->num_ops; i++)
+		if (hargs->ops[i].value != hargs->ops[0].value)
+			return -EINVAL;
+
+	/* without -P, a subtree starts at all ports of the hub */
+	if (hargs->subtree && !hargs->operands && !hargs->ports) {
+		ret = add_op(hargs, hargs->busnum, hargs->devnum, 0,
+			hargs->power);
+		if (ret)
+			return ret;
+	} else if (!hargs->operands && !hargs->monitor &&
+			!(hargs->cmd & COMMAND_TYPE_EEPROM)) {
+		ret = add_port_ops(hargs, hargs->ports ? hargs->ports : "1",
+			'\0', hargs->busnum, hargs->devnum, hargs->power);
+		if (ret && hargs->ports)
+			fprintf(stderr, "Invalid port list for -P: '%s'\n",
+				hargs->ports);
+		if (ret)
+			return ret;
+	}
+
+	/* a soak test writes the image of a single hub over and over */
+	if (hargs->soak && (hargs->cmd != COMMAND_SET_EEPROM ||
+			hargs->update || hargs->targets))
+		return -EINVAL;
+
+	/* a region lies within the BYTES of a single hub's EEPROM */
+	if (region && (!(hargs->cmd & COMMAND_TYPE_EEPROM) ||
+			hargs->update || hargs->targets || hargs->soak ||
+			hargs->offset >= hargs->eesize ||
+			hargs->length > hargs->eesize - hargs->offset))
+		return -EINVAL;
+	if (region && !hargs->length)
+		hargs->length = hargs->eesize - hargs->offset;
+
+	/* a checkpoint follows a single, plain write and verify */
+	if (hargs->checkpoint && (hargs->cmd != COMMAND_SET_EEPROM ||
+			hargs->update || hargs->targets || hargs->soak))
+		return -EINVAL;
+
+	/* serials are patched into a whole image */
+	if ((hargs->serial_counter || hargs->serial_csv) &&
+			((hargs->serial_counter && hargs->serial_csv) ||
+			hargs->cmd != COMMAND_SET_EEPROM || hargs->soak ||
+			hargs->length))
+		return -EINVAL;
+
+	/* only writing and erasing wait for the EEPROM */
+	if (hargs->eeprom_wait != EEPROM_WAIT_SLEEP &&
+			hargs->cmd != COMMAND_SET_EEPROM &&
+			hargs->cmd != COMMAND_CLR_EEPROM)
+		return -EINVAL;
+
+	/* skew is measured for port changes sent at once */
+	if (hargs->sync && (hargs->budget || hargs->monitor ||
+			(hargs->cmd & COMMAND_TYPE_EEPROM)))
+		return -EINVAL;
+
+	/* a cycle ends with the ports on, their power is not staggered */
+	if (hargs->cycle_ms && hargs->budget)
+		return -EINVAL;
+
+	/* only switching ports on is staggered */
+	for (i = 0; hargs->budget && i < hargs->num_ops; i++)
+		if (hargs->cmd == COMMAND_SET_LED || !hargs->ops[i].value)
+			return -EINVAL;
+	if (hargs->budget && (hargs->cmd & COMMAND_TYPE_EEPROM))
+		return -EINVAL;
+
 	return optind;
 }
+
+int options_filtered(const struct hub_options *hargs)
+{
+	return hargs->vendor >= 0 || hargs->product >= 0 ||
+		hargs->dev_class >= 0 || hargs->path || hargs->serial;
+}
+
+void options_free(struct hub_options *hargs)
+{
+	free(hargs->ops);
+	hargs->ops = NULL;
+	hargs->num_ops = 0;
+}
@@ -22,15 +22,80 @@
 #define COMMAND_TYPE_EEPROM		\
 		( COMMAND_GET_EEPROM | COMMAND_SET_EEPROM | COMMAND_CLR_EEPROM )
 
+/** Formats of the --stats report */
+#define STATS_NONE		0
+#define STATS_TEXT		1
+#define STATS_JSON		2
+
+/** Inrush current assumed for a port in mA, the USB 2.0 port maximum */
+#define DEFAULT_PORT_CURRENT	500
+
+/** Power or indicator change of a single hub port */
+struct port_op {
+	size_t busnum;	/**< USB bus number, 0 for the default hub */
+	size_t devnum;	/**< USB device number, 0 for the default hub */
+	size_t port;	/**< port number, starting at 1, 0 for all ports */
+	size_t value;	/**< power or indicator value */
+};
+
 struct hub_options {
 	int cmd;
 	char *filename;
+	char *socket;
 	size_t eesize;
 	size_t busnum;
 	size_t devnum;
 	size_t power;
-	size_t port;
+	/** port list given with -P, e.g. "1-4,7" */
+	char *ports;
+	/** port changes collected by options_scan() */
+	struct port_op *ops;
+	int num_ops;
+	/** non-zero if the changes came from BUS:DEV:PORTS=VALUE operands */
+	int operands;
 	int overwrite;
+	/** write only the EEPROM pages that differ */
+	int update;
+	/** hubs to program at once, see eeprom_select_targets() */
+	char *targets;
+	/** current budget for a staggered power-on in mA, 0 for none */
+	size_t budget;
+	/** inrush current of a port in mA */
+	size_t port_current;
+	/** off-time of a power cycle in ms, 0 for none */
+	size_t cycle_ms;
+	/** switch the ports of all hubs downstream of the ports as well */
+	int subtree;
+	/** report the completion skew of the port changes */
+	int sync;
+	/** time limit for all USB requests in ms, 0 for none */
+	size_t deadline_ms;
+	/** how EEPROM writes wait for the write cycle, enum eeprom_wait */
+	int eeprom_wait;
+	/** iterations of an EEPROM soak test, 0 for none */
+	size_t soak;
+	/** EEPROM region of -r, -w and -e, length 0 for all of BYTES */
+	size_t offset;
+	size_t length;
+	/** file keeping the progress of -w to resume from, NULL for none */
+	char *checkpoint;
+	/** image file to decode, NULL for none */
+	char *dump_fields;
+	/** number the serials of the hubs up from serial_start */
+	int serial_counter;
+	size_t serial_start;
+	/** CSV file with the serials of the hubs, NULL for none */
+	char *serial_csv;
+	/** print port status changes until interrupted */
+	int monitor;
+	/** request latency report printed at exit, STATS_* */
+	int stats;
+	/** selection filters applied while scanning, -1 or NULL for any */
+	int vendor;
+	int product;
+	int dev_class;
+	char *path;
+	char *serial;
 	int verbose;
 	int listing;
 	int quiet;
@@ -41,4 +106,15 @@ void options_help(const char *progname);
 
 int options_scan(struct hub_options *hargs, int argc, char **argv);;
 
+/**
+ * @brief Tell whether any selection filter was given
+ *
+ * @param hargs parsed options
+ * @return non-zero if hubs are selected by --vidpid, --path, --serial or
+ *         --class
+ */
+int options_filtered(const struct hub_options *hargs);
+
+void options_free(struct hub_options *hargs);
+
 #endif /* OPTIONS_H */
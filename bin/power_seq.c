@@ -0,0 +1,422 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Staggered power-on and timed power cycles of many ports
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hubs.h"
+#include "power_seq.h"
+#include "usb_policy.h"
+
+static int cmp_settle(const void *a, const void *b)
+{
+	const struct power_step *x = a;
+	const struct power_step *y = b;
+
+	if (x->settle_ms != y->settle_ms)
+		return x->settle_ms < y->settle_ms ? 1 : -1;
+	if (x->hub != y->hub)
+		return x->hub - y->hub;
+
+	return x->port - y->port;
+}
+
+static int cmp_start(const void *a, const void *b)
+{
+	const struct power_step *x = a;
+	const struct power_step *y = b;
+
+	if (x->start_ms != y->start_ms)
+		return x->start_ms < y->start_ms ? -1 : 1;
+
+	return cmp_settle(a, b);
+}
+
+int power_seq_plan(struct power_step *steps, int num, unsigned int budget_ma,
+	unsigned int port_ma)
+{
+	unsigned int *free_at;
+	unsigned int total = 0;
+	unsigned int slots;
+	unsigned int slot;
+	unsigned int i;
+	int j;
+
+	if (!port_ma || budget_ma < port_ma)
+		return -EINVAL;
+
+	slots = budget_ma / port_ma;
+	if (slots > num)
+		slots = num;
+	if (!slots)
+		return 0;
+
+	free_at = calloc(slots, sizeof(*free_at));
+	if (!free_at)
+		return -ENOMEM;
+
+	/* longest first into the earliest free slot */
+	qsort(steps, num, sizeof(*steps), cmp_settle);
+	for (j = 0; j < num; j++) {
+		slot = 0;
+		for (i = 1; i < slots; i++)
+			if (free_at[i] < free_at[slot])
+				slot = i;
+
+		steps[j].start_ms = free_at[slot];
+		free_at[slot] += steps[j].settle_ms;
+		if (free_at[slot] > total)
+			total = free_at[slot];
+	}
+
+	free(free_at);
+	qsort(steps, num, sizeof(*steps), cmp_start);
+
+	return total;
+}
+
+static void wait_until(const struct timespec *base, unsigned int ms)
+{
+	struct timespec ts = *base;
+
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+			EINTR)
+		;
+}
+
+static uint64_t ts_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/*
+ * Move the start of the plan so that the time after a wave counts from
+ * when its last request completed, not from when it was due.
+ */
+static void wave_done(struct timespec *base, const struct hub_port_req *reqs,
+	int num, unsigned int start_ms)
+{
+	struct timespec now;
+	uint64_t done = 0;
+	uint64_t start;
+	int i;
+
+	for (i = 0; i < num; i++)
+		if (reqs[i].done_ns > done)
+			done = reqs[i].done_ns;
+	if (!done) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		done = ts_ns(&now);
+	}
+
+	start = done - start_ms * 1000000ULL;
+	if (start > ts_ns(base)) {
+		base->tv_sec = start / 1000000000ULL;
+		base->tv_nsec = start % 1000000000ULL;
+	}
+}
+
+int power_seq_run(struct power_step *steps, int num)
+{
+	struct hub_port_req *reqs;
+	struct timespec base;
+	unsigned int end = 0;
+	int waves = 0;
+	int first;
+	int last;
+	int ret;
+	int i;
+
+	reqs = calloc(num, sizeof(*reqs));
+	if (!reqs && num)
+		return -ENOMEM;
+
+	clock_gettime(CLOCK_MONOTONIC, &base);
+
+	for (first = 0; first < num; first = last) {
+		for (last = first; last < num &&
+				steps[last].start_ms == steps[first].start_ms;
+				last++) {
+			reqs[last].hub = steps[last].hub;
+			reqs[last].port = steps[last].port;
+			reqs[last].feature = USB_PORT_FEAT_POWER;
+			reqs[last].value = 1;
+			if (steps[last].start_ms + steps[last].settle_ms > end)
+				end = steps[last].start_ms +
+					steps[last].settle_ms;
+		}
+
+		wait_until(&base, steps[first].start_ms);
+		ret = hub_port_request_batch(&reqs[first], last - first);
+		if (ret < 0) {
+			free(reqs);
+			return ret;
+		}
+
+		for (i = first; i < last; i++)
+			steps[i].result = reqs[i].result;
+		wave_done(&base, &reqs[first], last - first,
+			steps[first].start_ms);
+		waves++;
+	}
+
+	wait_until(&base, end);
+	free(reqs);
+
+	return waves;
+}
+
+/* Sleep on a timerfd until ms after base */
+static int wait_timerfd(const struct timespec *base, unsigned int ms)
+{
+	struct itimerspec its;
+	uint64_t expirations;
+	ssize_t len;
+	int fd;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value = *base;
+	its.it_value.tv_sec += ms / 1000;
+	its.it_value.tv_nsec += (ms % 1000) * 1000000L;
+	if (its.it_value.tv_nsec >= 1000000000L) {
+		its.it_value.tv_sec++;
+		its.it_value.tv_nsec -= 1000000000L;
+	}
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL)) {
+		close(fd);
+		return -errno;
+	}
+
+	do {
+		len = read(fd, &expirations, sizeof(expirations));
+	} while (len < 0 && errno == EINTR);
+
+	close(fd);
+
+	return len == sizeof(expirations) ? 0 : -EIO;
+}
+
+int power_seq_cycle(struct hub_port_req *reqs, int num, unsigned int off_ms,
+	uint64_t *off_ns, int *timer_error)
+{
+	struct hub_port_req *on;
+	struct timespec off_done;
+	struct timespec on_done;
+	int num_on = 0;
+	int wait;
+	int ret;
+	int i;
+
+	/* the ports must not be left off when the deadline hits */
+	ret = usb_policy_remaining();
+	if (ret >= 0 && ret <= off_ms)
+		return -ETIME;
+
+	for (i = 0; i < num; i++) {
+		reqs[i].feature = USB_PORT_FEAT_POWER;
+		reqs[i].value = 0;
+	}
+
+	on = calloc(num, sizeof(*on));
+	if (!on && num)
+		return -ENOMEM;
+
+	ret = hub_port_request_batch(reqs, num);
+	clock_gettime(CLOCK_MONOTONIC, &off_done);
+	if (ret < 0) {
+		free(on);
+		return ret;
+	}
+
+	for (i = 0; i < num; i++) {
+		if (reqs[i].result)
+			continue;
+
+		on[num_on] = reqs[i];
+		on[num_on].value = 1;
+		num_on++;
+	}
+
+	/* without a timer, sleep instead, the ports must go on again */
+	wait = wait_timerfd(&off_done, off_ms);
+	if (wait)
+		wait_until(&off_done, off_ms);
+	ret = hub_port_request_batch(on, num_on);
+	clock_gettime(CLOCK_MONOTONIC, &on_done);
+	if (ret < 0) {
+		free(on);
+		return ret;
+	}
+
+	num_on = 0;
+	for (i = 0; i < num; i++) {
+		if (reqs[i].result)
+			continue;
+
+		reqs[i].value = 1;
+		reqs[i].result = on[num_on].result;
+		reqs[i].submit_ns = on[num_on].submit_ns;
+		reqs[i].done_ns = on[num_on].done_ns;
+		num_on++;
+	}
+
+	if (off_ns)
+		*off_ns = ts_ns(&on_done) - ts_ns(&off_done);
+	if (timer_error)
+		*timer_error = wait;
+
+	free(on);
+
+	return ret;
+}
+
+static int add_req(struct hub_port_req **reqs, int *num, int *max, int hub,
+	int port, int value)
+{
+	struct hub_port_req *grown;
+
+	if (*num == *max) {
+		*max = *max ? *max * 2 : 16;
+		grown = realloc(*reqs, *max * sizeof(*grown));
+		if (!grown)
+			return -ENOMEM;
+		*reqs = grown;
+	}
+
+	memset(&(*reqs)[*num], 0, sizeof(**reqs));
+	(*reqs)[*num].hub = hub;
+	(*reqs)[*num].port = port;
+	(*reqs)[*num].feature = USB_PORT_FEAT_POWER;
+	(*reqs)[*num].value = value;
+	(*num)++;
+
+	return 0;
+}
+
+int power_seq_subtree(struct hub_port_req **reqs, int *num)
+{
+	struct hub_port_req *out = NULL;
+	int *children = NULL;
+	int num_children;
+	int max = 0;
+	int total = 0;
+	int ret = 0;
+	int port;
+	int i;
+	int j;
+
+	for (i = 0; i < *num && !ret; i++) {
+		if ((*reqs)[i].port)
+			ret = add_req(&out, &total, &max, (*reqs)[i].hub,
+				(*reqs)[i].port, (*reqs)[i].value);
+		for (port = 1; !(*reqs)[i].port && !ret &&
+				port <= hubs[(*reqs)[i].hub].nport; port++)
+			ret = add_req(&out, &total, &max, (*reqs)[i].hub, port,
+				(*reqs)[i].value);
+	}
+
+	children = calloc(num_hubs, sizeof(*children));
+	if (!children && num_hubs)
+		ret = -ENOMEM;
+
+	/* out grows while it is walked, so deeper hubs get visited too */
+	for (i = 0; i < total && !ret; i++) {
+		num_children = hub_children(out[i].hub, out[i].port, children,
+			num_hubs);
+		for (j = 0; j < num_children && !ret; j++)
+			for (port = 1; port <= hubs[children[j]].nport &&
+					!ret; port++)
+				ret = add_req(&out, &total, &max, children[j],
+					port, out[i].value);
+	}
+
+	free(children);
+	if (ret) {
+		free(out);
+		return ret;
+	}
+
+	free(*reqs);
+	*reqs = out;
+	*num = total;
+
+	return 0;
+}
+
+static int cmp_hub_port(const struct hub_port_req *x,
+	const struct hub_port_req *y)
+{
+	if (x->hub != y->hub)
+		return x->hub - y->hub;
+
+	return x->port - y->port;
+}
+
+static int cmp_depth_down(const void *a, const void *b)
+{
+	int dx = hub_depth(((const struct hub_port_req *)a)->hub);
+	int dy = hub_depth(((const struct hub_port_req *)b)->hub);
+
+	return dx != dy ? dy - dx : cmp_hub_port(a, b);
+}
+
+static int cmp_depth_up(const void *a, const void *b)
+{
+	int dx = hub_depth(((const struct hub_port_req *)a)->hub);
+	int dy = hub_depth(((const struct hub_port_req *)b)->hub);
+
+	return dx != dy ? dx - dy : cmp_hub_port(a, b);
+}
+
+int power_seq_branch(struct hub_port_req *reqs, int num)
+{
+	int levels = 0;
+	int first;
+	int last;
+	int ret;
+	int i;
+
+	for (i = 1; i < num; i++)
+		if (reqs[i].value != reqs[0].value)
+			return -EINVAL;
+
+	/* downstream first when switching off, upstream first when on */
+	if (num)
+		qsort(reqs, num, sizeof(*reqs), reqs[0].value ?
+			cmp_depth_up : cmp_depth_down);
+
+	for (first = 0; first < num; first = last) {
+		for (last = first; last < num && hub_depth(reqs[last].hub) ==
+				hub_depth(reqs[first].hub); last++)
+			;
+
+		ret = hub_port_request_batch(&reqs[first], last - first);
+		if (ret < 0)
+			return ret;
+		levels++;
+	}
+
+	return levels;
+}
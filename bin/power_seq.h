@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Staggered power-on and timed power cycles of many ports
+ *
+ * A port draws its inrush current from power-on until its hub declares the
+ * power good, bPwrOn2PwrGood * 2 ms later. Ports are switched on in waves
+ * so that the inrush of all ports still settling stays within the budget.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef POWER_SEQ_H
+#define POWER_SEQ_H
+
+#include <stdint.h>
+
+#include "hubs.h"
+
+/** A port to switch on and when */
+struct power_step {
+	int hub;		/**< registry index */
+	int port;		/**< port number, starting at 1 */
+	/** power-on to power-good time of the hub in ms */
+	unsigned int settle_ms;
+	/** time of the switch, relative to the first wave, in ms */
+	unsigned int start_ms;
+	/** 0 or -errno, set by power_seq_run() */
+	int result;
+};
+
+/**
+ * @brief Plan the waves for powering on a set of ports
+ *
+ * Ports with the longest settle time are placed first, each into the
+ * earliest slot of the budget that becomes free. The steps are then sorted
+ * by start time.
+ *
+ * @param steps ports with settle_ms set, start_ms is filled in
+ * @param num number of ports
+ * @param budget_ma current available for inrush in mA
+ * @param port_ma inrush current of a single port in mA
+ * @return time until the power of the last port is good in ms
+ * @return -EINVAL if the budget does not cover a single port
+ * @return -ENOMEM if out of memory
+ */
+int power_seq_plan(struct power_step *steps, int num, unsigned int budget_ma,
+	unsigned int port_ma);
+
+/**
+ * @brief Switch the ports on as planned
+ *
+ * The ports of each wave are switched with one batch of concurrent requests.
+ * The next wave is timed from the completion of the batch before it, a
+ * batch finishing late delays all waves after it. Returns after the power
+ * of the last port is good.
+ *
+ * @param steps ports planned by power_seq_plan()
+ * @param num number of ports
+ * @return number of waves on success
+ * @return -errno if a wave could not be sent
+ */
+int power_seq_run(struct power_step *steps, int num);
+
+/**
+ * @brief Switch ports off and on again after a shared off-time
+ *
+ * All ports are switched off with one batch of concurrent requests. A
+ * timerfd expiring off_ms after the last of them completed wakes up the
+ * batch switching them on again, so every port of the bank shares the same
+ * off-window. Should the timer fail, a sleep takes its place. Ports that
+ * failed to switch off are left alone.
+ *
+ * @param reqs power requests of the ports, value and result are set
+ * @param num number of ports
+ * @param off_ms time the ports stay off in ms
+ * @param off_ns set to the achieved off-time in ns, from the completion of
+ * the off batch to the completion of the on batch
+ * @param timer_error set to 0, or to -errno if the timer failed and a sleep
+ * took its place, may be @c NULL
+ * @return number of ports cycled on success
+ * @return -ETIME if the deadline of usb_policy.h is closer than off_ms,
+ *         nothing is switched
+ * @return -errno if a batch could not be sent
+ */
+int power_seq_cycle(struct hub_port_req *reqs, int num, unsigned int off_ms,
+	uint64_t *off_ns, int *timer_error);
+
+/**
+ * @brief Add the ports of all hubs downstream of the given ports
+ *
+ * Every hub plugged into one of the ports, directly or through further
+ * hubs, contributes all of its ports with the value of the upstream
+ * request. A request for port 0 stands for all ports of its hub.
+ *
+ * @param reqs requests of the upstream ports, replaced by the whole branch
+ * @param num number of requests, updated
+ * @return 0 on success
+ * @return -ENOMEM if out of memory
+ */
+int power_seq_subtree(struct hub_port_req **reqs, int *num);
+
+/**
+ * @brief Switch the power of a branch level by level
+ *
+ * Ports are grouped by the depth of their hub. Powering off starts with the
+ * deepest hubs, powering on with the topmost, each level being one batch
+ * of concurrent requests. All requests must have the same value.
+ *
+ * @param reqs power requests, sorted in place, results are set
+ * @param num number of requests
+ * @return number of levels on success
+ * @return -EINVAL if the values differ
+ * @return -errno if a level could not be sent
+ */
+int power_seq_branch(struct hub_port_req *reqs, int num);
+
+#endif /* POWER_SEQ_H */
@@ -0,0 +1,132 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Structured view of CY7C65620/CY7C65630 EEPROM images
+ *
+ * The hub reads its configuration from the start of the EEPROM: a header
+ * with signature, IDs, power and port settings, followed by the string
+ * descriptors the header points to. The functions work on the image in
+ * place, the header is overlaid on the data and strings are returned as
+ * pointers into it.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef EEPROM_IMAGE_H
+#define EEPROM_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** first byte of a configured EEPROM */
+#define EEPROM_IMAGE_SIGNATURE		0xd4
+/** string descriptor slots of the header */
+#define EEPROM_IMAGE_STRINGS		6
+/** largest bMaxPower, 500 mA in units of 2 mA */
+#define EEPROM_IMAGE_MAX_POWER		250
+/** string slot of the serial number */
+#define EEPROM_IMAGE_SERIAL		2
+/** most characters of a string, its bLength is a byte */
+#define EEPROM_IMAGE_STRING_MAX		126
+
+/** Header at EEPROM address 0, 16 bit values are little endian */
+struct eeprom_image_header {
+	uint8_t signature;	/**< @ref EEPROM_IMAGE_SIGNATURE */
+	uint8_t vid[2];		/**< idVendor */
+	uint8_t pid[2];		/**< idProduct */
+	uint8_t did[2];		/**< bcdDevice */
+	/** over-current timers, enable in the high, disable in the low nibble */
+	uint8_t overcurrent;
+	uint8_t max_power;	/**< bMaxPower in units of 2 mA */
+	uint8_t options[15];	/**< hub and port options */
+	uint8_t langid[2];	/**< language of the strings */
+	/**
+	 * offsets of the string descriptors, manufacturer, product and
+	 * serial number first, 0 for none
+	 */
+	uint8_t strings[EEPROM_IMAGE_STRINGS][2];
+};
+
+/**
+ * @brief Get a 16 bit value of the header
+ *
+ * @param field two bytes, little endian
+ * @return value
+ */
+static inline uint16_t eeprom_image_u16(const uint8_t field[2])
+{
+	return field[0] | field[1] << 8;
+}
+
+/**
+ * @brief Get the header of an image
+ *
+ * @param data image
+ * @param len size of the image
+ * @return header overlaid on data
+ * @return @c NULL if the image is shorter than the header
+ */
+const struct eeprom_image_header *eeprom_image_header(const uint8_t *data,
+	size_t len);
+
+/**
+ * @brief Get a string of an image
+ *
+ * @param data image
+ * @param len size of the image
+ * @param index slot of the string, below @ref EEPROM_IMAGE_STRINGS
+ * @param chars set to the number of UTF-16LE characters
+ * @return first character, within data
+ * @return @c NULL if the slot is empty or the descriptor invalid
+ */
+const uint8_t *eeprom_image_string(const uint8_t *data, size_t len,
+	int index, size_t *chars);
+
+/**
+ * @brief Replace a string of an image in place
+ *
+ * The descriptor is rewritten with the new bLength. What follows it moves
+ * by the difference in length and the offsets of the other strings are
+ * adjusted. A string missing so far is appended to the image.
+ *
+ * @param data valid image, see eeprom_image_validate()
+ * @param len size of the image
+ * @param size size of the buffer holding the image
+ * @param index slot of the string, below @ref EEPROM_IMAGE_STRINGS
+ * @param text new string, printable ASCII of up to
+ * @ref EEPROM_IMAGE_STRING_MAX characters
+ * @return new size of the image
+ * @return -EINVAL if the image or the string is invalid
+ * @return -ENOSPC if the image outgrows the buffer
+ */
+int eeprom_image_set_string(uint8_t *data, size_t len, size_t size,
+	int index, const char *text);
+
+/**
+ * @brief Check an image before it is written
+ *
+ * Checks the signature, IDs and power and that every string the header
+ * points to is a string descriptor within the image.
+ *
+ * @param data image
+ * @param len size of the image
+ * @param problem set to a description of the first problem found, may be
+ * @c NULL
+ * @return 0 if the image is valid
+ * @return -EINVAL otherwise
+ */
+int eeprom_image_validate(const uint8_t *data, size_t len,
+	const char **problem);
+
+/**
+ * @brief Print the fields of an image
+ *
+ * @param fp stream to print to
+ * @param data image
+ * @param len size of the image
+ */
+void eeprom_image_print(FILE *fp, const uint8_t *data, size_t len);
+
+#endif /* EEPROM_IMAGE_H */
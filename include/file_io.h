@@ -45,4 +45,20 @@ ssize_t file_read(const char *file, uint8_t **buffer, size_t size_in);
  */
 ssize_t file_write(const char *file, const uint8_t *buffer, size_t size);
 
+/**
+ * @brief Replace a file with the data of a buffer at once
+ *
+ * The buffer is written to the file name with ".tmp" appended, which is then
+ * renamed to the file. Readers find either the old or the new contents,
+ * never a file half written. The temporary file is removed on failure.
+ *
+ * @param file file name
+ * @param buffer pointer to the buffer
+ * @param size size of the buffer
+ * @return number of bytes written on success
+ * @return -ENAMETOOLONG if the temporary file name is too long
+ * @return -errno on any other failure
+ */
+ssize_t file_replace(const char *file, const uint8_t *buffer, size_t size);
+
 #endif
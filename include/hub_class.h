@@ -0,0 +1,123 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Hub class descriptors and port requests
+ *
+ * What hub-ctrl, hub-ctrld and libhubctrl need to know about a hub, taken
+ * from its descriptors, and the requests that switch or query its ports.
+ * The callers keep their own registries of hubs on top of it.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef HUB_CLASS_H
+#define HUB_CLASS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libusb.h>
+
+#include "hub_xfer.h"
+
+#define USB_RT_HUB			(LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_DEVICE)
+#define USB_RT_PORT			(LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_OTHER)
+#define USB_PORT_FEAT_POWER		8
+#define USB_PORT_FEAT_INDICATOR		22
+
+#define HUB_CHAR_LPSM			0x0003
+#define HUB_CHAR_PORTIND		0x0080
+
+#define CTRL_TIMEOUT			1000
+#define USB_STATUS_SIZE			4
+
+struct usb_hub_descriptor {
+	uint8_t bDescLength;
+	uint8_t bDescriptorType;
+	uint8_t bNbrPorts;
+	uint16_t wHubCharacteristics;
+	uint8_t bPwrOn2PwrGood;
+	uint8_t bHubContrCurrent;
+} __attribute__((packed));
+
+/** What the hub descriptor tells about a hub */
+struct hub_caps {
+	int nports;			/**< bNbrPorts */
+	uint16_t characteristics;	/**< wHubCharacteristics */
+	/** bPwrOn2PwrGood in ms, -1 if the descriptor ends before it */
+	int pwr_good_ms;
+};
+
+/**
+ * @brief Check whether a device may be a hub to control
+ *
+ * Hubs and Cypress devices with an EEPROM qualify, the latter even with a
+ * blank EEPROM, as vendor class device. Nothing is sent to the device.
+ *
+ * @param dev device
+ * @param desc set to the device descriptor, may be @c NULL
+ * @return EEPROM support flags of usb_eeprom_support(), 0 for a hub
+ * without EEPROM
+ * @return -EIO if the device descriptor cannot be read
+ * @return -ENODEV if the device is neither
+ */
+int hub_class_candidate(libusb_device *dev,
+	struct libusb_device_descriptor *desc);
+
+/**
+ * @brief Read the hub descriptor
+ *
+ * @param dev handle of the hub
+ * @param caps filled in from the descriptor
+ * @return 0 on success
+ * @return -ENODEV if the device has no hub descriptor, as a Cypress hub
+ * with a blank EEPROM
+ * @return -errno if the request failed, see usb_policy_errno()
+ */
+int hub_class_read_caps(libusb_device_handle *dev, struct hub_caps *caps);
+
+/**
+ * @brief Check whether a hub can switch port power or indicators
+ *
+ * @param caps read by hub_class_read_caps()
+ * @return 1 if it supports power switching or indicators, 0 otherwise
+ */
+int hub_class_switchable(const struct hub_caps *caps);
+
+/**
+ * @brief Get the port path of a device as sysfs names it
+ *
+ * @param dev device
+ * @param buf buffer for a path like "1-2.3", "usb1" for a root hub
+ * @param size size of the buffer
+ * @return length of the path on success
+ * @return -EIO if the port numbers are unknown
+ * @return -ENAMETOOLONG if the path does not fit the buffer
+ */
+int hub_class_port_path(libusb_device *dev, char *buf, size_t size);
+
+/**
+ * @brief Fill in a request switching port power or an indicator
+ *
+ * @param xfer request of a batch, see hub_xfer_run()
+ * @param dev handle of the hub
+ * @param port port number, starting at 1
+ * @param feature @ref USB_PORT_FEAT_POWER or @ref USB_PORT_FEAT_INDICATOR
+ * @param value power on/off, or indicator selector, 0 for automatic mode
+ */
+void hub_class_port_feature(struct hub_xfer *xfer, libusb_device_handle *dev,
+	int port, int feature, int value);
+
+/**
+ * @brief Fill in a GET_STATUS request of a port
+ *
+ * @param xfer request of a batch, see hub_xfer_run()
+ * @param dev handle of the hub
+ * @param port port number, starting at 1
+ * @param status @ref USB_STATUS_SIZE bytes for wPortStatus and wPortChange
+ */
+void hub_class_port_status(struct hub_xfer *xfer, libusb_device_handle *dev,
+	int port, uint8_t *status);
+
+#endif /* HUB_CLASS_H */
@@ -0,0 +1,58 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Batches of asynchronous control transfers
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef HUB_XFER_H
+#define HUB_XFER_H
+
+#include <stdint.h>
+
+#include <libusb.h>
+
+/** A single control request of a batch */
+struct hub_xfer {
+	libusb_device_handle *handle;	/**< device to send the request to */
+	uint8_t request_type;		/**< bmRequestType */
+	uint8_t request;		/**< bRequest */
+	uint16_t value;			/**< wValue */
+	uint16_t index;			/**< wIndex */
+	uint8_t *data;			/**< data stage buffer, may be NULL */
+	uint16_t length;		/**< size of the data stage */
+	/** bytes transferred or libusb error code, set on completion */
+	int result;
+	/** CLOCK_MONOTONIC time of submission in ns, set by hub_xfer_run() */
+	uint64_t submit_ns;
+	/** CLOCK_MONOTONIC time of completion in ns, set by hub_xfer_run() */
+	uint64_t done_ns;
+};
+
+/**
+ * @brief Submit a batch of control transfers and wait for all of them
+ *
+ * All transfers are allocated and filled in first, then submitted back to
+ * back before the first completion is awaited, so requests to different
+ * devices and buses are in flight at the same time. Requests to the same
+ * device are queued on its control endpoint in the order given.
+ *
+ * Timeouts and retries follow usb_policy.h. The timeout of a request grows
+ * with the requests queued ahead of it, failed requests are sent again
+ * together once the longest backoff passed. The requests following a
+ * failed one to the same device are sent again with it, even if they
+ * succeeded, to keep their order.
+ *
+ * @param ctx libusb context of the devices, NULL for the default context
+ * @param xfers requests to send, results are stored in place
+ * @param num number of requests
+ * @param timeout fixed timeout for each request in ms, the upper bound
+ * @return number of requests that completed without error
+ * @return libusb error code if the batch could not be set up
+ */
+int hub_xfer_run(libusb_context *ctx, struct hub_xfer *xfers, int num,
+	unsigned int timeout);
+
+#endif /* HUB_XFER_H */
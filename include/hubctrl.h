@@ -0,0 +1,273 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief libhubctrl, hub port and EEPROM control for embedding
+ *
+ * A context holds its own libusb context and the hubs found by the last
+ * hubctrl_enumerate(). Hubs are addressed by their index in that list and
+ * opened on first use, the handles stay open until hubctrl_close(), the
+ * next enumeration or hubctrl_free(). A program links the library once and
+ * keeps the context around instead of running hub-ctrl for every change.
+ *
+ * Functions return 0 or a count on success and -errno on failure, libusb
+ * error codes are converted, -ETIMEDOUT for LIBUSB_ERROR_TIMEOUT, -EPIPE
+ * for a stall and so on. A context must not be used by several threads at
+ * once, separate contexts may.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef HUBCTRL_H
+#define HUBCTRL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Opaque library context */
+struct hubctrl;
+
+/** Size of a port path like "1-2.3.4" */
+#define HUBCTRL_PATH_SIZE	32
+
+/** Description of an enumerated hub */
+struct hubctrl_hub {
+	int busnum;			/**< USB bus number */
+	int devnum;			/**< USB device number */
+	uint16_t vendor;		/**< idVendor */
+	uint16_t product;		/**< idProduct */
+	/** port path, e.g. "1-2.3", empty if unknown */
+	char path[HUBCTRL_PATH_SIZE];
+	/** non-zero if the EEPROM can be programmed, see usb_eeprom.h */
+	int eeprom;
+	/** number of ports, 0 until the hub was opened */
+	int nports;
+	/** non-zero if port power can be switched, ganged or per port */
+	int power_switching;
+	/** non-zero if ports are switched individually, not ganged */
+	int per_port_power;
+	/** non-zero if the ports have indicator LEDs */
+	int indicators;
+	/** power-on to power-good time in ms, -1 until the hub was opened */
+	int pwr_good_ms;
+};
+
+/** Kind of a request in hubctrl_batch() */
+enum hubctrl_op {
+	HUBCTRL_OP_POWER,	/**< switch port power, value 0 or 1 */
+	HUBCTRL_OP_INDICATOR,	/**< set the indicator LED to value */
+	HUBCTRL_OP_STATUS,	/**< read wPortStatus and wPortChange */
+};
+
+/** One port request of hubctrl_batch() */
+struct hubctrl_port_req {
+	int hub;		/**< index of the hub */
+	int port;		/**< port number, starting at 1 */
+	enum hubctrl_op op;	/**< what to do */
+	/** power on/off or indicator value, 0 for automatic mode */
+	int value;
+	/** wPortStatus, set for HUBCTRL_OP_STATUS */
+	uint16_t status;
+	/** wPortChange, set for HUBCTRL_OP_STATUS */
+	uint16_t change;
+	/** 0 on success or -errno, set by hubctrl_batch() */
+	int result;
+	/** CLOCK_MONOTONIC time the request was submitted in ns, 0 if not */
+	uint64_t submit_ns;
+	/** CLOCK_MONOTONIC time the request completed in ns, 0 if not */
+	uint64_t done_ns;
+};
+
+/**
+ * @brief Create a context
+ *
+ * @param ctx set to the new context on success
+ * @return 0 on success
+ * @return -ENOMEM if out of memory
+ * @return -errno if libusb cannot be initialized
+ */
+int hubctrl_new(struct hubctrl **ctx);
+
+/**
+ * @brief Close all hubs and release a context
+ *
+ * @param ctx context, may be @c NULL
+ */
+void hubctrl_free(struct hubctrl *ctx);
+
+/**
+ * @brief Find the hubs on all buses
+ *
+ * Hubs and devices with a programmable EEPROM are taken from the device
+ * descriptors libusb caches, none of them is opened. The hubs of a previous
+ * enumeration are closed and their indices become invalid.
+ *
+ * @param ctx context
+ * @return number of hubs on success
+ * @return -errno on failure
+ */
+int hubctrl_enumerate(struct hubctrl *ctx);
+
+/**
+ * @brief Get the number of hubs found by the last enumeration
+ *
+ * @param ctx context
+ * @return number of hubs
+ */
+int hubctrl_count(const struct hubctrl *ctx);
+
+/**
+ * @brief Describe a hub
+ *
+ * @param ctx context
+ * @param hub index of the hub
+ * @param info filled in on success
+ * @return 0 on success
+ * @return -ENODEV if there is no such hub
+ */
+int hubctrl_info(const struct hubctrl *ctx, int hub,
+	struct hubctrl_hub *info);
+
+/**
+ * @brief Find a hub by bus and device number
+ *
+ * @param ctx context
+ * @param busnum USB bus number
+ * @param devnum USB device number
+ * @return index of the hub
+ * @return -ENODEV if there is no such hub
+ */
+int hubctrl_find(const struct hubctrl *ctx, int busnum, int devnum);
+
+/**
+ * @brief Find a hub by its port path
+ *
+ * @param ctx context
+ * @param path port path as in /sys/bus/usb/devices, e.g. "1-2.3"
+ * @return index of the hub
+ * @return -ENODEV if there is no such hub
+ */
+int hubctrl_find_path(const struct hubctrl *ctx, const char *path);
+
+/**
+ * @brief Open a hub and read its hub descriptor
+ *
+ * Other functions open hubs as needed, this only reports errors early and
+ * fills in the port details of hubctrl_info().
+ *
+ * @param ctx context
+ * @param hub index of the hub
+ * @return 0 on success, also if the hub is open already
+ * @return -ENODEV if there is no such hub, or it has no hub descriptor and
+ *         no EEPROM
+ * @return -errno on failure
+ */
+int hubctrl_open(struct hubctrl *ctx, int hub);
+
+/**
+ * @brief Close the handle of a hub
+ *
+ * @param ctx context
+ * @param hub index of the hub, closed or unknown hubs are ignored
+ */
+void hubctrl_close(struct hubctrl *ctx, int hub);
+
+/**
+ * @brief Switch the power of a port
+ *
+ * @param ctx context
+ * @param hub index of the hub
+ * @param port port number, starting at 1
+ * @param on non-zero to switch power on
+ * @return 0 on success
+ * @return -errno on failure
+ */
+int hubctrl_set_power(struct hubctrl *ctx, int hub, int port, int on);
+
+/**
+ * @brief Set the indicator LED of a port
+ *
+ * @param ctx context
+ * @param hub index of the hub
+ * @param port port number, starting at 1
+ * @param value 0 for automatic mode, otherwise amber (1), green (2) or
+ * off (3)
+ * @return 0 on success
+ * @return -errno on failure
+ */
+int hubctrl_set_indicator(struct hubctrl *ctx, int hub, int port, int value);
+
+/**
+ * @brief Read the status of a port
+ *
+ * @param ctx context
+ * @param hub index of the hub
+ * @param port port number, starting at 1
+ * @param status set to wPortStatus on success
+ * @param change set to wPortChange on success, may be @c NULL
+ * @return 0 on success
+ * @return -errno on failure
+ */
+int hubctrl_get_status(struct hubctrl *ctx, int hub, int port,
+	uint16_t *status, uint16_t *change);
+
+/**
+ * @brief Send many port requests at once
+ *
+ * The hubs are opened as needed and all requests are submitted before the
+ * first completion is awaited, so different hubs are served concurrently.
+ * Requests are submitted in rounds, the first request to every hub before
+ * any second one, so hubs are switched nearly at once while the requests
+ * to one hub keep their order.
+ *
+ * @param ctx context
+ * @param reqs requests to send, results are stored in place
+ * @param num number of requests
+ * @return number of requests that succeeded
+ * @return -errno if the batch could not be set up
+ */
+int hubctrl_batch(struct hubctrl *ctx, struct hubctrl_port_req *reqs,
+	int num);
+
+/**
+ * @brief Read the EEPROM of a hub
+ *
+ * @param ctx context
+ * @param hub index of the hub
+ * @param buffer buffer for the contents
+ * @param size number of bytes to read
+ * @return number of bytes read on success
+ * @return -ENOTSUP if the hub has no programmable EEPROM
+ * @return -errno on failure
+ */
+int hubctrl_eeprom_read(struct hubctrl *ctx, int hub, uint8_t *buffer,
+	size_t size);
+
+/**
+ * @brief Write an image to the EEPROM of a hub
+ *
+ * @param ctx context
+ * @param hub index of the hub
+ * @param buffer image to write
+ * @param size size of the image
+ * @param update non-zero to write only the pages that differ
+ * @return number of bytes written on success
+ * @return -ENOTSUP if the hub has no programmable EEPROM
+ * @return -errno on failure
+ */
+int hubctrl_eeprom_write(struct hubctrl *ctx, int hub, uint8_t *buffer,
+	size_t size, int update);
+
+/**
+ * @brief Erase the EEPROM of a hub
+ *
+ * @param ctx context
+ * @param hub index of the hub
+ * @param size number of bytes to erase
+ * @return number of bytes erased on success
+ * @return -ENOTSUP if the hub has no programmable EEPROM
+ * @return -errno on failure
+ */
+int hubctrl_eeprom_erase(struct hubctrl *ctx, int hub, size_t size);
+
+#endif /* HUBCTRL_H */
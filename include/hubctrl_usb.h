@@ -0,0 +1,129 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief libusb side of libhubctrl for hub-ctrl and hub-ctrld
+ *
+ * The tools keep the hubs they found in a libhubctrl context and send their
+ * requests through it, but they scan with filters, follow hotplug events
+ * and open device nodes directly. These functions let them decide which
+ * hubs a context holds and reach the libusb objects behind a hub. They are
+ * not exported from the shared library.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef HUBCTRL_USB_H
+#define HUBCTRL_USB_H
+
+#include <libusb.h>
+
+#include "hubctrl.h"
+
+/* libusb_wrap_sys_device() and LIBUSB_OPTION_NO_DEVICE_DISCOVERY */
+#if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x01000108
+#define HAVE_LIBUSB_WRAP_SYS_DEVICE 1
+#endif
+
+/**
+ * @brief Decide whether an enumeration considers a device
+ *
+ * @param dev device of the bus
+ * @param data pointer given to hub_ctx_enumerate()
+ * @return non-zero to consider the device, 0 to skip it
+ */
+typedef int (*hub_ctx_match)(libusb_device *dev, void *data);
+
+/**
+ * @brief Create a context on an existing libusb context
+ *
+ * Unlike hubctrl_new(), the libusb context is neither initialized nor
+ * released by libhubctrl.
+ *
+ * @param ctx set to the new context on success
+ * @param usb libusb context, @c NULL for the default context
+ * @return 0 on success
+ * @return -ENOMEM if out of memory
+ */
+int hub_ctx_new(struct hubctrl **ctx, libusb_context *usb);
+
+/**
+ * @brief Find the hubs on all buses that match
+ *
+ * Like hubctrl_enumerate(), but every device of the bus is passed to match
+ * before it is checked for being a hub.
+ *
+ * @param ctx context
+ * @param match called for each device, @c NULL to consider all
+ * @param data passed to match
+ * @return number of hubs on success
+ * @return -errno on failure
+ */
+int hub_ctx_enumerate(struct hubctrl *ctx, hub_ctx_match match, void *data);
+
+/**
+ * @brief Add a device as the last hub of a context
+ *
+ * @param ctx context
+ * @param dev device, as reported by a hotplug event
+ * @return index of the hub on success
+ * @return -ENODEV if the device is no hub, see hub_class_candidate()
+ * @return -ENOMEM if out of memory
+ */
+int hub_ctx_add(struct hubctrl *ctx, libusb_device *dev);
+
+/**
+ * @brief Add a hub opened through its device node as the last hub
+ *
+ * The device node is wrapped into a libusb handle and the hub descriptor
+ * is read as by hubctrl_open(). The node is closed together with the hub.
+ * The port path of the hub stays empty, libusb does not know it.
+ *
+ * @param ctx context
+ * @param fd open device node, taken over even on failure
+ * @param busnum USB bus number of the node, libusb may not know it
+ * @param devnum USB device number of the node
+ * @return index of the hub on success
+ * @return -EACCES if libusb may not use the node
+ * @return -ENODEV if it is no hub or has no hub descriptor and no EEPROM
+ * @return -ENOSYS if libusb lacks libusb_wrap_sys_device()
+ * @return -ENOMEM if out of memory
+ */
+int hub_ctx_wrap(struct hubctrl *ctx, int fd, int busnum, int devnum);
+
+/**
+ * @brief Close and drop a hub, the hubs after it move up by one
+ *
+ * @param ctx context
+ * @param hub index of the hub, unknown hubs are ignored
+ */
+void hub_ctx_remove(struct hubctrl *ctx, int hub);
+
+/**
+ * @brief Close and drop all hubs
+ *
+ * @param ctx context
+ */
+void hub_ctx_clear(struct hubctrl *ctx);
+
+/**
+ * @brief Get the device of a hub
+ *
+ * @param ctx context
+ * @param hub index of the hub
+ * @return device, referenced by the context while it holds the hub
+ * @return @c NULL if there is no such hub
+ */
+libusb_device *hub_ctx_device(const struct hubctrl *ctx, int hub);
+
+/**
+ * @brief Get the handle of an open hub
+ *
+ * @param ctx context
+ * @param hub index of the hub
+ * @return handle, valid until the hub is closed
+ * @return @c NULL if the hub is not open or there is no such hub
+ */
+libusb_device_handle *hub_ctx_handle(const struct hubctrl *ctx, int hub);
+
+#endif /* HUBCTRL_USB_H */
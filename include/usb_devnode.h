@@ -0,0 +1,44 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Access to USB device nodes without enumerating the bus
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef USB_DEVNODE_H
+#define USB_DEVNODE_H
+
+#include <stddef.h>
+
+/** Directory holding the device nodes as BBB/DDD */
+#define USB_DEVNODE_ROOT	"/dev/bus/usb"
+
+/**
+ * @brief Build the path of a USB device node
+ *
+ * @param buf buffer for the path
+ * @param size size of the buffer
+ * @param root device node directory, usually @ref USB_DEVNODE_ROOT
+ * @param busnum USB bus number
+ * @param devnum USB device number
+ * @return length of the path on success
+ * @return -EINVAL on invalid arguments
+ * @return -ENAMETOOLONG if the buffer is too small
+ */
+int usb_devnode_path(char *buf, size_t size, const char *root, int busnum,
+	int devnum);
+
+/**
+ * @brief Open a USB device node for read and write access
+ *
+ * @param root device node directory, usually @ref USB_DEVNODE_ROOT
+ * @param busnum USB bus number
+ * @param devnum USB device number
+ * @return file descriptor on success
+ * @return -errno on failure
+ */
+int usb_devnode_open(const char *root, int busnum, int devnum);
+
+#endif /* USB_DEVNODE_H */
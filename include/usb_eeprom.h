@@ -27,6 +27,10 @@
 #define GET_TIMEOUT(t) (((t + 256 - 1) >> 8) * CTRL_TIMEOUT_PER_256_BYTES)
 /** maximum EEPROM size */
 #define MAX_EEPROM_SIZE 0x1000
+/** write page size of the 25AA640/25LC640 */
+#define EEPROM_PAGE_SIZE		32
+/** largest request of reads and writes, one GET_TIMEOUT() unit */
+#define EEPROM_CHUNK_SIZE		256
 
 /**
  * @defgroup eeprom_support_flags EEPROM support flags
@@ -42,6 +46,57 @@
 #define EEPROM_SUPPORT_BLANK		0x04	/**< Attached EEPROM is blank */
 /** @} */
 
+/** How to wait for the EEPROM write cycle after a write request */
+enum eeprom_wait {
+	/** sleep for the worst case write cycle time of 5 ms, the default */
+	EEPROM_WAIT_SLEEP,
+	/** read the last page back until it holds the new data */
+	EEPROM_WAIT_POLL,
+	/** do not wait, the caller takes care */
+	EEPROM_WAIT_NONE,
+};
+
+/**
+ * @brief Select how writes wait for the EEPROM write cycle
+ *
+ * Polling records the write cycle time seen in usb_stats as "write cycle",
+ * the fixed sleep records "write delay". A write whose last page is all
+ * 0xff, like an erase, cannot be told from a busy EEPROM and sleeps when
+ * polling as well.
+ *
+ * @param wait new strategy, for all following writes
+ */
+void usb_eeprom_set_wait(enum eeprom_wait wait);
+
+/**
+ * @brief Get the strategy set by usb_eeprom_set_wait()
+ *
+ * @return current strategy
+ */
+enum eeprom_wait usb_eeprom_get_wait(void);
+
+/**
+ * @brief Called after each chunk of an EEPROM transfer
+ *
+ * @param data pointer given to usb_eeprom_set_progress()
+ * @param offset EEPROM address of the chunk
+ * @param len size of the chunk, read or written and waited for
+ * @return 0 to go on with the next chunk, non-zero to stop
+ */
+typedef int (*usb_eeprom_progress)(void *data, size_t offset, size_t len);
+
+/**
+ * @brief Set the function called after each chunk
+ *
+ * The callback applies to the reads, writes, erases and updates of all
+ * threads. Stopping makes the transfer return -ECANCELED, the chunks
+ * reported so far are complete.
+ *
+ * @param progress callback, @c NULL for none
+ * @param data passed to the callback
+ */
+void usb_eeprom_set_progress(usb_eeprom_progress progress, void *data);
+
 /**
  * @brief Erase EEPROM data
  *
@@ -59,7 +114,8 @@ int usb_eeprom_erase(libusb_device_handle *dev, size_t size);
  * @brief Read EEPROM data to buffer
  *
  * Read the data from the EEPROM of the USB hub.
- * The data will be written into the given buffer.
+ * The data will be written into the given buffer, in chunks as
+ * usb_eeprom_read_at() from address 0.
  *
  * @param dev pointer to the libusb_device_handle to use
  * @param buffer pointer where the data will be stored
@@ -73,17 +129,124 @@ int usb_eeprom_read(libusb_device_handle *dev, uint8_t *buffer, size_t size);
 /**
  * @brief Write buffer EEPROM data
  *
- * Write given data from pointer to EEPROM of the USB hub.
+ * Write given data from pointer to EEPROM of the USB hub, in chunks as
+ * usb_eeprom_write_at() from address 0.
  *
  * @param dev pointer to the libusb_device_handle to use
  * @param buffer pointer where the data will be stored
  * @param size number of Bytes to write
  * @pre the buffer have to be allocated
  * @return number of actually written bytes on success
+ * @return -ETIMEDOUT if polling never read the new data back
+ * @return -ECANCELED if the progress callback stopped the write
  * @return -errno on failure
  */
 int usb_eeprom_write(libusb_device_handle *dev, uint8_t *buffer, size_t size);
 
+/**
+ * @brief Read a region of the EEPROM
+ *
+ * The region is read in chunks of at most @ref EEPROM_CHUNK_SIZE bytes that
+ * do not cross a multiple of it, each addressed by its offset in wIndex, so
+ * nothing in front of the region is transferred.
+ *
+ * @param dev pointer to the libusb_device_handle to use
+ * @param offset address of the first byte
+ * @param buffer pointer where the data will be stored
+ * @param size number of Bytes to read
+ * @return number of actually read bytes on success
+ * @return -ERANGE if the region ends beyond @ref MAX_EEPROM_SIZE
+ * @return -ECANCELED if the progress callback stopped the read
+ * @return -errno on failure
+ */
+int usb_eeprom_read_at(libusb_device_handle *dev, size_t offset,
+	uint8_t *buffer, size_t size);
+
+/**
+ * @brief Write a region of the EEPROM
+ *
+ * Like usb_eeprom_read_at(), in chunks that each wait for the write cycle
+ * as set by usb_eeprom_set_wait(). A chunk spans several pages of the
+ * EEPROM and, for a region not aligned to @ref EEPROM_PAGE_SIZE, page
+ * boundaries at either end; the hub splits the data into page writes
+ * itself. The chunks only keep each request within one GET_TIMEOUT() unit.
+ *
+ * @param dev pointer to the libusb_device_handle to use
+ * @param offset address of the first byte
+ * @param buffer data to write
+ * @param size number of Bytes to write
+ * @return number of actually written bytes on success
+ * @return -ERANGE if the region ends beyond @ref MAX_EEPROM_SIZE
+ * @return -ECANCELED if the progress callback stopped the write
+ * @return -errno on failure
+ */
+int usb_eeprom_write_at(libusb_device_handle *dev, size_t offset,
+	uint8_t *buffer, size_t size);
+
+/**
+ * @brief Erase a region of the EEPROM
+ *
+ * @param dev pointer to the libusb_device_handle to use
+ * @param offset address of the first byte
+ * @param size number of Bytes to erase
+ * @return number of actually erased bytes on success
+ * @return -ERANGE if the region ends beyond @ref MAX_EEPROM_SIZE
+ * @return -errno on failure
+ */
+int usb_eeprom_erase_at(libusb_device_handle *dev, size_t offset,
+	size_t size);
+
+/**
+ * @brief Write only the EEPROM pages that differ from buffer
+ *
+ * Reads the current contents first and rewrites each run of consecutive
+ * changed pages as usb_eeprom_write_at() does, in chunks addressed by
+ * their offset in wIndex. Nothing is written if the contents already
+ * match, which saves both time and write cycles when only a few bytes like
+ * a serial number change.
+ *
+ * @param dev pointer to the libusb_device_handle to use
+ * @param buffer new EEPROM contents
+ * @param size number of Bytes to compare and update
+ * @return number of actually written bytes on success, 0 if nothing changed
+ * @return -ECANCELED if the progress callback stopped the update
+ * @return -errno on failure
+ */
+int usb_eeprom_update(libusb_device_handle *dev, uint8_t *buffer, size_t size);
+
+/**
+ * @brief Write an EEPROM image and verify it by reading it back
+ *
+ * The read back is recorded in usb_stats as phase "verify".
+ *
+ * @param dev pointer to the libusb_device_handle to use
+ * @param buffer image to write
+ * @param len size of the image
+ * @param update non-zero to write only the pages that differ, see
+ * usb_eeprom_update()
+ * @return number of bytes written on success
+ * @return -EBADMSG if the read back data differs
+ * @return -errno on any other failure
+ */
+int usb_eeprom_program(libusb_device_handle *dev, uint8_t *buffer, int len,
+	int update);
+
+/**
+ * @brief Write a region of the EEPROM and verify it by reading it back
+ *
+ * Only the region is transferred, see usb_eeprom_write_at().
+ *
+ * @param dev pointer to the libusb_device_handle to use
+ * @param offset address of the region
+ * @param buffer data to write
+ * @param len size of the region
+ * @return number of bytes written on success
+ * @return -EBADMSG if the read back data differs
+ * @return -errno on any other failure
+ */
+int usb_eeprom_patch(libusb_device_handle *dev, size_t offset,
+	uint8_t *buffer, int len);
+
 /**
  * @brief Detect an attached EEPROM on a supported device
  *
@@ -0,0 +1,147 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Timeouts, retries and deadline of USB control transfers
+ *
+ * The fixed timeouts of the callers are upper bounds. Once a device answered
+ * enough requests of a kind, the timeout shrinks to a multiple of the 99th
+ * percentile latency observed, so a wedged hub is given up on quickly.
+ * Latency is kept per device and request in units of 256 bytes of data
+ * stage, the granularity of GET_TIMEOUT(). A device is known by its bus and
+ * port path, so nothing refers to devices unplugged in the meantime.
+ *
+ * Requests failing with a timeout or another transient error are retried a
+ * bounded number of times, waiting twice as long before each retry. A
+ * stall is retried once at most: it may be a transient protocol error, but
+ * a hub also stalls requests it does not support, like indicator changes,
+ * and those would stall on every attempt. A deadline caps the time left
+ * for all requests.
+ *
+ * The default policy is a single attempt with the fixed timeouts and no
+ * deadline, the behaviour without this layer.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef USB_POLICY_H
+#define USB_POLICY_H
+
+#include <stdint.h>
+
+#include <libusb.h>
+
+/** How control transfers are timed and retried */
+struct usb_policy {
+	/** tries per request, at least 1 */
+	unsigned int attempts;
+	/** wait before the first retry in ms, doubled for each further one */
+	unsigned int backoff_ms;
+	/** timeout as multiple of the p99 latency, 0 for fixed timeouts */
+	unsigned int timeout_factor;
+	/** shortest adaptive timeout in ms */
+	unsigned int min_timeout_ms;
+	/** requests of a kind observed before its timeout adapts */
+	unsigned int min_samples;
+};
+
+/**
+ * @brief Set the policy
+ *
+ * @param policy new policy, @c NULL for the default
+ */
+void usb_policy_set(const struct usb_policy *policy);
+
+/**
+ * @brief Get the policy
+ *
+ * @param policy filled in with the current policy
+ */
+void usb_policy_get(struct usb_policy *policy);
+
+/**
+ * @brief Set a deadline for all following requests
+ *
+ * @param ms time from now in ms, 0 to remove the deadline
+ */
+void usb_policy_deadline(unsigned int ms);
+
+/**
+ * @brief Get the time left until the deadline
+ *
+ * @return time left in ms, 0 once the deadline passed
+ * @return -1 if there is no deadline
+ */
+int usb_policy_remaining(void);
+
+/**
+ * @brief Get the timeout for a request
+ *
+ * @param dev device the request goes to
+ * @param request_type bmRequestType
+ * @param request bRequest
+ * @param length size of the data stage
+ * @param timeout fixed timeout of the caller in ms, the upper bound
+ * @return timeout in ms
+ * @return 0 if the deadline passed
+ */
+unsigned int usb_policy_timeout(libusb_device_handle *dev,
+	uint8_t request_type, uint8_t request, uint16_t length,
+	unsigned int timeout);
+
+/**
+ * @brief Record the latency of a completed request
+ *
+ * @param dev device the request went to
+ * @param request_type bmRequestType
+ * @param request bRequest
+ * @param length size of the data stage
+ * @param ns latency in ns
+ */
+void usb_policy_record(libusb_device_handle *dev, uint8_t request_type,
+	uint8_t request, uint16_t length, uint64_t ns);
+
+/**
+ * @brief Get the wait before retrying a failed request
+ *
+ * @param error libusb error code of the failed attempt
+ * @param attempt number of attempts made so far
+ * @return wait in ms, at least 1
+ * @return 0 if the request must not be retried, after the policy's
+ *         attempts or a second LIBUSB_ERROR_PIPE
+ */
+unsigned int usb_policy_retry(int error, unsigned int attempt);
+
+/**
+ * @brief Send a control request under the policy
+ *
+ * Takes the same arguments as libusb_control_transfer(). The request is
+ * recorded in the latency statistics of usb_stats as well.
+ *
+ * @return bytes transferred on success
+ * @return libusb error code of the last attempt on failure,
+ *         LIBUSB_ERROR_TIMEOUT if the deadline passed
+ */
+int usb_policy_control(libusb_device_handle *dev, uint8_t request_type,
+	uint8_t request, uint16_t value, uint16_t index, unsigned char *data,
+	uint16_t length, unsigned int timeout);
+
+/**
+ * @brief Convert a libusb error code into -errno
+ *
+ * usb_eeprom and libhubctrl report errors as -errno only. libusb error
+ * codes overlap with -errno values, LIBUSB_ERROR_NOT_SUPPORTED is -ENOMEM
+ * for instance, so they are converted where they leave libusb.
+ *
+ * @param error libusb error code
+ * @return matching -errno, -EIO for LIBUSB_ERROR_OTHER
+ * @return error itself if it is no libusb error code
+ */
+int usb_policy_errno(int error);
+
+/**
+ * @brief Forget all observed latencies
+ */
+void usb_policy_reset(void);
+
+#endif /* USB_POLICY_H */
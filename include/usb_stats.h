@@ -0,0 +1,120 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Latency statistics of USB requests
+ *
+ * Call sites take a monotonic timestamp before a request and hand it back
+ * with the request name afterwards. The time is filed under the phase the
+ * calling thread is in and the request name, each pair keeping a count, a
+ * total and a histogram with eight buckets per power of two, good for
+ * percentiles within about 6 %.
+ *
+ * Nothing is recorded and no clock is read until usb_stats_enable() is
+ * called, phase and request names must be string constants.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef USB_STATS_H
+#define USB_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/** Phase of requests made before any usb_stats_phase() call */
+#define USB_STATS_NO_PHASE	"-"
+
+/** Totals and latency percentiles of one request type in one phase */
+struct usb_stats_summary {
+	const char *phase;	/**< phase name */
+	const char *request;	/**< request name */
+	unsigned long count;	/**< number of requests */
+	uint64_t total_ns;	/**< time of all requests */
+	uint64_t p50_ns;	/**< median latency */
+	uint64_t p95_ns;	/**< 95th percentile latency */
+	uint64_t p99_ns;	/**< 99th percentile latency */
+	uint64_t max_ns;	/**< longest latency */
+};
+
+/**
+ * @brief Turn recording on or off
+ *
+ * @param enable non-zero to record
+ */
+void usb_stats_enable(int enable);
+
+/**
+ * @brief Set the phase following requests of the calling thread belong to
+ *
+ * @param phase name of the phase, e.g. "scan"
+ */
+void usb_stats_phase(const char *phase);
+
+/**
+ * @brief Get the phase of the calling thread
+ *
+ * @return name of the phase
+ */
+const char *usb_stats_get_phase(void);
+
+/**
+ * @brief Take the timestamp before a request
+ *
+ * @return monotonic time in ns
+ * @return 0 if recording is off
+ */
+uint64_t usb_stats_start(void);
+
+/**
+ * @brief Record a request started at usb_stats_start()
+ *
+ * @param request name of the request, e.g. "GET_STATUS"
+ * @param start return value of usb_stats_start(), nothing is recorded for 0
+ */
+void usb_stats_stop(const char *request, uint64_t start);
+
+/**
+ * @brief Record the latency of a request
+ *
+ * @param phase name of the phase
+ * @param request name of the request
+ * @param ns latency in ns
+ */
+void usb_stats_record(const char *phase, const char *request, uint64_t ns);
+
+/**
+ * @brief Name a control request for recording
+ *
+ * @param request_type bmRequestType
+ * @param request bRequest
+ * @return name of a standard or EEPROM request, "other" for the rest
+ */
+const char *usb_stats_request_name(uint8_t request_type, uint8_t request);
+
+/**
+ * @brief Get the statistics of one request type in one phase
+ *
+ * Entries are numbered in the order they were first recorded.
+ *
+ * @param index number of the entry, starting at 0
+ * @param summary filled in on success
+ * @return 0 on success
+ * @return -ENOENT if there is no such entry
+ */
+int usb_stats_get(int index, struct usb_stats_summary *summary);
+
+/**
+ * @brief Print all statistics
+ *
+ * @param out stream to print to
+ * @param json print one JSON object instead of a table
+ */
+void usb_stats_print(FILE *out, int json);
+
+/**
+ * @brief Drop all recorded requests
+ */
+void usb_stats_reset(void);
+
+#endif /* USB_STATS_H */
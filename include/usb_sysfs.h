@@ -0,0 +1,86 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief USB device information from sysfs
+ *
+ * Linux exposes the device descriptor fields and the number of hub ports
+ * under /sys/bus/usb/devices. Reading them does not touch the device, so
+ * even runtime suspended hubs stay asleep. The port attributes below the
+ * hub interface are left alone, reading "disable" resumes the hub.
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef USB_SYSFS_H
+#define USB_SYSFS_H
+
+#include <stdint.h>
+
+/** sysfs directory listing all USB devices and interfaces */
+#define USB_SYSFS_ROOT		"/sys/bus/usb/devices"
+
+/**
+ * @defgroup sysfs_valid_flags sysfs validity flags
+ *
+ * Flags telling which parts of a @ref usb_sysfs_device could be read.
+ *
+ * @{
+ */
+#define USB_SYSFS_HAVE_IDS		0x01	/**< bus, device and descriptor */
+#define USB_SYSFS_HAVE_MAXCHILD		0x02	/**< number of hub ports */
+#define USB_SYSFS_HAVE_SERIAL		0x04	/**< serial number string */
+/** @} */
+
+/** USB device as described by sysfs */
+struct usb_sysfs_device {
+	char name[32];		/**< sysfs name, e.g. "1-2.3" or "usb1" */
+	int busnum;		/**< USB bus number */
+	int devnum;		/**< USB device number */
+	uint8_t device_class;	/**< bDeviceClass */
+	uint16_t vendor;	/**< idVendor */
+	uint16_t product;	/**< idProduct */
+	uint16_t bcd_device;	/**< bcdDevice */
+	int maxchild;		/**< number of hub ports */
+	char serial[64];	/**< serial number, if the device has one */
+	unsigned int valid;	/**< @ref sysfs_valid_flags */
+};
+
+/**
+ * @brief Read a single device from sysfs
+ *
+ * @param root sysfs device directory, usually @ref USB_SYSFS_ROOT
+ * @param name sysfs name of the device
+ * @param dev result
+ * @return 0 on success, missing attributes are flagged in dev->valid
+ * @return -errno on failure
+ */
+int usb_sysfs_read_device(const char *root, const char *name,
+	struct usb_sysfs_device *dev);
+
+/**
+ * @brief Read all USB devices from sysfs
+ *
+ * Interfaces and devices lacking bus or device number are skipped.
+ *
+ * @param root sysfs device directory, usually @ref USB_SYSFS_ROOT
+ * @param devs set to an allocated array of devices, free() it after use
+ * @return number of devices on success
+ * @return -errno on failure
+ */
+int usb_sysfs_scan(const char *root, struct usb_sysfs_device **devs);
+
+/**
+ * @brief Find a device of a scan by bus and device number
+ *
+ * @param devs devices from usb_sysfs_scan()
+ * @param num number of devices
+ * @param busnum USB bus number
+ * @param devnum USB device number
+ * @return matching device
+ * @return @c NULL if there is none
+ */
+struct usb_sysfs_device *usb_sysfs_lookup(struct usb_sysfs_device *devs,
+	int num, int busnum, int devnum);
+
+#endif /* USB_SYSFS_H */
@@ -0,0 +1,244 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Structured view of CY7C65620/CY7C65630 EEPROM images
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "eeprom_image.h"
+
+#define STRING_DESCRIPTOR	0x03
+
+static const char *const string_names[EEPROM_IMAGE_STRINGS] = {
+	"manufacturer", "product", "serial", "string 4", "string 5",
+	"string 6",
+};
+
+const struct eeprom_image_header *eeprom_image_header(const uint8_t *data,
+	size_t len)
+{
+	if (!data || len < sizeof(struct eeprom_image_header))
+		return NULL;
+
+	return (const struct eeprom_image_header *)data;
+}
+
+/* Check the descriptor of a slot, 0 if valid or empty */
+static int check_string(const uint8_t *data, size_t len, int index)
+{
+	const struct eeprom_image_header *header = eeprom_image_header(data,
+		len);
+	size_t offset = eeprom_image_u16(header->strings[index]);
+	size_t length;
+
+	if (!offset)
+		return 0;
+	if (offset < sizeof(*header) || offset + 2 > len)
+		return -ERANGE;
+
+	length = data[offset];
+	if (length < 2 || length % 2 || offset + length > len)
+		return -EMSGSIZE;
+	if (data[offset + 1] != STRING_DESCRIPTOR)
+		return -EPROTO;
+
+	return 0;
+}
+
+const uint8_t *eeprom_image_string(const uint8_t *data, size_t len,
+	int index, size_t *chars)
+{
+	const struct eeprom_image_header *header = eeprom_image_header(data,
+		len);
+	size_t offset;
+
+	if (!header || index < 0 || index >= EEPROM_IMAGE_STRINGS || !chars)
+		return NULL;
+
+	offset = eeprom_image_u16(header->strings[index]);
+	if (!offset || check_string(data, len, index))
+		return NULL;
+
+	*chars = (data[offset] - 2) / 2;
+
+	return data + offset + 2;
+}
+
+static void put_u16(uint8_t field[2], uint16_t value)
+{
+	field[0] = value & 0xff;
+	field[1] = value >> 8;
+}
+
+int eeprom_image_set_string(uint8_t *data, size_t len, size_t size,
+	int index, const char *text)
+{
+	struct eeprom_image_header *header;
+	size_t chars;
+	size_t offset;
+	size_t old;
+	size_t new;
+	size_t next;
+	size_t i;
+
+	if (!data || !text || index < 0 || index >= EEPROM_IMAGE_STRINGS ||
+			eeprom_image_validate(data, len, NULL))
+		return -EINVAL;
+
+	chars = strlen(text);
+	if (chars > EEPROM_IMAGE_STRING_MAX)
+		return -EINVAL;
+	for (i = 0; i < chars; i++)
+		if (text[i] < 0x20 || text[i] >= 0x7f)
+			return -EINVAL;
+
+	header = (struct eeprom_image_header *)data;
+	offset = eeprom_image_u16(header->strings[index]);
+	old = offset ? data[offset] : 0;
+	if (!offset)
+		offset = len;
+	new = 2 + 2 * chars;
+	if (len - old + new > size || len - old + new > UINT16_MAX)
+		return -ENOSPC;
+
+	/* move what follows and the offsets pointing there */
+	memmove(data + offset + new, data + offset + old,
+		len - offset - old);
+	for (i = 0; i < EEPROM_IMAGE_STRINGS; i++) {
+		next = eeprom_image_u16(header->strings[i]);
+		if (next > offset)
+			put_u16(header->strings[i], next - old + new);
+	}
+
+	put_u16(header->strings[index], offset);
+	data[offset] = new;
+	data[offset + 1] = STRING_DESCRIPTOR;
+	for (i = 0; i < chars; i++)
+		put_u16(data + offset + 2 + 2 * i, text[i]);
+
+	return len - old + new;
+}
+
+int eeprom_image_validate(const uint8_t *data, size_t len,
+	const char **problem)
+{
+	const struct eeprom_image_header *header = eeprom_image_header(data,
+		len);
+	uint16_t vid;
+	const char *msg = NULL;
+	int strings = 0;
+	int i;
+
+	if (!header) {
+		msg = "shorter than the header";
+		goto invalid;
+	}
+	if (header->signature != EEPROM_IMAGE_SIGNATURE) {
+		msg = "no signature";
+		goto invalid;
+	}
+
+	vid = eeprom_image_u16(header->vid);
+	if (!vid || vid == 0xffff) {
+		msg = "no vendor ID";
+		goto invalid;
+	}
+	if (header->max_power > EEPROM_IMAGE_MAX_POWER) {
+		msg = "max power above 500 mA";
+		goto invalid;
+	}
+
+	for (i = 0; i < EEPROM_IMAGE_STRINGS; i++) {
+		switch (check_string(data, len, i)) {
+		case -ERANGE:
+			msg = "string offset outside the image";
+			goto invalid;
+		case -EMSGSIZE:
+			msg = "string length invalid";
+			goto invalid;
+		case -EPROTO:
+			msg = "no string descriptor at string offset";
+			goto invalid;
+		}
+		strings += !!eeprom_image_u16(header->strings[i]);
+	}
+	if (strings && !eeprom_image_u16(header->langid)) {
+		msg = "strings without language ID";
+		goto invalid;
+	}
+
+	return 0;
+
+invalid:
+	if (problem)
+		*problem = msg;
+
+	return -EINVAL;
+}
+
+static void print_string(FILE *fp, const uint8_t *chars, size_t num)
+{
+	size_t i;
+	uint16_t c;
+
+	fputc('"', fp);
+	for (i = 0; i < num; i++) {
+		c = eeprom_image_u16(chars + 2 * i);
+		fputc(c >= 0x20 && c < 0x7f && c != '"' ? c : '?', fp);
+	}
+	fputc('"', fp);
+}
+
+void eeprom_image_print(FILE *fp, const uint8_t *data, size_t len)
+{
+	const struct eeprom_image_header *header = eeprom_image_header(data,
+		len);
+	const uint8_t *chars;
+	const char *problem;
+	size_t offset;
+	size_t num;
+	size_t i;
+
+	if (!header) {
+		fprintf(fp, "%zu bytes, shorter than the header\n", len);
+		return;
+	}
+
+	fprintf(fp, "signature      0x%02x\n", header->signature);
+	fprintf(fp, "vendor         0x%04x\n", eeprom_image_u16(header->vid));
+	fprintf(fp, "product        0x%04x\n", eeprom_image_u16(header->pid));
+	fprintf(fp, "device         0x%04x\n", eeprom_image_u16(header->did));
+	fprintf(fp, "overcurrent    enable %u, disable %u\n",
+		header->overcurrent >> 4, header->overcurrent & 0xf);
+	fprintf(fp, "max power      %u mA\n", header->max_power * 2);
+	fprintf(fp, "options       ");
+	for (i = 0; i < sizeof(header->options); i++)
+		fprintf(fp, " %02x", header->options[i]);
+	fputc('\n', fp);
+	fprintf(fp, "language       0x%04x\n",
+		eeprom_image_u16(header->langid));
+
+	for (i = 0; i < EEPROM_IMAGE_STRINGS; i++) {
+		offset = eeprom_image_u16(header->strings[i]);
+		if (!offset)
+			continue;
+
+		fprintf(fp, "%-14s 0x%04zx ", string_names[i], offset);
+		chars = eeprom_image_string(data, len, i, &num);
+		if (chars)
+			print_string(fp, chars, num);
+		else
+			fprintf(fp, "invalid");
+		fputc('\n', fp);
+	}
+
+	if (eeprom_image_validate(data, len, &problem))
+		fprintf(fp, "invalid: %s\n", problem);
+}
@@ -1,5 +1,6 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -9,6 +10,7 @@
 #include "file_io.h"
 
 #define CHUNK_SIZE 1024
+#define TMP_SUFFIX ".tmp"
 
 ssize_t file_read(const char *file, uint8_t **buffer, size_t size_in)
 {
@@ -98,3 +100,42 @@ ssize_t file_write(const char *file, const uint8_t *buffer, size_t size)
 
 	return ret_val;
 }
+
+ssize_t file_replace(const char *file, const uint8_t *buffer, size_t size)
+{
+	char tmp[4096];
+	size_t written = 0;
+	ssize_t ret_val = 0;
+	int fd;
+
+	if (!file || !buffer || !size)
+		return -EINVAL;
+
+	if (snprintf(tmp, sizeof(tmp), "%s" TMP_SUFFIX, file) >= sizeof(tmp))
+		return -ENAMETOOLONG;
+
+	fd = open(tmp, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+	if (fd < 0)
+		return -errno;
+
+	while (written < size) {
+		ret_val = write(fd, buffer + written, size - written);
+		if (ret_val < 0) {
+			ret_val = -errno;
+			break;
+		}
+		written += ret_val;
+	}
+
+	if (close(fd) && ret_val >= 0)
+		ret_val = -errno;
+	if (ret_val >= 0 && rename(tmp, file))
+		ret_val = -errno;
+
+	if (ret_val < 0) {
+		unlink(tmp);
+		return ret_val;
+	}
+
+	return written;
+}
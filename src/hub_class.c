@@ -0,0 +1,130 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Hub class descriptors and port requests
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libusb.h>
+
+#include "hub_class.h"
+#include "usb_eeprom.h"
+#include "usb_policy.h"
+
+int hub_class_candidate(libusb_device *dev,
+	struct libusb_device_descriptor *desc)
+{
+	struct libusb_device_descriptor local;
+	int eeprom;
+
+	if (!desc)
+		desc = &local;
+	memset(desc, 0, sizeof(*desc));
+
+	if (libusb_get_device_descriptor(dev, desc))
+		return -EIO;
+
+	eeprom = usb_eeprom_support(dev);
+	if (eeprom < 0)
+		eeprom = 0;
+	if (desc->bDeviceClass != LIBUSB_CLASS_HUB && !eeprom)
+		return -ENODEV;
+
+	return eeprom;
+}
+
+int hub_class_read_caps(libusb_device_handle *dev, struct hub_caps *caps)
+{
+	struct usb_hub_descriptor desc;
+	uint8_t buf[sizeof(desc)];
+	int len;
+
+	len = usb_policy_control(dev, LIBUSB_ENDPOINT_IN | USB_RT_HUB,
+		LIBUSB_REQUEST_GET_DESCRIPTOR, LIBUSB_DT_HUB << 8, 0, buf,
+		sizeof(buf), CTRL_TIMEOUT);
+	if (len < 0)
+		return usb_policy_errno(len);
+
+	/* up to wHubCharacteristics at least */
+	if (len < 5)
+		return -ENODEV;
+
+	memset(&desc, 0, sizeof(desc));
+	memcpy(&desc, buf, len);
+
+	caps->nports = desc.bNbrPorts;
+	caps->characteristics = libusb_le16_to_cpu(desc.wHubCharacteristics);
+	caps->pwr_good_ms = len > 5 ? desc.bPwrOn2PwrGood * 2 : -1;
+
+	return 0;
+}
+
+int hub_class_switchable(const struct hub_caps *caps)
+{
+	return (caps->characteristics & HUB_CHAR_PORTIND) ||
+		(caps->characteristics & HUB_CHAR_LPSM) < 2;
+}
+
+int hub_class_port_path(libusb_device *dev, char *buf, size_t size)
+{
+	uint8_t ports[7];
+	int len;
+	int num;
+	int i;
+
+	num = libusb_get_port_numbers(dev, ports, sizeof(ports));
+	if (num < 0)
+		return -EIO;
+
+	if (!num)
+		len = snprintf(buf, size, "usb%d", libusb_get_bus_number(dev));
+	else
+		len = snprintf(buf, size, "%d-%d", libusb_get_bus_number(dev),
+			ports[0]);
+
+	for (i = 1; i < num && len < size; i++)
+		len += snprintf(buf + len, size - len, ".%d", ports[i]);
+
+	if (len >= size)
+		return -ENAMETOOLONG;
+
+	return len;
+}
+
+void hub_class_port_feature(struct hub_xfer *xfer, libusb_device_handle *dev,
+	int port, int feature, int value)
+{
+	memset(xfer, 0, sizeof(*xfer));
+	xfer->handle = dev;
+	xfer->request_type = USB_RT_PORT;
+	xfer->value = feature;
+
+	/* the indicator selector goes into the upper byte of wIndex */
+	if (feature == USB_PORT_FEAT_POWER) {
+		xfer->request = value ? LIBUSB_REQUEST_SET_FEATURE :
+			LIBUSB_REQUEST_CLEAR_FEATURE;
+		xfer->index = port;
+	} else {
+		xfer->request = LIBUSB_REQUEST_SET_FEATURE;
+		xfer->index = (value << 8) | port;
+	}
+}
+
+void hub_class_port_status(struct hub_xfer *xfer, libusb_device_handle *dev,
+	int port, uint8_t *status)
+{
+	memset(xfer, 0, sizeof(*xfer));
+	xfer->handle = dev;
+	xfer->request_type = LIBUSB_ENDPOINT_IN | USB_RT_PORT;
+	xfer->request = LIBUSB_REQUEST_GET_STATUS;
+	xfer->index = port;
+	xfer->data = status;
+	xfer->length = USB_STATUS_SIZE;
+}
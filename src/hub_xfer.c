@@ -0,0 +1,347 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Batches of asynchronous control transfers
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libusb.h>
+
+#include "hub_xfer.h"
+#include "usb_policy.h"
+#include "usb_stats.h"
+
+/* once event handling failed, wait this long for cancelled transfers */
+#define CANCEL_WAIT_MS		100
+#define CANCEL_TRIES		10
+
+struct xfer_batch {
+	int pending;
+	int completed;
+};
+
+struct xfer_slot {
+	struct hub_xfer *xfer;
+	struct xfer_batch *batch;
+	struct libusb_transfer *transfer;
+	/** time of submission for the statistics */
+	uint64_t start;
+	/** requests to the same device ahead of this one */
+	int position;
+	/** non-zero while the request is to be sent (again) */
+	int retry;
+	/** failed attempts, sending it again for the order does not count */
+	unsigned int attempts;
+};
+
+static int status_to_error(enum libusb_transfer_status status)
+{
+	switch (status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		return 0;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		return LIBUSB_ERROR_TIMEOUT;
+	case LIBUSB_TRANSFER_STALL:
+		return LIBUSB_ERROR_PIPE;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		return LIBUSB_ERROR_NO_DEVICE;
+	case LIBUSB_TRANSFER_OVERFLOW:
+		return LIBUSB_ERROR_OVERFLOW;
+	case LIBUSB_TRANSFER_CANCELLED:
+		return LIBUSB_ERROR_INTERRUPTED;
+	default:
+		return LIBUSB_ERROR_IO;
+	}
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void LIBUSB_CALL xfer_done(struct libusb_transfer *transfer)
+{
+	struct xfer_slot *slot = transfer->user_data;
+	struct hub_xfer *xfer = slot->xfer;
+
+	xfer->done_ns = now_ns();
+
+	usb_stats_stop(usb_stats_request_name(xfer->request_type,
+		xfer->request), slot->start);
+
+	xfer->result = status_to_error(transfer->status);
+	if (!xfer->result) {
+		usb_policy_record(xfer->handle, xfer->request_type,
+			xfer->request, xfer->length,
+			(xfer->done_ns - xfer->submit_ns) / (slot->position + 1));
+		xfer->result = transfer->actual_length;
+		if ((xfer->request_type & LIBUSB_ENDPOINT_IN) && xfer->data)
+			memcpy(xfer->data,
+				libusb_control_transfer_get_data(transfer),
+				transfer->actual_length);
+	}
+
+	libusb_free_transfer(transfer);
+	slot->transfer = NULL;
+	if (!--slot->batch->pending)
+		slot->batch->completed = 1;
+}
+
+/* Completion of a transfer given up on, the batch may be gone already */
+static void LIBUSB_CALL xfer_abandoned(struct libusb_transfer *transfer)
+{
+	libusb_free_transfer(transfer);
+}
+
+/* devices seen by queue_positions(), an open addressed hash table */
+struct xfer_queue {
+	libusb_device_handle *handle;
+	int count;
+};
+
+static struct xfer_queue *queue_alloc(int num, size_t *size)
+{
+	*size = 8;
+	while (*size < 2 * (size_t)num)
+		*size *= 2;
+
+	return calloc(*size, sizeof(struct xfer_queue));
+}
+
+/*
+ * Requests to one device are served one after the other, so the n-th of
+ * them waits for the n - 1 before it. Gets the place in the queue of its
+ * device, starting at 0, of each request about to be sent. Only those
+ * count, the others are done by now.
+ */
+static void queue_positions(struct xfer_slot *slots, int num,
+	struct xfer_queue *seen, size_t size)
+{
+	size_t h;
+	int i;
+
+	memset(seen, 0, size * sizeof(*seen));
+
+	for (i = 0; i < num; i++) {
+		if (!slots[i].retry)
+			continue;
+
+		h = ((uintptr_t)slots[i].xfer->handle >> 4) & (size - 1);
+		while (seen[h].handle && seen[h].handle != slots[i].xfer->handle)
+			h = (h + 1) & (size - 1);
+
+		seen[h].handle = slots[i].xfer->handle;
+		slots[i].position = seen[h].count++;
+	}
+}
+
+static void prepare(struct xfer_slot *slot, unsigned int timeout)
+{
+	struct hub_xfer *xfer = slot->xfer;
+	struct libusb_transfer *transfer;
+	unsigned char *buffer;
+	unsigned int limit;
+	int remaining;
+
+	/* the timeout runs from submission, the queue ahead counts as well */
+	limit = usb_policy_timeout(xfer->handle, xfer->request_type,
+		xfer->request, xfer->length, timeout);
+	if (limit < timeout / (slot->position + 1))
+		limit *= slot->position + 1;
+	else
+		limit = timeout;
+	remaining = usb_policy_remaining();
+	if (remaining >= 0 && remaining < limit)
+		limit = remaining;
+	if (!limit) {
+		xfer->result = LIBUSB_ERROR_TIMEOUT;
+		return;
+	}
+
+	transfer = libusb_alloc_transfer(0);
+	buffer = malloc(LIBUSB_CONTROL_SETUP_SIZE + xfer->length);
+	if (!transfer || !buffer) {
+		libusb_free_transfer(transfer);
+		free(buffer);
+		xfer->result = LIBUSB_ERROR_NO_MEM;
+		return;
+	}
+
+	libusb_fill_control_setup(buffer, xfer->request_type, xfer->request,
+		xfer->value, xfer->index, xfer->length);
+	if (!(xfer->request_type & LIBUSB_ENDPOINT_IN) && xfer->length)
+		memcpy(buffer + LIBUSB_CONTROL_SETUP_SIZE, xfer->data,
+			xfer->length);
+
+	libusb_fill_control_transfer(transfer, xfer->handle, buffer,
+		xfer_done, slot, limit);
+	transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+	slot->transfer = transfer;
+}
+
+int hub_xfer_run(libusb_context *ctx, struct hub_xfer *xfers, int num,
+	unsigned int timeout)
+{
+	struct xfer_batch batch = { 0, 0 };
+	struct xfer_queue *seen;
+	struct xfer_slot *slots;
+	struct libusb_transfer *transfer;
+	struct timeval tv;
+	unsigned int wait;
+	unsigned int backoff;
+	size_t size;
+	int cancelled;
+	int error = 0;
+	int retry;
+	int ok = 0;
+	int ret;
+	int i;
+	int j;
+
+	if (!xfers || num < 0)
+		return LIBUSB_ERROR_INVALID_PARAM;
+
+	slots = calloc(num, sizeof(*slots));
+	seen = queue_alloc(num, &size);
+	if ((!slots && num) || !seen) {
+		free(slots);
+		free(seen);
+		return LIBUSB_ERROR_NO_MEM;
+	}
+
+	for (i = 0; i < num; i++) {
+		slots[i].xfer = &xfers[i];
+		slots[i].batch = &batch;
+		slots[i].retry = 1;
+		xfers[i].submit_ns = 0;
+		xfers[i].done_ns = 0;
+	}
+
+	for (;;) {
+		queue_positions(slots, num, seen, size);
+
+		/* prepare everything first to submit with as little skew as possible */
+		for (i = 0; i < num; i++)
+			if (slots[i].retry)
+				prepare(&slots[i], timeout);
+
+		for (i = 0; i < num; i++) {
+			transfer = slots[i].transfer;
+			if (!transfer)
+				continue;
+
+			slots[i].start = usb_stats_start();
+			xfers[i].submit_ns = now_ns();
+			ret = libusb_submit_transfer(transfer);
+			if (ret) {
+				libusb_free_transfer(transfer);
+				slots[i].transfer = NULL;
+				xfers[i].result = ret;
+				continue;
+			}
+
+			batch.pending++;
+		}
+
+		batch.completed = 0;
+		cancelled = 0;
+		while (batch.pending) {
+			if (cancelled) {
+				if (cancelled++ > CANCEL_TRIES)
+					break;
+
+				tv.tv_sec = 0;
+				tv.tv_usec = CANCEL_WAIT_MS * 1000;
+				libusb_handle_events_timeout_completed(ctx,
+					&tv, &batch.completed);
+				continue;
+			}
+
+			ret = libusb_handle_events_completed(ctx,
+				&batch.completed);
+			if (!ret || ret == LIBUSB_ERROR_INTERRUPTED)
+				continue;
+
+			/* event handling broke down, get the transfers back */
+			error = ret;
+			for (i = 0; i < num; i++)
+				if (slots[i].transfer)
+					libusb_cancel_transfer(
+						slots[i].transfer);
+			cancelled = 1;
+		}
+
+		/*
+		 * Transfers that did not come back in time fail, the callback
+		 * frees them should they complete later on.
+		 */
+		for (i = 0; i < num && batch.pending; i++) {
+			if (!slots[i].transfer)
+				continue;
+
+			slots[i].transfer->callback = xfer_abandoned;
+			slots[i].transfer = NULL;
+			xfers[i].result = error;
+			batch.pending--;
+		}
+
+		/* failed requests go again together after the longest backoff */
+		backoff = 0;
+		retry = 0;
+		for (i = 0; i < num; i++) {
+			if (!slots[i].retry)
+				continue;
+
+			wait = 0;
+			if (xfers[i].result < 0 && !cancelled)
+				wait = usb_policy_retry(xfers[i].result,
+					++slots[i].attempts);
+			slots[i].retry = wait != 0;
+			if (wait > backoff)
+				backoff = wait;
+			retry |= slots[i].retry;
+		}
+
+		if (!retry)
+			break;
+
+		/*
+		 * Requests after a failed one to the same device go again as
+		 * well, so that they still take effect in the order given.
+		 */
+		for (i = 0; i < num; i++) {
+			if (!slots[i].retry || xfers[i].result >= 0)
+				continue;
+
+			for (j = i + 1; j < num; j++)
+				if (xfers[j].handle == xfers[i].handle)
+					slots[j].retry = 1;
+		}
+
+		usleep(backoff * 1000);
+	}
+
+	for (i = 0; i < num; i++) {
+		if (xfers[i].result >= 0)
+			ok++;
+	}
+
+	free(seen);
+	free(slots);
+
+	return ok;
+}
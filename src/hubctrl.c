@@ -0,0 +1,649 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief libhubctrl, hub port and EEPROM control for embedding
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libusb.h>
+
+#include "hub_class.h"
+#include "hub_xfer.h"
+#include "hubctrl.h"
+#include "hubctrl_usb.h"
+#include "usb_eeprom.h"
+#include "usb_policy.h"
+#include "usb_stats.h"
+
+struct hubctrl_entry {
+	struct hubctrl_hub info;
+	libusb_device *dev;
+	libusb_device_handle *handle;
+	/* device node wrapped by hub_ctx_wrap(), -1 otherwise */
+	int fd;
+};
+
+struct hubctrl {
+	libusb_context *usb;
+	/* libusb context initialized by hubctrl_new(), not borrowed */
+	int own_usb;
+	struct hubctrl_entry *hubs;
+	int num_hubs;
+	int max_hubs;
+};
+
+static struct hubctrl_entry *get_entry(const struct hubctrl *ctx, int hub)
+{
+	if (!ctx || hub < 0 || hub >= ctx->num_hubs)
+		return NULL;
+
+	return &ctx->hubs[hub];
+}
+
+static void close_entry(struct hubctrl_entry *entry)
+{
+	if (!entry->handle)
+		return;
+
+	libusb_close(entry->handle);
+	entry->handle = NULL;
+
+	/* a wrapped device node is gone together with its handle */
+	if (entry->fd >= 0) {
+		close(entry->fd);
+		entry->fd = -1;
+	}
+}
+
+/* Append a hub, the entry holds a reference of the device */
+static struct hubctrl_entry *add_entry(struct hubctrl *ctx,
+	libusb_device *dev, const struct libusb_device_descriptor *desc,
+	int eeprom)
+{
+	struct hubctrl_entry *entry;
+	int max;
+
+	if (ctx->num_hubs == ctx->max_hubs) {
+		max = ctx->max_hubs ? ctx->max_hubs * 2 : 32;
+		entry = realloc(ctx->hubs, max * sizeof(*entry));
+		if (!entry)
+			return NULL;
+		ctx->hubs = entry;
+		ctx->max_hubs = max;
+	}
+
+	entry = &ctx->hubs[ctx->num_hubs++];
+	memset(entry, 0, sizeof(*entry));
+	entry->dev = libusb_ref_device(dev);
+	entry->fd = -1;
+	entry->info.busnum = libusb_get_bus_number(dev);
+	entry->info.devnum = libusb_get_device_address(dev);
+	entry->info.vendor = desc->idVendor;
+	entry->info.product = desc->idProduct;
+	entry->info.eeprom = eeprom > 0 && (eeprom & EEPROM_SUPPORT_STORAGE);
+	entry->info.pwr_good_ms = -1;
+	if (hub_class_port_path(dev, entry->info.path,
+			sizeof(entry->info.path)) < 0)
+		entry->info.path[0] = '\0';
+
+	return entry;
+}
+
+/* Fill in the port details, a blank EEPROM leaves a Cypress hub without */
+static int read_caps(struct hubctrl_entry *entry)
+{
+	struct hub_caps caps;
+	int ret;
+
+	ret = hub_class_read_caps(entry->handle, &caps);
+	if (ret)
+		return usb_eeprom_support(entry->dev) > 0 ? 0 : ret;
+
+	entry->info.nports = caps.nports;
+	entry->info.power_switching =
+		(caps.characteristics & HUB_CHAR_LPSM) < 2;
+	entry->info.per_port_power =
+		(caps.characteristics & HUB_CHAR_LPSM) == 1;
+	entry->info.indicators =
+		(caps.characteristics & HUB_CHAR_PORTIND) ? 1 : 0;
+	entry->info.pwr_good_ms = caps.pwr_good_ms;
+
+	return 0;
+}
+
+int hub_ctx_new(struct hubctrl **ctx, libusb_context *usb)
+{
+	struct hubctrl *new;
+
+	if (!ctx)
+		return -EINVAL;
+
+	new = calloc(1, sizeof(*new));
+	if (!new)
+		return -ENOMEM;
+
+	new->usb = usb;
+	*ctx = new;
+
+	return 0;
+}
+
+int hubctrl_new(struct hubctrl **ctx)
+{
+	libusb_context *usb;
+	int ret;
+
+	if (!ctx)
+		return -EINVAL;
+
+	ret = libusb_init(&usb);
+	if (ret)
+		return usb_policy_errno(ret);
+
+	ret = hub_ctx_new(ctx, usb);
+	if (ret) {
+		libusb_exit(usb);
+		return ret;
+	}
+	(*ctx)->own_usb = 1;
+
+	return 0;
+}
+
+void hubctrl_free(struct hubctrl *ctx)
+{
+	if (!ctx)
+		return;
+
+	hub_ctx_clear(ctx);
+	free(ctx->hubs);
+	if (ctx->own_usb)
+		libusb_exit(ctx->usb);
+	free(ctx);
+}
+
+void hub_ctx_clear(struct hubctrl *ctx)
+{
+	int i;
+
+	for (i = 0; ctx && i < ctx->num_hubs; i++) {
+		close_entry(&ctx->hubs[i]);
+		libusb_unref_device(ctx->hubs[i].dev);
+	}
+
+	if (ctx)
+		ctx->num_hubs = 0;
+}
+
+int hub_ctx_enumerate(struct hubctrl *ctx, hub_ctx_match match, void *data)
+{
+	struct libusb_device_descriptor desc;
+	libusb_device **devlist;
+	uint64_t start;
+	ssize_t num;
+	int eeprom;
+	int ret;
+	int i;
+
+	if (!ctx)
+		return -EINVAL;
+
+	hub_ctx_clear(ctx);
+
+	start = usb_stats_start();
+	num = libusb_get_device_list(ctx->usb, &devlist);
+	usb_stats_stop("get_device_list", start);
+	if (num < 0)
+		return usb_policy_errno(num);
+
+	ret = 0;
+	for (i = 0; i < num && !ret; i++) {
+		if (match && !match(devlist[i], data))
+			continue;
+
+		eeprom = hub_class_candidate(devlist[i], &desc);
+		if (eeprom >= 0 && !add_entry(ctx, devlist[i], &desc, eeprom))
+			ret = -ENOMEM;
+	}
+
+	libusb_free_device_list(devlist, 1);
+	if (ret) {
+		hub_ctx_clear(ctx);
+		return ret;
+	}
+
+	return ctx->num_hubs;
+}
+
+int hubctrl_enumerate(struct hubctrl *ctx)
+{
+	return hub_ctx_enumerate(ctx, NULL, NULL);
+}
+
+int hub_ctx_add(struct hubctrl *ctx, libusb_device *dev)
+{
+	struct libusb_device_descriptor desc;
+	int eeprom;
+
+	if (!ctx || !dev)
+		return -EINVAL;
+
+	eeprom = hub_class_candidate(dev, &desc);
+	if (eeprom < 0)
+		return -ENODEV;
+	if (!add_entry(ctx, dev, &desc, eeprom))
+		return -ENOMEM;
+
+	return ctx->num_hubs - 1;
+}
+
+int hub_ctx_wrap(struct hubctrl *ctx, int fd, int busnum, int devnum)
+{
+#ifdef HAVE_LIBUSB_WRAP_SYS_DEVICE
+	struct libusb_device_descriptor desc;
+	struct hubctrl_entry *entry;
+	libusb_device_handle *handle;
+	libusb_device *dev;
+	uint64_t start;
+	int ret;
+
+	if (!ctx) {
+		close(fd);
+		return -EINVAL;
+	}
+
+	start = usb_stats_start();
+	ret = libusb_wrap_sys_device(ctx->usb, fd, &handle);
+	usb_stats_stop("open", start);
+	if (ret) {
+		close(fd);
+		return ret == LIBUSB_ERROR_ACCESS ? -EACCES : -ENODEV;
+	}
+
+	dev = libusb_get_device(handle);
+	memset(&desc, 0, sizeof(desc));
+	libusb_get_device_descriptor(dev, &desc);
+	entry = add_entry(ctx, dev, &desc, usb_eeprom_support(dev));
+	if (!entry) {
+		libusb_close(handle);
+		close(fd);
+		return -ENOMEM;
+	}
+
+	entry->handle = handle;
+	entry->fd = fd;
+	entry->info.busnum = busnum;
+	entry->info.devnum = devnum;
+	/* libusb knows no port numbers of a wrapped device, only "usb<bus>" */
+	entry->info.path[0] = '\0';
+
+	if (read_caps(entry)) {
+		hub_ctx_remove(ctx, ctx->num_hubs - 1);
+		return -ENODEV;
+	}
+
+	return ctx->num_hubs - 1;
+#else
+	close(fd);
+	return -ENOSYS;
+#endif
+}
+
+void hub_ctx_remove(struct hubctrl *ctx, int hub)
+{
+	struct hubctrl_entry *entry = get_entry(ctx, hub);
+
+	if (!entry)
+		return;
+
+	close_entry(entry);
+	libusb_unref_device(entry->dev);
+
+	ctx->num_hubs--;
+	memmove(entry, entry + 1, (ctx->num_hubs - hub) * sizeof(*entry));
+}
+
+libusb_device *hub_ctx_device(const struct hubctrl *ctx, int hub)
+{
+	struct hubctrl_entry *entry = get_entry(ctx, hub);
+
+	return entry ? entry->dev : NULL;
+}
+
+libusb_device_handle *hub_ctx_handle(const struct hubctrl *ctx, int hub)
+{
+	struct hubctrl_entry *entry = get_entry(ctx, hub);
+
+	return entry ? entry->handle : NULL;
+}
+
+int hubctrl_count(const struct hubctrl *ctx)
+{
+	return ctx ? ctx->num_hubs : 0;
+}
+
+int hubctrl_info(const struct hubctrl *ctx, int hub, struct hubctrl_hub *info)
+{
+	struct hubctrl_entry *entry = get_entry(ctx, hub);
+
+	if (!entry)
+		return -ENODEV;
+	if (!info)
+		return -EINVAL;
+
+	*info = entry->info;
+
+	return 0;
+}
+
+int hubctrl_find(const struct hubctrl *ctx, int busnum, int devnum)
+{
+	int i;
+
+	for (i = 0; ctx && i < ctx->num_hubs; i++)
+		if (ctx->hubs[i].info.busnum == busnum &&
+				ctx->hubs[i].info.devnum == devnum)
+			return i;
+
+	return -ENODEV;
+}
+
+int hubctrl_find_path(const struct hubctrl *ctx, const char *path)
+{
+	int i;
+
+	for (i = 0; ctx && path && path[0] && i < ctx->num_hubs; i++)
+		if (!strcmp(ctx->hubs[i].info.path, path))
+			return i;
+
+	return -ENODEV;
+}
+
+int hubctrl_open(struct hubctrl *ctx, int hub)
+{
+	struct hubctrl_entry *entry = get_entry(ctx, hub);
+	uint64_t start;
+	int ret;
+
+	if (!entry)
+		return -ENODEV;
+	if (entry->handle)
+		return 0;
+
+	start = usb_stats_start();
+	ret = libusb_open(entry->dev, &entry->handle);
+	usb_stats_stop("open", start);
+	if (ret) {
+		entry->handle = NULL;
+		return usb_policy_errno(ret);
+	}
+
+	ret = read_caps(entry);
+	if (ret)
+		close_entry(entry);
+
+	return ret;
+}
+
+void hubctrl_close(struct hubctrl *ctx, int hub)
+{
+	struct hubctrl_entry *entry = get_entry(ctx, hub);
+
+	if (entry)
+		close_entry(entry);
+}
+
+/* Open the hub of a request and check the request */
+static int check_request(struct hubctrl *ctx,
+	const struct hubctrl_port_req *req)
+{
+	int ret;
+
+	ret = hubctrl_open(ctx, req->hub);
+	if (ret)
+		return ret;
+
+	if (req->port < 1 || req->port > ctx->hubs[req->hub].info.nports)
+		return -EINVAL;
+
+	switch (req->op) {
+	case HUBCTRL_OP_POWER:
+	case HUBCTRL_OP_INDICATOR:
+	case HUBCTRL_OP_STATUS:
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+static void fill_xfer(struct hubctrl *ctx, const struct hubctrl_port_req *req,
+	struct hub_xfer *xfer, uint8_t *status)
+{
+	libusb_device_handle *handle = ctx->hubs[req->hub].handle;
+
+	if (req->op == HUBCTRL_OP_STATUS)
+		hub_class_port_status(xfer, handle, req->port, status);
+	else
+		hub_class_port_feature(xfer, handle, req->port,
+			req->op == HUBCTRL_OP_POWER ? USB_PORT_FEAT_POWER :
+				USB_PORT_FEAT_INDICATOR, req->value);
+}
+
+int hubctrl_batch(struct hubctrl *ctx, struct hubctrl_port_req *reqs,
+	int num)
+{
+	uint8_t (*status)[USB_STATUS_SIZE];
+	struct hub_xfer *xfers;
+	struct hub_xfer *xfer;
+	int *per_hub;
+	int *round;
+	int *pos;
+	int total = 0;
+	int ret;
+	int i;
+
+	if (!ctx || (!reqs && num) || num < 0)
+		return -EINVAL;
+	if (!num)
+		return 0;
+
+	xfers = calloc(num, sizeof(*xfers));
+	status = calloc(num, sizeof(*status));
+	pos = calloc(num, sizeof(*pos));
+	round = calloc(num + 1, sizeof(*round));
+	per_hub = calloc(ctx->num_hubs, sizeof(*per_hub));
+	if (!xfers || !status || !pos || !round ||
+			(!per_hub && ctx->num_hubs)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < num; i++) {
+		reqs[i].submit_ns = 0;
+		reqs[i].done_ns = 0;
+		reqs[i].result = check_request(ctx, &reqs[i]);
+		if (reqs[i].result) {
+			pos[i] = -1;
+			continue;
+		}
+
+		pos[i] = per_hub[reqs[i].hub]++;
+		round[pos[i] + 1]++;
+		total++;
+	}
+
+	/*
+	 * The n-th request to each hub goes into round n, so the first request
+	 * to every hub is submitted before any second one and the hubs switch
+	 * as close together as possible. Within a hub the order stays as given.
+	 */
+	for (i = 1; i <= num; i++)
+		round[i] += round[i - 1];
+	for (i = 0; i < num; i++)
+		if (pos[i] >= 0)
+			pos[i] = round[pos[i]]++;
+
+	for (i = 0; i < num; i++)
+		if (pos[i] >= 0)
+			fill_xfer(ctx, &reqs[i], &xfers[pos[i]],
+				status[pos[i]]);
+
+	ret = hub_xfer_run(ctx->usb, xfers, total, CTRL_TIMEOUT);
+	if (ret < 0) {
+		ret = usb_policy_errno(ret);
+		goto out;
+	}
+
+	ret = 0;
+	for (i = 0; i < num; i++) {
+		if (pos[i] < 0)
+			continue;
+
+		xfer = &xfers[pos[i]];
+		reqs[i].submit_ns = xfer->submit_ns;
+		reqs[i].done_ns = xfer->done_ns;
+		if (xfer->result < 0) {
+			reqs[i].result = usb_policy_errno(xfer->result);
+		} else if (reqs[i].op == HUBCTRL_OP_STATUS &&
+				xfer->result < USB_STATUS_SIZE) {
+			reqs[i].result = -EPROTO;
+		} else {
+			reqs[i].status = status[pos[i]][0] |
+				status[pos[i]][1] << 8;
+			reqs[i].change = status[pos[i]][2] |
+				status[pos[i]][3] << 8;
+			ret++;
+		}
+	}
+
+out:
+	free(per_hub);
+	free(round);
+	free(pos);
+	free(status);
+	free(xfers);
+
+	return ret;
+}
+
+static int port_request(struct hubctrl *ctx, struct hubctrl_port_req *req)
+{
+	int ret;
+
+	ret = hubctrl_batch(ctx, req, 1);
+	if (ret < 0)
+		return ret;
+
+	return req->result;
+}
+
+int hubctrl_set_power(struct hubctrl *ctx, int hub, int port, int on)
+{
+	struct hubctrl_port_req req = {
+		.hub = hub,
+		.port = port,
+		.op = HUBCTRL_OP_POWER,
+		.value = on ? 1 : 0,
+	};
+
+	return port_request(ctx, &req);
+}
+
+int hubctrl_set_indicator(struct hubctrl *ctx, int hub, int port, int value)
+{
+	struct hubctrl_port_req req = {
+		.hub = hub,
+		.port = port,
+		.op = HUBCTRL_OP_INDICATOR,
+		.value = value,
+	};
+
+	if (value < 0 || value > 3)
+		return -EINVAL;
+
+	return port_request(ctx, &req);
+}
+
+int hubctrl_get_status(struct hubctrl *ctx, int hub, int port,
+	uint16_t *status, uint16_t *change)
+{
+	struct hubctrl_port_req req = {
+		.hub = hub,
+		.port = port,
+		.op = HUBCTRL_OP_STATUS,
+	};
+	int ret;
+
+	if (!status)
+		return -EINVAL;
+
+	ret = port_request(ctx, &req);
+	if (ret)
+		return ret;
+
+	*status = req.status;
+	if (change)
+		*change = req.change;
+
+	return 0;
+}
+
+/* Open a hub for EEPROM access, which only Cypress hubs support */
+static int eeprom_open(struct hubctrl *ctx, int hub)
+{
+	struct hubctrl_entry *entry = get_entry(ctx, hub);
+
+	if (!entry)
+		return -ENODEV;
+	if (!entry->info.eeprom)
+		return -ENOTSUP;
+
+	return hubctrl_open(ctx, hub);
+}
+
+int hubctrl_eeprom_read(struct hubctrl *ctx, int hub, uint8_t *buffer,
+	size_t size)
+{
+	int ret;
+
+	ret = eeprom_open(ctx, hub);
+	if (ret)
+		return ret;
+
+	return usb_eeprom_read(ctx->hubs[hub].handle, buffer, size);
+}
+
+int hubctrl_eeprom_write(struct hubctrl *ctx, int hub, uint8_t *buffer,
+	size_t size, int update)
+{
+	int ret;
+
+	ret = eeprom_open(ctx, hub);
+	if (ret)
+		return ret;
+
+	if (update)
+		return usb_eeprom_update(ctx->hubs[hub].handle, buffer, size);
+
+	return usb_eeprom_write(ctx->hubs[hub].handle, buffer, size);
+}
+
+int hubctrl_eeprom_erase(struct hubctrl *ctx, int hub, size_t size)
+{
+	int ret;
+
+	ret = eeprom_open(ctx, hub);
+	if (ret)
+		return ret;
+
+	return usb_eeprom_erase(ctx->hubs[hub].handle, size);
+}
@@ -0,0 +1,40 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "usb_devnode.h"
+
+int usb_devnode_path(char *buf, size_t size, const char *root, int busnum,
+	int devnum)
+{
+	int len;
+
+	if (!buf || !root || busnum < 1 || busnum > 999 || devnum < 1 ||
+			devnum > 999)
+		return -EINVAL;
+
+	len = snprintf(buf, size, "%s/%03d/%03d", root, busnum, devnum);
+	if (len < 0 || len >= size)
+		return -ENAMETOOLONG;
+
+	return len;
+}
+
+int usb_devnode_open(const char *root, int busnum, int devnum)
+{
+	char path[PATH_MAX];
+	int ret;
+	int fd;
+
+	ret = usb_devnode_path(path, sizeof(path), root, busnum, devnum);
+	if (ret < 0)
+		return ret;
+
+	fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	return fd;
+}
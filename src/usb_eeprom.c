@@ -3,39 +3,285 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <unistd.h>
 #include <libusb.h>
 
 #include "usb_eeprom.h"
+#include "usb_policy.h"
+#include "usb_stats.h"
 
 #define CYPRESS_HUB_VID		0x04b4
 #define CYPRESS_HUB_PID		0x6560
 
+/*
+ * The maximal write cycle time of the EEPROM is 5 ms, specified in the
+ * 25AA640/25LC640 datasheet, plus some margin.
+ */
+#define WRITE_CYCLE_US		5500
+/* read back at this interval, give up polling after the limit */
+#define POLL_INTERVAL_US	250
+#define POLL_LIMIT_US		(4 * WRITE_CYCLE_US)
+
+static enum eeprom_wait write_wait = EEPROM_WAIT_SLEEP;
+static usb_eeprom_progress progress_cb;
+static void *progress_data;
+
+void usb_eeprom_set_wait(enum eeprom_wait wait)
+{
+	write_wait = wait;
+}
+
+enum eeprom_wait usb_eeprom_get_wait(void)
+{
+	return write_wait;
+}
+
+void usb_eeprom_set_progress(usb_eeprom_progress progress, void *data)
+{
+	progress_cb = progress;
+	progress_data = data;
+}
+
+/* wait long enough for any write to finish */
+static void sleep_write(void)
+{
+	uint64_t start;
+
+	start = usb_stats_start();
+	usleep(WRITE_CYCLE_US);
+	usb_stats_stop("write delay", start);
+}
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/*
+ * Read back the last page written until it holds the new data. A busy
+ * 25AA640 reads as 0xff, so a page of 0xff tells nothing and gets the
+ * fixed sleep instead.
+ */
+static int poll_write(libusb_device_handle *dev, uint16_t offset,
+	const uint8_t *buffer, size_t size)
+{
+	uint8_t page[EEPROM_PAGE_SIZE];
+	size_t len = size < EEPROM_PAGE_SIZE ? size : EEPROM_PAGE_SIZE;
+	size_t tail = size - len;
+	uint64_t start = now_us();
+	uint64_t limit = start + POLL_LIMIT_US;
+	uint64_t stats = usb_stats_start();
+	unsigned int timeout;
+	int remaining;
+	uint64_t now;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < len && buffer[tail + i] == 0xff; i++)
+		;
+	if (i == len) {
+		sleep_write();
+		return 0;
+	}
+
+	remaining = usb_policy_remaining();
+	if (remaining >= 0 && start + remaining * 1000ULL < limit)
+		limit = start + remaining * 1000ULL;
+
+	for (;;) {
+		/* a read the hub does not answer must not outlast the limit */
+		now = now_us();
+		timeout = now < limit ? (limit - now + 999) / 1000 : 0;
+		if (timeout > GET_TIMEOUT(len))
+			timeout = GET_TIMEOUT(len);
+		if (!timeout)
+			return -ETIMEDOUT;
+
+		ret = usb_policy_control(dev, USB_REQ_TYPE_READ_EEPROM,
+			USB_REQ_READ, 0, offset + tail, page, len, timeout);
+		if (ret == (int)len && !memcmp(page, buffer + tail, len))
+			break;
+
+		if (now_us() >= limit)
+			return -ETIMEDOUT;
+		usleep(POLL_INTERVAL_US);
+	}
+
+	usb_stats_stop("write cycle", stats);
+
+	return 0;
+}
+
 int usb_eeprom_erase(libusb_device_handle *dev, size_t size)
 {
-	uint8_t *erase_buf;
-	int ret_val = 0;
+	return usb_eeprom_erase_at(dev, 0, size);
+}
+
+int usb_eeprom_read(libusb_device_handle *dev, uint8_t *buffer, size_t size)
+{
+	return usb_eeprom_read_at(dev, 0, buffer, size);
+}
+
+/*
+ * Nothing tells whether the hub waits for the write cycle of the last page
+ * before it takes the next request, so each request waits for it here.
+ */
+static int eeprom_write_at(libusb_device_handle *dev, uint16_t offset,
+	uint8_t *buffer, size_t size)
+{
+	int len;
+	int ret;
+
+	len = usb_policy_control(dev, USB_REQ_TYPE_WRITE_EEPROM,
+		USB_REQ_WRITE, 0, offset, buffer, size, GET_TIMEOUT(size));
+	if (len < 0)
+		return usb_policy_errno(len);
+
+	switch (write_wait) {
+	case EEPROM_WAIT_POLL:
+		ret = poll_write(dev, offset, buffer, len);
+		if (ret)
+			return ret;
+		break;
+
+	case EEPROM_WAIT_NONE:
+		break;
+
+	default:
+		sleep_write();
+		break;
+	}
+
+	return len;
+}
+
+int usb_eeprom_write(libusb_device_handle *dev, uint8_t *buffer, size_t size)
+{
+	return usb_eeprom_write_at(dev, 0, buffer, size);
+}
 
+static int check_region(libusb_device_handle *dev, size_t offset,
+	size_t size)
+{
 	if (!dev || !size)
 		return -EINVAL;
-	if (size > MAX_EEPROM_SIZE)
+	if (offset >= MAX_EEPROM_SIZE || size > MAX_EEPROM_SIZE - offset)
 		return -ERANGE;
 
+	return 0;
+}
+
+/* Length of the chunk at offset, up to the next chunk boundary */
+static size_t chunk_len(size_t offset, size_t end)
+{
+	size_t len = EEPROM_CHUNK_SIZE - offset % EEPROM_CHUNK_SIZE;
+
+	return len < end - offset ? len : end - offset;
+}
+
+int usb_eeprom_read_at(libusb_device_handle *dev, size_t offset,
+	uint8_t *buffer, size_t size)
+{
+	size_t done;
+	size_t len;
+	int ret;
+
+	ret = check_region(dev, offset, size);
+	if (ret)
+		return ret;
+	if (!buffer)
+		return -EINVAL;
+
+	for (done = 0; done < size; done += len) {
+		len = chunk_len(offset + done, offset + size);
+		ret = usb_policy_control(dev, USB_REQ_TYPE_READ_EEPROM,
+			USB_REQ_READ, 0, offset + done, buffer + done, len,
+			GET_TIMEOUT(len));
+		if (ret < 0)
+			return usb_policy_errno(ret);
+		if (ret != len)
+			return done + ret;
+		if (progress_cb && progress_cb(progress_data, offset + done,
+				len))
+			return -ECANCELED;
+	}
+
+	return done;
+}
+
+int usb_eeprom_write_at(libusb_device_handle *dev, size_t offset,
+	uint8_t *buffer, size_t size)
+{
+	size_t done;
+	size_t len;
+	int ret;
+
+	ret = check_region(dev, offset, size);
+	if (ret)
+		return ret;
+	if (!buffer)
+		return -EINVAL;
+
+	for (done = 0; done < size; done += len) {
+		len = chunk_len(offset + done, offset + size);
+		ret = eeprom_write_at(dev, offset + done, buffer + done, len);
+		if (ret < 0)
+			return ret;
+		if (ret != len)
+			return done + ret;
+		if (progress_cb && progress_cb(progress_data, offset + done,
+				len))
+			return -ECANCELED;
+	}
+
+	return done;
+}
+
+int usb_eeprom_erase_at(libusb_device_handle *dev, size_t offset,
+	size_t size)
+{
+	uint8_t *erase_buf;
+	int ret;
+
+	ret = check_region(dev, offset, size);
+	if (ret)
+		return ret;
+
 	erase_buf = malloc(size);
 	if (!erase_buf)
 		return -ENOMEM;
 	memset(erase_buf, 0xff, size);
 
-	ret_val = usb_eeprom_write(dev, erase_buf, size);
+	ret = usb_eeprom_write_at(dev, offset, erase_buf, size);
 
 	free(erase_buf);
 
-	return ret_val;
+	return ret;
 }
 
-int usb_eeprom_read(libusb_device_handle *dev, uint8_t *buffer, size_t size)
+static int page_differs(const uint8_t *a, const uint8_t *b, size_t offset,
+	size_t size)
 {
+	size_t len = size - offset;
+
+	if (len > EEPROM_PAGE_SIZE)
+		len = EEPROM_PAGE_SIZE;
+
+	return memcmp(a + offset, b + offset, len) != 0;
+}
+
+int usb_eeprom_update(libusb_device_handle *dev, uint8_t *buffer, size_t size)
+{
+	uint8_t *current;
+	size_t written = 0;
+	size_t start;
+	size_t end;
 	int len;
 
 	if (!buffer || !dev || !size)
@@ -43,32 +289,104 @@ int usb_eeprom_read(libusb_device_handle *dev, uint8_t *buffer, size_t size)
 	if (size > MAX_EEPROM_SIZE)
 		return -ERANGE;
 
-	len = libusb_control_transfer(dev, USB_REQ_TYPE_READ_EEPROM,
-		USB_REQ_READ, 0, 0, buffer, size, GET_TIMEOUT(size));
+	current = malloc(size);
+	if (!current)
+		return -ENOMEM;
+
+	len = usb_eeprom_read(dev, current, size);
+	if (len != size) {
+		free(current);
+		return len < 0 ? len : -EIO;
+	}
 
-	return len;
+	for (start = 0; start < size; start = end) {
+		end = start + EEPROM_PAGE_SIZE;
+		if (!page_differs(buffer, current, start, size))
+			continue;
+
+		/* merge consecutive changed pages, written in chunks */
+		while (end < size && page_differs(buffer, current, end, size))
+			end += EEPROM_PAGE_SIZE;
+		if (end > size)
+			end = size;
+
+		len = usb_eeprom_write_at(dev, start, buffer + start,
+			end - start);
+		if (len != end - start) {
+			free(current);
+			return len < 0 ? len : -EIO;
+		}
+		written += len;
+	}
+
+	free(current);
+
+	return written;
 }
 
-int usb_eeprom_write(libusb_device_handle *dev, uint8_t *buffer, size_t size)
+int usb_eeprom_program(libusb_device_handle *dev, uint8_t *buffer, int len,
+	int update)
 {
-	int len;
+	const char *phase = usb_stats_get_phase();
+	uint8_t *cmp_buffer;
+	int written;
+	int ret_val;
 
-	if (!buffer || !dev || !size)
-		return -EINVAL;
-	if (size > MAX_EEPROM_SIZE)
-		return -ERANGE;
+	if (update) {
+		written = usb_eeprom_update(dev, buffer, len);
+		if (written <= 0)
+			return written;
+	} else {
+		written = usb_eeprom_write(dev, buffer, len);
+		if (written != len)
+			return written < 0 ? written : -EIO;
+	}
+
+	cmp_buffer = malloc(len);
+	if (!cmp_buffer)
+		return -ENOMEM;
 
-	len = libusb_control_transfer(dev, USB_REQ_TYPE_WRITE_EEPROM,
-		USB_REQ_WRITE, 0, 0, buffer, size, GET_TIMEOUT(size));
+	usb_stats_phase("verify");
+	ret_val = usb_eeprom_read(dev, cmp_buffer, len);
+	usb_stats_phase(phase);
+	if (ret_val != len)
+		ret_val = ret_val < 0 ? ret_val : -EIO;
+	else if (memcmp(buffer, cmp_buffer, len) != 0)
+		ret_val = -EBADMSG;
+	else
+		ret_val = written;
 
-	/*
-	 * Sleep for more than 5 ms to guarantee EEPROM data is written.
-	 * This is the maximal write cycle time of the EEPROM, specified
-	 * in the 25AA640/25LC640 datasheet.
-	 */
-	usleep(5500);
+	free(cmp_buffer);
 
-	return len;
+	return ret_val;
+}
+
+int usb_eeprom_patch(libusb_device_handle *dev, size_t offset,
+	uint8_t *buffer, int len)
+{
+	const char *phase = usb_stats_get_phase();
+	uint8_t *cmp_buffer;
+	int ret_val;
+
+	ret_val = usb_eeprom_write_at(dev, offset, buffer, len);
+	if (ret_val != len)
+		return ret_val < 0 ? ret_val : -EIO;
+
+	cmp_buffer = malloc(len);
+	if (!cmp_buffer)
+		return -ENOMEM;
+
+	usb_stats_phase("verify");
+	ret_val = usb_eeprom_read_at(dev, offset, cmp_buffer, len);
+	usb_stats_phase(phase);
+	if (ret_val != len)
+		ret_val = ret_val < 0 ? ret_val : -EIO;
+	else if (memcmp(buffer, cmp_buffer, len) != 0)
+		ret_val = -EBADMSG;
+
+	free(cmp_buffer);
+
+	return ret_val;
 }
 
 int usb_eeprom_support(libusb_device *dev)
@@ -0,0 +1,399 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Timeouts, retries and deadline of USB control transfers
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libusb.h>
+
+#include "usb_policy.h"
+#include "usb_stats.h"
+
+/* latency per 256 byte unit in us, bucket n holds [2^n, 2^(n+1)) */
+#define LATENCY_BUCKETS		32
+/* most attempts of a request that stalls */
+#define STALL_ATTEMPTS		2
+
+struct latency {
+	/* bus and port path of the device, see device_key() */
+	uint64_t key;
+	const char *request;
+	unsigned long count;
+	uint32_t buckets[LATENCY_BUCKETS];
+};
+
+static const struct usb_policy default_policy = {
+	.attempts = 1,
+	.backoff_ms = 0,
+	.timeout_factor = 0,
+	.min_timeout_ms = 0,
+	.min_samples = 0,
+};
+
+static pthread_mutex_t policy_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct usb_policy policy = {
+	.attempts = 1,
+};
+static uint64_t deadline_ns;
+/* open addressing hash table, at most half full */
+static struct latency *table;
+static size_t table_size;
+static size_t table_used;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int units_of(uint16_t length)
+{
+	return 1 + length / 256;
+}
+
+/*
+ * Latencies belong to the place of a device on the bus, its bus number and
+ * port path, not to a libusb_device which is freed once unplugged. A hub
+ * plugged in again at the same place continues its statistics. The bus
+ * number takes the top byte, the ports of the path the following ones, at
+ * most 7 deep as in USB. Without a port path, as for a device wrapped from
+ * a file descriptor, the device number in the low byte stands in for it.
+ */
+static uint64_t device_key(libusb_device_handle *handle)
+{
+	libusb_device *dev = libusb_get_device(handle);
+	uint8_t ports[7];
+	uint64_t key;
+	int num;
+	int i;
+
+	if (!dev)
+		return 0;
+
+	key = (uint64_t)libusb_get_bus_number(dev) << 56;
+	num = libusb_get_port_numbers(dev, ports, sizeof(ports));
+	if (num <= 0)
+		return key | libusb_get_device_address(dev);
+
+	for (i = 0; i < num; i++)
+		key |= (uint64_t)ports[i] << (48 - 8 * i);
+
+	return key;
+}
+
+static size_t hash_key(uint64_t dev, const char *request)
+{
+	uint64_t key = dev ^ ((uint64_t)(uintptr_t)request << 17);
+
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+
+	return key;
+}
+
+static struct latency *find_slot(struct latency *slots, size_t size,
+	uint64_t dev, const char *request)
+{
+	size_t i = hash_key(dev, request) & (size - 1);
+
+	while (slots[i].request && (slots[i].key != dev ||
+			slots[i].request != request))
+		i = (i + 1) & (size - 1);
+
+	return &slots[i];
+}
+
+static int grow_table(void)
+{
+	struct latency *slots;
+	size_t size = table_size ? table_size * 2 : 64;
+	size_t i;
+
+	slots = calloc(size, sizeof(*slots));
+	if (!slots)
+		return -ENOMEM;
+
+	for (i = 0; i < table_size; i++)
+		if (table[i].request)
+			*find_slot(slots, size, table[i].key,
+				table[i].request) = table[i];
+
+	free(table);
+	table = slots;
+	table_size = size;
+
+	return 0;
+}
+
+/* Entry of a device and request, created if asked for, under policy_lock */
+static struct latency *get_latency(libusb_device_handle *handle,
+	uint8_t request_type, uint8_t request, int create)
+{
+	const char *name = usb_stats_request_name(request_type, request);
+	uint64_t dev = device_key(handle);
+	struct latency *entry;
+
+	if (!table_size && (!create || grow_table()))
+		return NULL;
+
+	entry = find_slot(table, table_size, dev, name);
+	if (entry->request || !create)
+		return entry->request ? entry : NULL;
+
+	if (2 * (table_used + 1) > table_size) {
+		if (grow_table())
+			return NULL;
+		entry = find_slot(table, table_size, dev, name);
+	}
+
+	entry->key = dev;
+	entry->request = name;
+	table_used++;
+
+	return entry;
+}
+
+/*
+ * A stall may be a transient protocol error, but just as well a request the
+ * device rejects for good, so it is retried once only.
+ */
+static int retryable(int error, unsigned int attempt)
+{
+	switch (error) {
+	case LIBUSB_ERROR_IO:
+	case LIBUSB_ERROR_TIMEOUT:
+	case LIBUSB_ERROR_BUSY:
+	case LIBUSB_ERROR_OVERFLOW:
+	case LIBUSB_ERROR_INTERRUPTED:
+		return 1;
+	case LIBUSB_ERROR_PIPE:
+		return attempt < STALL_ATTEMPTS;
+	default:
+		return 0;
+	}
+}
+
+void usb_policy_set(const struct usb_policy *new)
+{
+	pthread_mutex_lock(&policy_lock);
+	policy = new ? *new : default_policy;
+	if (!policy.attempts)
+		policy.attempts = 1;
+	pthread_mutex_unlock(&policy_lock);
+}
+
+void usb_policy_get(struct usb_policy *current)
+{
+	pthread_mutex_lock(&policy_lock);
+	*current = policy;
+	pthread_mutex_unlock(&policy_lock);
+}
+
+void usb_policy_deadline(unsigned int ms)
+{
+	pthread_mutex_lock(&policy_lock);
+	deadline_ns = ms ? now_ns() + ms * 1000000ULL : 0;
+	pthread_mutex_unlock(&policy_lock);
+}
+
+int usb_policy_remaining(void)
+{
+	uint64_t deadline;
+	uint64_t now;
+
+	pthread_mutex_lock(&policy_lock);
+	deadline = deadline_ns;
+	pthread_mutex_unlock(&policy_lock);
+
+	if (!deadline)
+		return -1;
+
+	now = now_ns();
+	if (now >= deadline)
+		return 0;
+
+	/* round up, less than a ms left still counts */
+	return (deadline - now + 999999) / 1000000;
+}
+
+unsigned int usb_policy_timeout(libusb_device_handle *dev,
+	uint8_t request_type, uint8_t request, uint16_t length,
+	unsigned int timeout)
+{
+	struct latency *entry;
+	unsigned long seen = 0;
+	unsigned long rank;
+	uint64_t p99_us;
+	uint64_t adaptive;
+	int remaining;
+	int i;
+
+	pthread_mutex_lock(&policy_lock);
+
+	entry = policy.timeout_factor ?
+		get_latency(dev, request_type, request, 0) : NULL;
+	if (entry && entry->count >= policy.min_samples && entry->count) {
+		rank = (entry->count * 99 + 99) / 100;
+		for (i = 0; i < LATENCY_BUCKETS - 1; i++) {
+			seen += entry->buckets[i];
+			if (seen >= rank)
+				break;
+		}
+
+		/* upper end of the bucket */
+		p99_us = 2ULL << i;
+		adaptive = (p99_us * units_of(length) *
+			policy.timeout_factor + 999) / 1000;
+		if (adaptive < policy.min_timeout_ms)
+			adaptive = policy.min_timeout_ms;
+		if (adaptive < timeout)
+			timeout = adaptive;
+	}
+
+	pthread_mutex_unlock(&policy_lock);
+
+	remaining = usb_policy_remaining();
+	if (remaining >= 0 && remaining < timeout)
+		timeout = remaining;
+
+	return timeout;
+}
+
+void usb_policy_record(libusb_device_handle *dev, uint8_t request_type,
+	uint8_t request, uint16_t length, uint64_t ns)
+{
+	struct latency *entry;
+	uint64_t us;
+	int bucket;
+
+	us = ns / 1000 / units_of(length);
+	bucket = us > 1 ? 63 - __builtin_clzll(us) : 0;
+	if (bucket >= LATENCY_BUCKETS)
+		bucket = LATENCY_BUCKETS - 1;
+
+	pthread_mutex_lock(&policy_lock);
+
+	entry = get_latency(dev, request_type, request, 1);
+	if (entry) {
+		entry->count++;
+		entry->buckets[bucket]++;
+	}
+
+	pthread_mutex_unlock(&policy_lock);
+}
+
+unsigned int usb_policy_retry(int error, unsigned int attempt)
+{
+	unsigned int wait;
+	int remaining;
+
+	if (!retryable(error, attempt))
+		return 0;
+
+	pthread_mutex_lock(&policy_lock);
+	wait = attempt < policy.attempts ?
+		policy.backoff_ms << (attempt - 1) : 0;
+	if (attempt < policy.attempts && !wait)
+		wait = 1;
+	pthread_mutex_unlock(&policy_lock);
+
+	remaining = usb_policy_remaining();
+	if (remaining >= 0 && remaining <= wait)
+		return 0;
+
+	return wait;
+}
+
+int usb_policy_control(libusb_device_handle *dev, uint8_t request_type,
+	uint8_t request, uint16_t value, uint16_t index, unsigned char *data,
+	uint16_t length, unsigned int timeout)
+{
+	const char *name = usb_stats_request_name(request_type, request);
+	unsigned int attempt;
+	unsigned int wait;
+	uint64_t start;
+	uint64_t begin;
+	int ret;
+
+	for (attempt = 1;; attempt++) {
+		wait = usb_policy_timeout(dev, request_type, request, length,
+			timeout);
+		if (!wait)
+			return LIBUSB_ERROR_TIMEOUT;
+
+		start = usb_stats_start();
+		begin = now_ns();
+		ret = libusb_control_transfer(dev, request_type, request,
+			value, index, data, length, wait);
+		if (ret >= 0)
+			usb_policy_record(dev, request_type, request, length,
+				now_ns() - begin);
+		usb_stats_stop(name, start);
+		if (ret >= 0)
+			return ret;
+
+		wait = usb_policy_retry(ret, attempt);
+		if (!wait)
+			return ret;
+
+		usleep(wait * 1000);
+	}
+}
+
+int usb_policy_errno(int error)
+{
+	switch (error) {
+	case LIBUSB_ERROR_IO:
+	case LIBUSB_ERROR_OTHER:
+		return -EIO;
+	case LIBUSB_ERROR_INVALID_PARAM:
+		return -EINVAL;
+	case LIBUSB_ERROR_ACCESS:
+		return -EACCES;
+	case LIBUSB_ERROR_NO_DEVICE:
+		return -ENODEV;
+	case LIBUSB_ERROR_NOT_FOUND:
+		return -ENOENT;
+	case LIBUSB_ERROR_BUSY:
+		return -EBUSY;
+	case LIBUSB_ERROR_TIMEOUT:
+		return -ETIMEDOUT;
+	case LIBUSB_ERROR_OVERFLOW:
+		return -EOVERFLOW;
+	case LIBUSB_ERROR_PIPE:
+		return -EPIPE;
+	case LIBUSB_ERROR_INTERRUPTED:
+		return -EINTR;
+	case LIBUSB_ERROR_NO_MEM:
+		return -ENOMEM;
+	case LIBUSB_ERROR_NOT_SUPPORTED:
+		return -ENOTSUP;
+	default:
+		return error;
+	}
+}
+
+void usb_policy_reset(void)
+{
+	pthread_mutex_lock(&policy_lock);
+	free(table);
+	table = NULL;
+	table_size = 0;
+	table_used = 0;
+	pthread_mutex_unlock(&policy_lock);
+}
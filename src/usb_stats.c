@@ -0,0 +1,277 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Latency statistics of USB requests
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libusb.h>
+
+#include "usb_eeprom.h"
+#include "usb_stats.h"
+
+/*
+ * Latencies in us below 16 get a bucket each, above that every power of two
+ * is split into eight buckets. The last bucket takes everything from
+ * 2^31 us on.
+ */
+#define LINEAR_BUCKETS		16
+#define SUB_BUCKET_BITS		3
+#define SUB_BUCKETS		(1 << SUB_BUCKET_BITS)
+#define MAX_EXPONENT		31
+#define NUM_BUCKETS		(LINEAR_BUCKETS + \
+				 (MAX_EXPONENT - 3) * SUB_BUCKETS)
+
+struct stats_entry {
+	const char *phase;
+	const char *request;
+	unsigned long count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint32_t buckets[NUM_BUCKETS];
+};
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stats_entry *entries;
+static int num_entries;
+static int stats_enabled;
+static __thread const char *current_phase;
+
+static int bucket_of(uint64_t us)
+{
+	int exp;
+
+	if (us < LINEAR_BUCKETS)
+		return us;
+
+	exp = 63 - __builtin_clzll(us);
+	if (exp > MAX_EXPONENT)
+		return NUM_BUCKETS - 1;
+
+	return LINEAR_BUCKETS + (exp - 4) * SUB_BUCKETS +
+		((us >> (exp - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/* middle of a bucket in us */
+static uint64_t bucket_value(int bucket)
+{
+	int exp;
+	int sub;
+
+	if (bucket < LINEAR_BUCKETS)
+		return bucket;
+
+	exp = (bucket - LINEAR_BUCKETS) / SUB_BUCKETS + 4;
+	sub = (bucket - LINEAR_BUCKETS) % SUB_BUCKETS;
+
+	return ((uint64_t)(SUB_BUCKETS + sub) << (exp - SUB_BUCKET_BITS)) +
+		((uint64_t)1 << (exp - SUB_BUCKET_BITS - 1));
+}
+
+static uint64_t percentile(const struct stats_entry *entry, int percent)
+{
+	unsigned long rank;
+	unsigned long seen = 0;
+	uint64_t ns;
+	int i;
+
+	if (!entry->count)
+		return 0;
+
+	rank = (entry->count * percent + 99) / 100;
+	for (i = 0; i < NUM_BUCKETS; i++) {
+		seen += entry->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+
+	ns = bucket_value(i) * 1000;
+
+	return ns < entry->max_ns ? ns : entry->max_ns;
+}
+
+static struct stats_entry *find_entry(const char *phase, const char *request)
+{
+	struct stats_entry *grown;
+	int i;
+
+	for (i = 0; i < num_entries; i++)
+		if (!strcmp(entries[i].phase, phase) &&
+				!strcmp(entries[i].request, request))
+			return &entries[i];
+
+	grown = realloc(entries, (num_entries + 1) * sizeof(*entries));
+	if (!grown)
+		return NULL;
+	entries = grown;
+
+	memset(&entries[num_entries], 0, sizeof(*entries));
+	entries[num_entries].phase = phase;
+	entries[num_entries].request = request;
+
+	return &entries[num_entries++];
+}
+
+void usb_stats_enable(int enable)
+{
+	stats_enabled = enable;
+}
+
+void usb_stats_phase(const char *phase)
+{
+	current_phase = phase;
+}
+
+const char *usb_stats_get_phase(void)
+{
+	return current_phase ? current_phase : USB_STATS_NO_PHASE;
+}
+
+uint64_t usb_stats_start(void)
+{
+	struct timespec ts;
+
+	if (!stats_enabled)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void usb_stats_stop(const char *request, uint64_t start)
+{
+	uint64_t now;
+
+	if (!start)
+		return;
+
+	now = usb_stats_start();
+	if (now)
+		usb_stats_record(usb_stats_get_phase(), request, now - start);
+}
+
+void usb_stats_record(const char *phase, const char *request, uint64_t ns)
+{
+	struct stats_entry *entry;
+
+	pthread_mutex_lock(&stats_lock);
+
+	entry = find_entry(phase, request);
+	if (entry) {
+		entry->count++;
+		entry->total_ns += ns;
+		if (ns > entry->max_ns)
+			entry->max_ns = ns;
+		entry->buckets[bucket_of(ns / 1000)]++;
+	}
+
+	pthread_mutex_unlock(&stats_lock);
+}
+
+const char *usb_stats_request_name(uint8_t request_type, uint8_t request)
+{
+	if (request_type == USB_REQ_TYPE_READ_EEPROM &&
+			request == USB_REQ_READ)
+		return "EEPROM read";
+	if (request_type == USB_REQ_TYPE_WRITE_EEPROM &&
+			request == USB_REQ_WRITE)
+		return "EEPROM write";
+
+	/* standard requests, hub class requests share their numbers */
+	if ((request_type & LIBUSB_REQUEST_TYPE_VENDOR) ==
+			LIBUSB_REQUEST_TYPE_VENDOR)
+		return "other";
+
+	switch (request) {
+	case LIBUSB_REQUEST_GET_STATUS:
+		return "GET_STATUS";
+	case LIBUSB_REQUEST_CLEAR_FEATURE:
+		return "CLEAR_FEATURE";
+	case LIBUSB_REQUEST_SET_FEATURE:
+		return "SET_FEATURE";
+	case LIBUSB_REQUEST_GET_DESCRIPTOR:
+		return "GET_DESCRIPTOR";
+	default:
+		return "other";
+	}
+}
+
+int usb_stats_get(int index, struct usb_stats_summary *summary)
+{
+	struct stats_entry *entry;
+
+	pthread_mutex_lock(&stats_lock);
+
+	if (index < 0 || index >= num_entries) {
+		pthread_mutex_unlock(&stats_lock);
+		return -ENOENT;
+	}
+
+	entry = &entries[index];
+	summary->phase = entry->phase;
+	summary->request = entry->request;
+	summary->count = entry->count;
+	summary->total_ns = entry->total_ns;
+	summary->p50_ns = percentile(entry, 50);
+	summary->p95_ns = percentile(entry, 95);
+	summary->p99_ns = percentile(entry, 99);
+	summary->max_ns = entry->max_ns;
+
+	pthread_mutex_unlock(&stats_lock);
+
+	return 0;
+}
+
+void usb_stats_print(FILE *out, int json)
+{
+	struct usb_stats_summary sum;
+	int i;
+
+	if (json)
+		fprintf(out, "{\"stats\": [");
+	else
+		fprintf(out, "%-10s %-16s %7s %11s %9s %9s %9s\n", "PHASE",
+			"REQUEST", "COUNT", "TOTAL ms", "p50 ms", "p95 ms",
+			"p99 ms");
+
+	for (i = 0; usb_stats_get(i, &sum) == 0; i++) {
+		if (json)
+			fprintf(out, "%s\n  {\"phase\": \"%s\", "
+				"\"request\": \"%s\", \"count\": %lu, "
+				"\"total_ms\": %.3f, \"p50_ms\": %.3f, "
+				"\"p95_ms\": %.3f, \"p99_ms\": %.3f, "
+				"\"max_ms\": %.3f}", i ? "," : "",
+				sum.phase, sum.request, sum.count,
+				sum.total_ns / 1e6, sum.p50_ns / 1e6,
+				sum.p95_ns / 1e6, sum.p99_ns / 1e6,
+				sum.max_ns / 1e6);
+		else
+			fprintf(out, "%-10s %-16s %7lu %11.3f %9.3f %9.3f "
+				"%9.3f\n", sum.phase, sum.request, sum.count,
+				sum.total_ns / 1e6, sum.p50_ns / 1e6,
+				sum.p95_ns / 1e6, sum.p99_ns / 1e6);
+	}
+
+	if (json)
+		fprintf(out, "\n]}\n");
+}
+
+void usb_stats_reset(void)
+{
+	pthread_mutex_lock(&stats_lock);
+	free(entries);
+	entries = NULL;
+	num_entries = 0;
+	pthread_mutex_unlock(&stats_lock);
+}
@@ -0,0 +1,163 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "usb_sysfs.h"
+
+static int read_attr(const char *root, const char *name, const char *attr,
+	char *buf, size_t size)
+{
+	char path[PATH_MAX];
+	ssize_t len;
+	int ret;
+	int fd;
+
+	ret = snprintf(path, sizeof(path), "%s/%s/%s", root, name, attr);
+	if (ret < 0 || ret >= sizeof(path))
+		return -ENAMETOOLONG;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	len = read(fd, buf, size - 1);
+	if (len < 0)
+		len = -errno;
+	close(fd);
+
+	if (len < 0)
+		return len;
+
+	buf[len] = '\0';
+	if (len && buf[len - 1] == '\n')
+		buf[--len] = '\0';
+
+	return len;
+}
+
+static int read_ul(const char *root, const char *name, const char *attr,
+	int base, unsigned long *value)
+{
+	char buf[32];
+	char *end;
+	int ret;
+
+	ret = read_attr(root, name, attr, buf, sizeof(buf));
+	if (ret < 0)
+		return ret;
+
+	errno = 0;
+	*value = strtoul(buf, &end, base);
+	if (errno || end == buf)
+		return -EINVAL;
+
+	return 0;
+}
+
+int usb_sysfs_read_device(const char *root, const char *name,
+	struct usb_sysfs_device *dev)
+{
+	unsigned long busnum;
+	unsigned long devnum;
+	unsigned long dclass;
+	unsigned long vendor;
+	unsigned long product;
+	unsigned long bcd;
+	unsigned long maxchild;
+
+	if (!root || !name || !dev)
+		return -EINVAL;
+	if (strlen(name) >= sizeof(dev->name))
+		return -ENAMETOOLONG;
+
+	memset(dev, 0, sizeof(*dev));
+	strcpy(dev->name, name);
+	dev->maxchild = -1;
+
+	if (!read_ul(root, name, "busnum", 10, &busnum) &&
+			!read_ul(root, name, "devnum", 10, &devnum) &&
+			!read_ul(root, name, "bDeviceClass", 16, &dclass) &&
+			!read_ul(root, name, "idVendor", 16, &vendor) &&
+			!read_ul(root, name, "idProduct", 16, &product) &&
+			!read_ul(root, name, "bcdDevice", 16, &bcd)) {
+		dev->busnum = busnum;
+		dev->devnum = devnum;
+		dev->device_class = dclass;
+		dev->vendor = vendor;
+		dev->product = product;
+		dev->bcd_device = bcd;
+		dev->valid |= USB_SYSFS_HAVE_IDS;
+	}
+
+	if (read_attr(root, name, "serial", dev->serial,
+			sizeof(dev->serial)) >= 0)
+		dev->valid |= USB_SYSFS_HAVE_SERIAL;
+
+	if (!read_ul(root, name, "maxchild", 10, &maxchild)) {
+		dev->maxchild = maxchild;
+		dev->valid |= USB_SYSFS_HAVE_MAXCHILD;
+	}
+
+	return 0;
+}
+
+int usb_sysfs_scan(const char *root, struct usb_sysfs_device **devs)
+{
+	struct usb_sysfs_device *list = NULL;
+	struct usb_sysfs_device *tmp;
+	struct dirent *entry;
+	int num = 0;
+	int max = 0;
+	DIR *dir;
+
+	if (!root || !devs)
+		return -EINVAL;
+
+	dir = opendir(root);
+	if (!dir)
+		return -errno;
+
+	while ((entry = readdir(dir))) {
+		/* skip ".", ".." and interfaces like "1-2:1.0" */
+		if (entry->d_name[0] == '.' || strchr(entry->d_name, ':'))
+			continue;
+
+		if (num == max) {
+			max = max * 2 + 16;
+			tmp = realloc(list, max * sizeof(*list));
+			if (!tmp) {
+				free(list);
+				closedir(dir);
+				return -ENOMEM;
+			}
+			list = tmp;
+		}
+
+		if (usb_sysfs_read_device(root, entry->d_name, &list[num]))
+			continue;
+		if (list[num].valid & USB_SYSFS_HAVE_IDS)
+			num++;
+	}
+
+	closedir(dir);
+	*devs = list;
+
+	return num;
+}
+
+struct usb_sysfs_device *usb_sysfs_lookup(struct usb_sysfs_device *devs,
+	int num, int busnum, int devnum)
+{
+	int i;
+
+	for (i = 0; devs && i < num; i++)
+		if (devs[i].busnum == busnum && devs[i].devnum == devnum)
+			return &devs[i];
+
+	return NULL;
+}
@@ -0,0 +1,206 @@
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "ctrld.h"
+
+static int sock[2] = { -1, -1 };
+
+void setup_socket()
+{
+	ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, sock), 0);
+}
+
+void teardown_socket()
+{
+	close(sock[0]);
+	close(sock[1]);
+	sock[0] = -1;
+	sock[1] = -1;
+}
+
+static void send_str(const char *str)
+{
+	ck_assert_int_eq(send(sock[1], str, strlen(str), 0), strlen(str));
+}
+
+/**
+ * @test lines sent back to back are read one at a time
+ */
+START_TEST(test_read_pipelined)
+{
+	char buf[32];
+
+	send_str("power 1 2 3 1\nled 1 2 3 2\nrescan");
+
+	ck_assert_int_eq(ctrld_read_line(sock[0], buf, sizeof(buf)), 14);
+	ck_assert_str_eq(buf, "power 1 2 3 1");
+
+	/* the second line is still in the socket, not in the buffer */
+	ck_assert_int_eq(ctrld_read_line(sock[0], buf, sizeof(buf)), 12);
+	ck_assert_str_eq(buf, "led 1 2 3 2");
+
+	/* the last line ends with the connection */
+	shutdown(sock[1], SHUT_WR);
+	ck_assert_int_eq(ctrld_read_line(sock[0], buf, sizeof(buf)), 7);
+	ck_assert_str_eq(buf, "rescan");
+	ck_assert_int_eq(ctrld_read_line(sock[0], buf, sizeof(buf)), 0);
+}
+END_TEST
+
+/**
+ * @test an empty line counts, a line beyond the buffer does not fit
+ */
+START_TEST(test_read_limits)
+{
+	char buf[8];
+
+	send_str("\n0123456789\n");
+
+	ck_assert_int_eq(ctrld_read_line(sock[0], buf, sizeof(buf)), 1);
+	ck_assert_str_eq(buf, "");
+	ck_assert_int_eq(ctrld_read_line(sock[0], buf, sizeof(buf)),
+		-EMSGSIZE);
+
+	ck_assert_int_eq(ctrld_read_line(sock[0], NULL, sizeof(buf)), -EINVAL);
+	ck_assert_int_eq(ctrld_read_line(sock[0], buf, 0), -EINVAL);
+}
+END_TEST
+
+/**
+ * @test a line written without newline gets one
+ */
+START_TEST(test_write_line)
+{
+	char buf[16];
+
+	ck_assert_int_eq(ctrld_write_line(sock[1], "OK 1"), 0);
+	ck_assert_int_eq(ctrld_write_line(sock[1], "OK 2\n"), 0);
+
+	ck_assert_int_eq(ctrld_read_line(sock[0], buf, sizeof(buf)), 5);
+	ck_assert_str_eq(buf, "OK 1");
+	ck_assert_int_eq(ctrld_read_line(sock[0], buf, sizeof(buf)), 5);
+	ck_assert_str_eq(buf, "OK 2");
+}
+END_TEST
+
+/**
+ * @test EEPROM data survives the hex encoding
+ */
+START_TEST(test_hex)
+{
+	static const uint8_t data[] = { 0x00, 0x5a, 0xa5, 0xff, 0x12 };
+	uint8_t decoded[sizeof(data)];
+	char hex[2 * sizeof(data) + 1];
+
+	ctrld_hex_encode(hex, data, sizeof(data));
+	ck_assert_str_eq(hex, "005aa5ff12");
+	ck_assert_int_eq(ctrld_hex_decode(decoded, sizeof(decoded), hex),
+		sizeof(data));
+	ck_assert_int_eq(memcmp(decoded, data, sizeof(data)), 0);
+
+	/* upper case, and the data ends at a blank */
+	ck_assert_int_eq(ctrld_hex_decode(decoded, sizeof(decoded),
+		"A5fF 00"), 2);
+	ck_assert_uint_eq(decoded[0], 0xa5);
+	ck_assert_uint_eq(decoded[1], 0xff);
+
+	ck_assert_int_eq(ctrld_hex_decode(decoded, sizeof(decoded), ""), 0);
+	ck_assert_int_eq(ctrld_hex_decode(decoded, sizeof(decoded), "5g"),
+		-EINVAL);
+	/* an odd number of digits */
+	ck_assert_int_eq(ctrld_hex_decode(decoded, sizeof(decoded), "abc"),
+		-EINVAL);
+	ck_assert_int_eq(ctrld_hex_decode(decoded, 2, "000000"), -EMSGSIZE);
+}
+END_TEST
+
+/**
+ * @test requests are split into verb and arguments
+ */
+START_TEST(test_parse)
+{
+	struct ctrld_req req;
+
+	ck_assert_int_eq(ctrld_parse_request("rescan", &req), 0);
+	ck_assert_int_eq(req.verb, CTRLD_RESCAN);
+
+	ck_assert_int_eq(ctrld_parse_request("power 1 5 3 0", &req), 0);
+	ck_assert_int_eq(req.verb, CTRLD_POWER);
+	ck_assert_uint_eq(req.busnum, 1);
+	ck_assert_uint_eq(req.devnum, 5);
+	ck_assert_uint_eq(req.port, 3);
+	ck_assert_uint_eq(req.value, 0);
+
+	ck_assert_int_eq(ctrld_parse_request("led 0 0 2 1", &req), 0);
+	ck_assert_int_eq(req.verb, CTRLD_LED);
+	ck_assert_uint_eq(req.busnum, 0);
+	ck_assert_uint_eq(req.port, 2);
+	ck_assert_uint_eq(req.value, 1);
+
+	ck_assert_int_eq(ctrld_parse_request("read 2 7 4096", &req), 0);
+	ck_assert_int_eq(req.verb, CTRLD_READ);
+	ck_assert_uint_eq(req.size, 4096);
+	/* reads without the overwrite flag accept non-blank EEPROMs */
+	ck_assert_uint_eq(req.value, 1);
+
+	ck_assert_int_eq(ctrld_parse_request("erase 2 7 64", &req), 0);
+	ck_assert_int_eq(req.verb, CTRLD_ERASE);
+	ck_assert_uint_eq(req.size, 64);
+
+	ck_assert_int_eq(ctrld_parse_request("write 1 5 0 d4b4", &req), 0);
+	ck_assert_int_eq(req.verb, CTRLD_WRITE);
+	ck_assert_uint_eq(req.value, 0);
+	ck_assert_str_eq(req.data, "d4b4");
+
+	ck_assert_int_eq(ctrld_parse_request("update 1 5 1 d4b4", &req), 0);
+	ck_assert_int_eq(req.verb, CTRLD_UPDATE);
+	ck_assert_uint_eq(req.value, 1);
+	ck_assert_str_eq(req.data, "d4b4");
+}
+END_TEST
+
+/**
+ * @test malformed requests are refused
+ */
+START_TEST(test_parse_invalid)
+{
+	struct ctrld_req req;
+
+	ck_assert_int_eq(ctrld_parse_request("", &req), -EINVAL);
+	ck_assert_int_eq(ctrld_parse_request("reset 1 5", &req), -EOPNOTSUPP);
+	ck_assert_int_eq(ctrld_parse_request("power 1", &req), -EINVAL);
+	ck_assert_int_eq(ctrld_parse_request("power 1 5 3", &req), -EINVAL);
+	ck_assert_int_eq(ctrld_parse_request("read 1 5", &req), -EINVAL);
+	ck_assert_int_eq(ctrld_parse_request("read 1 5 0", &req), -EINVAL);
+	ck_assert_int_eq(ctrld_parse_request("read 1 5 4097", &req), -EINVAL);
+	ck_assert_int_eq(ctrld_parse_request("write 1 5", &req), -EINVAL);
+	ck_assert_int_eq(ctrld_parse_request(NULL, &req), -EINVAL);
+}
+END_TEST
+
+int ctrld_suite(Suite *s_ctrld)
+{
+	TCase *tc_line;
+	TCase *tc_request;
+
+	tc_line = tcase_create("Daemon lines");
+	tc_request = tcase_create("Daemon requests");
+
+	tcase_add_checked_fixture(tc_line, setup_socket, teardown_socket);
+	tcase_add_test(tc_line, test_read_pipelined);
+	tcase_add_test(tc_line, test_read_limits);
+	tcase_add_test(tc_line, test_write_line);
+
+	tcase_add_test(tc_request, test_hex);
+	tcase_add_test(tc_request, test_parse);
+	tcase_add_test(tc_request, test_parse_invalid);
+
+	suite_add_tcase(s_ctrld, tc_line);
+	suite_add_tcase(s_ctrld, tc_request);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for the hub-ctrld line protocol
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_CTRLD_H
+#define CHECK_CTRLD_H
+
+/**
+ * @brief Add line protocol test cases to the given suite
+ *
+ * @param ctrld_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int ctrld_suite(Suite *ctrld_suite);
+
+#endif /* CHECK_CTRLD_H */
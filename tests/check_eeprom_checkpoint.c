@@ -0,0 +1,198 @@
+#include <check.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dummy_usb.h"
+#include "eeprom_checkpoint.h"
+#include "usb_eeprom.h"
+
+#define CP_HUB		"04b4:6570@1-2"
+#define CP_OFFSET	0x100
+#define CP_LEN		(4 * EEPROM_CHUNK_SIZE)
+
+char cp_name[] = "/tmp/checkpointXXXXXX";
+static libusb_device_handle *cp_dev;
+static uint8_t cp_image[CP_LEN];
+
+void setup_checkpoint()
+{
+	int fd;
+	int i;
+
+	cp_dev = libusb_device_handle_create();
+	ck_assert_ptr_ne(cp_dev, NULL);
+
+	for (i = 0; i < CP_LEN; i++)
+		cp_image[i] = i * 13 + 1;
+
+	/* reserve a name, the checkpoint does not exist yet */
+	fd = mkstemp(cp_name);
+	ck_assert_int_ge(fd, 0);
+	close(fd);
+	unlink(cp_name);
+}
+
+void teardown_checkpoint()
+{
+	unlink(cp_name);
+	strcpy(cp_name, "/tmp/checkpointXXXXXX");
+	if (cp_dev)
+		libusb_device_handle_free(&cp_dev);
+}
+
+/* Read the fields of the checkpoint, returns the number found */
+static int read_checkpoint(char *hub, size_t *written, size_t *verified)
+{
+	uint64_t hash;
+	size_t offset;
+	size_t len;
+	FILE *fp;
+	int num;
+
+	fp = fopen(cp_name, "r");
+	if (!fp)
+		return -errno;
+
+	num = fscanf(fp, "hub-ctrl-checkpoint 1 %47s %" SCNx64
+		" %zu %zu %zu %zu", hub, &hash, &offset, &len, written,
+		verified);
+	fclose(fp);
+
+	ck_assert_uint_eq(offset, CP_OFFSET);
+	ck_assert_uint_eq(len, CP_LEN);
+
+	return num;
+}
+
+/* Stop after the first chunk, leaving a checkpoint of it */
+static void program_first_chunk(void)
+{
+	volatile sig_atomic_t stop = 1;
+	char hub[EEPROM_CHECKPOINT_HUB_SIZE];
+	size_t written;
+	size_t verified;
+
+	cp_dev->writes = 0;
+	ck_assert_int_eq(eeprom_checkpoint_program(cp_dev, CP_HUB, cp_image,
+		CP_OFFSET, CP_LEN, cp_name, 0, &stop), -ECANCELED);
+	ck_assert_int_eq(cp_dev->writes, 1);
+
+	ck_assert_int_eq(read_checkpoint(hub, &written, &verified), 6);
+	ck_assert_str_eq(hub, CP_HUB);
+	ck_assert_uint_eq(written, EEPROM_CHUNK_SIZE);
+	ck_assert_uint_eq(verified, 0);
+
+	cp_dev->writes = 0;
+}
+
+/**
+ * @test without a checkpoint the region is written and verified at once
+ */
+START_TEST(test_checkpoint_fresh)
+{
+	ck_assert_int_eq(eeprom_checkpoint_program(cp_dev, CP_HUB, cp_image,
+		CP_OFFSET, CP_LEN, cp_name, 0, NULL), CP_LEN);
+	ck_assert_int_eq(cp_dev->writes, 4);
+	ck_assert_int_eq(memcmp(cp_dev->eeprom + CP_OFFSET, cp_image, CP_LEN),
+		0);
+	ck_assert_int_eq(access(cp_name, F_OK), -1);
+
+	ck_assert_int_eq(eeprom_checkpoint_program(NULL, CP_HUB, cp_image,
+		CP_OFFSET, CP_LEN, cp_name, 0, NULL), -EINVAL);
+	ck_assert_int_eq(eeprom_checkpoint_program(cp_dev, CP_HUB, cp_image,
+		CP_OFFSET, 0, cp_name, 0, NULL), -EINVAL);
+}
+END_TEST
+
+/**
+ * @test a stopped run is resumed after the last chunk written
+ */
+START_TEST(test_checkpoint_resume)
+{
+	program_first_chunk();
+
+	ck_assert_int_eq(eeprom_checkpoint_program(cp_dev, CP_HUB, cp_image,
+		CP_OFFSET, CP_LEN, cp_name, 0, NULL),
+		CP_LEN - EEPROM_CHUNK_SIZE);
+	ck_assert_int_eq(cp_dev->writes, 3);
+	ck_assert_int_eq(memcmp(cp_dev->eeprom + CP_OFFSET, cp_image, CP_LEN),
+		0);
+	ck_assert_int_eq(access(cp_name, F_OK), -1);
+}
+END_TEST
+
+/**
+ * @test only what still reads back as in the image counts as written
+ */
+START_TEST(test_checkpoint_changed)
+{
+	program_first_chunk();
+
+	/* another hub of the same kind took the place */
+	cp_dev->eeprom[CP_OFFSET + 100] ^= 0xff;
+
+	ck_assert_int_eq(eeprom_checkpoint_program(cp_dev, CP_HUB, cp_image,
+		CP_OFFSET, CP_LEN, cp_name, 0, NULL), CP_LEN - 100);
+	ck_assert_int_eq(memcmp(cp_dev->eeprom + CP_OFFSET, cp_image, CP_LEN),
+		0);
+	ck_assert_int_eq(access(cp_name, F_OK), -1);
+}
+END_TEST
+
+/**
+ * @test a checkpoint of another hub, image or region starts over
+ */
+START_TEST(test_checkpoint_stale)
+{
+	FILE *fp;
+
+	program_first_chunk();
+	ck_assert_int_eq(eeprom_checkpoint_program(cp_dev, "04b4:6570@1-3",
+		cp_image, CP_OFFSET, CP_LEN, cp_name, 0, NULL), CP_LEN);
+	ck_assert_int_eq(cp_dev->writes, 4);
+
+	program_first_chunk();
+	cp_image[CP_LEN - 1] ^= 0xff;
+	ck_assert_int_eq(eeprom_checkpoint_program(cp_dev, CP_HUB, cp_image,
+		CP_OFFSET, CP_LEN, cp_name, 0, NULL), CP_LEN);
+	ck_assert_int_eq(cp_dev->writes, 4);
+
+	program_first_chunk();
+	ck_assert_int_eq(eeprom_checkpoint_program(cp_dev, CP_HUB, cp_image,
+		0, CP_LEN, cp_name, 0, NULL), CP_LEN);
+	ck_assert_int_eq(cp_dev->writes, 4);
+
+	/* a damaged checkpoint is no checkpoint */
+	fp = fopen(cp_name, "w");
+	ck_assert_ptr_ne(fp, NULL);
+	fputs("hub-ctrl-checkpoint 1 " CP_HUB " zz\n", fp);
+	fclose(fp);
+	cp_dev->writes = 0;
+	ck_assert_int_eq(eeprom_checkpoint_program(cp_dev, CP_HUB, cp_image,
+		CP_OFFSET, CP_LEN, cp_name, 0, NULL), CP_LEN);
+	ck_assert_int_eq(cp_dev->writes, 4);
+	ck_assert_int_eq(access(cp_name, F_OK), -1);
+}
+END_TEST
+
+int checkpoint_suite(Suite *s_checkpoint)
+{
+	TCase *tc_checkpoint;
+
+	tc_checkpoint = tcase_create("EEPROM checkpoint");
+
+	tcase_add_checked_fixture(tc_checkpoint, setup_checkpoint,
+		teardown_checkpoint);
+	tcase_add_test(tc_checkpoint, test_checkpoint_fresh);
+	tcase_add_test(tc_checkpoint, test_checkpoint_resume);
+	tcase_add_test(tc_checkpoint, test_checkpoint_changed);
+	tcase_add_test(tc_checkpoint, test_checkpoint_stale);
+
+	suite_add_tcase(s_checkpoint, tc_checkpoint);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for eeprom_checkpoint
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_EEPROM_CHECKPOINT_H
+#define CHECK_EEPROM_CHECKPOINT_H
+
+/**
+ * @brief Add checkpoint test cases to the given suite
+ *
+ * @param checkpoint_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int checkpoint_suite(Suite *checkpoint_suite);
+
+#endif /* CHECK_EEPROM_CHECKPOINT_H */
@@ -0,0 +1,263 @@
+#include <check.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eeprom_image.h"
+
+/* image of test_write_eeprom.sh */
+static const uint8_t cypress_image[] = {
+	0xd4, 0xb4, 0x04, 0x60, 0x65, 0x00, 0x92, 0x88,
+	0x28, 0x5f, 0x00, 0x00, 0x50, 0xbe, 0x50, 0x64,
+	0x32, 0x90, 0x41, 0x00, 0x01, 0x07, 0x03, 0x03,
+	0x09, 0x04, 0x26, 0x00, 0x32, 0x00, 0x52, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x03,
+	0x43, 0x00, 0x31, 0x00, 0x30, 0x00, 0x30, 0x00,
+	0x38, 0x00, 0x20, 0x03, 0x41, 0x00, 0x44, 0x00,
+	0x54, 0x00, 0x30, 0x00, 0x37, 0x00, 0x31, 0x00,
+	0x36, 0x00, 0x2d, 0x00, 0x30, 0x00, 0x30, 0x00,
+	0x31, 0x00, 0x2d, 0x00, 0x30, 0x00, 0x30, 0x00,
+	0x30, 0x00, 0x18, 0x03, 0x34, 0x00, 0x34, 0x00,
+	0x31, 0x00, 0x36, 0x00, 0x2d, 0x00, 0x30, 0x00,
+	0x30, 0x00, 0x30, 0x00, 0x30, 0x00, 0x30, 0x00,
+	0x31, 0x00,
+};
+
+static uint8_t image[sizeof(cypress_image)];
+
+void setup_image()
+{
+	memcpy(image, cypress_image, sizeof(image));
+}
+
+/**
+ * @test the header is overlaid on the image
+ */
+START_TEST(test_image_header)
+{
+	const struct eeprom_image_header *header;
+
+	ck_assert_int_eq(sizeof(*header), 0x26);
+
+	header = eeprom_image_header(image, sizeof(image));
+	ck_assert_ptr_eq(header, (const void *)image);
+	ck_assert_int_eq(header->signature, EEPROM_IMAGE_SIGNATURE);
+	ck_assert_int_eq(eeprom_image_u16(header->vid), 0x04b4);
+	ck_assert_int_eq(eeprom_image_u16(header->pid), 0x6560);
+	ck_assert_int_eq(eeprom_image_u16(header->langid), 0x0409);
+
+	ck_assert_ptr_eq(eeprom_image_header(image, sizeof(*header) - 1),
+		NULL);
+	ck_assert_ptr_eq(eeprom_image_header(NULL, sizeof(image)), NULL);
+}
+END_TEST
+
+/**
+ * @test strings are returned in place
+ */
+START_TEST(test_image_strings)
+{
+	const uint8_t *chars;
+	size_t num = 0;
+
+	chars = eeprom_image_string(image, sizeof(image), 2, &num);
+	ck_assert_ptr_eq(chars, image + 0x54);
+	ck_assert_int_eq(num, 11);
+	ck_assert_int_eq(chars[0], '4');
+	ck_assert_int_eq(chars[20], '1');
+
+	chars = eeprom_image_string(image, sizeof(image), 0, &num);
+	ck_assert_ptr_ne(chars, NULL);
+	ck_assert_int_eq(num, 5);
+
+	/* empty slot and slot out of range */
+	ck_assert_ptr_eq(eeprom_image_string(image, sizeof(image), 3, &num),
+		NULL);
+	ck_assert_ptr_eq(eeprom_image_string(image, sizeof(image),
+		EEPROM_IMAGE_STRINGS, &num), NULL);
+}
+END_TEST
+
+/**
+ * @test a valid image passes, broken ones are named
+ */
+START_TEST(test_image_validate)
+{
+	const char *problem = NULL;
+
+	ck_assert_int_eq(eeprom_image_validate(image, sizeof(image),
+		&problem), 0);
+	ck_assert_ptr_eq(problem, NULL);
+
+	/* cut off in the serial number */
+	ck_assert_int_eq(eeprom_image_validate(image, sizeof(image) - 2,
+		&problem), -EINVAL);
+	ck_assert_str_eq(problem, "string length invalid");
+
+	ck_assert_int_eq(eeprom_image_validate(image, 0x20, &problem),
+		-EINVAL);
+	ck_assert_str_eq(problem, "shorter than the header");
+
+	image[0] = 0xff;
+	ck_assert_int_eq(eeprom_image_validate(image, sizeof(image),
+		&problem), -EINVAL);
+	ck_assert_str_eq(problem, "no signature");
+	image[0] = EEPROM_IMAGE_SIGNATURE;
+
+	image[8] = EEPROM_IMAGE_MAX_POWER + 1;
+	ck_assert_int_eq(eeprom_image_validate(image, sizeof(image), NULL),
+		-EINVAL);
+	image[8] = cypress_image[8];
+
+	/* product string pointing into the header */
+	image[0x1c] = 0x10;
+	ck_assert_int_eq(eeprom_image_validate(image, sizeof(image),
+		&problem), -EINVAL);
+	ck_assert_str_eq(problem, "string offset outside the image");
+
+	/* at data that is no string descriptor */
+	image[0x1c] = 0x33;
+	ck_assert_int_eq(eeprom_image_validate(image, sizeof(image),
+		&problem), -EINVAL);
+	image[0x1c] = cypress_image[0x1c];
+
+	image[0x18] = image[0x19] = 0;
+	ck_assert_int_eq(eeprom_image_validate(image, sizeof(image),
+		&problem), -EINVAL);
+	ck_assert_str_eq(problem, "strings without language ID");
+}
+END_TEST
+
+/* room for strings to grow, filled by setup_big() */
+static uint8_t big[sizeof(cypress_image) + 64];
+
+void setup_big()
+{
+	memset(big, 0, sizeof(big));
+	memcpy(big, cypress_image, sizeof(cypress_image));
+}
+
+static int string_is(int index, const char *text, size_t len)
+{
+	const uint8_t *chars;
+	size_t num = 0;
+	size_t i;
+
+	chars = eeprom_image_string(big, len, index, &num);
+	if (!chars || num != strlen(text))
+		return 0;
+
+	for (i = 0; i < num; i++)
+		if (eeprom_image_u16(chars + 2 * i) != text[i])
+			return 0;
+
+	return 1;
+}
+
+/**
+ * @test strings are replaced in place, what follows moves along
+ */
+START_TEST(test_image_set_string)
+{
+	int len = sizeof(cypress_image);
+
+	/* the serial at the end grows */
+	len = eeprom_image_set_string(big, len, sizeof(big),
+		EEPROM_IMAGE_SERIAL, "4416-0000042");
+	ck_assert_int_eq(len, sizeof(cypress_image) + 2);
+	ck_assert_int_eq(eeprom_image_validate(big, len, NULL), 0);
+	ck_assert(string_is(EEPROM_IMAGE_SERIAL, "4416-0000042", len));
+
+	/* the manufacturer shrinks, product and serial move down */
+	len = eeprom_image_set_string(big, len, sizeof(big), 0, "AD");
+	ck_assert_int_eq(len, sizeof(cypress_image) + 2 - 6);
+	ck_assert_int_eq(eeprom_image_validate(big, len, NULL), 0);
+	ck_assert_int_eq(eeprom_image_u16(big + 0x1c), 0x32 - 6);
+	ck_assert(string_is(0, "AD", len));
+	ck_assert(string_is(1, "ADT0716-001-000", len));
+	ck_assert(string_is(EEPROM_IMAGE_SERIAL, "4416-0000042", len));
+
+	/* an empty slot is appended */
+	len = eeprom_image_set_string(big, len, sizeof(big), 3, "X");
+	ck_assert_int_eq(len, sizeof(cypress_image) + 2 - 6 + 4);
+	ck_assert_int_eq(eeprom_image_validate(big, len, NULL), 0);
+	ck_assert(string_is(3, "X", len));
+}
+END_TEST
+
+/**
+ * @test strings that do not fit or are no printable ASCII are refused
+ */
+START_TEST(test_image_set_string_boundaries)
+{
+	char text[EEPROM_IMAGE_STRING_MAX + 2];
+	int len = sizeof(cypress_image);
+
+	ck_assert_int_eq(eeprom_image_set_string(big, len, sizeof(big),
+		EEPROM_IMAGE_SERIAL, "tab\t"), -EINVAL);
+	ck_assert_int_eq(eeprom_image_set_string(big, len, sizeof(big),
+		EEPROM_IMAGE_STRINGS, "0"), -EINVAL);
+	ck_assert_int_eq(eeprom_image_set_string(big, len - 1,
+		sizeof(big), EEPROM_IMAGE_SERIAL, "0"), -EINVAL);
+
+	memset(text, 'x', sizeof(text) - 1);
+	text[sizeof(text) - 1] = '\0';
+	ck_assert_int_eq(eeprom_image_set_string(big, len, sizeof(big),
+		EEPROM_IMAGE_SERIAL, text), -EINVAL);
+
+	text[sizeof(text) - 2] = '\0';
+	ck_assert_int_eq(eeprom_image_set_string(big, len, sizeof(big),
+		EEPROM_IMAGE_SERIAL, text), -ENOSPC);
+
+	ck_assert_int_eq(memcmp(big, cypress_image, len), 0);
+}
+END_TEST
+
+/**
+ * @test the fields are printed decoded
+ */
+START_TEST(test_image_print)
+{
+	char *text = NULL;
+	size_t size = 0;
+	FILE *fp;
+
+	fp = open_memstream(&text, &size);
+	ck_assert_ptr_ne(fp, NULL);
+	eeprom_image_print(fp, image, sizeof(image));
+	fclose(fp);
+
+	ck_assert_ptr_ne(strstr(text, "vendor         0x04b4\n"), NULL);
+	ck_assert_ptr_ne(strstr(text, "max power      80 mA\n"), NULL);
+	ck_assert_ptr_ne(strstr(text, "serial         0x0052 "
+		"\"4416-000001\"\n"), NULL);
+	ck_assert_ptr_eq(strstr(text, "invalid"), NULL);
+
+	free(text);
+}
+END_TEST
+
+int image_suite(Suite *s_image)
+{
+	TCase *tc_image;
+	TCase *tc_image_strings;
+
+	tc_image = tcase_create("EEPROM image");
+	tc_image_strings = tcase_create("EEPROM image strings");
+
+	tcase_add_checked_fixture(tc_image, setup_image, NULL);
+	tcase_add_test(tc_image, test_image_header);
+	tcase_add_test(tc_image, test_image_strings);
+	tcase_add_test(tc_image, test_image_validate);
+	tcase_add_test(tc_image, test_image_print);
+
+	tcase_add_checked_fixture(tc_image_strings, setup_big, NULL);
+	tcase_add_test(tc_image_strings, test_image_set_string);
+	tcase_add_test(tc_image_strings, test_image_set_string_boundaries);
+
+	suite_add_tcase(s_image, tc_image);
+	suite_add_tcase(s_image, tc_image_strings);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for eeprom_image
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_EEPROM_IMAGE_H
+#define CHECK_EEPROM_IMAGE_H
+
+/**
+ * @brief Add EEPROM image test cases to the given suite
+ *
+ * @param image_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int image_suite(Suite *image_suite);
+
+#endif /* CHECK_EEPROM_IMAGE_H */
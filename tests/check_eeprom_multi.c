@@ -0,0 +1,173 @@
+#include <check.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dummy_usb.h"
+#include "eeprom_multi.h"
+#include "hubs.h"
+
+/* registry index of the simulated hubs, by their number */
+static int hub[4];
+
+/*
+ * Hub 0 has a programmed EEPROM, hubs 1 and 3 a blank one and hub 2 is not
+ * a Cypress hub at all.
+ */
+void setup_targets()
+{
+	int i;
+
+	ck_assert_int_eq(dummy_bus_create(4, 4), 0);
+	for (i = 1; i < 4; i += 2) {
+		dummy_bus_device(i)->desc.bDeviceClass =
+			LIBUSB_CLASS_VENDOR_SPEC;
+		dummy_bus_device(i)->desc.bcdDevice = 0x9015;
+	}
+	dummy_bus_device(2)->desc.idProduct = 0x1234;
+
+	libusb_init(NULL);
+	hub_sysfs_root = NULL;
+	ck_assert_int_eq(usb_find_hubs(0), 4);
+
+	for (i = 0; i < 4; i++) {
+		hub[i] = get_hub(1, dummy_bus_device(i)->devnum);
+		ck_assert_int_ge(hub[i], 0);
+	}
+}
+
+void teardown_targets()
+{
+	hub_registry_exit();
+	libusb_exit(NULL);
+	dummy_bus_destroy();
+}
+
+/**
+ * @test "blank" selects the hubs with blank EEPROM, with or without overwrite
+ */
+START_TEST(test_select_blank)
+{
+	struct eeprom_target *targets;
+	int overwrite;
+
+	for (overwrite = 0; overwrite < 2; overwrite++) {
+		ck_assert_int_eq(eeprom_select_targets("blank", overwrite,
+			&targets), 2);
+		ck_assert_int_eq(targets[0].hub, hub[1]);
+		ck_assert_int_eq(targets[1].hub, hub[3]);
+		ck_assert_int_eq(targets[0].result, 0);
+		ck_assert_str_eq(targets[0].serial, "");
+		free(targets);
+	}
+}
+END_TEST
+
+/**
+ * @test "all" takes programmed hubs only with overwrite, never other hubs
+ */
+START_TEST(test_select_all)
+{
+	struct eeprom_target *targets;
+
+	ck_assert_int_eq(eeprom_select_targets("all", 0, &targets), 2);
+	ck_assert_int_eq(targets[0].hub, hub[1]);
+	ck_assert_int_eq(targets[1].hub, hub[3]);
+	free(targets);
+
+	ck_assert_int_eq(eeprom_select_targets("all", 1, &targets), 3);
+	ck_assert_int_eq(targets[0].hub, hub[0]);
+	ck_assert_int_eq(targets[1].hub, hub[1]);
+	ck_assert_int_eq(targets[2].hub, hub[3]);
+	free(targets);
+}
+END_TEST
+
+/**
+ * @test a listed hub with programmed EEPROM needs overwrite
+ */
+START_TEST(test_select_overwrite)
+{
+	struct eeprom_target *targets = NULL;
+	char name[16];
+
+	snprintf(name, sizeof(name), "1:%d", dummy_bus_device(0)->devnum);
+	ck_assert_int_eq(eeprom_select_targets(name, 0, &targets), -ENODEV);
+	ck_assert_ptr_eq(targets, NULL);
+
+	ck_assert_int_eq(eeprom_select_targets(name, 1, &targets), 1);
+	ck_assert_int_eq(targets[0].hub, hub[0]);
+	free(targets);
+
+	/* not even overwrite makes a hub without EEPROM usable */
+	ck_assert_int_eq(eeprom_select_targets(hubs[hub[2]].path, 1,
+		&targets), -ENODEV);
+	ck_assert_ptr_eq(targets, NULL);
+}
+END_TEST
+
+/**
+ * @test hubs matched by several targets are selected once, in first order
+ */
+START_TEST(test_select_duplicates)
+{
+	struct eeprom_target *targets;
+	char spec[128];
+
+	snprintf(spec, sizeof(spec), "%s,1:%d,blank,all,%s",
+		hubs[hub[3]].path, dummy_bus_device(1)->devnum,
+		hubs[hub[3]].path);
+	ck_assert_int_eq(eeprom_select_targets(spec, 0, &targets), 2);
+	ck_assert_int_eq(targets[0].hub, hub[3]);
+	ck_assert_int_eq(targets[1].hub, hub[1]);
+	free(targets);
+
+	snprintf(spec, sizeof(spec), "all,1:%d", dummy_bus_device(0)->devnum);
+	ck_assert_int_eq(eeprom_select_targets(spec, 1, &targets), 3);
+	ck_assert_int_eq(targets[0].hub, hub[0]);
+	free(targets);
+}
+END_TEST
+
+/**
+ * @test unknown hubs fail the whole list
+ */
+START_TEST(test_select_unknown)
+{
+	struct eeprom_target *targets = NULL;
+
+	ck_assert_int_eq(eeprom_select_targets("blank,1:99", 1, &targets),
+		-ENODEV);
+	ck_assert_ptr_eq(targets, NULL);
+	ck_assert_int_eq(eeprom_select_targets("9-9.9", 1, &targets),
+		-ENODEV);
+	ck_assert_int_eq(eeprom_select_targets("1:2:3", 1, &targets),
+		-ENODEV);
+
+	ck_assert_int_eq(eeprom_select_targets(NULL, 1, &targets), -EINVAL);
+	ck_assert_int_eq(eeprom_select_targets("all", 1, NULL), -EINVAL);
+
+	/* nothing to select is no error */
+	ck_assert_int_eq(eeprom_select_targets("", 1, &targets), 0);
+	ck_assert_ptr_eq(targets, NULL);
+}
+END_TEST
+
+int multi_suite(Suite *s_multi)
+{
+	TCase *tc_select;
+
+	tc_select = tcase_create("EEPROM targets");
+
+	tcase_add_checked_fixture(tc_select, setup_targets, teardown_targets);
+	tcase_add_test(tc_select, test_select_blank);
+	tcase_add_test(tc_select, test_select_all);
+	tcase_add_test(tc_select, test_select_overwrite);
+	tcase_add_test(tc_select, test_select_duplicates);
+	tcase_add_test(tc_select, test_select_unknown);
+
+	suite_add_tcase(s_multi, tc_select);
+
+	return EXIT_SUCCESS;
+}
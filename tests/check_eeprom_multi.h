@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for eeprom_multi
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_EEPROM_MULTI_H
+#define CHECK_EEPROM_MULTI_H
+
+/**
+ * @brief Add target selection test cases to the given suite
+ *
+ * @param multi_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int multi_suite(Suite *multi_suite);
+
+#endif /* CHECK_EEPROM_MULTI_H */
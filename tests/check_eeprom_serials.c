@@ -0,0 +1,176 @@
+#include <check.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "eeprom_serials.h"
+
+char csv_name[] = "/tmp/serialsXXXXXX";
+
+/* Header followed by the serial string descriptor, if any */
+static size_t make_image(uint8_t *image, const char *serial)
+{
+	struct eeprom_image_header *header = (void *)image;
+	size_t chars;
+	size_t i;
+
+	memset(image, 0, sizeof(*header));
+	header->signature = EEPROM_IMAGE_SIGNATURE;
+	if (!serial)
+		return sizeof(*header);
+
+	chars = strlen(serial);
+	header->strings[EEPROM_IMAGE_SERIAL][0] = sizeof(*header);
+
+	image[sizeof(*header)] = 2 + 2 * chars;
+	image[sizeof(*header) + 1] = 0x03;
+	for (i = 0; i < chars; i++) {
+		image[sizeof(*header) + 2 + 2 * i] = serial[i];
+		image[sizeof(*header) + 3 + 2 * i] = 0;
+	}
+
+	return sizeof(*header) + 2 + 2 * chars;
+}
+
+static void assert_next(struct serial_source *src, const char *serial)
+{
+	char buf[EEPROM_IMAGE_STRING_MAX + 1];
+
+	ck_assert_int_eq(serial_source_next(src, buf, sizeof(buf)), 0);
+	ck_assert_str_eq(buf, serial);
+}
+
+/**
+ * @test the counter keeps prefix and width of the template serial
+ */
+START_TEST(test_counter_prefix)
+{
+	struct serial_source src;
+	uint8_t image[64 + 2 * EEPROM_IMAGE_STRING_MAX];
+	size_t len;
+
+	len = make_image(image, "4416-000001");
+	ck_assert_int_eq(serial_source_counter(&src, image, len, 42), 0);
+	ck_assert_str_eq(src.prefix, "4416-");
+	ck_assert_int_eq(src.width, 6);
+	assert_next(&src, "4416-000042");
+	assert_next(&src, "4416-000043");
+
+	/* no number to replace, one is appended */
+	len = make_image(image, "ADT");
+	ck_assert_int_eq(serial_source_counter(&src, image, len, 7), 0);
+	assert_next(&src, "ADT7");
+	assert_next(&src, "ADT8");
+
+	/* only a number */
+	len = make_image(image, "0042");
+	ck_assert_int_eq(serial_source_counter(&src, image, len, 5), 0);
+	ck_assert_str_eq(src.prefix, "");
+	assert_next(&src, "0005");
+
+	/* no serial at all */
+	len = make_image(image, NULL);
+	ck_assert_int_eq(serial_source_counter(&src, image, len, 1), 0);
+	assert_next(&src, "1");
+
+	len = make_image(image, "44\x7f" "1");
+	ck_assert_int_eq(serial_source_counter(&src, image, len, 1), -EINVAL);
+}
+END_TEST
+
+/**
+ * @test a number outgrowing the width widens the serial
+ */
+START_TEST(test_counter_rollover)
+{
+	struct serial_source src;
+	uint8_t image[64 + 2 * EEPROM_IMAGE_STRING_MAX];
+	char buf[9];
+	size_t len;
+
+	len = make_image(image, "AB-98");
+	ck_assert_int_eq(serial_source_counter(&src, image, len, 98), 0);
+	assert_next(&src, "AB-98");
+	assert_next(&src, "AB-99");
+	assert_next(&src, "AB-100");
+
+	/* a serial not fitting the buffer is not taken */
+	ck_assert_int_eq(serial_source_counter(&src, image, len, 99999), 0);
+	ck_assert_int_eq(serial_source_next(&src, buf, sizeof(buf)), 0);
+	ck_assert_str_eq(buf, "AB-99999");
+	ck_assert_int_eq(serial_source_next(&src, buf, sizeof(buf)), -ENOSPC);
+	assert_next(&src, "AB-100000");
+}
+END_TEST
+
+void setup_csv()
+{
+	FILE *fp;
+	int fd;
+
+	fd = mkstemp(csv_name);
+	ck_assert_int_ge(fd, 0);
+	fp = fdopen(fd, "w");
+	ck_assert_ptr_ne(fp, NULL);
+	fputs("# serial,board\n\n4416-000100,A\n \"4416-000101\" ,B\n"
+		"4416-000102\r\n", fp);
+	fclose(fp);
+}
+
+void teardown_csv()
+{
+	char state[sizeof(csv_name) + 8];
+
+	snprintf(state, sizeof(state), "%s.next", csv_name);
+	unlink(state);
+	unlink(csv_name);
+	strcpy(csv_name, "/tmp/serialsXXXXXX");
+}
+
+/**
+ * @test serials of a CSV file are taken once, across runs
+ */
+START_TEST(test_csv)
+{
+	struct serial_source src;
+	char buf[EEPROM_IMAGE_STRING_MAX + 1];
+
+	ck_assert_int_eq(serial_source_csv(&src, csv_name), 0);
+	ck_assert_int_eq(src.num, 3);
+	assert_next(&src, "4416-000100");
+	assert_next(&src, "4416-000101");
+	serial_source_free(&src);
+
+	/* the next run goes on after the serials taken */
+	ck_assert_int_eq(serial_source_csv(&src, csv_name), 0);
+	assert_next(&src, "4416-000102");
+	ck_assert_int_eq(serial_source_next(&src, buf, sizeof(buf)),
+		-ENODATA);
+	serial_source_free(&src);
+
+	ck_assert_int_eq(serial_source_csv(&src, "/nonexistent/serials.csv"),
+		-ENOENT);
+}
+END_TEST
+
+int serials_suite(Suite *s_serials)
+{
+	TCase *tc_counter;
+	TCase *tc_csv;
+
+	tc_counter = tcase_create("Serial counter");
+	tc_csv = tcase_create("Serial CSV");
+
+	tcase_add_test(tc_counter, test_counter_prefix);
+	tcase_add_test(tc_counter, test_counter_rollover);
+
+	tcase_add_checked_fixture(tc_csv, setup_csv, teardown_csv);
+	tcase_add_test(tc_csv, test_csv);
+
+	suite_add_tcase(s_serials, tc_counter);
+	suite_add_tcase(s_serials, tc_csv);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for eeprom_serials
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_EEPROM_SERIALS_H
+#define CHECK_EEPROM_SERIALS_H
+
+/**
+ * @brief Add serial source test cases to the given suite
+ *
+ * @param serials_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int serials_suite(Suite *serials_suite);
+
+#endif /* CHECK_EEPROM_SERIALS_H */
@@ -0,0 +1,173 @@
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dummy_usb.h"
+#include "eeprom_soak.h"
+
+#define SOAK_IMAGE_SIZE	256
+
+static libusb_device_handle *soak_dev;
+static uint8_t soak_image[SOAK_IMAGE_SIZE];
+
+void setup_soak()
+{
+	int i;
+
+	soak_dev = libusb_device_handle_create();
+	ck_assert_ptr_ne(soak_dev, NULL);
+
+	for (i = 0; i < SOAK_IMAGE_SIZE; i++)
+		soak_image[i] = i * 7;
+}
+
+void teardown_soak()
+{
+	if (soak_dev)
+		libusb_device_handle_free(&soak_dev);
+}
+
+/**
+ * @test eeprom_soak_classify()
+ */
+START_TEST(test_soak_classify)
+{
+	ck_assert_int_eq(eeprom_soak_classify(256, 256), SOAK_PASS);
+	ck_assert_int_eq(eeprom_soak_classify(255, 256), SOAK_SHORT);
+	ck_assert_int_eq(eeprom_soak_classify(0, 256), SOAK_SHORT);
+	ck_assert_int_eq(eeprom_soak_classify(-ETIMEDOUT, 256), SOAK_TIMEOUT);
+	ck_assert_int_eq(eeprom_soak_classify(-EIO, 256), SOAK_ERROR);
+	ck_assert_int_eq(eeprom_soak_classify(-EPIPE, 256), SOAK_ERROR);
+}
+END_TEST
+
+/**
+ * @test eeprom_soak_compare()
+ */
+START_TEST(test_soak_compare)
+{
+	struct soak_iteration it;
+	uint8_t read[SOAK_IMAGE_SIZE];
+
+	memcpy(read, soak_image, sizeof(read));
+	memset(&it, 0, sizeof(it));
+	it.step = SOAK_WRITE;
+	eeprom_soak_compare(&it, soak_image, read, sizeof(read));
+	ck_assert_int_eq(it.fault, SOAK_PASS);
+	ck_assert_int_eq(it.step, SOAK_WRITE);
+	ck_assert_int_eq(it.mismatches, 0);
+
+	read[3] ^= 0x01;
+	read[10] ^= 0x80;
+	read[200] = ~read[200];
+	eeprom_soak_compare(&it, soak_image, read, sizeof(read));
+	ck_assert_int_eq(it.fault, SOAK_MISMATCH);
+	ck_assert_int_eq(it.step, SOAK_VERIFY);
+	ck_assert_int_eq(it.first, 3);
+	ck_assert_int_eq(it.last, 200);
+	ck_assert_int_eq(it.mismatches, 3);
+
+	/* a single byte at either end */
+	memcpy(read, soak_image, sizeof(read));
+	read[0] ^= 0xff;
+	memset(&it, 0, sizeof(it));
+	eeprom_soak_compare(&it, soak_image, read, sizeof(read));
+	ck_assert_int_eq(it.first, 0);
+	ck_assert_int_eq(it.last, 0);
+	ck_assert_int_eq(it.mismatches, 1);
+
+	memcpy(read, soak_image, sizeof(read));
+	read[SOAK_IMAGE_SIZE - 1] ^= 0xff;
+	memset(&it, 0, sizeof(it));
+	eeprom_soak_compare(&it, soak_image, read, sizeof(read));
+	ck_assert_int_eq(it.first, SOAK_IMAGE_SIZE - 1);
+	ck_assert_int_eq(it.last, SOAK_IMAGE_SIZE - 1);
+	ck_assert_int_eq(it.mismatches, 1);
+}
+END_TEST
+
+/**
+ * @test eeprom_soak_percentile() takes the nearest rank
+ */
+START_TEST(test_soak_percentile)
+{
+	static const uint64_t three[] = { 10, 20, 30 };
+	uint64_t ns[100];
+	int i;
+
+	for (i = 0; i < 100; i++)
+		ns[i] = i + 1;
+
+	ck_assert_uint_eq(eeprom_soak_percentile(ns, 100, 0), 1);
+	ck_assert_uint_eq(eeprom_soak_percentile(ns, 100, 1), 1);
+	ck_assert_uint_eq(eeprom_soak_percentile(ns, 100, 50), 50);
+	ck_assert_uint_eq(eeprom_soak_percentile(ns, 100, 99), 99);
+	ck_assert_uint_eq(eeprom_soak_percentile(ns, 100, 100), 100);
+
+	ck_assert_uint_eq(eeprom_soak_percentile(three, 3, 50), 20);
+	ck_assert_uint_eq(eeprom_soak_percentile(three, 3, 99), 30);
+	ck_assert_uint_eq(eeprom_soak_percentile(three, 3, 34), 20);
+	ck_assert_uint_eq(eeprom_soak_percentile(three, 3, 33), 10);
+
+	ck_assert_uint_eq(eeprom_soak_percentile(three, 1, 50), 10);
+	ck_assert_uint_eq(eeprom_soak_percentile(three, 1, 99), 10);
+}
+END_TEST
+
+/**
+ * @test a failed step ends the iteration, the next one starts over
+ */
+START_TEST(test_soak_run)
+{
+	struct soak_iteration *results;
+	volatile sig_atomic_t stop = 0;
+
+	/* the first erase request times out, it is not retried by default */
+	soak_dev->failures = 1;
+	ck_assert_int_eq(eeprom_soak(soak_dev, soak_image, SOAK_IMAGE_SIZE, 3,
+		0, &stop, &results), 3);
+
+	ck_assert_int_eq(results[0].fault, SOAK_TIMEOUT);
+	ck_assert_int_eq(results[0].step, SOAK_ERASE);
+	ck_assert_int_eq(results[0].result, -ETIMEDOUT);
+	ck_assert_uint_eq(results[0].ns[SOAK_WRITE], 0);
+	ck_assert_uint_eq(results[0].ns[SOAK_VERIFY], 0);
+
+	ck_assert_int_eq(results[1].fault, SOAK_PASS);
+	ck_assert_int_eq(results[2].fault, SOAK_PASS);
+	ck_assert_int_eq(results[2].mismatches, 0);
+	ck_assert_int_eq(memcmp(soak_dev->eeprom, soak_image,
+		SOAK_IMAGE_SIZE), 0);
+	free(results);
+
+	stop = 1;
+	ck_assert_int_eq(eeprom_soak(soak_dev, soak_image, SOAK_IMAGE_SIZE, 3,
+		0, &stop, &results), 0);
+	free(results);
+
+	ck_assert_int_eq(eeprom_soak(soak_dev, soak_image, SOAK_IMAGE_SIZE, 0,
+		0, NULL, &results), -EINVAL);
+	ck_assert_int_eq(eeprom_soak(soak_dev, soak_image, SOAK_IMAGE_SIZE,
+		SOAK_LIMIT + 1, 0, NULL, &results), -EINVAL);
+	ck_assert_int_eq(eeprom_soak(NULL, soak_image, SOAK_IMAGE_SIZE, 1,
+		0, NULL, &results), -EINVAL);
+}
+END_TEST
+
+int soak_suite(Suite *s_soak)
+{
+	TCase *tc_soak;
+
+	tc_soak = tcase_create("EEPROM soak");
+
+	tcase_add_checked_fixture(tc_soak, setup_soak, teardown_soak);
+	tcase_add_test(tc_soak, test_soak_classify);
+	tcase_add_test(tc_soak, test_soak_compare);
+	tcase_add_test(tc_soak, test_soak_percentile);
+	tcase_add_test(tc_soak, test_soak_run);
+
+	suite_add_tcase(s_soak, tc_soak);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for eeprom_soak
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_EEPROM_SOAK_H
+#define CHECK_EEPROM_SOAK_H
+
+/**
+ * @brief Add soak test cases to the given suite
+ *
+ * @param soak_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int soak_suite(Suite *soak_suite);
+
+#endif /* CHECK_EEPROM_SOAK_H */
@@ -3,7 +3,9 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "file_io.h"
 
@@ -136,13 +138,64 @@ START_TEST(test_file_write)
 }
 END_TEST
 
+START_TEST(test_file_replace_boundaries)
+{
+	char name[5000];
+
+	ck_assert_int_eq(file_replace(NULL, cmp_buffer, sizeof(cmp_buffer)),
+		-EINVAL);
+	ck_assert_int_eq(file_replace(file_name, NULL, sizeof(cmp_buffer)),
+		-EINVAL);
+	ck_assert_int_eq(file_replace(file_name, cmp_buffer, 0), -EINVAL);
+
+	memset(name, 'a', sizeof(name) - 1);
+	name[sizeof(name) - 1] = '\0';
+	ck_assert_int_eq(file_replace(name, cmp_buffer, sizeof(cmp_buffer)),
+		-ENAMETOOLONG);
+
+	ck_assert_int_eq(file_replace("/nonexistent/file", cmp_buffer,
+		sizeof(cmp_buffer)), -ENOENT);
+}
+END_TEST
+
+START_TEST(test_file_replace)
+{
+	char tmp[sizeof(file_name) + 16];
+	char dir[sizeof(file_name) + 8];
+	ssize_t ret_val;
+
+	/* the new contents replace the old ones as a whole */
+	ret_val = file_replace(file_name, cmp_buffer + 8, 16);
+	ck_assert_int_eq(ret_val, 16);
+
+	ret_val = file_read(file_name, &file_buffer, 0);
+	ck_assert_int_eq(ret_val, 16);
+	ck_assert_int_eq(memcmp(file_buffer, cmp_buffer + 8, 16), 0);
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", file_name);
+	ck_assert_int_eq(access(tmp, F_OK), -1);
+
+	/* a failed rename leaves no temporary file behind */
+	snprintf(dir, sizeof(dir), "%s.d", file_name);
+	ck_assert_int_eq(mkdir(dir, 0700), 0);
+	ret_val = file_replace(dir, cmp_buffer, sizeof(cmp_buffer));
+	ck_assert_int_eq(ret_val, -EISDIR);
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", dir);
+	ck_assert_int_eq(access(tmp, F_OK), -1);
+	ck_assert_int_eq(rmdir(dir), 0);
+}
+END_TEST
+
 Suite * file_io_suite(Suite *s_file)
 {
 	TCase *tc_file_write;
 	TCase *tc_file_read;
+	TCase *tc_file_replace;
 
 	tc_file_read = tcase_create("file read");
 	tc_file_write = tcase_create("file write");
+	tc_file_replace = tcase_create("file replace");
 
 	tcase_add_unchecked_fixture(tc_file_read, setup_create_file_with_data, teardown);
 	tcase_add_test(tc_file_read, test_file_read);
@@ -153,8 +206,14 @@ Suite * file_io_suite(Suite *s_file)
 	tcase_add_test(tc_file_write, test_file_write);
 	tcase_add_test(tc_file_write, test_file_write_boundaries);
 
+	tcase_add_unchecked_fixture(tc_file_replace,
+			setup_create_file_with_data, teardown);
+	tcase_add_test(tc_file_replace, test_file_replace);
+	tcase_add_test(tc_file_replace, test_file_replace_boundaries);
+
 	suite_add_tcase(s_file, tc_file_read);
 	suite_add_tcase(s_file, tc_file_write);
+	suite_add_tcase(s_file, tc_file_replace);
 
 	return EXIT_SUCCESS;
 }
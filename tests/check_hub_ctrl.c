@@ -2,7 +2,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "check_ctrld.h"
+#include "check_eeprom_checkpoint.h"
+#include "check_eeprom_image.h"
+#include "check_eeprom_multi.h"
+#include "check_eeprom_serials.h"
+#include "check_eeprom_soak.h"
+#include "check_hubctrl.h"
+#include "check_options.h"
+#include "check_power_seq.h"
+#include "check_usb_devnode.h"
 #include "check_usb_eeprom.h"
+#include "check_usb_policy.h"
+#include "check_usb_stats.h"
+#include "check_usb_sysfs.h"
 #include "check_file_io.h"
 
 int main(void)
@@ -20,6 +33,32 @@ int main(void)
 
 	eeprom_suite(master_suite);
 
+	multi_suite(master_suite);
+
+	soak_suite(master_suite);
+
+	checkpoint_suite(master_suite);
+
+	image_suite(master_suite);
+
+	devnode_suite(master_suite);
+
+	sysfs_suite(master_suite);
+
+	stats_suite(master_suite);
+
+	policy_suite(master_suite);
+
+	hubctrl_suite(master_suite);
+
+	power_suite(master_suite);
+
+	serials_suite(master_suite);
+
+	ctrld_suite(master_suite);
+
+	options_suite(master_suite);
+
 	srunner_set_tap(sr, filename);
 
 	srunner_run_all(sr, CK_MINIMAL);
@@ -0,0 +1,213 @@
+#include <check.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dummy_usb.h"
+#include "hubctrl.h"
+#include "hubctrl_usb.h"
+
+static struct hubctrl *ctx;
+
+void setup_hubctrl()
+{
+	ck_assert_int_eq(dummy_bus_create(3, 4), 0);
+	ck_assert_int_eq(hubctrl_new(&ctx), 0);
+}
+
+void teardown_hubctrl()
+{
+	hubctrl_free(ctx);
+	ctx = NULL;
+	dummy_bus_destroy();
+}
+
+START_TEST(test_hubctrl_enumerate)
+{
+	struct hubctrl_hub info;
+
+	ck_assert_int_eq(hubctrl_count(ctx), 0);
+	ck_assert_int_eq(hubctrl_enumerate(ctx), 3);
+	ck_assert_int_eq(hubctrl_count(ctx), 3);
+
+	ck_assert_int_eq(hubctrl_info(ctx, 1, &info), 0);
+	ck_assert_int_eq(info.busnum, 1);
+	ck_assert_int_eq(info.devnum, 3);
+	ck_assert_uint_eq(info.vendor, 0x04b4);
+	ck_assert_str_eq(info.path, "1-2");
+	ck_assert_int_eq(info.eeprom, 1);
+	/* nothing is opened by the enumeration */
+	ck_assert_int_eq(info.nports, 0);
+	ck_assert_int_eq(info.pwr_good_ms, -1);
+	ck_assert_int_eq(hubctrl_info(ctx, 3, &info), -ENODEV);
+
+	ck_assert_int_eq(hubctrl_find(ctx, 1, 4), 2);
+	ck_assert_int_eq(hubctrl_find(ctx, 2, 4), -ENODEV);
+	ck_assert_int_eq(hubctrl_find_path(ctx, "1-1"), 0);
+	ck_assert_int_eq(hubctrl_find_path(ctx, "1-1.1"), -ENODEV);
+
+	ck_assert_int_eq(hubctrl_open(ctx, 1), 0);
+	ck_assert_int_eq(hubctrl_info(ctx, 1, &info), 0);
+	ck_assert_int_eq(info.nports, 4);
+	ck_assert_int_eq(info.per_port_power, 1);
+	ck_assert_int_eq(info.indicators, 1);
+	ck_assert_int_eq(info.pwr_good_ms, 100);
+	hubctrl_close(ctx, 1);
+
+	/* a new enumeration starts over */
+	ck_assert_int_eq(dummy_bus_create(1, 4), 0);
+	ck_assert_int_eq(hubctrl_enumerate(ctx), 1);
+	ck_assert_int_eq(hubctrl_open(ctx, 1), -ENODEV);
+}
+END_TEST
+
+START_TEST(test_hubctrl_ports)
+{
+	uint16_t status;
+	uint16_t change;
+
+	ck_assert_int_eq(hubctrl_enumerate(ctx), 3);
+
+	ck_assert_int_eq(hubctrl_get_status(ctx, 0, 2, &status, &change), 0);
+	ck_assert_uint_eq(status, 0x0103);
+	ck_assert_uint_eq(change, 0);
+
+	ck_assert_int_eq(hubctrl_set_power(ctx, 0, 2, 0), 0);
+	ck_assert_int_eq(hubctrl_get_status(ctx, 0, 2, &status, &change), 0);
+	ck_assert_uint_eq(status, 0);
+	ck_assert_uint_eq(change, 0x0001);
+	ck_assert_int_eq(hubctrl_get_status(ctx, 0, 1, &status, NULL), 0);
+	ck_assert_uint_eq(status, 0x0103);
+
+	ck_assert_int_eq(hubctrl_set_indicator(ctx, 2, 4, 2), 0);
+	ck_assert_uint_eq(dummy_bus_device(2)->indicator[3], 2);
+	ck_assert_int_eq(hubctrl_set_indicator(ctx, 2, 4, 4), -EINVAL);
+
+	ck_assert_int_eq(hubctrl_set_power(ctx, 0, 5, 0), -EINVAL);
+	ck_assert_int_eq(hubctrl_set_power(ctx, 0, 0, 0), -EINVAL);
+	ck_assert_int_eq(hubctrl_set_power(ctx, 3, 1, 0), -ENODEV);
+}
+END_TEST
+
+START_TEST(test_hubctrl_batch)
+{
+	struct hubctrl_port_req reqs[] = {
+		{ .hub = 0, .port = 1, .op = HUBCTRL_OP_POWER, .value = 0 },
+		{ .hub = 1, .port = 3, .op = HUBCTRL_OP_POWER, .value = 0 },
+		{ .hub = 2, .port = 9, .op = HUBCTRL_OP_POWER, .value = 0 },
+		{ .hub = 0, .port = 1, .op = HUBCTRL_OP_STATUS },
+		{ .hub = 1, .port = 2, .op = HUBCTRL_OP_STATUS },
+		{ .hub = 2, .port = 1, .op = HUBCTRL_OP_INDICATOR, .value = 1 },
+	};
+
+	ck_assert_int_eq(hubctrl_enumerate(ctx), 3);
+	ck_assert_int_eq(hubctrl_batch(ctx, reqs, 6), 5);
+
+	ck_assert_int_eq(reqs[0].result, 0);
+	ck_assert_int_eq(reqs[2].result, -EINVAL);
+	/* requests to one hub keep their order */
+	ck_assert_int_eq(reqs[3].result, 0);
+	ck_assert_uint_eq(reqs[3].status, 0);
+	ck_assert_uint_eq(reqs[4].status, 0x0103);
+	ck_assert_uint_eq(dummy_bus_device(1)->port_status[2], 0);
+	ck_assert_uint_eq(dummy_bus_device(2)->indicator[0], 1);
+	ck_assert(reqs[0].submit_ns > 0);
+	ck_assert(reqs[0].done_ns >= reqs[0].submit_ns);
+	ck_assert(reqs[3].submit_ns >= reqs[0].submit_ns);
+	ck_assert_uint_eq(reqs[2].submit_ns, 0);
+
+	ck_assert_int_eq(hubctrl_batch(ctx, reqs, 0), 0);
+	ck_assert_int_eq(hubctrl_batch(NULL, reqs, 1), -EINVAL);
+}
+END_TEST
+
+START_TEST(test_hubctrl_eeprom)
+{
+	uint8_t image[256];
+	uint8_t buffer[256];
+
+	ck_assert_int_eq(hubctrl_enumerate(ctx), 3);
+
+	memset(image, 0x5a, sizeof(image));
+	ck_assert_int_eq(hubctrl_eeprom_write(ctx, 1, image, sizeof(image),
+		0), sizeof(image));
+	ck_assert_int_eq(hubctrl_eeprom_read(ctx, 1, buffer, sizeof(buffer)),
+		sizeof(buffer));
+	ck_assert_int_eq(memcmp(image, buffer, sizeof(image)), 0);
+	ck_assert_int_eq(hubctrl_eeprom_write(ctx, 1, image, sizeof(image),
+		1), 0);
+
+	ck_assert_int_eq(hubctrl_eeprom_erase(ctx, 1, sizeof(buffer)),
+		sizeof(buffer));
+	ck_assert_uint_eq(dummy_bus_device(1)->eeprom[0], 0xff);
+	ck_assert_uint_eq(dummy_bus_device(0)->eeprom[0], 0xff);
+	ck_assert_int_eq(hubctrl_eeprom_read(ctx, 5, buffer, sizeof(buffer)),
+		-ENODEV);
+
+	/* a hub of another vendor has no EEPROM to access */
+	dummy_bus_device(2)->desc.idVendor = 0x0424;
+	ck_assert_int_eq(hubctrl_enumerate(ctx), 3);
+	ck_assert_int_eq(hubctrl_eeprom_read(ctx, 2, buffer, sizeof(buffer)),
+		-ENOTSUP);
+	ck_assert_int_eq(hubctrl_eeprom_write(ctx, 2, image, sizeof(image),
+		0), -ENOTSUP);
+	ck_assert_int_eq(hubctrl_eeprom_erase(ctx, 2, sizeof(buffer)),
+		-ENOTSUP);
+}
+END_TEST
+
+static int match_bus1(libusb_device *dev, void *data)
+{
+	(*(int *)data)++;
+
+	return libusb_get_device_address(dev) != 3;
+}
+
+START_TEST(test_hubctrl_registry)
+{
+	struct hubctrl_hub info;
+	int seen = 0;
+
+	ck_assert_int_eq(hub_ctx_enumerate(ctx, match_bus1, &seen), 2);
+	ck_assert_int_eq(seen, 3);
+	ck_assert_ptr_eq(hub_ctx_device(ctx, 1), dummy_bus_device(2));
+	ck_assert_ptr_eq(hub_ctx_handle(ctx, 1), NULL);
+
+	/* added hubs go last, removed ones leave no gap */
+	ck_assert_int_eq(hub_ctx_add(ctx, dummy_bus_device(1)), 2);
+	ck_assert_int_eq(hubctrl_open(ctx, 2), 0);
+	ck_assert_ptr_ne(hub_ctx_handle(ctx, 2), NULL);
+	hub_ctx_remove(ctx, 0);
+	ck_assert_int_eq(hubctrl_count(ctx), 2);
+	ck_assert_int_eq(hubctrl_info(ctx, 1, &info), 0);
+	ck_assert_int_eq(info.devnum, 3);
+	ck_assert_int_eq(info.nports, 4);
+	ck_assert_ptr_ne(hub_ctx_handle(ctx, 1), NULL);
+	hub_ctx_remove(ctx, 5);
+	ck_assert_int_eq(hubctrl_count(ctx), 2);
+
+	hub_ctx_clear(ctx);
+	ck_assert_int_eq(hubctrl_count(ctx), 0);
+	ck_assert_ptr_eq(hub_ctx_device(ctx, 0), NULL);
+}
+END_TEST
+
+int hubctrl_suite(Suite *s_hubctrl)
+{
+	TCase *tc_hubctrl;
+
+	tc_hubctrl = tcase_create("libhubctrl");
+
+	tcase_add_checked_fixture(tc_hubctrl, setup_hubctrl,
+		teardown_hubctrl);
+	tcase_add_test(tc_hubctrl, test_hubctrl_enumerate);
+	tcase_add_test(tc_hubctrl, test_hubctrl_ports);
+	tcase_add_test(tc_hubctrl, test_hubctrl_batch);
+	tcase_add_test(tc_hubctrl, test_hubctrl_eeprom);
+	tcase_add_test(tc_hubctrl, test_hubctrl_registry);
+
+	suite_add_tcase(s_hubctrl, tc_hubctrl);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for libhubctrl
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_HUBCTRL_H
+#define CHECK_HUBCTRL_H
+
+/**
+ * @brief Add libhubctrl test cases to the given suite
+ *
+ * @param hubctrl_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int hubctrl_suite(Suite *hubctrl_suite);
+
+#endif /* CHECK_HUBCTRL_H */
@@ -0,0 +1,177 @@
+#include <check.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "options.h"
+#include "usb_eeprom.h"
+
+static struct hub_options opts;
+
+void setup_options()
+{
+	memset(&opts, 0, sizeof(opts));
+	opts.port_current = DEFAULT_PORT_CURRENT;
+	opts.eeprom_wait = EEPROM_WAIT_SLEEP;
+	opts.vendor = -1;
+	opts.product = -1;
+	opts.dev_class = -1;
+}
+
+void teardown_options()
+{
+	options_free(&opts);
+}
+
+/* Scan a command line split at blanks, as options_scan() of main() */
+static int scan(const char *line)
+{
+	static char buf[256];
+	char *argv[16];
+	int argc = 0;
+	char *arg;
+
+	ck_assert_uint_lt(strlen(line), sizeof(buf));
+	strcpy(buf, line);
+
+	argv[argc++] = "hub-ctrl";
+	for (arg = strtok(buf, " "); arg; arg = strtok(NULL, " ")) {
+		ck_assert_int_lt(argc, 15);
+		argv[argc++] = arg;
+	}
+	argv[argc] = NULL;
+
+	/* start getopt over for each command line */
+	optind = 0;
+
+	return options_scan(&opts, argc, argv);
+}
+
+static void assert_ports(const size_t *ports, int num, size_t value)
+{
+	int i;
+
+	ck_assert_int_eq(opts.num_ops, num);
+	for (i = 0; i < num; i++) {
+		ck_assert_uint_eq(opts.ops[i].port, ports[i]);
+		ck_assert_uint_eq(opts.ops[i].value, value);
+	}
+}
+
+/**
+ * @test ranges and single ports of a list
+ */
+START_TEST(test_ports_list)
+{
+	static const size_t ports[] = { 1, 2, 3, 4, 7 };
+
+	ck_assert_int_gt(scan("-P 1-4,7 -p 1"), 0);
+	assert_ports(ports, 5, 1);
+}
+END_TEST
+
+/**
+ * @test without -P, port 1 is switched
+ */
+START_TEST(test_ports_default)
+{
+	static const size_t ports[] = { 1 };
+
+	ck_assert_int_gt(scan("-p 0"), 0);
+	assert_ports(ports, 1, 0);
+}
+END_TEST
+
+/**
+ * @test a port listed twice is switched once
+ */
+START_TEST(test_ports_duplicates)
+{
+	static const size_t ports[] = { 1, 2, 3, 4 };
+
+	ck_assert_int_gt(scan("-P 1,1,2-3,3,2-4 -p 0"), 0);
+	assert_ports(ports, 4, 0);
+}
+END_TEST
+
+/**
+ * @test reversed ranges and ports beyond the limit
+ */
+START_TEST(test_ports_range)
+{
+	ck_assert_int_eq(scan("-P 4-1 -p 1"), -ERANGE);
+	options_free(&opts);
+	ck_assert_int_eq(scan("-P 0 -p 1"), -ERANGE);
+	options_free(&opts);
+	ck_assert_int_eq(scan("-P 1-256 -p 1"), -ERANGE);
+	options_free(&opts);
+
+	ck_assert_int_gt(scan("-P 255 -p 1"), 0);
+	ck_assert_int_eq(opts.num_ops, 1);
+	ck_assert_uint_eq(opts.ops[0].port, 255);
+}
+END_TEST
+
+/**
+ * @test numbers that do not fit and malformed lists
+ */
+START_TEST(test_ports_invalid)
+{
+	ck_assert_int_eq(scan("-P 99999999999999999999 -p 1"), -EINVAL);
+	options_free(&opts);
+	ck_assert_int_eq(scan("-P 1-99999999999999999999 -p 1"), -EINVAL);
+	options_free(&opts);
+	ck_assert_int_eq(scan("-P 1,,2 -p 1"), -EINVAL);
+	options_free(&opts);
+	ck_assert_int_eq(scan("-P 1- -p 1"), -EINVAL);
+	options_free(&opts);
+	ck_assert_int_eq(scan("-P 1x -p 1"), -EINVAL);
+	options_free(&opts);
+	/* strtoul() takes the minus, the port is out of range */
+	ck_assert_int_eq(scan("-P -1 -p 1"), -ERANGE);
+}
+END_TEST
+
+/**
+ * @test BUS:DEV:PORTS=VALUE operands share the list syntax
+ */
+START_TEST(test_operands)
+{
+	ck_assert_int_gt(scan("1:4:1-3,3=0 1:5:2=1"), 0);
+	ck_assert_int_eq(opts.operands, 1);
+	ck_assert_int_eq(opts.num_ops, 4);
+	ck_assert_uint_eq(opts.ops[2].devnum, 4);
+	ck_assert_uint_eq(opts.ops[2].port, 3);
+	ck_assert_uint_eq(opts.ops[2].value, 0);
+	ck_assert_uint_eq(opts.ops[3].devnum, 5);
+	ck_assert_uint_eq(opts.ops[3].port, 2);
+	ck_assert_uint_eq(opts.ops[3].value, 1);
+	options_free(&opts);
+
+	setup_options();
+	ck_assert_int_eq(scan("1:4:3-1=0"), -EINVAL);
+	options_free(&opts);
+	setup_options();
+	ck_assert_int_eq(scan("1:4:300=0"), -EINVAL);
+}
+END_TEST
+
+int options_suite(Suite *s_options)
+{
+	TCase *tc_ports;
+
+	tc_ports = tcase_create("Port lists");
+
+	tcase_add_checked_fixture(tc_ports, setup_options, teardown_options);
+	tcase_add_test(tc_ports, test_ports_list);
+	tcase_add_test(tc_ports, test_ports_default);
+	tcase_add_test(tc_ports, test_ports_duplicates);
+	tcase_add_test(tc_ports, test_ports_range);
+	tcase_add_test(tc_ports, test_ports_invalid);
+	tcase_add_test(tc_ports, test_operands);
+
+	suite_add_tcase(s_options, tc_ports);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for the hub-ctrl options
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_OPTIONS_H
+#define CHECK_OPTIONS_H
+
+/**
+ * @brief Add option parsing test cases to the given suite
+ *
+ * @param options_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int options_suite(Suite *options_suite);
+
+#endif /* CHECK_OPTIONS_H */
@@ -0,0 +1,381 @@
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dummy_usb.h"
+#include "hub_class.h"
+#include "power_seq.h"
+
+#define PORT_STAT_POWER		0x0100
+
+/* registry index of the simulated hubs, by their number */
+static int cascade[4];
+
+static void fill_steps(struct power_step *steps, const unsigned int *settle,
+	int num)
+{
+	int i;
+
+	memset(steps, 0, num * sizeof(*steps));
+	for (i = 0; i < num; i++) {
+		steps[i].port = i + 1;
+		steps[i].settle_ms = settle[i];
+	}
+}
+
+/* Most ports settling at once at any start of a step */
+static int max_settling(const struct power_step *steps, int num)
+{
+	int most = 0;
+	int count;
+	int i;
+	int j;
+
+	for (i = 0; i < num; i++) {
+		count = 0;
+		for (j = 0; j < num; j++)
+			if (steps[j].start_ms <= steps[i].start_ms &&
+					steps[i].start_ms < steps[j].start_ms +
+						steps[j].settle_ms)
+				count++;
+		if (count > most)
+			most = count;
+	}
+
+	return most;
+}
+
+/**
+ * @test a budget not covering a single port is refused
+ */
+START_TEST(test_plan_budget)
+{
+	static const unsigned int settle[] = { 100, 100 };
+	struct power_step steps[2];
+
+	fill_steps(steps, settle, 2);
+	ck_assert_int_eq(power_seq_plan(steps, 2, 499, 500), -EINVAL);
+	ck_assert_int_eq(power_seq_plan(steps, 2, 500, 0), -EINVAL);
+
+	/* exactly one port at a time */
+	ck_assert_int_eq(power_seq_plan(steps, 2, 999, 500), 200);
+	ck_assert_uint_eq(steps[0].start_ms, 0);
+	ck_assert_uint_eq(steps[1].start_ms, 100);
+
+	ck_assert_int_eq(power_seq_plan(steps, 0, 1000, 500), 0);
+}
+END_TEST
+
+/**
+ * @test with a slot for every port all of them go at once
+ */
+START_TEST(test_plan_all_at_once)
+{
+	static const unsigned int settle[] = { 20, 40, 30 };
+	struct power_step steps[3];
+	int i;
+
+	fill_steps(steps, settle, 3);
+	ck_assert_int_eq(power_seq_plan(steps, 3, 10000, 500), 40);
+	for (i = 0; i < 3; i++)
+		ck_assert_uint_eq(steps[i].start_ms, 0);
+
+	/* longest first within a wave */
+	ck_assert_int_eq(steps[0].port, 2);
+	ck_assert_int_eq(steps[1].port, 3);
+	ck_assert_int_eq(steps[2].port, 1);
+
+	fill_steps(steps, settle, 3);
+	ck_assert_int_eq(power_seq_plan(steps, 3, 1500, 500), 40);
+}
+END_TEST
+
+/**
+ * @test hubs with different settle times share the budget
+ */
+START_TEST(test_plan_mixed)
+{
+	static const unsigned int settle[] = { 50, 100, 30, 50, 20, 100 };
+	struct power_step steps[6];
+	int i;
+
+	/* two at a time: 100 + 50 + 30 and 100 + 50 + 20 */
+	fill_steps(steps, settle, 6);
+	ck_assert_int_eq(power_seq_plan(steps, 6, 1000, 500), 180);
+	ck_assert_int_le(max_settling(steps, 6), 2);
+
+	for (i = 1; i < 6; i++)
+		ck_assert_uint_le(steps[i - 1].start_ms, steps[i].start_ms);
+	ck_assert_uint_eq(steps[0].settle_ms, 100);
+	ck_assert_uint_eq(steps[1].settle_ms, 100);
+	ck_assert_uint_eq(steps[0].start_ms, 0);
+	ck_assert_uint_eq(steps[1].start_ms, 0);
+
+	/* three at a time: 100 + 30, 100 + 20 and 50 + 50 */
+	fill_steps(steps, settle, 6);
+	ck_assert_int_eq(power_seq_plan(steps, 6, 1500, 500), 130);
+	ck_assert_int_le(max_settling(steps, 6), 3);
+}
+END_TEST
+
+/*
+ * Hub 1 behind port 2 of hub 0, hub 2 behind port 3 of hub 1 and hub 3
+ * behind port 4 of hub 0, four ports each.
+ */
+void setup_cascade()
+{
+	int i;
+
+	ck_assert_int_eq(dummy_bus_create(4, 4), 0);
+	ck_assert_int_eq(dummy_bus_attach(1, 0, 2), 0);
+	ck_assert_int_eq(dummy_bus_attach(2, 1, 3), 0);
+	ck_assert_int_eq(dummy_bus_attach(3, 0, 4), 0);
+
+	libusb_init(NULL);
+	hub_sysfs_root = NULL;
+	ck_assert_int_eq(usb_find_hubs(0), 4);
+
+	for (i = 0; i < 4; i++) {
+		cascade[i] = get_hub(1, dummy_bus_device(i)->devnum);
+		ck_assert_int_ge(cascade[i], 0);
+	}
+}
+
+void teardown_cascade()
+{
+	hub_registry_exit();
+	libusb_exit(NULL);
+	dummy_bus_destroy();
+}
+
+static int powered(int index, int port)
+{
+	return !!(dummy_bus_device(index)->port_status[port - 1] &
+		PORT_STAT_POWER);
+}
+
+/* Bit 4 * n + port - 1 for each port of hub n */
+static unsigned int port_set(const struct hub_port_req *reqs, int num)
+{
+	unsigned int set = 0;
+	int i;
+	int j;
+
+	for (i = 0; i < num; i++)
+		for (j = 0; j < 4; j++)
+			if (reqs[i].hub == cascade[j])
+				set |= 1U << (4 * j + reqs[i].port - 1);
+
+	return set;
+}
+
+/**
+ * @test a port stands for itself and every hub behind it
+ */
+START_TEST(test_subtree_port)
+{
+	struct hub_port_req *reqs;
+	int num = 1;
+	int i;
+
+	reqs = calloc(1, sizeof(*reqs));
+	ck_assert_ptr_ne(reqs, NULL);
+	reqs[0].hub = cascade[0];
+	reqs[0].port = 2;
+	reqs[0].feature = USB_PORT_FEAT_POWER;
+
+	ck_assert_int_eq(power_seq_subtree(&reqs, &num), 0);
+	ck_assert_int_eq(num, 9);
+	/* port 2 of hub 0, all of hubs 1 and 2, nothing of hub 3 */
+	ck_assert_uint_eq(port_set(reqs, num), 0x0ff2);
+	for (i = 0; i < num; i++) {
+		ck_assert_int_eq(reqs[i].feature, USB_PORT_FEAT_POWER);
+		ck_assert_int_eq(reqs[i].value, 0);
+	}
+
+	free(reqs);
+}
+END_TEST
+
+/**
+ * @test port 0 stands for all ports of its hub
+ */
+START_TEST(test_subtree_hub)
+{
+	struct hub_port_req *reqs;
+	int num = 1;
+
+	reqs = calloc(1, sizeof(*reqs));
+	ck_assert_ptr_ne(reqs, NULL);
+	reqs[0].hub = cascade[1];
+	reqs[0].value = 1;
+
+	ck_assert_int_eq(power_seq_subtree(&reqs, &num), 0);
+	ck_assert_int_eq(num, 8);
+	ck_assert_uint_eq(port_set(reqs, num), 0x0ff0);
+
+	/* a leaf hub is just its own ports */
+	reqs[0].hub = cascade[3];
+	reqs[0].port = 0;
+	num = 1;
+	ck_assert_int_eq(power_seq_subtree(&reqs, &num), 0);
+	ck_assert_int_eq(num, 4);
+	ck_assert_uint_eq(port_set(reqs, num), 0xf000);
+
+	free(reqs);
+}
+END_TEST
+
+/**
+ * @test off goes from the deepest hub up, on from the top down
+ */
+START_TEST(test_branch_levels)
+{
+	struct hub_port_req *reqs;
+	int num = 1;
+	int i;
+
+	reqs = calloc(1, sizeof(*reqs));
+	ck_assert_ptr_ne(reqs, NULL);
+	reqs[0].hub = cascade[0];
+	reqs[0].port = 2;
+	ck_assert_int_eq(power_seq_subtree(&reqs, &num), 0);
+
+	ck_assert_int_eq(power_seq_branch(reqs, num), 3);
+	for (i = 0; i < num; i++) {
+		ck_assert_int_eq(reqs[i].result, 0);
+		if (i)
+			ck_assert_int_ge(hub_depth(reqs[i - 1].hub),
+				hub_depth(reqs[i].hub));
+	}
+	ck_assert_int_eq(reqs[0].hub, cascade[2]);
+	ck_assert_int_eq(reqs[num - 1].hub, cascade[0]);
+	/* each level completed before the next one was sent */
+	for (i = 1; i < num; i++)
+		if (reqs[i].hub != reqs[i - 1].hub)
+			ck_assert_uint_le(reqs[i - 1].done_ns,
+				reqs[i].submit_ns);
+
+	for (i = 1; i <= 4; i++) {
+		ck_assert_int_eq(powered(1, i), 0);
+		ck_assert_int_eq(powered(2, i), 0);
+		ck_assert_int_eq(powered(3, i), 1);
+		ck_assert_int_eq(powered(0, i), i != 2);
+	}
+
+	for (i = 0; i < num; i++)
+		reqs[i].value = 1;
+	ck_assert_int_eq(power_seq_branch(reqs, num), 3);
+	for (i = 1; i < num; i++)
+		ck_assert_int_le(hub_depth(reqs[i - 1].hub),
+			hub_depth(reqs[i].hub));
+	ck_assert_int_eq(reqs[0].hub, cascade[0]);
+	ck_assert_int_eq(reqs[num - 1].hub, cascade[2]);
+	for (i = 1; i <= 4; i++) {
+		ck_assert_int_eq(powered(1, i), 1);
+		ck_assert_int_eq(powered(2, i), 1);
+	}
+
+	/* all requests must switch the same way */
+	reqs[1].value = 0;
+	ck_assert_int_eq(power_seq_branch(reqs, num), -EINVAL);
+
+	free(reqs);
+}
+END_TEST
+
+/**
+ * @test the ports go off and on again after the off-time
+ */
+START_TEST(test_cycle)
+{
+	struct hub_port_req reqs[4];
+	uint64_t off_ns = 0;
+	int timer_error = -1;
+	int i;
+
+	memset(reqs, 0, sizeof(reqs));
+	for (i = 0; i < 4; i++) {
+		reqs[i].hub = cascade[3];
+		reqs[i].port = i + 1;
+	}
+
+	ck_assert_int_eq(power_seq_cycle(reqs, 4, 20, &off_ns,
+		&timer_error), 4);
+	ck_assert_int_eq(timer_error, 0);
+	ck_assert_uint_ge(off_ns, 20000000);
+	for (i = 0; i < 4; i++) {
+		ck_assert_int_eq(reqs[i].result, 0);
+		ck_assert_int_eq(reqs[i].value, 1);
+		ck_assert_int_eq(powered(3, i + 1), 1);
+		/* the port went off in between */
+		ck_assert_uint_eq(dummy_bus_device(3)->port_change[i] & 1, 1);
+	}
+}
+END_TEST
+
+/**
+ * @test a port that failed to go off is not switched on
+ */
+START_TEST(test_cycle_failed)
+{
+	struct hub_port_req reqs[4];
+	libusb_device_handle *handle;
+	uint64_t off_ns = 0;
+	int i;
+
+	memset(reqs, 0, sizeof(reqs));
+	for (i = 0; i < 4; i++) {
+		reqs[i].hub = cascade[3];
+		reqs[i].port = i + 1;
+	}
+
+	ck_assert_int_eq(hub_open(&hubs[cascade[3]]), 0);
+	handle = hub_handle(&hubs[cascade[3]]);
+	/* the off request of port 2 times out */
+	handle->fail_pattern = 0x2;
+
+	ck_assert_int_eq(power_seq_cycle(reqs, 4, 10, &off_ns, NULL), 3);
+	ck_assert_int_eq(reqs[1].result, -ETIMEDOUT);
+	ck_assert_int_eq(reqs[1].value, 0);
+	ck_assert_uint_eq(dummy_bus_device(3)->port_change[1] & 1, 0);
+	for (i = 0; i < 4; i++) {
+		ck_assert_int_eq(powered(3, i + 1), 1);
+		if (i != 1) {
+			ck_assert_int_eq(reqs[i].result, 0);
+			ck_assert_int_eq(reqs[i].value, 1);
+		}
+	}
+}
+END_TEST
+
+int power_suite(Suite *s_power)
+{
+	TCase *tc_plan;
+	TCase *tc_branch;
+	TCase *tc_cycle;
+
+	tc_plan = tcase_create("Power-on plan");
+	tc_branch = tcase_create("Power branch");
+	tc_cycle = tcase_create("Power cycle");
+
+	tcase_add_test(tc_plan, test_plan_budget);
+	tcase_add_test(tc_plan, test_plan_all_at_once);
+	tcase_add_test(tc_plan, test_plan_mixed);
+
+	tcase_add_checked_fixture(tc_branch, setup_cascade, teardown_cascade);
+	tcase_add_test(tc_branch, test_subtree_port);
+	tcase_add_test(tc_branch, test_subtree_hub);
+	tcase_add_test(tc_branch, test_branch_levels);
+
+	tcase_add_checked_fixture(tc_cycle, setup_cascade, teardown_cascade);
+	tcase_add_test(tc_cycle, test_cycle);
+	tcase_add_test(tc_cycle, test_cycle_failed);
+
+	suite_add_tcase(s_power, tc_plan);
+	suite_add_tcase(s_power, tc_branch);
+	suite_add_tcase(s_power, tc_cycle);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for power_seq
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_POWER_SEQ_H
+#define CHECK_POWER_SEQ_H
+
+/**
+ * @brief Add power sequencing test cases to the given suite
+ *
+ * @param power_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int power_suite(Suite *power_suite);
+
+#endif /* CHECK_POWER_SEQ_H */
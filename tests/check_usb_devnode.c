@@ -0,0 +1,110 @@
+#include <check.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "usb_devnode.h"
+
+char devnode_root[] = "/tmp/devnodeXXXXXX";
+char devnode_bus[64];
+char devnode_file[80];
+
+/* fake device node tree with a single device 001/005 */
+void setup_devnode_tree()
+{
+	int fd;
+
+	ck_assert_ptr_ne(mkdtemp(devnode_root), NULL);
+
+	snprintf(devnode_bus, sizeof(devnode_bus), "%s/001", devnode_root);
+	ck_assert_int_eq(mkdir(devnode_bus, 0700), 0);
+
+	snprintf(devnode_file, sizeof(devnode_file), "%s/005", devnode_bus);
+	fd = open(devnode_file, O_CREAT | O_WRONLY, 0600);
+	ck_assert_int_ge(fd, 0);
+	close(fd);
+}
+
+void teardown_devnode_tree()
+{
+	ck_assert_int_eq(remove(devnode_file), 0);
+	ck_assert_int_eq(remove(devnode_bus), 0);
+	ck_assert_int_eq(remove(devnode_root), 0);
+	strcpy(devnode_root, "/tmp/devnodeXXXXXX");
+}
+
+START_TEST(test_devnode_path)
+{
+	char path[32];
+	int ret_val;
+
+	ret_val = usb_devnode_path(path, sizeof(path), USB_DEVNODE_ROOT, 1, 5);
+	ck_assert_int_eq(ret_val, strlen("/dev/bus/usb/001/005"));
+	ck_assert_str_eq(path, "/dev/bus/usb/001/005");
+
+	ret_val = usb_devnode_path(path, sizeof(path), "/x", 12, 127);
+	ck_assert_str_eq(path, "/x/012/127");
+}
+END_TEST
+
+START_TEST(test_devnode_path_boundaries)
+{
+	char path[32];
+	int ret_val;
+
+	/* missing buffer or root */
+	ret_val = usb_devnode_path(NULL, sizeof(path), USB_DEVNODE_ROOT, 1, 1);
+	ck_assert_int_eq(ret_val, -EINVAL);
+	ret_val = usb_devnode_path(path, sizeof(path), NULL, 1, 1);
+	ck_assert_int_eq(ret_val, -EINVAL);
+
+	/* bus or device number out of range */
+	ret_val = usb_devnode_path(path, sizeof(path), USB_DEVNODE_ROOT, 0, 1);
+	ck_assert_int_eq(ret_val, -EINVAL);
+	ret_val = usb_devnode_path(path, sizeof(path), USB_DEVNODE_ROOT, 1, 1000);
+	ck_assert_int_eq(ret_val, -EINVAL);
+
+	/* buffer too small */
+	ret_val = usb_devnode_path(path, 8, USB_DEVNODE_ROOT, 1, 1);
+	ck_assert_int_eq(ret_val, -ENAMETOOLONG);
+}
+END_TEST
+
+START_TEST(test_devnode_open)
+{
+	int fd;
+
+	fd = usb_devnode_open(devnode_root, 1, 5);
+	ck_assert_int_ge(fd, 0);
+	close(fd);
+
+	/* device and bus not present */
+	ck_assert_int_eq(usb_devnode_open(devnode_root, 1, 6), -ENOENT);
+	ck_assert_int_eq(usb_devnode_open(devnode_root, 2, 5), -ENOENT);
+}
+END_TEST
+
+int devnode_suite(Suite *s_devnode)
+{
+	TCase *tc_devnode_path;
+	TCase *tc_devnode_open;
+
+	tc_devnode_path = tcase_create("devnode path");
+	tc_devnode_open = tcase_create("devnode open");
+
+	tcase_add_test(tc_devnode_path, test_devnode_path);
+	tcase_add_test(tc_devnode_path, test_devnode_path_boundaries);
+
+	tcase_add_unchecked_fixture(tc_devnode_open, setup_devnode_tree,
+			teardown_devnode_tree);
+	tcase_add_test(tc_devnode_open, test_devnode_open);
+
+	suite_add_tcase(s_devnode, tc_devnode_path);
+	suite_add_tcase(s_devnode, tc_devnode_open);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for usb_devnode
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_USB_DEVNODE_H
+#define CHECK_USB_DEVNODE_H
+
+/**
+ * @brief Add device node test cases to the given suite
+ *
+ * @param devnode_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int devnode_suite(Suite *devnode_suite);
+
+#endif /* CHECK_USB_DEVNODE_H */
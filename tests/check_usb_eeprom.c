@@ -2,6 +2,8 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "dummy_usb.h"
 #include "usb_eeprom.h"
@@ -48,6 +50,41 @@ void teardown_device_handle_with_buffer()
 		libusb_device_handle_free(&uh);
 }
 
+void setup_write_cycle()
+{
+	struct dummy_timing timing = { .write_cycle_us = 2000 };
+
+	dummy_bus_set_timing(&timing, 1);
+	setup_device_handle();
+}
+
+void teardown_write_cycle()
+{
+	struct dummy_timing timing = { 0 };
+
+	usb_eeprom_set_wait(EEPROM_WAIT_SLEEP);
+	dummy_bus_set_timing(&timing, 1);
+	teardown_device_handle();
+}
+
+static void fill_image(uint8_t *image, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		image[i] = i;
+}
+
+static long elapsed_us(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000000L +
+		(now.tv_nsec - start->tv_nsec) / 1000;
+}
+
 START_TEST(test_eeprom_erase_boundaries)
 {
 	int ret_val = 0;
@@ -177,6 +214,361 @@ START_TEST(test_eeprom_read)
 }
 END_TEST
 
+START_TEST(test_eeprom_update_boundaries)
+{
+	int ret_val = 0;
+
+	/* size is zero */
+	ret_val = usb_eeprom_update(uh, eeprom_buffer, 0);
+	ck_assert_int_eq(ret_val, -EINVAL);
+
+	/* size to large */
+	ret_val = usb_eeprom_update(uh, eeprom_buffer, MAX_EEPROM_SIZE + 1);
+	ck_assert_int_eq(ret_val, -ERANGE);
+
+	/* missing buffer */
+	ret_val = usb_eeprom_update(uh, NULL, sizeof(eeprom_buffer));
+	ck_assert_int_eq(ret_val, -EINVAL);
+
+	/* missing usb_device_handle */
+	ret_val = usb_eeprom_update(NULL, eeprom_buffer, sizeof(eeprom_buffer));
+	ck_assert_int_eq(ret_val, -EINVAL);
+}
+END_TEST
+
+/**
+ * @test usb_eeprom_update() skips the write for identical contents
+ */
+START_TEST(test_eeprom_update_unchanged)
+{
+	uint8_t image[100];
+	int ret_val = 0;
+
+	memset(image, 0xff, sizeof(image));
+
+	ret_val = usb_eeprom_update(uh, image, sizeof(image));
+	ck_assert_int_eq(ret_val, 0);
+	ck_assert_int_eq(uh->writes, 0);
+}
+END_TEST
+
+/**
+ * @test usb_eeprom_update() rewrites changed pages only
+ */
+START_TEST(test_eeprom_update)
+{
+	struct usb_msg *msg = NULL;
+	uint8_t image[100];
+	int ret_val = 0;
+
+	memset(image, 0xff, sizeof(image));
+
+	/* last, partial page */
+	image[99] = 0x42;
+	ret_val = usb_eeprom_update(uh, image, sizeof(image));
+	ck_assert_int_eq(ret_val, 4);
+	ck_assert_int_eq(uh->writes, 1);
+
+	msg = get_usb_msg(uh);
+	ck_assert_int_eq(msg->requesttype, USB_REQ_TYPE_WRITE_EEPROM);
+	ck_assert_int_eq(msg->index, 96);
+	ck_assert_int_eq(msg->size, 4);
+
+	/* two separate pages */
+	image[0] = 0x00;
+	image[70] = 0x00;
+	ret_val = usb_eeprom_update(uh, image, sizeof(image));
+	ck_assert_int_eq(ret_val, 2 * EEPROM_PAGE_SIZE);
+	ck_assert_int_eq(uh->writes, 3);
+
+	/* consecutive pages are merged into one request */
+	image[33] = 0x00;
+	image[64] = 0x01;
+	ret_val = usb_eeprom_update(uh, image, sizeof(image));
+	ck_assert_int_eq(ret_val, 2 * EEPROM_PAGE_SIZE);
+	ck_assert_int_eq(uh->writes, 4);
+	ck_assert_int_eq(msg->index, EEPROM_PAGE_SIZE);
+
+	ck_assert_int_eq(memcmp(uh->eeprom, image, sizeof(image)), 0);
+}
+END_TEST
+
+/**
+ * @test the offset-addressed functions reject regions beyond the EEPROM
+ */
+START_TEST(test_eeprom_region_boundaries)
+{
+	uint8_t data[4] = { 0 };
+	int ret_val = 0;
+
+	ret_val = usb_eeprom_read_at(uh, 0, data, 0);
+	ck_assert_int_eq(ret_val, -EINVAL);
+
+	ret_val = usb_eeprom_read_at(uh, MAX_EEPROM_SIZE, data, 1);
+	ck_assert_int_eq(ret_val, -ERANGE);
+
+	ret_val = usb_eeprom_write_at(uh, MAX_EEPROM_SIZE - 2, data,
+		sizeof(data));
+	ck_assert_int_eq(ret_val, -ERANGE);
+
+	ret_val = usb_eeprom_write_at(uh, 0, NULL, sizeof(data));
+	ck_assert_int_eq(ret_val, -EINVAL);
+
+	ret_val = usb_eeprom_erase_at(NULL, 0, sizeof(data));
+	ck_assert_int_eq(ret_val, -EINVAL);
+
+	ck_assert_int_eq(uh->writes, 0);
+}
+END_TEST
+
+/**
+ * @test a region is written in chunks addressed by wIndex, the rest stays
+ */
+START_TEST(test_eeprom_region_write)
+{
+	struct usb_msg *msg = NULL;
+	uint8_t data[200];
+	int ret_val = 0;
+
+	memset(uh->eeprom, 0xff, MAX_EEPROM_SIZE);
+	fill_image(data, sizeof(data));
+
+	/* crosses one chunk boundary */
+	ret_val = usb_eeprom_write_at(uh, 250, data, sizeof(data));
+	ck_assert_int_eq(ret_val, sizeof(data));
+	ck_assert_int_eq(uh->writes, 2);
+	ck_assert_int_eq(uh->written, sizeof(data));
+
+	msg = get_usb_msg(uh);
+	ck_assert_int_eq(msg->requesttype, USB_REQ_TYPE_WRITE_EEPROM);
+	ck_assert_int_eq(msg->index, EEPROM_CHUNK_SIZE);
+	ck_assert_int_eq(msg->size, 250 + sizeof(data) - EEPROM_CHUNK_SIZE);
+
+	ck_assert_int_eq(memcmp(uh->eeprom + 250, data, sizeof(data)), 0);
+	ck_assert_int_eq(uh->eeprom[249], 0xff);
+	ck_assert_int_eq(uh->eeprom[250 + sizeof(data)], 0xff);
+
+	/* erasing part of it */
+	ret_val = usb_eeprom_erase_at(uh, 260, 10);
+	ck_assert_int_eq(ret_val, 10);
+	ck_assert_int_eq(uh->eeprom[259], data[9]);
+	ck_assert_int_eq(uh->eeprom[260], 0xff);
+	ck_assert_int_eq(uh->eeprom[269], 0xff);
+	ck_assert_int_eq(uh->eeprom[270], data[20]);
+}
+END_TEST
+
+/**
+ * @test a region is read without the bytes in front of it
+ */
+START_TEST(test_eeprom_region_read)
+{
+	struct usb_msg *msg = NULL;
+	uint8_t data[MAX_EEPROM_SIZE];
+	uint8_t read[2];
+	int ret_val = 0;
+
+	fill_image(data, sizeof(data));
+	memcpy(uh->eeprom, data, sizeof(data));
+
+	/* the last two bytes */
+	ret_val = usb_eeprom_read_at(uh, MAX_EEPROM_SIZE - 2, read,
+		sizeof(read));
+	ck_assert_int_eq(ret_val, sizeof(read));
+	ck_assert_int_eq(memcmp(read, data + MAX_EEPROM_SIZE - 2,
+		sizeof(read)), 0);
+
+	msg = get_usb_msg(uh);
+	ck_assert_int_eq(msg->requesttype, USB_REQ_TYPE_READ_EEPROM);
+	ck_assert_int_eq(msg->index, MAX_EEPROM_SIZE - 2);
+	ck_assert_int_eq(msg->size, sizeof(read));
+
+	/* all of it, chunk by chunk */
+	memset(data, 0, sizeof(data));
+	ret_val = usb_eeprom_read_at(uh, 0, data, sizeof(data));
+	ck_assert_int_eq(ret_val, sizeof(data));
+	ck_assert_int_eq(memcmp(uh->eeprom, data, sizeof(data)), 0);
+	ck_assert_int_eq(msg->index, MAX_EEPROM_SIZE - EEPROM_CHUNK_SIZE);
+	ck_assert_int_eq(msg->size, EEPROM_CHUNK_SIZE);
+}
+END_TEST
+
+struct progress_log {
+	size_t offsets[8];
+	int calls;
+	int stop_at;
+};
+
+static int log_progress(void *data, size_t offset, size_t len)
+{
+	struct progress_log *log = data;
+
+	log->offsets[log->calls++] = offset;
+
+	return log->calls == log->stop_at;
+}
+
+/**
+ * @test the progress callback sees every chunk and can stop the transfer
+ */
+START_TEST(test_eeprom_progress)
+{
+	struct progress_log log = { .stop_at = 0 };
+	uint8_t data[600];
+	int ret_val = 0;
+
+	fill_image(data, sizeof(data));
+	usb_eeprom_set_progress(log_progress, &log);
+
+	ret_val = usb_eeprom_write(uh, data, sizeof(data));
+	ck_assert_int_eq(ret_val, sizeof(data));
+	ck_assert_int_eq(log.calls, 3);
+	ck_assert_int_eq(log.offsets[0], 0);
+	ck_assert_int_eq(log.offsets[1], EEPROM_CHUNK_SIZE);
+	ck_assert_int_eq(log.offsets[2], 2 * EEPROM_CHUNK_SIZE);
+	ck_assert_int_eq(uh->writes, 3);
+
+	/* stopped after the second chunk */
+	log.calls = 0;
+	log.stop_at = 2;
+	ret_val = usb_eeprom_read(uh, data, sizeof(data));
+	ck_assert_int_eq(ret_val, -ECANCELED);
+	ck_assert_int_eq(log.calls, 2);
+
+	usb_eeprom_set_progress(NULL, NULL);
+}
+END_TEST
+
+/**
+ * @test usb_eeprom_update() writes changed pages in chunks as well
+ */
+START_TEST(test_eeprom_update_chunks)
+{
+	struct progress_log log = { .stop_at = 0 };
+	uint8_t data[600];
+	int ret_val = 0;
+
+	fill_image(data, sizeof(data));
+	usb_eeprom_set_progress(log_progress, &log);
+
+	/* three chunks read, then all pages differ and go in three chunks */
+	ret_val = usb_eeprom_update(uh, data, sizeof(data));
+	ck_assert_int_eq(ret_val, sizeof(data));
+	ck_assert_int_eq(log.calls, 6);
+	ck_assert_int_eq(log.offsets[3], 0);
+	ck_assert_int_eq(log.offsets[4], EEPROM_CHUNK_SIZE);
+	ck_assert_int_eq(log.offsets[5], 2 * EEPROM_CHUNK_SIZE);
+	ck_assert_int_eq(uh->writes, 3);
+	ck_assert_int_eq(memcmp(uh->eeprom, data, sizeof(data)), 0);
+
+	usb_eeprom_set_progress(NULL, NULL);
+}
+END_TEST
+
+/**
+ * @test polling waits for the write cycle and reads the last page back
+ */
+START_TEST(test_eeprom_wait_poll)
+{
+	struct usb_msg *msg = get_usb_msg(uh);
+	struct timespec start;
+	uint8_t data[50];
+	uint8_t image[sizeof(data)];
+
+	fill_image(data, sizeof(data));
+	usb_eeprom_set_wait(EEPROM_WAIT_POLL);
+	ck_assert_int_eq(usb_eeprom_get_wait(), EEPROM_WAIT_POLL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ck_assert_int_eq(usb_eeprom_write(uh, data,
+		sizeof(data)), sizeof(data));
+	ck_assert_int_ge(elapsed_us(&start), 2000);
+
+	ck_assert_int_eq(msg->requesttype, USB_REQ_TYPE_READ_EEPROM);
+	ck_assert_int_eq(msg->index, sizeof(data) - EEPROM_PAGE_SIZE);
+	ck_assert_int_eq(msg->size, EEPROM_PAGE_SIZE);
+	/* a poll never waits longer than polling as a whole */
+	ck_assert_int_lt(msg->timeout, GET_TIMEOUT(EEPROM_PAGE_SIZE));
+
+	ck_assert_int_eq(usb_eeprom_read(uh, image, sizeof(image)),
+		sizeof(image));
+	ck_assert_int_eq(memcmp(image, data, sizeof(image)), 0);
+}
+END_TEST
+
+/**
+ * @test each chunk of a write waits for its write cycle
+ */
+START_TEST(test_eeprom_wait_chunks)
+{
+	struct timespec start;
+	uint8_t data[3 * EEPROM_CHUNK_SIZE];
+
+	fill_image(data, sizeof(data));
+	usb_eeprom_set_wait(EEPROM_WAIT_POLL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ck_assert_int_eq(usb_eeprom_write(uh, data,
+		sizeof(data)), sizeof(data));
+	ck_assert_int_ge(elapsed_us(&start), 3 * 2000);
+	ck_assert_int_eq(uh->writes, 3);
+}
+END_TEST
+
+/**
+ * @test an erase cannot be polled for and sleeps
+ */
+START_TEST(test_eeprom_wait_poll_erase)
+{
+	struct usb_msg *msg = get_usb_msg(uh);
+	struct timespec start;
+
+	usb_eeprom_set_wait(EEPROM_WAIT_POLL);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ck_assert_int_eq(usb_eeprom_erase(uh, 64), 64);
+	ck_assert_int_ge(elapsed_us(&start), 5000);
+	ck_assert_int_eq(msg->requesttype, USB_REQ_TYPE_WRITE_EEPROM);
+}
+END_TEST
+
+/**
+ * @test polling gives up on an EEPROM that never finishes
+ */
+START_TEST(test_eeprom_wait_poll_timeout)
+{
+	struct dummy_timing timing = { .write_cycle_us = 100000 };
+	uint8_t data[50];
+
+	fill_image(data, sizeof(data));
+	dummy_bus_set_timing(&timing, 1);
+	usb_eeprom_set_wait(EEPROM_WAIT_POLL);
+
+	ck_assert_int_eq(usb_eeprom_write(uh, data,
+		sizeof(data)), -ETIMEDOUT);
+}
+END_TEST
+
+/**
+ * @test without waiting, the EEPROM is still busy after the write
+ */
+START_TEST(test_eeprom_wait_none)
+{
+	uint8_t data[50];
+	uint8_t image[sizeof(data)];
+
+	fill_image(data, sizeof(data));
+	usb_eeprom_set_wait(EEPROM_WAIT_NONE);
+
+	ck_assert_int_eq(usb_eeprom_write(uh, data,
+		sizeof(data)), sizeof(data));
+	ck_assert_int_eq(usb_eeprom_read(uh, image, sizeof(image)),
+		sizeof(image));
+	ck_assert_int_eq(image[0], 0xff);
+	ck_assert_int_eq(memcmp(uh->eeprom, data, sizeof(image)), 0);
+}
+END_TEST
+
 /**
  * @test usb_eeprom_support()
  */
@@ -204,11 +596,17 @@ int eeprom_suite(Suite *s_eeprom)
 	TCase *tc_eeprom_erase;
 	TCase *tc_eeprom_write;
 	TCase *tc_eeprom_read;
+	TCase *tc_eeprom_update;
+	TCase *tc_eeprom_region;
+	TCase *tc_eeprom_wait;
 	TCase *tc_eeprom_support;
 
 	tc_eeprom_erase = tcase_create("EEPROM erase");
 	tc_eeprom_write = tcase_create("EEPROM write");
 	tc_eeprom_read = tcase_create("EEPROM read");
+	tc_eeprom_update = tcase_create("EEPROM update");
+	tc_eeprom_region = tcase_create("EEPROM region");
+	tc_eeprom_wait = tcase_create("EEPROM write wait");
 	tc_eeprom_support = tcase_create("EEPROM support");
 
 	tcase_add_unchecked_fixture(tc_eeprom_erase, setup_device_handle,
@@ -228,6 +626,28 @@ int eeprom_suite(Suite *s_eeprom)
 	tcase_add_test(tc_eeprom_read, test_eeprom_read);
 	tcase_add_test(tc_eeprom_read, test_eeprom_read_boundaries);
 
+	tcase_add_checked_fixture(tc_eeprom_update, setup_device_handle,
+			teardown_device_handle);
+	tcase_add_test(tc_eeprom_update, test_eeprom_update);
+	tcase_add_test(tc_eeprom_update, test_eeprom_update_unchanged);
+	tcase_add_test(tc_eeprom_update, test_eeprom_update_boundaries);
+
+	tcase_add_checked_fixture(tc_eeprom_region, setup_device_handle,
+		teardown_device_handle);
+	tcase_add_test(tc_eeprom_region, test_eeprom_region_read);
+	tcase_add_test(tc_eeprom_region, test_eeprom_region_write);
+	tcase_add_test(tc_eeprom_region, test_eeprom_region_boundaries);
+	tcase_add_test(tc_eeprom_region, test_eeprom_progress);
+	tcase_add_test(tc_eeprom_region, test_eeprom_update_chunks);
+
+	tcase_add_checked_fixture(tc_eeprom_wait, setup_write_cycle,
+			teardown_write_cycle);
+	tcase_add_test(tc_eeprom_wait, test_eeprom_wait_poll);
+	tcase_add_test(tc_eeprom_wait, test_eeprom_wait_chunks);
+	tcase_add_test(tc_eeprom_wait, test_eeprom_wait_poll_erase);
+	tcase_add_test(tc_eeprom_wait, test_eeprom_wait_poll_timeout);
+	tcase_add_test(tc_eeprom_wait, test_eeprom_wait_none);
+
 	tcase_add_loop_test(tc_eeprom_support, test_eeprom_support, 0,
 		sizeof(eeprom_support_data) / sizeof(struct data_eesupport));
 	tcase_add_test(tc_eeprom_support, test_eeprom_support_boundaries);
@@ -235,6 +655,9 @@ int eeprom_suite(Suite *s_eeprom)
 	suite_add_tcase(s_eeprom, tc_eeprom_erase);
 	suite_add_tcase(s_eeprom, tc_eeprom_write);
 	suite_add_tcase(s_eeprom, tc_eeprom_read);
+	suite_add_tcase(s_eeprom, tc_eeprom_update);
+	suite_add_tcase(s_eeprom, tc_eeprom_region);
+	suite_add_tcase(s_eeprom, tc_eeprom_wait);
 	suite_add_tcase(s_eeprom, tc_eeprom_support);
 
 	return EXIT_SUCCESS;
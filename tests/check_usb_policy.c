@@ -0,0 +1,401 @@
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dummy_usb.h"
+#include "hub_xfer.h"
+#include "usb_eeprom.h"
+#include "usb_policy.h"
+
+#define GET_STATUS_TYPE		(LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS | \
+				 LIBUSB_RECIPIENT_OTHER)
+#define PORT_FEAT_POWER		8
+#define PORT_STAT_POWER		0x0100
+
+static const struct usb_policy test_policy = {
+	.attempts = 3,
+	.backoff_ms = 1,
+	.timeout_factor = 4,
+	.min_timeout_ms = 1,
+	.min_samples = 8,
+};
+
+void setup_policy()
+{
+	usb_policy_reset();
+	usb_policy_set(&test_policy);
+}
+
+void teardown_policy()
+{
+	usb_policy_set(NULL);
+	usb_policy_deadline(0);
+	usb_policy_reset();
+}
+
+START_TEST(test_policy_default)
+{
+	struct usb_policy policy;
+	libusb_device_handle *dev;
+	uint8_t buffer[64];
+	int i;
+
+	usb_policy_set(NULL);
+	usb_policy_get(&policy);
+	ck_assert_uint_eq(policy.attempts, 1);
+	ck_assert_uint_eq(policy.timeout_factor, 0);
+
+	dev = libusb_device_handle_create();
+	ck_assert_ptr_ne(dev, NULL);
+
+	/* fixed timeouts however fast the device answers */
+	for (i = 0; i < 20; i++)
+		usb_policy_record(dev, USB_REQ_TYPE_READ_EEPROM, USB_REQ_READ,
+			0, 10000);
+	ck_assert_uint_eq(usb_policy_timeout(dev, USB_REQ_TYPE_READ_EEPROM,
+		USB_REQ_READ, 64, 1000), 1000);
+
+	/* a single attempt */
+	dev->failures = 1;
+	ck_assert_int_eq(usb_eeprom_read(dev, buffer, sizeof(buffer)),
+		-ETIMEDOUT);
+	ck_assert_int_eq(usb_eeprom_read(dev, buffer, sizeof(buffer)),
+		sizeof(buffer));
+
+	libusb_device_handle_free(&dev);
+}
+END_TEST
+
+START_TEST(test_policy_adaptive)
+{
+	libusb_device_handle *dev;
+	int i;
+
+	dev = libusb_device_handle_create();
+	ck_assert_ptr_ne(dev, NULL);
+
+	/* 100 us per 256 bytes, in the bucket up to 128 us */
+	for (i = 0; i < 7; i++)
+		usb_policy_record(dev, USB_REQ_TYPE_READ_EEPROM, USB_REQ_READ,
+			512, 300000);
+	ck_assert_uint_eq(usb_policy_timeout(dev, USB_REQ_TYPE_READ_EEPROM,
+		USB_REQ_READ, 1024, 1000), 1000);
+
+	usb_policy_record(dev, USB_REQ_TYPE_READ_EEPROM, USB_REQ_READ, 512,
+		300000);
+	/* 5 units of 4 * 128 us */
+	ck_assert_uint_eq(usb_policy_timeout(dev, USB_REQ_TYPE_READ_EEPROM,
+		USB_REQ_READ, 1024, 1000), 3);
+	ck_assert_uint_eq(usb_policy_timeout(dev, USB_REQ_TYPE_READ_EEPROM,
+		USB_REQ_READ, 0, 1000), 1);
+	/* the fixed timeout stays the upper bound */
+	ck_assert_uint_eq(usb_policy_timeout(dev, USB_REQ_TYPE_READ_EEPROM,
+		USB_REQ_READ, 1024, 2), 2);
+
+	/* other requests keep their own latency */
+	ck_assert_uint_eq(usb_policy_timeout(dev, USB_REQ_TYPE_WRITE_EEPROM,
+		USB_REQ_WRITE, 1024, 1000), 1000);
+
+	usb_policy_reset();
+	ck_assert_uint_eq(usb_policy_timeout(dev, USB_REQ_TYPE_READ_EEPROM,
+		USB_REQ_READ, 1024, 1000), 1000);
+
+	libusb_device_handle_free(&dev);
+}
+END_TEST
+
+START_TEST(test_policy_device_key)
+{
+	libusb_device_handle *hub;
+	libusb_device_handle *other;
+	int i;
+
+	ck_assert_int_eq(dummy_bus_create(2, 4), 0);
+	ck_assert_int_eq(libusb_open(dummy_bus_device(0), &hub), 0);
+	for (i = 0; i < 8; i++)
+		usb_policy_record(hub, GET_STATUS_TYPE,
+			LIBUSB_REQUEST_GET_STATUS, 4, 300000);
+	libusb_close(hub);
+
+	/* the other hub has a latency of its own */
+	ck_assert_int_eq(libusb_open(dummy_bus_device(1), &other), 0);
+	ck_assert_uint_eq(usb_policy_timeout(other, GET_STATUS_TYPE,
+		LIBUSB_REQUEST_GET_STATUS, 4, 1000), 1000);
+	libusb_close(other);
+
+	/* unplugged and plugged in again at the same place */
+	dummy_bus_destroy();
+	ck_assert_int_eq(dummy_bus_create(2, 4), 0);
+	ck_assert_int_eq(libusb_open(dummy_bus_device(0), &hub), 0);
+	ck_assert_uint_eq(usb_policy_timeout(hub, GET_STATUS_TYPE,
+		LIBUSB_REQUEST_GET_STATUS, 4, 1000), 3);
+	libusb_close(hub);
+
+	/* moved behind the other hub, it is a new place */
+	ck_assert_int_eq(dummy_bus_attach(0, 1, 1), 0);
+	ck_assert_int_eq(libusb_open(dummy_bus_device(0), &hub), 0);
+	ck_assert_uint_eq(usb_policy_timeout(hub, GET_STATUS_TYPE,
+		LIBUSB_REQUEST_GET_STATUS, 4, 1000), 1000);
+	libusb_close(hub);
+
+	dummy_bus_destroy();
+}
+END_TEST
+
+START_TEST(test_policy_retry)
+{
+	libusb_device_handle *dev;
+	uint8_t buffer[64];
+
+	ck_assert_uint_eq(usb_policy_retry(LIBUSB_ERROR_TIMEOUT, 1), 1);
+	ck_assert_uint_eq(usb_policy_retry(LIBUSB_ERROR_IO, 2), 2);
+	ck_assert_uint_eq(usb_policy_retry(LIBUSB_ERROR_TIMEOUT, 3), 0);
+	/* a stall goes again once */
+	ck_assert_uint_eq(usb_policy_retry(LIBUSB_ERROR_PIPE, 1), 1);
+	ck_assert_uint_eq(usb_policy_retry(LIBUSB_ERROR_PIPE, 2), 0);
+	ck_assert_uint_eq(usb_policy_retry(LIBUSB_ERROR_NO_DEVICE, 1), 0);
+
+	dev = libusb_device_handle_create();
+	ck_assert_ptr_ne(dev, NULL);
+
+	memset(buffer, 0x5a, sizeof(buffer));
+	dev->failures = 2;
+	ck_assert_int_eq(usb_eeprom_write(dev, buffer, sizeof(buffer)),
+		sizeof(buffer));
+	ck_assert_int_eq(dev->eeprom[0], 0x5a);
+
+	dev->failures = 3;
+	ck_assert_int_eq(usb_eeprom_read(dev, buffer, sizeof(buffer)),
+		-ETIMEDOUT);
+	ck_assert_int_eq(dev->failures, 0);
+
+	libusb_device_handle_free(&dev);
+}
+END_TEST
+
+START_TEST(test_policy_batch_retry)
+{
+	libusb_device_handle *hub;
+	struct hub_xfer xfers[3];
+	uint8_t status[3][4];
+	int i;
+
+	ck_assert_int_eq(dummy_bus_create(1, 4), 0);
+	ck_assert_int_eq(libusb_open(dummy_bus_device(0), &hub), 0);
+
+	memset(xfers, 0, sizeof(xfers));
+	for (i = 0; i < 3; i++) {
+		xfers[i].handle = hub;
+		xfers[i].request_type = GET_STATUS_TYPE;
+		xfers[i].request = LIBUSB_REQUEST_GET_STATUS;
+		xfers[i].index = i + 1;
+		xfers[i].data = status[i];
+		xfers[i].length = sizeof(status[i]);
+	}
+
+	/* the first two time out once and go again */
+	hub->failures = 2;
+	ck_assert_int_eq(hub_xfer_run(NULL, xfers, 3, 1000), 3);
+	for (i = 0; i < 3; i++)
+		ck_assert_int_eq(xfers[i].result, 4);
+
+	hub->failures = 9;
+	ck_assert_int_eq(hub_xfer_run(NULL, xfers, 3, 1000), 0);
+	ck_assert_int_eq(xfers[0].result, LIBUSB_ERROR_TIMEOUT);
+	ck_assert_int_eq(hub->failures, 0);
+
+	libusb_close(hub);
+	dummy_bus_destroy();
+}
+END_TEST
+
+START_TEST(test_policy_batch_order)
+{
+	libusb_device_handle *hub;
+	struct hub_xfer xfers[2];
+
+	ck_assert_int_eq(dummy_bus_create(1, 4), 0);
+	ck_assert_int_eq(libusb_open(dummy_bus_device(0), &hub), 0);
+
+	/* port 1 off, then on again */
+	memset(xfers, 0, sizeof(xfers));
+	xfers[0].handle = hub;
+	xfers[0].request_type = LIBUSB_REQUEST_TYPE_CLASS |
+		LIBUSB_RECIPIENT_OTHER;
+	xfers[0].request = LIBUSB_REQUEST_CLEAR_FEATURE;
+	xfers[0].value = PORT_FEAT_POWER;
+	xfers[0].index = 1;
+	xfers[1] = xfers[0];
+	xfers[1].request = LIBUSB_REQUEST_SET_FEATURE;
+
+	/* the off request times out, the on request gets through */
+	hub->failures = 1;
+	ck_assert_int_eq(hub_xfer_run(NULL, xfers, 2, 1000), 2);
+	ck_assert_int_eq(hub->failures, 0);
+
+	/* the on request went again after the retried off request */
+	ck_assert(dummy_bus_device(0)->port_status[0] & PORT_STAT_POWER);
+
+	/*
+	 * The off request fails three times, the on request only in the
+	 * second and third round. Sent again in the second round for the
+	 * order, it still has its third attempt in the fourth round.
+	 */
+	hub->fail_pattern = 0x3d;
+	ck_assert_int_eq(hub_xfer_run(NULL, xfers, 2, 1000), 1);
+	ck_assert_int_eq(xfers[0].result, LIBUSB_ERROR_TIMEOUT);
+	ck_assert_int_eq(xfers[1].result, 0);
+	ck_assert_int_eq(hub->fail_pattern, 0);
+	ck_assert(dummy_bus_device(0)->port_status[0] & PORT_STAT_POWER);
+
+	libusb_close(hub);
+	dummy_bus_destroy();
+}
+END_TEST
+
+START_TEST(test_policy_batch_queue)
+{
+	libusb_device_handle *hub;
+	struct hub_xfer xfers[3];
+	uint8_t status[3][4];
+	int i;
+
+	ck_assert_int_eq(dummy_bus_create(1, 4), 0);
+	ck_assert_int_eq(libusb_open(dummy_bus_device(0), &hub), 0);
+
+	/* about 2 ms per status request, some 9 ms timeout */
+	for (i = 0; i < 100; i++)
+		usb_policy_record(hub, GET_STATUS_TYPE,
+			LIBUSB_REQUEST_GET_STATUS, 4, 2000000);
+
+	memset(xfers, 0, sizeof(xfers));
+	for (i = 0; i < 3; i++) {
+		xfers[i].handle = hub;
+		xfers[i].request_type = GET_STATUS_TYPE;
+		xfers[i].request = LIBUSB_REQUEST_GET_STATUS;
+		xfers[i].index = i + 1;
+		xfers[i].data = status[i];
+		xfers[i].length = sizeof(status[i]);
+	}
+
+	/* the third request queues behind two others, then goes alone */
+	hub->fail_pattern = 0x4;
+	ck_assert_int_eq(hub_xfer_run(NULL, xfers, 3, 1000), 3);
+	ck_assert_int_eq(hub->fail_pattern, 0);
+	ck_assert_int_eq(get_usb_msg(hub)->timeout,
+		usb_policy_timeout(hub, GET_STATUS_TYPE,
+			LIBUSB_REQUEST_GET_STATUS, 4, 1000));
+
+	libusb_close(hub);
+	dummy_bus_destroy();
+}
+END_TEST
+
+START_TEST(test_policy_batch_events)
+{
+	libusb_device_handle *hub;
+	struct hub_xfer xfers[2];
+	struct timeval tv = { 1, 0 };
+	uint8_t status[2][4];
+	int i;
+
+	ck_assert_int_eq(dummy_bus_create(1, 4), 0);
+	ck_assert_int_eq(libusb_open(dummy_bus_device(0), &hub), 0);
+
+	memset(xfers, 0, sizeof(xfers));
+	for (i = 0; i < 2; i++) {
+		xfers[i].handle = hub;
+		xfers[i].request_type = GET_STATUS_TYPE;
+		xfers[i].request = LIBUSB_REQUEST_GET_STATUS;
+		xfers[i].index = i + 1;
+		xfers[i].data = status[i];
+		xfers[i].length = sizeof(status[i]);
+	}
+
+	/* event handling never recovers, the batch gives up nonetheless */
+	dummy_bus_fail_events(1000);
+	ck_assert_int_eq(hub_xfer_run(NULL, xfers, 2, 1000), 0);
+	for (i = 0; i < 2; i++)
+		ck_assert_int_eq(xfers[i].result, LIBUSB_ERROR_OTHER);
+
+	/* the abandoned transfers still complete and are freed */
+	dummy_bus_fail_events(0);
+	libusb_handle_events_timeout(NULL, &tv);
+
+	libusb_close(hub);
+	dummy_bus_destroy();
+}
+END_TEST
+
+START_TEST(test_policy_deadline)
+{
+	libusb_device_handle *dev;
+	uint8_t buffer[64];
+	int remaining;
+
+	dev = libusb_device_handle_create();
+	ck_assert_ptr_ne(dev, NULL);
+
+	ck_assert_int_eq(usb_policy_remaining(), -1);
+
+	usb_policy_deadline(500);
+	remaining = usb_policy_remaining();
+	ck_assert_int_gt(remaining, 0);
+	ck_assert_int_le(remaining, 500);
+	ck_assert_uint_le(usb_policy_timeout(dev, USB_REQ_TYPE_READ_EEPROM,
+		USB_REQ_READ, 64, 1000), 500);
+
+	usb_policy_deadline(1);
+	usleep(2000);
+	ck_assert_int_eq(usb_policy_remaining(), 0);
+	ck_assert_uint_eq(usb_policy_retry(LIBUSB_ERROR_TIMEOUT, 1), 0);
+	ck_assert_int_eq(usb_eeprom_read(dev, buffer, sizeof(buffer)),
+		-ETIMEDOUT);
+
+	usb_policy_deadline(0);
+	ck_assert_int_eq(usb_policy_remaining(), -1);
+	ck_assert_int_eq(usb_eeprom_read(dev, buffer, sizeof(buffer)),
+		sizeof(buffer));
+
+	libusb_device_handle_free(&dev);
+}
+END_TEST
+
+START_TEST(test_policy_errno)
+{
+	ck_assert_int_eq(usb_policy_errno(LIBUSB_ERROR_TIMEOUT), -ETIMEDOUT);
+	ck_assert_int_eq(usb_policy_errno(LIBUSB_ERROR_PIPE), -EPIPE);
+	ck_assert_int_eq(usb_policy_errno(LIBUSB_ERROR_NOT_SUPPORTED),
+		-ENOTSUP);
+	ck_assert_int_eq(usb_policy_errno(LIBUSB_ERROR_OTHER), -EIO);
+
+	/* -errno values and counts pass through */
+	ck_assert_int_eq(usb_policy_errno(-EBADMSG), -EBADMSG);
+	ck_assert_int_eq(usb_policy_errno(64), 64);
+}
+END_TEST
+
+int policy_suite(Suite *s_policy)
+{
+	TCase *tc_policy;
+
+	tc_policy = tcase_create("Transfer policy");
+
+	tcase_add_checked_fixture(tc_policy, setup_policy, teardown_policy);
+	tcase_add_test(tc_policy, test_policy_default);
+	tcase_add_test(tc_policy, test_policy_adaptive);
+	tcase_add_test(tc_policy, test_policy_device_key);
+	tcase_add_test(tc_policy, test_policy_retry);
+	tcase_add_test(tc_policy, test_policy_batch_retry);
+	tcase_add_test(tc_policy, test_policy_batch_order);
+	tcase_add_test(tc_policy, test_policy_batch_queue);
+	tcase_add_test(tc_policy, test_policy_batch_events);
+	tcase_add_test(tc_policy, test_policy_deadline);
+	tcase_add_test(tc_policy, test_policy_errno);
+
+	suite_add_tcase(s_policy, tc_policy);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for usb_policy
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_USB_POLICY_H
+#define CHECK_USB_POLICY_H
+
+/**
+ * @brief Add transfer policy test cases to the given suite
+ *
+ * @param policy_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int policy_suite(Suite *policy_suite);
+
+#endif /* CHECK_USB_POLICY_H */
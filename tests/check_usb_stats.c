@@ -0,0 +1,187 @@
+#include <check.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dummy_usb.h"
+#include "usb_eeprom.h"
+#include "usb_stats.h"
+
+void setup_stats()
+{
+	usb_stats_reset();
+	usb_stats_enable(1);
+	usb_stats_phase("test");
+}
+
+void teardown_stats()
+{
+	usb_stats_enable(0);
+	usb_stats_phase(NULL);
+	usb_stats_reset();
+}
+
+START_TEST(test_stats_disabled)
+{
+	struct usb_stats_summary sum;
+
+	usb_stats_enable(0);
+	ck_assert_uint_eq(usb_stats_start(), 0);
+	usb_stats_stop("GET_STATUS", 0);
+	ck_assert_int_eq(usb_stats_get(0, &sum), -ENOENT);
+}
+END_TEST
+
+START_TEST(test_stats_percentiles)
+{
+	struct usb_stats_summary sum;
+	int i;
+
+	/* 1 ms to 100 ms, in shuffled order */
+	for (i = 0; i < 100; i++)
+		usb_stats_record("test", "GET_STATUS",
+			((i * 37) % 100 + 1) * 1000000ULL);
+
+	ck_assert_int_eq(usb_stats_get(0, &sum), 0);
+	ck_assert_str_eq(sum.phase, "test");
+	ck_assert_str_eq(sum.request, "GET_STATUS");
+	ck_assert_uint_eq(sum.count, 100);
+	ck_assert_uint_eq(sum.total_ns, 5050 * 1000000ULL);
+	ck_assert_uint_eq(sum.max_ns, 100 * 1000000ULL);
+
+	/* within the width of a bucket */
+	ck_assert_uint_ge(sum.p50_ns, 47 * 1000000ULL);
+	ck_assert_uint_le(sum.p50_ns, 53 * 1000000ULL);
+	ck_assert_uint_ge(sum.p95_ns, 89 * 1000000ULL);
+	ck_assert_uint_le(sum.p95_ns, 100 * 1000000ULL);
+	ck_assert_uint_ge(sum.p99_ns, 93 * 1000000ULL);
+	ck_assert_uint_le(sum.p99_ns, 100 * 1000000ULL);
+
+	ck_assert_int_eq(usb_stats_get(1, &sum), -ENOENT);
+}
+END_TEST
+
+START_TEST(test_stats_small)
+{
+	struct usb_stats_summary sum;
+
+	usb_stats_record("test", "open", 3000);
+	usb_stats_record("test", "open", 500);
+
+	ck_assert_int_eq(usb_stats_get(0, &sum), 0);
+	ck_assert_uint_eq(sum.count, 2);
+	ck_assert_uint_eq(sum.p50_ns, 0);
+	ck_assert_uint_eq(sum.p99_ns, 3000);
+}
+END_TEST
+
+START_TEST(test_stats_entries)
+{
+	struct usb_stats_summary sum;
+
+	usb_stats_record("scan", "open", 1000);
+	usb_stats_record("write", "open", 1000);
+	usb_stats_record("scan", "open", 1000);
+	usb_stats_record("scan", "GET_DESCRIPTOR", 1000);
+
+	ck_assert_int_eq(usb_stats_get(0, &sum), 0);
+	ck_assert_str_eq(sum.phase, "scan");
+	ck_assert_str_eq(sum.request, "open");
+	ck_assert_uint_eq(sum.count, 2);
+	ck_assert_int_eq(usb_stats_get(1, &sum), 0);
+	ck_assert_str_eq(sum.phase, "write");
+	ck_assert_int_eq(usb_stats_get(2, &sum), 0);
+	ck_assert_str_eq(sum.request, "GET_DESCRIPTOR");
+	ck_assert_int_eq(usb_stats_get(3, &sum), -ENOENT);
+
+	ck_assert_str_eq(usb_stats_request_name(0xa3, 0), "GET_STATUS");
+	ck_assert_str_eq(usb_stats_request_name(0x23, 1), "CLEAR_FEATURE");
+	ck_assert_str_eq(usb_stats_request_name(0x23, 3), "SET_FEATURE");
+	ck_assert_str_eq(usb_stats_request_name(0xa0, 6), "GET_DESCRIPTOR");
+	ck_assert_str_eq(usb_stats_request_name(USB_REQ_TYPE_READ_EEPROM,
+		USB_REQ_READ), "EEPROM read");
+	ck_assert_str_eq(usb_stats_request_name(USB_REQ_TYPE_WRITE_EEPROM,
+		USB_REQ_WRITE), "EEPROM write");
+	ck_assert_str_eq(usb_stats_request_name(0x40, 0x10), "other");
+}
+END_TEST
+
+START_TEST(test_stats_eeprom)
+{
+	struct usb_stats_summary sum;
+	libusb_device_handle *dev;
+	uint8_t buffer[64];
+
+	dev = libusb_device_handle_create();
+	ck_assert_ptr_ne(dev, NULL);
+
+	memset(buffer, 0x5a, sizeof(buffer));
+	ck_assert_int_eq(usb_eeprom_write(dev, buffer, sizeof(buffer)),
+		sizeof(buffer));
+	usb_stats_phase("verify");
+	ck_assert_int_eq(usb_eeprom_read(dev, buffer, sizeof(buffer)),
+		sizeof(buffer));
+
+	ck_assert_int_eq(usb_stats_get(0, &sum), 0);
+	ck_assert_str_eq(sum.phase, "test");
+	ck_assert_str_eq(sum.request, "EEPROM write");
+	ck_assert_int_eq(usb_stats_get(1, &sum), 0);
+	ck_assert_str_eq(sum.request, "write delay");
+	ck_assert_uint_ge(sum.total_ns, 5000000);
+	ck_assert_int_eq(usb_stats_get(2, &sum), 0);
+	ck_assert_str_eq(sum.phase, "verify");
+	ck_assert_str_eq(sum.request, "EEPROM read");
+	ck_assert_uint_eq(sum.count, 1);
+
+	libusb_device_handle_free(&dev);
+}
+END_TEST
+
+START_TEST(test_stats_json)
+{
+	char text[512];
+	size_t len;
+	FILE *out;
+
+	/* percentiles are bucket middles, 1408-1535 us and 240-255 us */
+	usb_stats_record("scan", "open", 1500000);
+	usb_stats_record("scan", "GET_STATUS", 250000);
+
+	out = tmpfile();
+	ck_assert_ptr_ne(out, NULL);
+	usb_stats_print(out, 1);
+	rewind(out);
+	len = fread(text, 1, sizeof(text) - 1, out);
+	fclose(out);
+	text[len] = '\0';
+
+	ck_assert_str_eq(text, "{\"stats\": [\n"
+		"  {\"phase\": \"scan\", \"request\": \"open\", \"count\": 1, "
+		"\"total_ms\": 1.500, \"p50_ms\": 1.472, \"p95_ms\": 1.472, "
+		"\"p99_ms\": 1.472, \"max_ms\": 1.500},\n"
+		"  {\"phase\": \"scan\", \"request\": \"GET_STATUS\", "
+		"\"count\": 1, \"total_ms\": 0.250, \"p50_ms\": 0.248, "
+		"\"p95_ms\": 0.248, \"p99_ms\": 0.248, \"max_ms\": 0.250}\n"
+		"]}\n");
+}
+END_TEST
+
+int stats_suite(Suite *s_stats)
+{
+	TCase *tc_stats;
+
+	tc_stats = tcase_create("Request statistics");
+
+	tcase_add_checked_fixture(tc_stats, setup_stats, teardown_stats);
+	tcase_add_test(tc_stats, test_stats_disabled);
+	tcase_add_test(tc_stats, test_stats_percentiles);
+	tcase_add_test(tc_stats, test_stats_small);
+	tcase_add_test(tc_stats, test_stats_entries);
+	tcase_add_test(tc_stats, test_stats_eeprom);
+	tcase_add_test(tc_stats, test_stats_json);
+
+	suite_add_tcase(s_stats, tc_stats);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for usb_stats
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_USB_STATS_H
+#define CHECK_USB_STATS_H
+
+/**
+ * @brief Add request statistics test cases to the given suite
+ *
+ * @param stats_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int stats_suite(Suite *stats_suite);
+
+#endif /* CHECK_USB_STATS_H */
@@ -0,0 +1,185 @@
+#define _XOPEN_SOURCE 700
+#include <check.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "usb_sysfs.h"
+
+char sysfs_root[] = "/tmp/sysfsXXXXXX";
+
+static void sysfs_mkdir(const char *dir)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", sysfs_root, dir);
+	ck_assert_int_eq(mkdir(path, 0700), 0);
+}
+
+static void sysfs_attr(const char *attr, const char *value)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", sysfs_root, attr);
+	fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+	ck_assert_int_ge(fd, 0);
+	ck_assert_int_eq(write(fd, value, strlen(value)), strlen(value));
+	close(fd);
+}
+
+/*
+ * Fixture standing in for /sys/bus/usb/devices: the root hub of bus 1, a
+ * Cypress hub behind its port 1, a mouse and an interface entry.
+ */
+void setup_sysfs_tree()
+{
+	ck_assert_ptr_ne(mkdtemp(sysfs_root), NULL);
+
+	sysfs_mkdir("usb1");
+	sysfs_attr("usb1/busnum", "1\n");
+	sysfs_attr("usb1/devnum", "1\n");
+	sysfs_attr("usb1/bDeviceClass", "09\n");
+	sysfs_attr("usb1/idVendor", "1d6b\n");
+	sysfs_attr("usb1/idProduct", "0002\n");
+	sysfs_attr("usb1/bcdDevice", "0510\n");
+	sysfs_attr("usb1/maxchild", "2\n");
+	sysfs_mkdir("1-0:1.0");
+
+	sysfs_mkdir("1-1");
+	sysfs_attr("1-1/busnum", "1\n");
+	sysfs_attr("1-1/devnum", "5\n");
+	sysfs_attr("1-1/bDeviceClass", "09\n");
+	sysfs_attr("1-1/idVendor", "04b4\n");
+	sysfs_attr("1-1/idProduct", "6560\n");
+	sysfs_attr("1-1/bcdDevice", "9215\n");
+	sysfs_attr("1-1/maxchild", "4\n");
+	sysfs_attr("1-1/serial", "AD0042\n");
+	sysfs_mkdir("1-1:1.0");
+
+	sysfs_mkdir("1-1.3");
+	sysfs_attr("1-1.3/busnum", "1\n");
+	sysfs_attr("1-1.3/devnum", "7\n");
+	sysfs_attr("1-1.3/bDeviceClass", "00\n");
+	sysfs_attr("1-1.3/idVendor", "046d\n");
+	sysfs_attr("1-1.3/idProduct", "c077\n");
+	sysfs_attr("1-1.3/bcdDevice", "7200\n");
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag,
+	struct FTW *ftw)
+{
+	return remove(path);
+}
+
+void teardown_sysfs_tree()
+{
+	ck_assert_int_eq(nftw(sysfs_root, remove_entry, 8,
+		FTW_DEPTH | FTW_PHYS), 0);
+	strcpy(sysfs_root, "/tmp/sysfsXXXXXX");
+}
+
+START_TEST(test_sysfs_read_device)
+{
+	struct usb_sysfs_device dev;
+	int ret_val;
+
+	ret_val = usb_sysfs_read_device(sysfs_root, "1-1", &dev);
+	ck_assert_int_eq(ret_val, 0);
+	ck_assert_str_eq(dev.name, "1-1");
+	ck_assert_uint_eq(dev.valid, USB_SYSFS_HAVE_IDS |
+		USB_SYSFS_HAVE_MAXCHILD | USB_SYSFS_HAVE_SERIAL);
+	ck_assert_str_eq(dev.serial, "AD0042");
+	ck_assert_int_eq(dev.busnum, 1);
+	ck_assert_int_eq(dev.devnum, 5);
+	ck_assert_uint_eq(dev.device_class, 0x09);
+	ck_assert_uint_eq(dev.vendor, 0x04b4);
+	ck_assert_uint_eq(dev.product, 0x6560);
+	ck_assert_uint_eq(dev.bcd_device, 0x9215);
+	ck_assert_int_eq(dev.maxchild, 4);
+
+	ret_val = usb_sysfs_read_device(sysfs_root, "usb1", &dev);
+	ck_assert_int_eq(ret_val, 0);
+	ck_assert_int_eq(dev.maxchild, 2);
+
+	/* no hub, no maxchild */
+	ret_val = usb_sysfs_read_device(sysfs_root, "1-1.3", &dev);
+	ck_assert_int_eq(ret_val, 0);
+	ck_assert_uint_eq(dev.valid, USB_SYSFS_HAVE_IDS);
+	ck_assert_int_eq(dev.maxchild, -1);
+	ck_assert_str_eq(dev.serial, "");
+
+	/* missing device */
+	ret_val = usb_sysfs_read_device(sysfs_root, "2-1", &dev);
+	ck_assert_int_eq(ret_val, 0);
+	ck_assert_uint_eq(dev.valid, 0);
+}
+END_TEST
+
+START_TEST(test_sysfs_read_device_boundaries)
+{
+	struct usb_sysfs_device dev;
+
+	ck_assert_int_eq(usb_sysfs_read_device(NULL, "1-1", &dev), -EINVAL);
+	ck_assert_int_eq(usb_sysfs_read_device(sysfs_root, NULL, &dev), -EINVAL);
+	ck_assert_int_eq(usb_sysfs_read_device(sysfs_root, "1-1", NULL),
+		-EINVAL);
+	ck_assert_int_eq(usb_sysfs_read_device(sysfs_root,
+		"1-1.1.1.1.1.1.1.1.1.1.1.1.1.1.1.1", &dev), -ENAMETOOLONG);
+}
+END_TEST
+
+START_TEST(test_sysfs_scan)
+{
+	struct usb_sysfs_device *devs = NULL;
+	struct usb_sysfs_device *dev;
+	int num;
+
+	num = usb_sysfs_scan(sysfs_root, &devs);
+	ck_assert_int_eq(num, 3);
+
+	dev = usb_sysfs_lookup(devs, num, 1, 5);
+	ck_assert_ptr_ne(dev, NULL);
+	ck_assert_str_eq(dev->name, "1-1");
+
+	dev = usb_sysfs_lookup(devs, num, 1, 7);
+	ck_assert_ptr_ne(dev, NULL);
+	ck_assert_str_eq(dev->name, "1-1.3");
+
+	ck_assert_ptr_eq(usb_sysfs_lookup(devs, num, 2, 5), NULL);
+
+	free(devs);
+
+	ck_assert_int_eq(usb_sysfs_scan("/nonexistent", &devs), -ENOENT);
+	ck_assert_int_eq(usb_sysfs_scan(sysfs_root, NULL), -EINVAL);
+}
+END_TEST
+
+int sysfs_suite(Suite *s_sysfs)
+{
+	TCase *tc_sysfs_read;
+	TCase *tc_sysfs_scan;
+
+	tc_sysfs_read = tcase_create("sysfs read");
+	tc_sysfs_scan = tcase_create("sysfs scan");
+
+	tcase_add_unchecked_fixture(tc_sysfs_read, setup_sysfs_tree,
+			teardown_sysfs_tree);
+	tcase_add_test(tc_sysfs_read, test_sysfs_read_device);
+	tcase_add_test(tc_sysfs_read, test_sysfs_read_device_boundaries);
+
+	tcase_add_unchecked_fixture(tc_sysfs_scan, setup_sysfs_tree,
+			teardown_sysfs_tree);
+	tcase_add_test(tc_sysfs_scan, test_sysfs_scan);
+
+	suite_add_tcase(s_sysfs, tc_sysfs_read);
+	suite_add_tcase(s_sysfs, tc_sysfs_scan);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Provide testsuite for usb_sysfs
+ *
+ * @copyright GPLv3
+ */
+
+#ifndef CHECK_USB_SYSFS_H
+#define CHECK_USB_SYSFS_H
+
+/**
+ * @brief Add sysfs test cases to the given suite
+ *
+ * @param sysfs_suite Suite the test cases should be added
+ * @return 0 on success
+ */
+int sysfs_suite(Suite *sysfs_suite);
+
+#endif /* CHECK_USB_SYSFS_H */
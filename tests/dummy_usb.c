@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "dummy_usb.h"
 
@@ -14,6 +15,39 @@
 /** USB control message Request for write */
 #define USB_REQ_WRITE			0x01
 
+/** Class requests to the hub and its ports */
+#define USB_RT_HUB_IN			0xA0
+#define USB_RT_PORT_IN			0xA3
+#define USB_RT_PORT_OUT			0x23
+
+#define USB_PORT_FEAT_POWER		8
+#define USB_PORT_FEAT_C_CONNECTION	16
+#define USB_PORT_FEAT_INDICATOR		22
+
+#define USB_PORT_STAT_CONNECTION	0x0001
+#define USB_PORT_STAT_ENABLE		0x0002
+#define USB_PORT_STAT_POWER		0x0100
+#define USB_PORT_STAT_C_CONNECTION	0x0001
+
+#define CYPRESS_HUB_VID			0x04b4
+#define CYPRESS_HUB_PID			0x6560
+
+/** asynchronous request waiting for its completion time */
+struct dummy_pending {
+	struct libusb_transfer *transfer;
+	struct timespec done;
+	int cancelled;
+	struct dummy_pending *next;
+};
+
+static libusb_device **bus_devs;
+static int bus_num;
+static struct dummy_timing bus_timing;
+static unsigned int bus_seed;
+/* sorted by completion time */
+static struct dummy_pending *bus_pending;
+static int event_failures;
+
 libusb_device_handle *libusb_device_handle_create()
 {
 	libusb_device_handle *uh = NULL;
@@ -23,10 +57,21 @@ libusb_device_handle *libusb_device_handle_create()
 		return NULL;
 
 	uh->msg = calloc(1, sizeof(struct usb_msg));
-	if (!(uh->msg)) {
+	uh->eeprom = malloc(DUMMY_EEPROM_SIZE);
+	if (!(uh->msg) || !(uh->eeprom)) {
+		free(uh->msg);
+		free(uh->eeprom);
 		free(uh);
 		return NULL;
 	}
+	memset(uh->eeprom, 0xff, DUMMY_EEPROM_SIZE);
+	uh->writes = 0;
+	uh->written = 0;
+	uh->dev = NULL;
+	uh->failures = 0;
+	uh->fail_pattern = 0;
+	uh->eeprom_ready.tv_sec = 0;
+	uh->eeprom_ready.tv_nsec = 0;
 
 	return uh;
 }
@@ -43,6 +88,7 @@ int libusb_device_handle_free(libusb_device_handle **dev)
 
 	free((*dev)->msg);
 	(*dev)->msg = NULL;
+	free((*dev)->eeprom);
 	free(*dev);
 	*dev = NULL;
 
@@ -57,34 +103,251 @@ struct usb_msg *get_usb_msg(libusb_device_handle *dev)
 	return dev->msg;
 }
 
+static void ts_add_ns(struct timespec *ts, unsigned long ns)
+{
+	ts->tv_sec += ns / 1000000000;
+	ts->tv_nsec += ns % 1000000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+static int ts_before(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec ||
+		(a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static void sleep_until(const struct timespec *ts)
+{
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL) ==
+			EINTR)
+		;
+}
+
+/* Queue a request behind earlier ones to the same hub, returns its end */
+static struct timespec schedule(libusb_device *dev, uint16_t length)
+{
+	unsigned long ns;
+	struct timespec now;
+
+	ns = bus_timing.latency_us * 1000UL +
+		(unsigned long)length * bus_timing.byte_ns;
+	if (bus_timing.jitter_us)
+		ns += (rand_r(&bus_seed) % (bus_timing.jitter_us + 1)) *
+			1000UL;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ts_before(&dev->busy_until, &now))
+		dev->busy_until = now;
+	ts_add_ns(&dev->busy_until, ns);
+
+	return dev->busy_until;
+}
+
+static int eeprom_request(uint8_t *eeprom, uint8_t request_type,
+	uint8_t bRequest, uint16_t wIndex, unsigned char *data,
+	uint16_t wLength)
+{
+	if (wIndex + wLength > DUMMY_EEPROM_SIZE)
+		return -ERANGE;
+
+	if (request_type == USB_REQ_TYPE_WRITE_EEPROM)
+		memcpy(eeprom + wIndex, data, wLength);
+	else
+		memcpy(data, eeprom + wIndex, wLength);
+
+	return wLength;
+}
+
+static int port_feature(libusb_device *dev, int port, int set, int feature,
+	int selector)
+{
+	uint16_t *status = &dev->port_status[port - 1];
+	uint16_t *change = &dev->port_change[port - 1];
+
+	switch (feature) {
+	case USB_PORT_FEAT_POWER:
+		if (set && !(*status & USB_PORT_STAT_POWER)) {
+			*status |= USB_PORT_STAT_POWER;
+			if (dev->attached & (1UL << (port - 1))) {
+				*status |= USB_PORT_STAT_CONNECTION;
+				*change |= USB_PORT_STAT_C_CONNECTION;
+			}
+		} else if (!set) {
+			if (*status & USB_PORT_STAT_CONNECTION)
+				*change |= USB_PORT_STAT_C_CONNECTION;
+			*status &= ~(USB_PORT_STAT_POWER |
+				USB_PORT_STAT_CONNECTION |
+				USB_PORT_STAT_ENABLE);
+		}
+		return 0;
+	case USB_PORT_FEAT_C_CONNECTION:
+		if (set)
+			break;
+		*change &= ~USB_PORT_STAT_C_CONNECTION;
+		return 0;
+	case USB_PORT_FEAT_INDICATOR:
+		if (!set || selector > 3)
+			break;
+		dev->indicator[port - 1] = selector;
+		return 0;
+	}
+
+	return LIBUSB_ERROR_PIPE;
+}
+
+/* Carry out a request on a simulated hub, returns the libusb result */
+static int hub_request(libusb_device *dev, uint8_t request_type,
+	uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+	unsigned char *data, uint16_t wLength)
+{
+	uint8_t desc[7 + 2 * 2];
+	int port = wIndex & 0xff;
+	int len;
+
+	switch (request_type) {
+	case USB_RT_HUB_IN:
+		if (bRequest != LIBUSB_REQUEST_GET_DESCRIPTOR ||
+				wValue >> 8 != LIBUSB_DT_HUB)
+			break;
+
+		/* DeviceRemovable and PortPwrCtrlMask, one byte each up to 7 ports */
+		len = 7 + 2 * (dev->nports / 8 + 1);
+		memset(desc, 0, sizeof(desc));
+		desc[0] = len;
+		desc[1] = LIBUSB_DT_HUB;
+		desc[2] = dev->nports;
+		desc[3] = dev->characteristics & 0xff;
+		desc[4] = dev->characteristics >> 8;
+		desc[5] = dev->pwr_on_2_pwr_good;
+		desc[6] = dev->contr_current;
+		memset(desc + len - (dev->nports / 8 + 1), 0xff,
+			dev->nports / 8 + 1);
+
+		if (len > wLength)
+			len = wLength;
+		memcpy(data, desc, len);
+		return len;
+	case USB_RT_PORT_IN:
+		if (bRequest != LIBUSB_REQUEST_GET_STATUS || port < 1 ||
+				port > dev->nports || wLength < 4)
+			break;
+
+		data[0] = dev->port_status[port - 1] & 0xff;
+		data[1] = dev->port_status[port - 1] >> 8;
+		data[2] = dev->port_change[port - 1] & 0xff;
+		data[3] = dev->port_change[port - 1] >> 8;
+		return 4;
+	case USB_RT_PORT_OUT:
+		if ((bRequest != LIBUSB_REQUEST_SET_FEATURE &&
+				bRequest != LIBUSB_REQUEST_CLEAR_FEATURE) ||
+				port < 1 || port > dev->nports)
+			break;
+
+		return port_feature(dev, port,
+			bRequest == LIBUSB_REQUEST_SET_FEATURE, wValue,
+			wIndex >> 8);
+	case USB_REQ_TYPE_READ_EEPROM:
+	case USB_REQ_TYPE_WRITE_EEPROM:
+		if (bRequest != USB_REQ_READ && bRequest != USB_REQ_WRITE)
+			break;
+
+		return eeprom_request(dev->eeprom, request_type, bRequest,
+			wIndex, data, wLength);
+	}
+
+	return LIBUSB_ERROR_PIPE;
+}
+
+/* Whether the next request to the handle is to time out */
+static int request_fails(libusb_device_handle *uh)
+{
+	int fail;
+
+	if (uh->failures) {
+		uh->failures--;
+		return 1;
+	}
+
+	fail = uh->fail_pattern & 1;
+	uh->fail_pattern >>= 1;
+
+	return fail;
+}
+
 /* declared in libusb.h */
 int libusb_control_transfer(libusb_device_handle *dev_handle,
 	uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
 	unsigned char *data, uint16_t wLength, unsigned int timeout)
 {
-	if (!dev_handle || !dev_handle->msg || !data || !wLength)
+	struct timespec done;
+	struct timespec now;
+	int ret;
+
+	if (!dev_handle || !dev_handle->msg)
 		return -EINVAL;
 
-	if (request_type != USB_REQ_TYPE_READ_EEPROM &&
-			request_type != USB_REQ_TYPE_WRITE_EEPROM)
-		return -ERANGE;
+	if (request_fails(dev_handle))
+		return LIBUSB_ERROR_TIMEOUT;
 
-	if (bRequest != USB_REQ_READ && bRequest != USB_REQ_WRITE)
-		return -ERANGE;
+	if (!dev_handle->dev) {
+		if (!data || !wLength)
+			return -EINVAL;
 
-	dev_handle->msg->bytes = malloc(wLength);
-	if (!dev_handle->msg->bytes)
-		return -ENOMEM;
+		if (request_type != USB_REQ_TYPE_READ_EEPROM &&
+				request_type != USB_REQ_TYPE_WRITE_EEPROM)
+			return -ERANGE;
+
+		if (bRequest != USB_REQ_READ && bRequest != USB_REQ_WRITE)
+			return -ERANGE;
+
+		if (wIndex + wLength > DUMMY_EEPROM_SIZE)
+			return -ERANGE;
+	}
+
+	free(dev_handle->msg->bytes);
+	dev_handle->msg->bytes = NULL;
+	if (wLength) {
+		dev_handle->msg->bytes = malloc(wLength);
+		if (!dev_handle->msg->bytes)
+			return -ENOMEM;
+		memcpy(dev_handle->msg->bytes, data, wLength);
+	}
 
 	dev_handle->msg->requesttype = request_type;
 	dev_handle->msg->request = bRequest;
 	dev_handle->msg->value = wValue;
 	dev_handle->msg->index = wIndex;
-	memcpy(dev_handle->msg->bytes, data, wLength);
 	dev_handle->msg->size = wLength;
 	dev_handle->msg->timeout = timeout;
 
-	return wLength;
+	if (dev_handle->dev) {
+		done = schedule(dev_handle->dev, wLength);
+		sleep_until(&done);
+		ret = hub_request(dev_handle->dev, request_type, bRequest,
+			wValue, wIndex, data, wLength);
+	} else {
+		ret = eeprom_request(dev_handle->eeprom, request_type,
+			bRequest, wIndex, data, wLength);
+	}
+
+	/* a busy EEPROM reads as 0xff until the write cycle ended */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ret > 0 && request_type == USB_REQ_TYPE_READ_EEPROM &&
+			ts_before(&now, &dev_handle->eeprom_ready))
+		memset(data, 0xff, ret);
+
+	if (ret >= 0 && request_type == USB_REQ_TYPE_WRITE_EEPROM) {
+		dev_handle->writes++;
+		dev_handle->written += wLength;
+		dev_handle->eeprom_ready = now;
+		ts_add_ns(&dev_handle->eeprom_ready,
+			bus_timing.write_cycle_us * 1000UL);
+	}
+
+	return ret;
 }
 
 /**
@@ -113,3 +376,402 @@ int libusb_get_device_descriptor(libusb_device *dev,
 
 	return 0;
 }
+
+int libusb_init(libusb_context **ctx)
+{
+	if (ctx)
+		*ctx = NULL;
+
+	return 0;
+}
+
+void libusb_exit(libusb_context *ctx)
+{
+}
+
+ssize_t libusb_get_device_list(libusb_context *ctx, libusb_device ***list)
+{
+	libusb_device **devs;
+	int i;
+
+	devs = calloc(bus_num + 1, sizeof(*devs));
+	if (!devs)
+		return LIBUSB_ERROR_NO_MEM;
+
+	for (i = 0; i < bus_num; i++)
+		devs[i] = libusb_ref_device(bus_devs[i]);
+
+	*list = devs;
+
+	return bus_num;
+}
+
+void libusb_free_device_list(libusb_device **list, int unref_devices)
+{
+	int i;
+
+	if (!list)
+		return;
+
+	for (i = 0; unref_devices && list[i]; i++)
+		libusb_unref_device(list[i]);
+
+	free(list);
+}
+
+libusb_device *libusb_ref_device(libusb_device *dev)
+{
+	dev->refcount++;
+
+	return dev;
+}
+
+void libusb_unref_device(libusb_device *dev)
+{
+	if (dev && --dev->refcount == 0)
+		free(dev);
+}
+
+uint8_t libusb_get_bus_number(libusb_device *dev)
+{
+	return dev->busnum;
+}
+
+uint8_t libusb_get_device_address(libusb_device *dev)
+{
+	return dev->devnum;
+}
+
+int libusb_get_port_numbers(libusb_device *dev, uint8_t *port_numbers,
+	int port_numbers_len)
+{
+	int num;
+
+	if (!dev->parent) {
+		if (port_numbers_len < 1)
+			return LIBUSB_ERROR_OVERFLOW;
+
+		port_numbers[0] = dev->root_port;
+
+		return 1;
+	}
+
+	num = libusb_get_port_numbers(dev->parent, port_numbers,
+		port_numbers_len);
+	if (num < 0)
+		return num;
+	if (num >= port_numbers_len)
+		return LIBUSB_ERROR_OVERFLOW;
+
+	port_numbers[num] = dev->parent_port;
+
+	return num + 1;
+}
+
+libusb_device *libusb_get_parent(libusb_device *dev)
+{
+	return dev->parent;
+}
+
+int libusb_open(libusb_device *dev, libusb_device_handle **dev_handle)
+{
+	libusb_device_handle *uh;
+
+	uh = calloc(1, sizeof(*uh));
+	if (!uh)
+		return LIBUSB_ERROR_NO_MEM;
+
+	uh->msg = calloc(1, sizeof(struct usb_msg));
+	if (!uh->msg) {
+		free(uh);
+		return LIBUSB_ERROR_NO_MEM;
+	}
+
+	uh->dev = libusb_ref_device(dev);
+	uh->eeprom = dev->eeprom;
+	*dev_handle = uh;
+
+	return 0;
+}
+
+void libusb_close(libusb_device_handle *dev_handle)
+{
+	if (!dev_handle)
+		return;
+
+	free(dev_handle->msg->bytes);
+	free(dev_handle->msg);
+	libusb_unref_device(dev_handle->dev);
+	free(dev_handle);
+}
+
+libusb_device *libusb_get_device(libusb_device_handle *dev_handle)
+{
+	return dev_handle->dev;
+}
+
+struct libusb_transfer *libusb_alloc_transfer(int iso_packets)
+{
+	return calloc(1, sizeof(struct libusb_transfer) +
+		iso_packets * sizeof(struct libusb_iso_packet_descriptor));
+}
+
+void libusb_free_transfer(struct libusb_transfer *transfer)
+{
+	if (!transfer)
+		return;
+
+	if (transfer->flags & LIBUSB_TRANSFER_FREE_BUFFER)
+		free(transfer->buffer);
+	free(transfer);
+}
+
+int libusb_submit_transfer(struct libusb_transfer *transfer)
+{
+	struct libusb_control_setup *setup;
+	struct dummy_pending **pos;
+	struct dummy_pending *pending;
+	libusb_device_handle *uh = transfer->dev_handle;
+
+	if (!uh || !uh->dev || transfer->type != LIBUSB_TRANSFER_TYPE_CONTROL)
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+
+	pending = calloc(1, sizeof(*pending));
+	if (!pending)
+		return LIBUSB_ERROR_NO_MEM;
+
+	setup = libusb_control_transfer_get_setup(transfer);
+	pending->transfer = transfer;
+	uh->msg->timeout = transfer->timeout;
+	pending->done = schedule(uh->dev, libusb_le16_to_cpu(setup->wLength));
+
+	for (pos = &bus_pending; *pos; pos = &(*pos)->next)
+		if (ts_before(&pending->done, &(*pos)->done))
+			break;
+	pending->next = *pos;
+	*pos = pending;
+
+	return 0;
+}
+
+int libusb_cancel_transfer(struct libusb_transfer *transfer)
+{
+	struct dummy_pending *pending;
+
+	for (pending = bus_pending; pending; pending = pending->next) {
+		if (pending->transfer != transfer)
+			continue;
+		if (pending->cancelled)
+			break;
+
+		pending->cancelled = 1;
+		return 0;
+	}
+
+	return LIBUSB_ERROR_NOT_FOUND;
+}
+
+/* The hub state changes when the request completes, not on submission */
+static void complete(struct dummy_pending *pending)
+{
+	struct libusb_transfer *transfer = pending->transfer;
+	struct libusb_control_setup *setup;
+	libusb_device_handle *uh = transfer->dev_handle;
+	uint16_t length;
+	int ret;
+
+	transfer->actual_length = 0;
+
+	if (pending->cancelled) {
+		transfer->status = LIBUSB_TRANSFER_CANCELLED;
+	} else if (request_fails(uh)) {
+		transfer->status = LIBUSB_TRANSFER_TIMED_OUT;
+	} else {
+		setup = libusb_control_transfer_get_setup(transfer);
+		length = libusb_le16_to_cpu(setup->wLength);
+		ret = hub_request(uh->dev, setup->bmRequestType,
+			setup->bRequest, libusb_le16_to_cpu(setup->wValue),
+			libusb_le16_to_cpu(setup->wIndex),
+			libusb_control_transfer_get_data(transfer), length);
+
+		if (ret >= 0) {
+			transfer->status = LIBUSB_TRANSFER_COMPLETED;
+			transfer->actual_length = ret;
+			if (setup->bmRequestType == USB_REQ_TYPE_WRITE_EEPROM) {
+				uh->writes++;
+				uh->written += length;
+			}
+		} else if (ret == LIBUSB_ERROR_PIPE) {
+			transfer->status = LIBUSB_TRANSFER_STALL;
+		} else {
+			transfer->status = LIBUSB_TRANSFER_ERROR;
+		}
+	}
+
+	free(pending);
+	transfer->callback(transfer);
+}
+
+/*
+ * Wait for the next request to complete, but not beyond limit, then complete
+ * every request that is due.
+ */
+static void handle_events(const struct timespec *limit)
+{
+	struct dummy_pending *pending;
+	struct timespec now;
+
+	if (!bus_pending)
+		return;
+
+	if (limit && ts_before(limit, &bus_pending->done)) {
+		sleep_until(limit);
+		return;
+	}
+	sleep_until(&bus_pending->done);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	while (bus_pending && !ts_before(&now, &bus_pending->done)) {
+		pending = bus_pending;
+		bus_pending = pending->next;
+		complete(pending);
+	}
+}
+
+int libusb_handle_events_completed(libusb_context *ctx, int *completed)
+{
+	if (event_failures) {
+		event_failures--;
+		return LIBUSB_ERROR_OTHER;
+	}
+
+	if (!completed || !*completed)
+		handle_events(NULL);
+
+	return 0;
+}
+
+int libusb_handle_events_timeout_completed(libusb_context *ctx,
+	struct timeval *tv, int *completed)
+{
+	struct timespec limit;
+
+	if (event_failures) {
+		event_failures--;
+		return LIBUSB_ERROR_OTHER;
+	}
+
+	if (completed && *completed)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &limit);
+	ts_add_ns(&limit, tv->tv_sec * 1000000000UL + tv->tv_usec * 1000UL);
+	handle_events(&limit);
+
+	return 0;
+}
+
+int libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv)
+{
+	return libusb_handle_events_timeout_completed(ctx, tv, NULL);
+}
+
+int dummy_bus_create(int num_hubs, int num_ports)
+{
+	libusb_device *dev;
+	int i;
+	int j;
+
+	dummy_bus_destroy();
+
+	if (num_hubs < 0 || num_hubs > DUMMY_MAX_HUBS || num_ports < 1 ||
+			num_ports > DUMMY_MAX_PORTS)
+		return -EINVAL;
+
+	bus_devs = calloc(num_hubs, sizeof(*bus_devs));
+	if (!bus_devs && num_hubs)
+		return -ENOMEM;
+
+	for (i = 0; i < num_hubs; i++) {
+		dev = calloc(1, sizeof(*dev));
+		if (!dev) {
+			dummy_bus_destroy();
+			return -ENOMEM;
+		}
+
+		dev->desc.bLength = 18;
+		dev->desc.bDescriptorType = LIBUSB_DT_DEVICE;
+		dev->desc.bcdUSB = 0x0200;
+		dev->desc.bDeviceClass = LIBUSB_CLASS_HUB;
+		dev->desc.bMaxPacketSize0 = 64;
+		dev->desc.idVendor = CYPRESS_HUB_VID;
+		dev->desc.idProduct = CYPRESS_HUB_PID;
+		dev->desc.bcdDevice = 0x0100;
+		dev->desc.bNumConfigurations = 1;
+
+		dev->refcount = 1;
+		dev->busnum = 1 + i / DUMMY_HUBS_PER_BUS;
+		dev->devnum = i % DUMMY_HUBS_PER_BUS + 2;
+		dev->root_port = i % DUMMY_HUBS_PER_BUS + 1;
+		dev->nports = num_ports;
+		/* individual power switching, port indicators */
+		dev->characteristics = 0x0001 | 0x0080;
+		dev->pwr_on_2_pwr_good = 50;
+		dev->contr_current = 100;
+		dev->attached = (1UL << num_ports) - 1;
+		for (j = 0; j < num_ports; j++)
+			dev->port_status[j] = USB_PORT_STAT_POWER |
+				USB_PORT_STAT_CONNECTION | USB_PORT_STAT_ENABLE;
+		memset(dev->eeprom, 0xff, sizeof(dev->eeprom));
+
+		bus_devs[bus_num++] = dev;
+	}
+
+	return 0;
+}
+
+void dummy_bus_destroy(void)
+{
+	int i;
+
+	for (i = 0; i < bus_num; i++)
+		libusb_unref_device(bus_devs[i]);
+
+	free(bus_devs);
+	bus_devs = NULL;
+	bus_num = 0;
+}
+
+void dummy_bus_set_timing(const struct dummy_timing *timing, unsigned int seed)
+{
+	bus_timing = *timing;
+	bus_seed = seed;
+}
+
+int dummy_bus_attach(int index, int parent, int port)
+{
+	libusb_device *dev = dummy_bus_device(index);
+	libusb_device *up = dummy_bus_device(parent);
+
+	if (!dev || !up || dev == up || dev->busnum != up->busnum ||
+			port < 1 || port > up->nports)
+		return -EINVAL;
+
+	dev->parent = up;
+	dev->parent_port = port;
+
+	return 0;
+}
+
+void dummy_bus_fail_events(int num)
+{
+	event_failures = num;
+}
+
+libusb_device *dummy_bus_device(int index)
+{
+	if (index < 0 || index >= bus_num)
+		return NULL;
+
+	return bus_devs[index];
+}
@@ -5,6 +5,11 @@
  *
  * @brief libusb.h mocks for usb_eeprom functions testing
  *
+ * Besides the bare handles used by the EEPROM tests, the mock simulates a bus
+ * of Cypress hubs with ports, port status, hub descriptor and EEPROM. Control
+ * requests to simulated hubs take a configurable time, asynchronous ones to
+ * different hubs overlap like on a real bus.
+ *
  * @copyright GPLv3
  */
 
@@ -12,8 +17,18 @@
 #define DUMMY_USB_H
 
 #include <stdint.h>
+#include <time.h>
 #include <libusb.h>
 
+/** size of the simulated EEPROM, erased on creation */
+#define DUMMY_EEPROM_SIZE	0x1000
+/** most ports of a simulated hub */
+#define DUMMY_MAX_PORTS		15
+/** hubs on each simulated bus, device 1 being the root hub */
+#define DUMMY_HUBS_PER_BUS	126
+/** most simulated hubs */
+#define DUMMY_MAX_HUBS		(8 * DUMMY_HUBS_PER_BUS)
+
 /** struct for passed parameters of usb_control_msg */
 struct usb_msg {
 	/** usb requesttype */
@@ -32,15 +47,82 @@ struct usb_msg {
 	int size;
 };
 
+/** simulated hub */
+struct libusb_device {
+	/**
+	 * device descriptor, must come first as libusb_get_device_descriptor()
+	 * takes any pointer to a descriptor for a device
+	 */
+	struct libusb_device_descriptor desc;
+	/** references held by the device list and handles */
+	int refcount;
+	/** USB bus number */
+	uint8_t busnum;
+	/** USB device number */
+	uint8_t devnum;
+	/** port of the root hub the hub is plugged into */
+	uint8_t root_port;
+	/** hub this one is plugged into, @c NULL for a root hub port */
+	struct libusb_device *parent;
+	/** port of the parent hub this one is plugged into */
+	uint8_t parent_port;
+	/** number of ports */
+	uint8_t nports;
+	/** wHubCharacteristics */
+	uint16_t characteristics;
+	/** bPwrOn2PwrGood, in units of 2 ms */
+	uint8_t pwr_on_2_pwr_good;
+	/** bHubContrCurrent in mA */
+	uint8_t contr_current;
+	/** wPortStatus of each port */
+	uint16_t port_status[DUMMY_MAX_PORTS];
+	/** wPortChange of each port */
+	uint16_t port_change[DUMMY_MAX_PORTS];
+	/** indicator selector of each port */
+	uint8_t indicator[DUMMY_MAX_PORTS];
+	/** bit n-1 is set when a device is plugged into port n */
+	uint32_t attached;
+	/** EEPROM contents */
+	uint8_t eeprom[DUMMY_EEPROM_SIZE];
+	/** end of the last queued request, requests to a hub are serialized */
+	struct timespec busy_until;
+};
+
 /** struct as for usb device */
 struct libusb_device_handle {
 	/** pointer to usb control message */
 	struct usb_msg *msg;
+	/** simulated EEPROM contents, addressed by wIndex */
+	uint8_t *eeprom;
+	/** number of EEPROM write requests */
+	int writes;
+	/** number of bytes written to the EEPROM */
+	int written;
+	/** simulated hub, @c NULL for a bare handle */
+	struct libusb_device *dev;
+	/** number of following requests that time out */
+	int failures;
+	/** bit n times out the n-th request after those of failures */
+	uint32_t fail_pattern;
+	/** end of the EEPROM write cycle, reads return 0xff until then */
+	struct timespec eeprom_ready;
 };
 
 /** typedef for use of libusb_device_handle as in libusb.h */
 typedef struct libusb_device_handle libusb_device_handle;
 
+/** Time taken by each control request to a simulated hub */
+struct dummy_timing {
+	/** fixed time per request in us */
+	unsigned int latency_us;
+	/** random extra time per request, up to this many us */
+	unsigned int jitter_us;
+	/** time per byte of the data stage in ns */
+	unsigned int byte_ns;
+	/** EEPROM write cycle after each write request in us */
+	unsigned int write_cycle_us;
+};
+
 /**
  * @brief Create a libusb_device_handle struct
  *
@@ -67,4 +149,67 @@ int libusb_device_handle_free(libusb_device_handle **dev);
  */
 struct usb_msg *get_usb_msg(libusb_device_handle *dev);
 
+/**
+ * @brief Simulate a bus of Cypress hubs
+ *
+ * The hubs appear on bus 1 as devices 2 and up, each plugged into its own
+ * root hub port, continuing on bus 2 after @ref DUMMY_HUBS_PER_BUS hubs.
+ * They support per-port power switching and indicators, all ports are
+ * powered and have a device attached. A previous bus is removed.
+ *
+ * @param num_hubs number of hubs
+ * @param num_ports ports per hub, at most @ref DUMMY_MAX_PORTS
+ * @return 0 on success
+ * @return -EINVAL on invalid arguments
+ * @return -ENOMEM if out of memory
+ */
+int dummy_bus_create(int num_hubs, int num_ports);
+
+/**
+ * @brief Remove the simulated bus
+ *
+ * Devices still referenced are freed once the last reference is dropped.
+ */
+void dummy_bus_destroy(void);
+
+/**
+ * @brief Set the time control requests to simulated hubs take
+ *
+ * @param timing new timing, all zero by default
+ * @param seed seed for the jitter
+ */
+void dummy_bus_set_timing(const struct dummy_timing *timing, unsigned int seed);
+
+/**
+ * @brief Plug a simulated hub into a port of another one
+ *
+ * Both hubs must be on the same bus. The hub keeps its device number, its
+ * port path continues the one of the parent.
+ *
+ * @param index number of the hub to move, starting at 0
+ * @param parent number of the hub to plug it into
+ * @param port port of the parent, starting at 1
+ * @return 0 on success
+ * @return -EINVAL if there is no such hub or port
+ */
+int dummy_bus_attach(int index, int parent, int port);
+
+/**
+ * @brief Let the following calls handling events fail
+ *
+ * The calls return LIBUSB_ERROR_OTHER without completing any request.
+ *
+ * @param num number of libusb_handle_events*() calls to fail
+ */
+void dummy_bus_fail_events(int num);
+
+/**
+ * @brief Get a hub of the simulated bus
+ *
+ * @param index number of the hub, starting at 0
+ * @return simulated hub
+ * @return @c NULL if there is no such hub
+ */
+libusb_device *dummy_bus_device(int index);
+
 #endif /* DUMMY_USB_H */
@@ -0,0 +1,343 @@
+/**
+ * @file
+ * @date 2026
+ *
+ * @brief Benchmark of the hub code paths against simulated hubs
+ *
+ * Runs the enumeration, port status, port switching and EEPROM code of
+ * hub-ctrl on the hub simulator of dummy_usb.c, so that changes in the number
+ * or the overlap of bus requests show up as timing changes without hardware.
+ *
+ * @copyright GPLv3
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dummy_usb.h"
+#include "hubs.h"
+#include "usb_eeprom.h"
+
+struct bench_config {
+	int hubs;
+	int ports;
+	int rounds;
+	struct dummy_timing timing;
+};
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void report(const char *name, double total_ms, int count,
+	const char *unit)
+{
+	printf("%-28s %10.3f ms %10.3f ms/%s\n", name, total_ms,
+		total_ms / count, unit);
+}
+
+static int bench_enumeration(const struct bench_config *cfg)
+{
+	double start;
+	int i;
+
+	start = now_ms();
+	for (i = 0; i < cfg->rounds; i++) {
+		if (usb_find_hubs(0) != cfg->hubs) {
+			fprintf(stderr, "Enumeration found %d hubs\n",
+				num_hubs);
+			return -EIO;
+		}
+	}
+	report("enumeration", now_ms() - start, cfg->rounds, "scan");
+
+	return 0;
+}
+
+static int bench_lookup(const struct bench_config *cfg)
+{
+	double start;
+	double ms;
+	int count = 0;
+	int i;
+	int j;
+
+	start = now_ms();
+	for (i = 0; i < cfg->rounds * 100; i++)
+		for (j = 0; j < num_hubs; j++, count++)
+			if (get_hub(hubs[j].busnum, hubs[j].devnum) != j)
+				return -EIO;
+	ms = now_ms() - start;
+	printf("%-28s %10.3f ms %10.1f ns/lookup\n", "lookup by bus:dev", ms,
+		ms * 1e6 / count);
+
+	count = 0;
+	start = now_ms();
+	for (i = 0; i < cfg->rounds * 100; i++)
+		for (j = 0; j < num_hubs; j++, count++)
+			if (get_hub_by_path(hubs[j].path) != j)
+				return -EIO;
+	ms = now_ms() - start;
+	printf("%-28s %10.3f ms %10.1f ns/lookup\n", "lookup by port path", ms,
+		ms * 1e6 / count);
+
+	return 0;
+}
+
+static int bench_status(const struct bench_config *cfg)
+{
+	double start;
+	int i;
+
+	start = now_ms();
+	for (i = 0; i < cfg->rounds; i++)
+		if (hub_status_collect(hubs, num_hubs))
+			return -EIO;
+	report("port status, all hubs", now_ms() - start, cfg->rounds,
+		"round");
+
+	return 0;
+}
+
+static int bench_toggle(const struct bench_config *cfg)
+{
+	struct hub_port_req *reqs;
+	int total = num_hubs * cfg->ports;
+	uint64_t first;
+	uint64_t last;
+	double start;
+	double skew;
+	int i;
+	int j;
+
+	start = now_ms();
+	for (i = 0; i < cfg->rounds; i++)
+		for (j = 0; j < total; j++)
+			if (hub_set_power(j % num_hubs, j / num_hubs + 1,
+					i & 1))
+				return -EIO;
+	report("port toggle, one by one", now_ms() - start,
+		cfg->rounds * total, "port");
+
+	reqs = calloc(total, sizeof(*reqs));
+	if (!reqs)
+		return -ENOMEM;
+
+	start = now_ms();
+	for (i = 0; i < cfg->rounds; i++) {
+		for (j = 0; j < total; j++) {
+			reqs[j].hub = j % num_hubs;
+			reqs[j].port = j / num_hubs + 1;
+			reqs[j].feature = USB_PORT_FEAT_POWER;
+			reqs[j].value = i & 1;
+		}
+		if (hub_port_request_batch(reqs, total) != total) {
+			free(reqs);
+			return -EIO;
+		}
+	}
+	report("port toggle, batched", now_ms() - start, cfg->rounds * total,
+		"port");
+
+	/* one port per hub, how far apart the hubs switch */
+	skew = 0;
+	for (i = 0; i < cfg->rounds; i++) {
+		first = UINT64_MAX;
+		last = 0;
+		for (j = 0; j < num_hubs; j++) {
+			reqs[j].hub = j;
+			reqs[j].port = 1;
+			reqs[j].feature = USB_PORT_FEAT_POWER;
+			reqs[j].value = i & 1;
+		}
+		if (hub_port_request_batch(reqs, num_hubs) != num_hubs) {
+			free(reqs);
+			return -EIO;
+		}
+		for (j = 0; j < num_hubs; j++) {
+			if (reqs[j].done_ns < first)
+				first = reqs[j].done_ns;
+			if (reqs[j].done_ns > last)
+				last = reqs[j].done_ns;
+		}
+		skew += (last - first) / 1e6;
+	}
+	report("completion skew, all hubs", skew, cfg->rounds, "round");
+
+	free(reqs);
+
+	return 0;
+}
+
+static int bench_eeprom(const struct bench_config *cfg)
+{
+	libusb_device_handle *dev = hub_handle(&hubs[0]);
+	uint8_t *image;
+	double start;
+	double ms;
+	int i;
+
+	image = malloc(MAX_EEPROM_SIZE);
+	if (!image)
+		return -ENOMEM;
+
+	start = now_ms();
+	for (i = 0; i < cfg->rounds; i++)
+		if (usb_eeprom_read(dev, image, MAX_EEPROM_SIZE) !=
+				MAX_EEPROM_SIZE)
+			goto fail;
+	ms = now_ms() - start;
+	report("EEPROM read", ms, cfg->rounds, "image");
+	printf("%-28s %10.1f KiB/s\n", "", cfg->rounds * MAX_EEPROM_SIZE /
+		1.024 / ms);
+
+	start = now_ms();
+	for (i = 0; i < cfg->rounds; i++) {
+		image[0] = i;
+		if (usb_eeprom_program(dev, image, MAX_EEPROM_SIZE, 0) !=
+				MAX_EEPROM_SIZE)
+			goto fail;
+	}
+	ms = now_ms() - start;
+	report("EEPROM write and verify", ms, cfg->rounds, "image");
+	printf("%-28s %10.1f KiB/s\n", "", cfg->rounds * MAX_EEPROM_SIZE /
+		1.024 / ms);
+
+	start = now_ms();
+	for (i = 0; i < cfg->rounds; i++) {
+		image[MAX_EEPROM_SIZE / 2] = i + 1;
+		if (usb_eeprom_program(dev, image, MAX_EEPROM_SIZE, 1) !=
+				EEPROM_PAGE_SIZE)
+			goto fail;
+	}
+	report("EEPROM update, one page", now_ms() - start, cfg->rounds,
+		"image");
+
+	usb_eeprom_set_wait(EEPROM_WAIT_POLL);
+	start = now_ms();
+	for (i = 0; i < cfg->rounds; i++) {
+		image[MAX_EEPROM_SIZE / 2] = i;
+		if (usb_eeprom_program(dev, image, MAX_EEPROM_SIZE, 1) !=
+				EEPROM_PAGE_SIZE)
+			goto fail;
+	}
+	report("EEPROM update, polled", now_ms() - start, cfg->rounds,
+		"image");
+	usb_eeprom_set_wait(EEPROM_WAIT_SLEEP);
+
+	free(image);
+
+	return 0;
+
+fail:
+	free(image);
+
+	return -EIO;
+}
+
+static void usage(const char *progname)
+{
+	fprintf(stderr,
+		"Usage: %s [-n HUBS] [-p PORTS] [-r ROUNDS] [-l LATENCY_US]\n"
+		"          [-j JITTER_US] [-b BYTE_NS] [-c WRITE_CYCLE_US]\n",
+		progname);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_config cfg = {
+		.hubs = 8,
+		.ports = 7,
+		.rounds = 20,
+		/* roughly a high-speed hub behind a root port */
+		.timing = {
+			.latency_us = 250,
+			.jitter_us = 100,
+			.byte_ns = 200,
+			/* typical for the 25LC640, 5 ms at most */
+			.write_cycle_us = 3000,
+		},
+	};
+	int option;
+	int ret = 0;
+	int i;
+
+	while ((option = getopt(argc, argv, "b:c:hj:l:n:p:r:")) != -1) {
+		switch (option) {
+		case 'b':
+			cfg.timing.byte_ns = atoi(optarg);
+			break;
+		case 'c':
+			cfg.timing.write_cycle_us = atoi(optarg);
+			break;
+		case 'j':
+			cfg.timing.jitter_us = atoi(optarg);
+			break;
+		case 'l':
+			cfg.timing.latency_us = atoi(optarg);
+			break;
+		case 'n':
+			cfg.hubs = atoi(optarg);
+			break;
+		case 'p':
+			cfg.ports = atoi(optarg);
+			break;
+		case 'r':
+			cfg.rounds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (cfg.hubs < 1 || cfg.rounds < 1 ||
+			dummy_bus_create(cfg.hubs, cfg.ports)) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	dummy_bus_set_timing(&cfg.timing, 1);
+
+	printf("%d hubs with %d ports, %u us latency, %u us jitter, "
+		"%u ns/byte, %u us write cycle, %d rounds\n\n", cfg.hubs,
+		cfg.ports, cfg.timing.latency_us, cfg.timing.jitter_us,
+		cfg.timing.byte_ns, cfg.timing.write_cycle_us, cfg.rounds);
+
+	libusb_init(NULL);
+
+	/* every request goes to the simulator */
+	hub_sysfs_root = NULL;
+
+	ret = bench_enumeration(&cfg);
+	if (!ret)
+		ret = bench_lookup(&cfg);
+
+	for (i = 0; i < num_hubs && !ret; i++)
+		ret = hub_open(&hubs[i]);
+
+	if (!ret)
+		ret = bench_status(&cfg);
+	if (!ret)
+		ret = bench_toggle(&cfg);
+	if (!ret)
+		ret = bench_eeprom(&cfg);
+
+	if (ret)
+		fprintf(stderr, "Benchmark failed: %d\n", ret);
+
+	hub_registry_exit();
+	libusb_exit(NULL);
+	dummy_bus_destroy();
+
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -2,7 +2,7 @@
 
 #
 # Write EEPROM test script for evaluating the reliability of writings with
-# hub-ctrl.
+# hub-ctrl. The number of runs can be given, 180 by default.
 #
 
 # get required bus and device ID
@@ -29,23 +29,13 @@ eeprom+="\x30\x00\x30\x00\x31\x00\x2d\x00\x30\x00\x30\x00\x30\x00\x18\x03\x34"
 eeprom+="\x00\x34\x00\x31\x00\x36\x00\x2d\x00\x30\x00\x30\x00\x30\x00\x30\x00"
 eeprom+="\x30\x00\x31\x00"
 
-i=0
-fails=0
-runs=180
+runs=${1:-180}
 # number of bytes
 bytes=$((${#eeprom} / 4))
+image=$(mktemp)
+trap 'rm -f "$image"' EXIT
 
-while [ "$i" -lt "$runs" ]; do
+printf "%b" "$eeprom" > "$image"
 
-        hub-ctrl -b "$BUSNR" -d "$DEVNR" -e "$bytes" > /dev/null
-
-        printf "%b" "$eeprom" | \
-                hub-ctrl -b "$BUSNR" -d "$DEVNR" -w "$bytes" -f - > /dev/null || \
-                fails=$((fails + 1))
-        i=$((i + 1))
-done;
-
-successes=$((runs - fails))
-
-echo
-echo "EEPROM write succeeded $successes out of $runs times."
+# erase, write and verify in a single hub-ctrl process, the hub stays open
+hub-ctrl -b "$BUSNR" -d "$DEVNR" -x --soak "$runs" -w "$bytes" -f "$image"